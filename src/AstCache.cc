@@ -0,0 +1,801 @@
+#include "AstCache.h"
+#include "Instrument.h"
+#include "StaticExpressionVisitor.h"
+#include "TreeWalker.h"
+#include "syntax_nodes.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <initializer_list>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Operands of nodes by kind, where `string` is a string index, `node` a
+// node index, and `list, count` the index of the first of count entries,
+// or pairs of entries, in the lists section:
+//
+//   StringConstant       text string
+//   IntegerConstant      value
+//   IdLValue             id string
+//   FieldLValue          l-value node, id string
+//   IndexLValue          l-value node, index node
+//   Negated              node
+//   Binary               left node, right node, and op of the record
+//   Assignment           l-value node, expression node
+//   FunctionCall         id string, list, count of argument nodes
+//   Block                list, count of nodes
+//   Record               type id string, list, count of pairs of field id
+//                        string and node
+//   Array                type id string, size node, value node
+//   IfThen               condition node, then node
+//   IfThenElse           condition node, then node, else node
+//   While                condition node, body node
+//   For                  id string, first node, last node, body node
+//   Let                  list, count of declaration nodes, list, count of
+//                        body nodes
+//   TypeDeclaration      id string, type node
+//   VariableDeclaration  id string, type id string or kNoIndex, value node
+//   FunctionDeclaration  id string, result type id string or kNoIndex,
+//                        list, count of pairs of parameter id and type id
+//                        strings, body node
+//   TypeReference        id string
+//   RecordType           list, count of pairs of field id and type id
+//                        strings
+//   ArrayType            element type id string
+namespace ast_cache {
+namespace {
+using Kind = Expression::Kind;
+
+constexpr char kMagic[8] = {'t', 'c', '-', 'a', 's', 't', '\0', '\0'};
+constexpr uint32_t kVersion = 1;
+
+static_assert(sizeof(NodeRecord) == 32);
+static_assert(sizeof(BindingRecord) == 24);
+static_assert(sizeof(Header) == 64);
+
+bool IsExpression(uint8_t kind) { return kind <= uint8_t(Kind::kLet); }
+bool IsLValue(uint8_t kind) {
+  return kind == uint8_t(Kind::kIdLValue) ||
+         kind == uint8_t(Kind::kFieldLValue) ||
+         kind == uint8_t(Kind::kIndexLValue);
+}
+bool IsDeclaration(uint8_t kind) {
+  return kind >= kTypeDeclaration && kind <= kFunctionDeclaration;
+}
+bool IsType(uint8_t kind) {
+  return kind >= kTypeReference && kind <= kStringType;
+}
+
+// Returns whether the node has a binding, and whether that is of a type.
+bool HasBinding(uint8_t kind) {
+  return kind == uint8_t(Kind::kIdLValue) ||
+         kind == uint8_t(Kind::kFunctionCall) ||
+         kind == uint8_t(Kind::kRecord) || kind == uint8_t(Kind::kArray);
+}
+bool HasTypeBinding(uint8_t kind) {
+  return kind == uint8_t(Kind::kRecord) || kind == uint8_t(Kind::kArray);
+}
+
+// Collects records while walking a tree, so that children are added before
+// their parents.
+class Writer : public TreeWalker,
+               public StaticExpressionVisitor<Writer>,
+               public DeclarationVisitor,
+               public TypeVisitor {
+public:
+  std::string Finish(uint64_t source_hash) {
+    std::vector<BindingRecord> bindings;
+    for (const auto& [node, binding] : uses_) {
+      BindingRecord b = {node,     kNoIndex,      kNoIndex,
+                         kNoIndex, binding.depth, binding.slot};
+      if (auto d = declarations_.find(binding.declaration);
+          d != declarations_.end()) {
+        b.declaration = d->second.first;
+        b.param = d->second.second;
+      } else {
+        b.built_in = String(binding.declaration->Id());
+      }
+      bindings.push_back(b);
+    }
+    std::vector<StringRecord> strings;
+    std::string string_bytes;
+    for (const std::string* s : strings_) {
+      strings.push_back({uint32_t(string_bytes.size()), uint32_t(s->size())});
+      string_bytes += *s;
+    }
+
+    Header header = {};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.source_hash = source_hash;
+    std::string out(sizeof(header), '\0');
+    header.nodes = Append(out, nodes_);
+    header.lists = Append(out, lists_);
+    header.bindings = Append(out, bindings);
+    header.strings = Append(out, strings);
+    header.string_bytes = Append(out, string_bytes);
+    std::memcpy(out.data(), &header, sizeof(header));
+    return out;
+  }
+
+  // Visit methods fill in the operands of record_, without visiting
+  // children.
+  bool VisitStringConstant(const std::string& text) {
+    return Operands({String(text)});
+  }
+  bool VisitIntegerConstant(int value) { return Operands({uint32_t(value)}); }
+  bool VisitNegated(const Expression& value) {
+    return Operands({Index(value)});
+  }
+  bool VisitBinary(const Expression& left, BinaryOp op,
+                   const Expression& right) {
+    record_.op = op;
+    return Operands({Index(left), Index(right)});
+  }
+  bool VisitAssignment(const LValue& value, const Expression& expr) {
+    return Operands({Index(value), Index(expr)});
+  }
+  bool VisitFunctionCall(const std::string& id,
+                         const std::vector<std::shared_ptr<Expression>>& args,
+                         const Expression& exp) {
+    return Operands({String(id), List(args), uint32_t(args.size())});
+  }
+  bool VisitBlock(const std::vector<std::shared_ptr<Expression>>& exprs) {
+    return Operands({List(exprs), uint32_t(exprs.size())});
+  }
+  bool VisitRecord(const std::string& type_id,
+                   const std::vector<FieldValue>& field_values,
+                   const Expression& exp) {
+    uint32_t first = lists_.size();
+    for (const auto& f : field_values) {
+      lists_.push_back(String(f.id));
+      lists_.push_back(Index(*f.expr));
+    }
+    return Operands({String(type_id), first, uint32_t(field_values.size())});
+  }
+  bool VisitArray(const std::string& type_id, const Expression& size,
+                  const Expression& value) {
+    return Operands({String(type_id), Index(size), Index(value)});
+  }
+  bool VisitIfThen(const Expression& condition, const Expression& expr) {
+    return Operands({Index(condition), Index(expr)});
+  }
+  bool VisitIfThenElse(const Expression& condition,
+                       const Expression& then_expr,
+                       const Expression& else_expr) {
+    return Operands({Index(condition), Index(then_expr), Index(else_expr)});
+  }
+  bool VisitWhile(const Expression& condition, const Expression& body) {
+    return Operands({Index(condition), Index(body)});
+  }
+  bool VisitFor(const std::string& id, const Expression& first,
+                const Expression& last, const Expression& body) {
+    return Operands({String(id), Index(first), Index(last), Index(body)});
+  }
+  bool VisitLet(const std::vector<std::shared_ptr<Declaration>>& declarations,
+                const std::vector<std::shared_ptr<Expression>>& body) {
+    return Operands({List(declarations), uint32_t(declarations.size()),
+                     List(body), uint32_t(body.size())});
+  }
+  bool VisitId(const std::string& id) { return Operands({String(id)}); }
+  bool VisitField(const LValue& value, const std::string& id) {
+    return Operands({Index(value), String(id)});
+  }
+  bool VisitIndex(const LValue& value, const Expression& expr) {
+    return Operands({Index(value), Index(expr)});
+  }
+
+  bool VisitTypeDeclaration(const std::string& id, const Type& type) override {
+    uint32_t type_index = AddType(type);
+    record_.kind = kTypeDeclaration;
+    return Operands({String(id), type_index});
+  }
+  bool VisitVariableDeclaration(const std::string& id,
+                                const std::optional<std::string>& type_id,
+                                const Expression& expr) override {
+    record_.kind = kVariableDeclaration;
+    return Operands({String(id), type_id ? String(*type_id) : kNoIndex,
+                     Index(expr)});
+  }
+  bool VisitFunctionDeclaration(const std::string& id,
+                                const std::vector<TypeField>& params,
+                                const std::optional<std::string> type_id,
+                                const Expression& body) override {
+    record_.kind = kFunctionDeclaration;
+    return Operands({String(id), type_id ? String(*type_id) : kNoIndex,
+                     Pairs(params), uint32_t(params.size()), Index(body)});
+  }
+
+  bool VisitTypeReference(const std::string& id) override {
+    type_record_.kind = kTypeReference;
+    type_record_.operands[0] = String(id);
+    return true;
+  }
+  bool VisitRecordType(const std::vector<TypeField>& fields) override {
+    type_record_.kind = kRecordType;
+    type_record_.operands[0] = Pairs(fields);
+    type_record_.operands[1] = fields.size();
+    return true;
+  }
+  bool VisitArrayType(const std::string& type_id) override {
+    type_record_.kind = kArrayType;
+    type_record_.operands[0] = String(type_id);
+    return true;
+  }
+  bool VisitInt() override {
+    type_record_.kind = kIntType;
+    return true;
+  }
+  bool VisitString() override {
+    type_record_.kind = kStringType;
+    return true;
+  }
+
+protected:
+  void Leave(TreeNode& node) override {
+    record_ = Blank(node.source_offset());
+    if (auto e = node.expression(); e) {
+      record_.kind = uint8_t((*e)->kind());
+      record_.type = String((*e)->GetType());
+      Visit(**e);
+    } else if (auto d = node.declaration(); d) {
+      (*d)->Accept(static_cast<DeclarationVisitor&>(*this));
+    }
+    uint32_t index = nodes_.size();
+    nodes_.push_back(record_);
+    indexes_[&node] = index;
+
+    // Remember declarations, including those of parameters and loop
+    // variables, for the bindings of their uses.
+    if (auto d = node.declaration(); d) {
+      declarations_[*d] = {index, kNoIndex};
+      if (record_.kind == kFunctionDeclaration) {
+        const auto& params =
+            static_cast<const FunctionDeclaration*>(*d)->ParamDeclarations();
+        for (uint32_t i = 0; i < params.size(); ++i) {
+          declarations_[&params[i]] = {index, i};
+        }
+      }
+    } else if (record_.kind == uint8_t(Kind::kFor)) {
+      auto f = static_cast<const For*>(*node.expression());
+      declarations_[&f->Variable()] = {index, 0};
+    }
+    if (HasBinding(record_.kind)) {
+      const Binding& binding = (*node.expression())->GetBinding();
+      if (binding.declaration) uses_.push_back({index, binding});
+    }
+  }
+
+private:
+  static NodeRecord Blank(uint32_t source_offset) {
+    NodeRecord r = {};
+    r.source_offset = source_offset;
+    std::fill(std::begin(r.operands), std::end(r.operands), kNoIndex);
+    r.type = kNoIndex;
+    return r;
+  }
+
+  bool Operands(std::initializer_list<uint32_t> operands) {
+    std::copy(operands.begin(), operands.end(), record_.operands);
+    return true;
+  }
+
+  uint32_t AddType(const Type& type) {
+    type_record_ = Blank(SourceMap::kNoOffset);
+    type.Accept(static_cast<TypeVisitor&>(*this));
+    nodes_.push_back(type_record_);
+    return nodes_.size() - 1;
+  }
+
+  uint32_t Index(const TreeNode& node) const { return indexes_.at(&node); }
+
+  template <class T>
+  uint32_t List(const std::vector<std::shared_ptr<T>>& nodes) {
+    uint32_t first = lists_.size();
+    for (const auto& n : nodes) lists_.push_back(Index(*n));
+    return first;
+  }
+
+  uint32_t Pairs(const std::vector<TypeField>& fields) {
+    uint32_t first = lists_.size();
+    for (const auto& f : fields) {
+      lists_.push_back(String(f.id));
+      lists_.push_back(String(f.type_id));
+    }
+    return first;
+  }
+
+  uint32_t String(const std::string& s) {
+    auto [i, added] = string_indexes_.emplace(s, strings_.size());
+    if (added) strings_.push_back(&i->first);
+    return i->second;
+  }
+
+  // Appends the given records at the next offset aligned to 8.
+  template <class T> static Section Append(std::string& out, const T& v) {
+    out.resize((out.size() + 7) & ~size_t(7), '\0');
+    Section section = {uint32_t(out.size()), uint32_t(v.size())};
+    out.append(reinterpret_cast<const char*>(v.data()),
+               v.size() * sizeof(v[0]));
+    return section;
+  }
+
+  NodeRecord record_;
+  NodeRecord type_record_;
+  std::vector<NodeRecord> nodes_;
+  std::vector<uint32_t> lists_;
+  std::unordered_map<const TreeNode*, uint32_t> indexes_;
+  // Node and parameter index of declarations in the tree.
+  std::unordered_map<const Declaration*, std::pair<uint32_t, uint32_t>>
+      declarations_;
+  // Bound nodes in order.
+  std::vector<std::pair<uint32_t, Binding>> uses_;
+  std::unordered_map<std::string, uint32_t> string_indexes_;
+  std::vector<const std::string*> strings_;
+};
+
+// Checks the nodes of a view in order, counting the parents of each.
+class Validator {
+public:
+  explicit Validator(const View& view)
+      : view_(view), parents_(view.node_count()) {}
+
+  bool Valid() {
+    for (uint32_t i = 0; i < view_.node_count(); ++i) {
+      if (!ValidNode(i)) return false;
+    }
+    for (uint32_t i = 0; i < view_.root(); ++i) {
+      if (parents_[i] != 1) return false;
+    }
+    if (!IsExpression(view_.node(view_.root()).kind)) return false;
+    return ValidBindings();
+  }
+
+private:
+  bool ValidNode(uint32_t index) {
+    const NodeRecord& r = view_.node(index);
+    const uint32_t* o = r.operands;
+    index_ = index;
+    if (IsExpression(r.kind) && !String(r.type)) return false;
+    switch (r.kind) {
+    case uint8_t(Kind::kStringConstant):
+    case uint8_t(Kind::kIdLValue):
+    case kTypeReference:
+    case kArrayType:
+      return String(o[0]);
+    case uint8_t(Kind::kIntegerConstant):
+    case uint8_t(Kind::kNil):
+    case uint8_t(Kind::kBreak):
+    case kIntType:
+    case kStringType:
+      return true;
+    case uint8_t(Kind::kFieldLValue):
+      return Child(o[0], IsLValue) && String(o[1]);
+    case uint8_t(Kind::kIndexLValue):
+    case uint8_t(Kind::kAssignment):
+      return Child(o[0], IsLValue) && Child(o[1], IsExpression);
+    case uint8_t(Kind::kNegated):
+      return Child(o[0], IsExpression);
+    case uint8_t(Kind::kBinary):
+      return r.op <= kOr && Child(o[0], IsExpression) &&
+             Child(o[1], IsExpression);
+    case uint8_t(Kind::kFunctionCall):
+      return String(o[0]) && Children(o[1], o[2], IsExpression);
+    case uint8_t(Kind::kBlock):
+      return Children(o[0], o[1], IsExpression);
+    case uint8_t(Kind::kRecord):
+      if (!String(o[0]) || !Entries(o[1], o[2], 2)) return false;
+      for (uint32_t i = 0; i < o[2]; ++i) {
+        if (!String(view_.list(o[1] + 2 * i)) ||
+            !Child(view_.list(o[1] + 2 * i + 1), IsExpression)) {
+          return false;
+        }
+      }
+      return true;
+    case uint8_t(Kind::kArray):
+      return String(o[0]) && Child(o[1], IsExpression) &&
+             Child(o[2], IsExpression);
+    case uint8_t(Kind::kIfThen):
+    case uint8_t(Kind::kWhile):
+      return Child(o[0], IsExpression) && Child(o[1], IsExpression);
+    case uint8_t(Kind::kIfThenElse):
+      return Child(o[0], IsExpression) && Child(o[1], IsExpression) &&
+             Child(o[2], IsExpression);
+    case uint8_t(Kind::kFor):
+      return String(o[0]) && Child(o[1], IsExpression) &&
+             Child(o[2], IsExpression) && Child(o[3], IsExpression);
+    case uint8_t(Kind::kLet):
+      return Children(o[0], o[1], IsDeclaration) &&
+             Children(o[2], o[3], IsExpression);
+    case kTypeDeclaration:
+      return String(o[0]) && Child(o[1], IsType);
+    case kVariableDeclaration:
+      return String(o[0]) && OptionalString(o[1]) &&
+             Child(o[2], IsExpression);
+    case kFunctionDeclaration:
+      return String(o[0]) && OptionalString(o[1]) && Strings(o[2], o[3]) &&
+             Child(o[4], IsExpression);
+    case kRecordType:
+      return Strings(o[0], o[1]);
+    default:
+      return false;
+    }
+  }
+
+  bool ValidBindings() const {
+    for (uint32_t k = 0; k < view_.binding_count(); ++k) {
+      const BindingRecord& b = view_.binding_record(k);
+      if (b.node >= view_.node_count() ||
+          (k > 0 && b.node <= view_.binding_record(k - 1).node) ||
+          !HasBinding(view_.node(b.node).kind)) {
+        return false;
+      }
+      bool is_type = HasTypeBinding(view_.node(b.node).kind);
+      if (b.built_in != kNoIndex) {
+        if (!String(b.built_in) ||
+            !Expression::BuiltInDeclaration(
+                std::string(view_.string(b.built_in)), is_type)) {
+          return false;
+        }
+      } else if (b.declaration >= view_.node_count()) {
+        return false;
+      } else if (const NodeRecord& d = view_.node(b.declaration);
+                 d.kind == uint8_t(Kind::kFor)) {
+        if (b.param != 0 || is_type) return false;
+      } else if (!IsDeclaration(d.kind) ||
+                 (d.kind == kTypeDeclaration) != is_type) {
+        return false;
+      } else if (b.param != kNoIndex &&
+                 (d.kind != kFunctionDeclaration || b.param >= d.operands[3])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool String(uint32_t i) const { return i < view_.string_count(); }
+  bool OptionalString(uint32_t i) const { return i == kNoIndex || String(i); }
+
+  // Returns whether count entries of the given size from first are in the
+  // lists section.
+  bool Entries(uint32_t first, uint32_t count, uint32_t size) const {
+    uint64_t end = uint64_t(first) + uint64_t(count) * size;
+    return end <= view_.list_count();
+  }
+
+  // Counts a parent for a child of the current node, which must come before
+  // it, and be of the given kind.
+  bool Child(uint32_t i, bool (*is_kind)(uint8_t)) {
+    if (i >= index_ || !is_kind(view_.node(i).kind)) return false;
+    return ++parents_[i] == 1;
+  }
+  bool Children(uint32_t first, uint32_t count, bool (*is_kind)(uint8_t)) {
+    if (!Entries(first, count, 1)) return false;
+    for (uint32_t i = 0; i < count; ++i) {
+      if (!Child(view_.list(first + i), is_kind)) return false;
+    }
+    return true;
+  }
+  bool Strings(uint32_t first, uint32_t pairs) const {
+    if (!Entries(first, pairs, 2)) return false;
+    for (uint32_t i = 0; i < 2 * pairs; ++i) {
+      if (!String(view_.list(first + i))) return false;
+    }
+    return true;
+  }
+
+  const View& view_;
+  std::vector<uint32_t> parents_;
+  // Index of the node checked.
+  uint32_t index_ = 0;
+};
+} // namespace
+
+// Builds nodes in the order of the cache, so that children are built before
+// the parents that adopt them.
+class Loader {
+public:
+  explicit Loader(const View& view)
+      : view_(view), expressions_(view.node_count()),
+        declarations_(view.node_count()), types_(view.node_count()) {}
+
+  std::shared_ptr<Expression> Load() {
+    auto tree = std::make_shared<Tree>();
+    for (uint32_t i = 0; i < view_.string_count(); ++i) {
+      tree->strings.emplace_back(view_.string(i));
+    }
+    for (uint32_t i = 0; i < view_.node_count(); ++i) {
+      const NodeRecord& r = view_.node(i);
+      if (IsType(r.kind)) {
+        types_[i] = NewType(r);
+      } else if (IsDeclaration(r.kind)) {
+        declarations_[i] = NewDeclaration(r);
+        declarations_[i]->set_source_offset(r.source_offset);
+      } else {
+        Expression* e = NewExpression(r);
+        e->set_source_offset(r.source_offset);
+        e->type_ = &tree->strings[r.type];
+        expressions_[i] = e;
+      }
+    }
+    for (uint32_t i = 0; i < view_.node_count(); ++i) {
+      if (const BindingRecord* b = view_.binding(i); b) {
+        expressions_[i]->binding_ = {BoundDeclaration(*b), b->depth, b->slot};
+      }
+    }
+    tree->root.reset(expressions_[view_.root()]);
+    return std::shared_ptr<Expression>(tree, tree->root.get());
+  }
+
+private:
+  // Owns the tree and the strings its types point to.
+  struct Tree {
+    std::vector<std::string> strings;
+    std::unique_ptr<Expression> root;
+  };
+
+  Expression* NewExpression(const NodeRecord& r) {
+    const uint32_t* o = r.operands;
+    switch (Kind(r.kind)) {
+    case Kind::kStringConstant:
+      return new StringConstant(view_.string(o[0]));
+    case Kind::kIntegerConstant:
+      return new IntegerConstant(int32_t(o[0]));
+    case Kind::kNil:
+      return new Nil();
+    case Kind::kIdLValue:
+      return new IdLValue(view_.string(o[0]));
+    case Kind::kFieldLValue:
+      return new FieldLValue(LValueAt(o[0]), view_.string(o[1]));
+    case Kind::kIndexLValue:
+      return new IndexLValue(LValueAt(o[0]), expressions_[o[1]]);
+    case Kind::kNegated:
+      return new Negated(expressions_[o[0]]);
+    case Kind::kBinary:
+      return new Binary(expressions_[o[0]], BinaryOp(r.op),
+                        expressions_[o[1]]);
+    case Kind::kAssignment:
+      return new Assignment(std::shared_ptr<LValue>(LValueAt(o[0])),
+                            expressions_[o[1]]);
+    case Kind::kFunctionCall:
+      return new FunctionCall(view_.string(o[0]),
+                              List(expressions_, o[1], o[2]));
+    case Kind::kBlock:
+      return new Block(List(expressions_, o[0], o[1]));
+    case Kind::kRecord: {
+      std::vector<FieldValue> fields;
+      for (uint32_t i = 0; i < o[2]; ++i) {
+        uint32_t entry = o[1] + 2 * i;
+        fields.push_back(
+            {std::string(view_.string(view_.list(entry))),
+             std::shared_ptr<Expression>(
+                 expressions_[view_.list(entry + 1)])});
+      }
+      return new Record(view_.string(o[0]), std::move(fields));
+    }
+    case Kind::kArray:
+      return new Array(view_.string(o[0]), expressions_[o[1]],
+                       expressions_[o[2]]);
+    case Kind::kIfThen:
+      return new IfThen(expressions_[o[0]], expressions_[o[1]]);
+    case Kind::kIfThenElse:
+      return new IfThenElse(expressions_[o[0]], expressions_[o[1]],
+                            expressions_[o[2]]);
+    case Kind::kWhile:
+      return new While(expressions_[o[0]], expressions_[o[1]]);
+    case Kind::kFor:
+      return new For(view_.string(o[0]), expressions_[o[1]],
+                     expressions_[o[2]], expressions_[o[3]]);
+    case Kind::kBreak:
+      return new Break();
+    case Kind::kLet:
+      return new Let(List(declarations_, o[0], o[1]),
+                     List(expressions_, o[2], o[3]));
+    }
+    return nullptr;
+  }
+
+  Declaration* NewDeclaration(const NodeRecord& r) {
+    const uint32_t* o = r.operands;
+    switch (r.kind) {
+    case kTypeDeclaration:
+      return new TypeDeclaration(view_.string(o[0]), types_[o[1]]);
+    case kVariableDeclaration:
+      if (o[1] == kNoIndex) {
+        return new VariableDeclaration(view_.string(o[0]), expressions_[o[2]]);
+      }
+      return new VariableDeclaration(view_.string(o[0]), view_.string(o[1]),
+                                     expressions_[o[2]]);
+    default:
+      if (o[1] == kNoIndex) {
+        return new FunctionDeclaration(view_.string(o[0]), Fields(o[2], o[3]),
+                                       expressions_[o[4]]);
+      }
+      return new FunctionDeclaration(view_.string(o[0]), Fields(o[2], o[3]),
+                                     view_.string(o[1]), expressions_[o[4]]);
+    }
+  }
+
+  Type* NewType(const NodeRecord& r) {
+    switch (r.kind) {
+    case kTypeReference:
+      return new TypeReference(view_.string(r.operands[0]));
+    case kRecordType:
+      return new RecordType(Fields(r.operands[0], r.operands[1]));
+    case kArrayType:
+      return new ArrayType(view_.string(r.operands[0]));
+    case kIntType:
+      return new IntType();
+    default:
+      return new StringType();
+    }
+  }
+
+  const Declaration* BoundDeclaration(const BindingRecord& b) {
+    if (b.built_in != kNoIndex) {
+      return Expression::BuiltInDeclaration(
+          std::string(view_.string(b.built_in)),
+          HasTypeBinding(view_.node(b.node).kind));
+    }
+    if (view_.node(b.declaration).kind == uint8_t(Kind::kFor)) {
+      return &static_cast<const For*>(expressions_[b.declaration])
+                  ->Variable();
+    }
+    if (b.param != kNoIndex) {
+      return &static_cast<const FunctionDeclaration*>(
+                  declarations_[b.declaration])
+                  ->ParamDeclarations()[b.param];
+    }
+    return declarations_[b.declaration];
+  }
+
+  LValue* LValueAt(uint32_t index) {
+    return static_cast<LValue*>(expressions_[index]);
+  }
+
+  template <class T>
+  std::vector<std::shared_ptr<T>> List(const std::vector<T*>& nodes,
+                                       uint32_t first, uint32_t count) {
+    std::vector<std::shared_ptr<T>> list;
+    list.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+      list.emplace_back(nodes[view_.list(first + i)]);
+    }
+    return list;
+  }
+
+  std::vector<TypeField> Fields(uint32_t first, uint32_t count) {
+    std::vector<TypeField> fields;
+    for (uint32_t i = 0; i < count; ++i) {
+      fields.push_back({std::string(view_.string(view_.list(first + 2 * i))),
+                        std::string(view_.string(
+                            view_.list(first + 2 * i + 1)))});
+    }
+    return fields;
+  }
+
+  const View& view_;
+  std::vector<Expression*> expressions_;
+  std::vector<Declaration*> declarations_;
+  std::vector<Type*> types_;
+};
+
+uint64_t SourceHash(std::string_view source) {
+  // 64 bit FNV-1a.
+  uint64_t hash = 14695981039346656037u;
+  for (unsigned char c : source) {
+    hash ^= c;
+    hash *= 1099511628211u;
+  }
+  return hash;
+}
+
+std::string Write(const Expression& root, uint64_t source_hash) {
+  Writer writer;
+  writer.Walk(root);
+  return writer.Finish(source_hash);
+}
+
+std::optional<View> View::Open(std::string_view bytes) {
+  if (bytes.size() < sizeof(Header) ||
+      reinterpret_cast<uintptr_t>(bytes.data()) % 8 != 0) {
+    return {};
+  }
+  View view(bytes);
+  const Header& h = view.header();
+  if (std::memcmp(h.magic, kMagic, sizeof(kMagic)) != 0 ||
+      h.version != kVersion) {
+    return {};
+  }
+  std::pair<const Section*, size_t> sections[] = {
+      {&h.nodes, sizeof(NodeRecord)},
+      {&h.lists, sizeof(uint32_t)},
+      {&h.bindings, sizeof(BindingRecord)},
+      {&h.strings, sizeof(StringRecord)},
+      {&h.string_bytes, 1}};
+  for (const auto& [section, size] : sections) {
+    if (section->offset % 8 != 0 ||
+        section->offset + uint64_t(section->count) * size > bytes.size()) {
+      return {};
+    }
+  }
+  if (h.nodes.count == 0) return {};
+  const StringRecord* strings = view.Records<StringRecord>(h.strings);
+  for (uint32_t i = 0; i < h.strings.count; ++i) {
+    if (uint64_t(strings[i].offset) + strings[i].size > h.string_bytes.count) {
+      return {};
+    }
+  }
+  if (!Validator(view).Valid()) return {};
+  return view;
+}
+
+const Header& View::header() const {
+  return *reinterpret_cast<const Header*>(bytes_.data());
+}
+
+template <class T> const T* View::Records(const Section& section) const {
+  return reinterpret_cast<const T*>(bytes_.data() + section.offset);
+}
+
+const NodeRecord& View::node(uint32_t index) const {
+  return Records<NodeRecord>(header().nodes)[index];
+}
+
+uint32_t View::list(uint32_t index) const {
+  return Records<uint32_t>(header().lists)[index];
+}
+
+std::string_view View::string(uint32_t index) const {
+  const StringRecord& s = Records<StringRecord>(header().strings)[index];
+  return std::string_view(
+      Records<char>(header().string_bytes) + s.offset, s.size);
+}
+
+const BindingRecord& View::binding_record(uint32_t index) const {
+  return Records<BindingRecord>(header().bindings)[index];
+}
+
+const BindingRecord* View::binding(uint32_t node) const {
+  const BindingRecord* first = Records<BindingRecord>(header().bindings);
+  const BindingRecord* last = first + header().bindings.count;
+  const BindingRecord* b = std::lower_bound(
+      first, last, node,
+      [](const BindingRecord& b, uint32_t node) { return b.node < node; });
+  return b != last && b->node == node ? b : nullptr;
+}
+
+std::shared_ptr<Expression> Rehydrate(const View& view) {
+  instrument::ScopedPhase phase(instrument::kParse);
+  return Loader(view).Load();
+}
+
+MappedFile::MappedFile(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return;
+  struct stat status;
+  if (fstat(fd, &status) == 0 && status.st_size > 0) {
+    void* data =
+        mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      data_ = data;
+      size_ = status.st_size;
+    }
+  }
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data_) munmap(data_, size_);
+}
+
+std::optional<std::string_view> MappedFile::bytes() const {
+  if (!data_) return {};
+  return std::string_view(static_cast<const char*>(data_), size_);
+}
+
+} // namespace ast_cache
@@ -0,0 +1,154 @@
+#pragma once
+#include "Expression.h"
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Binary cache of a typed tree, so that programs which rarely change need
+// not be scanned, parsed, bound, and typed on every compile. A cache holds
+// every expression, declaration, and type of the tree, with source
+// offsets, the types of expressions, and the bindings of uses of names,
+// and the hash of the source it was compiled from.
+//
+// Caches are a Header followed by sections of fixed size records, at
+// offsets relative to the start of the cache, so that they are position
+// independent and can be read in place, e.g. from a mapped file. Nodes
+// refer to each other, to strings, and to lists by index. Records are in
+// host byte order, so caches are not portable between machines.
+//
+// Nodes are in post-order, so that children come before their parents and
+// the root is last. Thus reading a cache does not recurse, and a valid
+// cache cannot contain cycles.
+namespace ast_cache {
+
+// Index of no node, string, or list entry.
+constexpr uint32_t kNoIndex = UINT32_MAX;
+
+// Kinds of nodes, besides those of Expression::Kind.
+enum NodeKind : uint8_t {
+  kTypeDeclaration = 64,
+  kVariableDeclaration,
+  kFunctionDeclaration,
+  kTypeReference,
+  kRecordType,
+  kArrayType,
+  kIntType,
+  kStringType,
+};
+
+// An expression, declaration, or type. Operands are indexes of strings,
+// nodes, and list entries, by kind, see AstCache.cc.
+struct NodeRecord {
+  uint8_t kind; // Expression::Kind or NodeKind
+  uint8_t op;   // BinaryOp of Binary nodes
+  uint16_t unused;
+  uint32_t source_offset;
+  uint32_t operands[5];
+  // Index of the string of the type of an expression.
+  uint32_t type;
+};
+
+// Binding of the IdLValue, FunctionCall, Record, or Array node with the
+// given index, to a declaration in the tree, a built-in, or to none.
+struct BindingRecord {
+  uint32_t node;
+  // Index of a declaration, or, given a param, of a FunctionDeclaration or
+  // For node.
+  uint32_t declaration;
+  // Index of a function parameter, or 0 for the variable of a For node,
+  // or kNoIndex.
+  uint32_t param;
+  // Index of the string of the ID of a built-in declaration, or kNoIndex.
+  uint32_t built_in;
+  int32_t depth;
+  int32_t slot;
+};
+
+struct StringRecord {
+  uint32_t offset; // In the string bytes
+  uint32_t size;
+};
+
+struct Section {
+  uint32_t offset; // From the start of the cache, a multiple of 8
+  uint32_t count;  // Of records
+};
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t unused;
+  uint64_t source_hash;
+  Section nodes;        // NodeRecords
+  Section lists;        // uint32_t
+  Section bindings;     // BindingRecords, ordered by node
+  Section strings;      // StringRecords
+  Section string_bytes; // char
+};
+
+// Returns the hash of source text stored in caches, to tell whether a
+// cache is still valid.
+uint64_t SourceHash(std::string_view source);
+
+// Returns the cache of the tree with the given root. Undefined behavior
+// until Expression::SetTypesBelow has been called on the tree.
+std::string Write(const Expression& root, uint64_t source_hash);
+
+// Read-only view of a cache, which reads records in place.
+class View {
+public:
+  // Returns a view of the given bytes, if they hold a well formed cache,
+  // i.e. all indexes are in range, every node but the root is the child of
+  // exactly one node, and nodes are children and declarations of the
+  // right kinds. Bytes must be aligned to 8 and outlive the view.
+  static std::optional<View> Open(std::string_view bytes);
+
+  uint64_t source_hash() const { return header().source_hash; }
+  uint32_t node_count() const { return header().nodes.count; }
+  uint32_t root() const { return node_count() - 1; }
+  const NodeRecord& node(uint32_t index) const;
+  // Returns an entry of the lists section.
+  uint32_t list(uint32_t index) const;
+  uint32_t list_count() const { return header().lists.count; }
+  std::string_view string(uint32_t index) const;
+  uint32_t string_count() const { return header().strings.count; }
+  // Returns the binding of the node with the given index, if it has one.
+  const BindingRecord* binding(uint32_t node) const;
+  // Returns the binding record with the given index, in order of nodes.
+  const BindingRecord& binding_record(uint32_t index) const;
+  uint32_t binding_count() const { return header().bindings.count; }
+
+private:
+  explicit View(std::string_view bytes) : bytes_(bytes) {}
+  const Header& header() const;
+  template <class T> const T* Records(const Section& section) const;
+
+  std::string_view bytes_;
+};
+
+// Returns the tree cached, as parsed, with bindings as set by
+// Expression::SetNameSpacesBelow, and types as set by SetTypesBelow.
+// Expressions have no name spaces though, so that
+// Expression::GetTypeNameSpace and GetNonTypeNameSpace are undefined
+// behavior. Types point to strings owned along with the root.
+std::shared_ptr<Expression> Rehydrate(const View& view);
+
+// Contents of a file mapped read-only into memory.
+class MappedFile {
+public:
+  explicit MappedFile(const std::string& path);
+  ~MappedFile();
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  // Returns the contents, if the file could be mapped.
+  std::optional<std::string_view> bytes() const;
+
+private:
+  void* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+} // namespace ast_cache
@@ -0,0 +1,190 @@
+#include "AstCache.h"
+#include "Checker.h"
+#include "ToString.h"
+#include "TreeWalker.h"
+#include "compiler.h"
+#include "syntax_nodes.h"
+#include "testing/catch.h"
+#include "testing/generator.h"
+#include "testing/testing.h"
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+using testing::Parse;
+
+const char* kPrograms[] = {
+    "3",
+    "\"Hello\"",
+    "nil",
+    "-3 * (4 - 5)",
+    "IntArray [3] of 0",
+    "if 1 then \"you\" else \"world\"",
+    "while 1 do (printi(2); break)",
+    "for i := 1 to 3 do printi(i)",
+    "let var a : int := 3 in a end",
+    "let type T = int in let type T = string var a : T := \"Hello\" "
+    "in a end end",
+    "let function f(x: int, s: string): string = s in f(1, \"a\") end",
+    "let function f():int = g() function g():int = f() in f() end",
+    "let type Bulk = {height:int, weight:int} var b : Bulk := nil in "
+    "b := nil; b.height end",
+    "let type Bulk = {height:int, weight:int} in "
+    "Bulk {weight=200, height=6}; Heft {height=6} end",
+    "let type A = array of int var a := A [2] of 0 in a[1] := a[0] end",
+    "(666 < \"Hello\"; \"foo\" & \"bar\"; if \"s\" then 1)",
+};
+
+// Source offset, type, and binding of every node in walk order.
+std::vector<std::string> Describe(const Expression& root) {
+  struct Describer : TreeWalker {
+    bool Enter(TreeNode& node) override {
+      std::ostringstream os;
+      os << node.source_offset();
+      if (auto e = node.expression(); e) {
+        os << " " << (*e)->GetType();
+        const Binding& b = (*e)->GetBinding();
+        if (b.declaration) {
+          os << " bound to " << b.declaration->Id() << " at "
+             << b.declaration->source_offset() << " " << b.depth << " "
+             << b.slot;
+        }
+      }
+      lines.push_back(os.str());
+      return true;
+    }
+    std::vector<std::string> lines;
+  } describer;
+  describer.Walk(root);
+  return describer.lines;
+}
+
+std::shared_ptr<Expression> Typed(const std::string& text) {
+  std::shared_ptr<Expression> e = Parse(text);
+  Expression::SetNameSpacesBelow(*e);
+  Expression::SetTypesBelow(*e);
+  return e;
+}
+
+std::string Jar(const Expression& e) {
+  std::ostringstream os;
+  CompileToJar(e, os);
+  return os.str();
+}
+
+// Copy of a cache in memory aligned like a mapped file.
+struct Aligned {
+  explicit Aligned(const std::string& bytes)
+      : words((bytes.size() + 7) / 8), size(bytes.size()) {
+    std::memcpy(words.data(), bytes.data(), size);
+  }
+  std::string_view bytes() const {
+    return std::string_view(reinterpret_cast<const char*>(words.data()),
+                            size);
+  }
+  std::vector<uint64_t> words;
+  size_t size;
+};
+
+SCENARIO("AST caches keep typed trees", "[ast_cache]") {
+  std::vector<std::string> programs(std::begin(kPrograms),
+                                    std::end(kPrograms));
+  programs.push_back(testing::ManyFunctions(20));
+  programs.push_back(testing::RecordTypes(20));
+  for (const std::string& text : programs) {
+    GIVEN(text.substr(0, 60)) {
+      std::shared_ptr<Expression> parsed = Typed(text);
+      Aligned cache(ast_cache::Write(*parsed, ast_cache::SourceHash(text)));
+      auto view = ast_cache::View::Open(cache.bytes());
+      REQUIRE(view);
+      REQUIRE(view->source_hash() == ast_cache::SourceHash(text));
+      std::shared_ptr<Expression> read = ast_cache::Rehydrate(*view);
+      THEN("reading gives the tree as parsed, bound, and typed") {
+        REQUIRE(ToString(*read) == ToString(*parsed));
+        REQUIRE(Describe(*read) == Describe(*parsed));
+        REQUIRE(ListErrors(*read) == ListErrors(*parsed));
+        REQUIRE(Jar(*read) == Jar(*parsed));
+      }
+    }
+  }
+  GIVEN("a tree nested deeply") {
+    std::string text = testing::BinaryChain(100000);
+    std::shared_ptr<Expression> parsed = Typed(text);
+    Aligned cache(ast_cache::Write(*parsed, 0));
+    auto view = ast_cache::View::Open(cache.bytes());
+    REQUIRE(view);
+    REQUIRE(ToString(*ast_cache::Rehydrate(*view)) == ToString(*parsed));
+  }
+}
+
+SCENARIO("AST caches are read in place", "[ast_cache]") {
+  GIVEN("a cache") {
+    std::string bytes = ast_cache::Write(*Typed("let var s := \"x\" in s end"),
+                                         ast_cache::SourceHash("source"));
+    Aligned cache(bytes);
+    auto view = ast_cache::View::Open(cache.bytes());
+    REQUIRE(view);
+    THEN("records are in post-order") {
+      REQUIRE(view->node_count() == 4);
+      const ast_cache::NodeRecord& let = view->node(view->root());
+      REQUIRE(let.kind == uint8_t(Expression::Kind::kLet));
+      REQUIRE(view->string(let.type) == "string");
+      const ast_cache::NodeRecord& s = view->node(view->root() - 1);
+      REQUIRE(s.kind == uint8_t(Expression::Kind::kIdLValue));
+      REQUIRE(view->string(s.operands[0]) == "s");
+      REQUIRE(view->binding(view->root() - 1)->declaration == 1);
+      REQUIRE(view->node(1).kind == ast_cache::kVariableDeclaration);
+    }
+    THEN("moving it keeps it valid") {
+      Aligned moved(bytes);
+      REQUIRE(moved.bytes().data() != cache.bytes().data());
+      REQUIRE(ast_cache::View::Open(moved.bytes()));
+    }
+    THEN("it tells a changed source") {
+      REQUIRE(view->source_hash() != ast_cache::SourceHash("sourcE"));
+    }
+  }
+}
+
+SCENARIO("Malformed AST caches are rejected", "[ast_cache]") {
+  std::string bytes =
+      ast_cache::Write(*Typed("let function f(x: int): int = -x in f(1) end"),
+                       0);
+  GIVEN("a truncated cache") {
+    for (size_t size = 0; size < bytes.size(); size += 7) {
+      REQUIRE_FALSE(ast_cache::View::Open(Aligned(bytes.substr(0, size))
+                                              .bytes()));
+    }
+  }
+  GIVEN("a cache with a node used twice") {
+    Aligned cache(bytes);
+    auto view = ast_cache::View::Open(cache.bytes());
+    REQUIRE(view);
+    // Make the call argument the negation, which is the function body.
+    uint32_t negated = 0;
+    while (view->node(negated).kind != uint8_t(Expression::Kind::kNegated)) {
+      ++negated;
+    }
+    std::string changed = bytes;
+    for (size_t i = 0; i + 4 <= changed.size(); i += 4) {
+      uint32_t word;
+      std::memcpy(&word, changed.data() + i, 4);
+      // Index of the constant 1, the only IntegerConstant after f.
+      if (i >= sizeof(ast_cache::Header) && word == view->root() - 2 &&
+          view->node(word).kind ==
+              uint8_t(Expression::Kind::kIntegerConstant)) {
+        std::memcpy(changed.data() + i, &negated, 4);
+      }
+    }
+    REQUIRE(changed != bytes);
+    REQUIRE_FALSE(ast_cache::View::Open(Aligned(changed).bytes()));
+  }
+  GIVEN("a cache of another version") {
+    std::string changed = bytes;
+    changed[8] ^= 1;
+    REQUIRE_FALSE(ast_cache::View::Open(Aligned(changed).bytes()));
+  }
+}
+} // namespace
@@ -0,0 +1,82 @@
+#pragma once
+#include "ScopedMap.h"
+#include <string>
+#include <vector>
+
+class Declaration;
+
+// Declaration bound to a use of a variable, function, or type, as found
+// once by Expression::SetNameSpacesBelow, so that later phases need not
+// look names up again.
+struct Binding {
+  const Declaration* declaration = nullptr;
+  // Number of function declarations enclosing the declaration.
+  int depth = 0;
+  // Index of a variable, parameter, or loop variable among those of its
+  // function, or of the main program at depth 0. Functions and types
+  // have no slot.
+  int slot = kNoSlot;
+
+  static constexpr int kNoSlot = -1;
+};
+
+// Bindings in scope while resolving a tree.
+class Scopes {
+public:
+  Scopes() { EnterFunction(); }
+
+  // Pushes a scope, e.g. for a Let expression.
+  void EnterScope() {
+    values_.EnterScope();
+    types_.EnterScope();
+  }
+
+  // Drops all bindings since the last EnterScope.
+  void ExitScope() {
+    values_.ExitScope();
+    types_.ExitScope();
+  }
+
+  // Pushes a scope with a fresh frame of slots for a function body.
+  void EnterFunction() {
+    frame_sizes_.push_back(0);
+    EnterScope();
+  }
+
+  void ExitFunction() {
+    ExitScope();
+    frame_sizes_.pop_back();
+  }
+
+  // Binds a variable, parameter, or loop variable to the next slot.
+  void BindValue(const std::string& id, const Declaration& declaration) {
+    values_[id] = {&declaration, Depth(), frame_sizes_.back()++};
+  }
+
+  void BindFunction(const std::string& id, const Declaration& declaration) {
+    values_[id] = {&declaration, Depth()};
+  }
+
+  void BindType(const std::string& id, const Declaration& declaration) {
+    types_[id] = {&declaration, Depth()};
+  }
+
+  // Returns binding of variable or function with the given ID, or a binding
+  // without declaration if there is none.
+  Binding LookupValue(const std::string& id) const {
+    const Binding* b = values_.Lookup(id);
+    return b ? *b : Binding();
+  }
+
+  Binding LookupType(const std::string& id) const {
+    const Binding* b = types_.Lookup(id);
+    return b ? *b : Binding();
+  }
+
+private:
+  int Depth() const { return frame_sizes_.size() - 1; }
+
+  ScopedMap<Binding> values_;
+  ScopedMap<Binding> types_;
+  std::vector<int> frame_sizes_;
+};
@@ -0,0 +1,75 @@
+#include "Checker.h"
+#include "syntax_nodes.h"
+#include "testing/catch.h"
+#include "testing/testing.h"
+#include <sstream>
+#include <string>
+
+namespace {
+using testing::Parse;
+
+// Returns "id@depth:slot" for every bound use below node in pre-order, with
+// "?" for uses without declaration.
+void AppendBindings(const TreeNode& node, std::ostringstream& os) {
+  if (auto e = const_cast<TreeNode&>(node).expression(); e) {
+    const Binding& b = (*e)->GetBinding();
+    if (b.declaration) {
+      os << b.declaration->Id() << "@" << b.depth << ":" << b.slot << " ";
+    }
+  }
+  for (const TreeNode* c : node.Children()) AppendBindings(*c, os);
+}
+
+std::string Bindings(const char* text) {
+  std::shared_ptr<Expression> e = Parse(text);
+  Expression::SetNameSpacesBelow(*e);
+  std::ostringstream os;
+  AppendBindings(*e, os);
+  return os.str();
+}
+
+std::string InferType(const char* text) {
+  std::shared_ptr<Expression> e = Parse(text);
+  Expression::SetNameSpacesBelow(*e);
+  Expression::SetTypesBelow(*e);
+  return e->GetType();
+}
+
+SCENARIO("uses are bound to declarations", "[Binding]") {
+  GIVEN("variables in nested functions") {
+    REQUIRE(Bindings("let var a := 1 "
+                     "function f(x: int, y: int): int = "
+                     "let var z := x in z + y + a end "
+                     "in f(a, 2) end") ==
+            "x@1:0 z@1:2 y@1:1 a@0:0 f@0:-1 a@0:0 ");
+  }
+  GIVEN("shadowed variables") {
+    REQUIRE(Bindings("let var a := 1 in let var a := \"s\" in a end; a end") ==
+            "a@0:1 a@0:0 ");
+    REQUIRE(InferType("let var a := 1 in let var a := \"s\" in a end end") ==
+            "string");
+  }
+  GIVEN("built-in functions and types") {
+    REQUIRE(Bindings("printi(size(\"abc\"))") == "printi@0:-1 size@0:-1 ");
+    REQUIRE(Bindings("let type A = array of int in A [2] of 0 end") ==
+            "A@0:-1 ");
+  }
+  GIVEN("a for loop") {
+    THEN("only the body sees the loop variable") {
+      REQUIRE(Bindings("let var i := 1 in for i := i to 3 do printi(i) end") ==
+              "i@0:0 printi@0:-1 i@0:1 ");
+    }
+    THEN("the loop variable is an int") {
+      auto e =
+          Parse("let var s := \"\" in for s := 1 to 2 do if s then () end");
+      Expression::SetNameSpacesBelow(*e);
+      Expression::SetTypesBelow(*e);
+      REQUIRE(ListErrors(*e).empty());
+    }
+  }
+  GIVEN("undeclared names") {
+    REQUIRE(Bindings("(x; f(1); R {})") == "");
+    REQUIRE(InferType("x") == "???");
+  }
+}
+} // namespace
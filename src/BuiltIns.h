@@ -0,0 +1,120 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+
+// The Tiger standard library, as described in Appendix A of
+// http://www.cs.columbia.edu/~sedwards/classes/2002/w4115/tiger.pdf. Both
+// the front end, which declares these functions in the outermost scope,
+// and the emitter, which calls their implementation in class Std of
+// Std.java, read this one table.
+
+struct BuiltInParam {
+  std::string_view id;
+  std::string_view type_id;
+};
+
+// What calls of a built-in function do besides returning their result.
+enum class BuiltInEffects : uint8_t {
+  // Nothing, so that optimizations may move calls, e.g. out of loops.
+  kNone,
+  // Nothing, but they fail for some arguments, e.g. substring with bounds
+  // out of the string.
+  kMayFail,
+  // Input or output, e.g. print.
+  kIo,
+};
+
+struct BuiltInFunction {
+  static constexpr int kMaxParams = 3;
+
+  // Name in Tiger.
+  std::string_view name;
+  BuiltInParam params[kMaxParams];
+  int param_count;
+  // Type of the returned value, or empty for procedures.
+  std::string_view result_type;
+  // Name of the static method implementing the function in class Std.
+  std::string_view jvm_name;
+  // Method descriptor of jvm_name, see
+  // https://docs.oracle.com/javase/specs/jvms/se7/html/jvms-4.html#jvms-4.3.3
+  std::string_view descriptor;
+  BuiltInEffects effects = BuiltInEffects::kIo;
+};
+
+// Class implementing all built-in functions.
+constexpr std::string_view kBuiltInClass = "Std";
+
+constexpr std::string_view kBuiltInTypes[] = {"int", "string"};
+
+constexpr BuiltInFunction kBuiltInFunctions[] = {
+    {"print", {{"s", "string"}}, 1, "", "print", "(Ljava/lang/String;)V"},
+    {"printi", {{"i", "int"}}, 1, "", "printi", "(I)V"},
+    {"flush", {}, 0, "", "flush", "()V"},
+    {"getchar", {}, 0, "string", "getChar", "()Ljava/lang/String;"},
+    {"ord", {{"s", "string"}}, 1, "int", "ord", "(Ljava/lang/String;)I",
+     BuiltInEffects::kNone},
+    {"chr", {{"i", "int"}}, 1, "string", "chr", "(I)Ljava/lang/String;",
+     BuiltInEffects::kNone},
+    {"size", {{"s", "string"}}, 1, "int", "size", "(Ljava/lang/String;)I",
+     BuiltInEffects::kNone},
+    {"substring",
+     {{"s", "string"}, {"f", "int"}, {"n", "int"}},
+     3,
+     "string",
+     "substring",
+     "(Ljava/lang/String;II)Ljava/lang/String;",
+     BuiltInEffects::kMayFail},
+    {"concat",
+     {{"s1", "string"}, {"s2", "string"}},
+     2,
+     "string",
+     "concat",
+     "(Ljava/lang/String;Ljava/lang/String;)Ljava/lang/String;",
+     BuiltInEffects::kNone},
+    {"not", {{"i", "int"}}, 1, "int", "not", "(I)I", BuiltInEffects::kNone},
+    {"exit", {{"i", "int"}}, 1, "", "exit", "(I)V"},
+};
+
+// Returns the built-in function with the given name, or nullptr.
+constexpr const BuiltInFunction* FindBuiltInFunction(std::string_view name) {
+  for (const BuiltInFunction& f : kBuiltInFunctions) {
+    if (f.name == name) return &f;
+  }
+  return nullptr;
+}
+
+namespace built_ins_internal {
+// Returns the JVM field descriptor for values of the given Tiger type.
+constexpr std::string_view JvmType(std::string_view type_id) {
+  if (type_id == "int") return "I";
+  if (type_id == "string") return "Ljava/lang/String;";
+  return type_id.empty() ? "V" : "?";
+}
+
+// Returns true if the descriptor agrees with the Tiger signature.
+constexpr bool HasMatchingDescriptor(const BuiltInFunction& f) {
+  std::string_view d = f.descriptor;
+  if (d.empty() || d[0] != '(') return false;
+  d.remove_prefix(1);
+  for (int i = 0; i < f.param_count; ++i) {
+    std::string_view t = JvmType(f.params[i].type_id);
+    if (d.substr(0, t.size()) != t) return false;
+    d.remove_prefix(t.size());
+  }
+  if (d.empty() || d[0] != ')') return false;
+  d.remove_prefix(1);
+  return d == JvmType(f.result_type);
+}
+
+constexpr bool AllDescriptorsMatch() {
+  for (const BuiltInFunction& f : kBuiltInFunctions) {
+    if (f.param_count > BuiltInFunction::kMaxParams ||
+        !HasMatchingDescriptor(f)) {
+      return false;
+    }
+  }
+  return true;
+}
+static_assert(AllDescriptorsMatch(),
+              "JVM descriptors must match Tiger signatures of built-ins");
+} // namespace built_ins_internal
@@ -0,0 +1,45 @@
+#include "BuiltIns.h"
+#include "Checker.h"
+#include "emit.h"
+#include "testing/catch.h"
+#include "testing/testing.h"
+#include <string>
+
+namespace {
+
+// Returns a call of f with constant arguments of the declared types.
+std::string CallOf(const BuiltInFunction& f) {
+  std::string call = std::string(f.name) + "(";
+  for (int i = 0; i < f.param_count; ++i) {
+    if (i > 0) call += ", ";
+    call += f.params[i].type_id == "int" ? "1" : "\"a\"";
+  }
+  return call + ")";
+}
+
+SCENARIO("Built-in functions are known to front end and emitter",
+         "[BuiltIns]") {
+  for (const BuiltInFunction& f : kBuiltInFunctions) {
+    GIVEN(CallOf(f)) {
+      std::shared_ptr<Expression> e = testing::Parse(CallOf(f));
+      Expression::SetNameSpacesBelow(*e);
+      Expression::SetTypesBelow(*e);
+      THEN("it is declared with its parameter and result types") {
+        REQUIRE(e->GetBinding().declaration != nullptr);
+        REQUIRE(ListErrors(*e).empty());
+        if (!f.result_type.empty()) REQUIRE(e->GetType() == f.result_type);
+      }
+      THEN("the emitter finds its implementation") {
+        auto program = emit::Program::JavaProgram();
+        REQUIRE(program->LookupLibraryFunction(f.name) != nullptr);
+      }
+    }
+  }
+  GIVEN("a name that is no built-in") {
+    REQUIRE(FindBuiltInFunction("getChar") == nullptr);
+    REQUIRE(emit::Program::JavaProgram()->LookupLibraryFunction("getChar") ==
+            nullptr);
+  }
+}
+
+} // namespace
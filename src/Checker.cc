@@ -1,14 +1,17 @@
 #include "Checker.h"
-#include "StoppingExpressionVisitor.h"
+#include "Instrument.h"
+#include "StaticExpressionVisitor.h"
 #include "ToString.h"
+#include "TreeWalker.h"
+#include "WorkStealing.h"
 #include "syntax_nodes.h"
 #include <functional>
+#include <iterator>
 #include <sstream>
+#include <tuple>
 
 namespace {
 using Errors = std::vector<std::string>;
-using CheckerBuilder =
-    std::function<std::unique_ptr<ExpressionVisitor>(Errors&)>;
 
 struct Emitter : public std::ostringstream {
   Emitter(Errors& v) : errors(v) {}
@@ -16,7 +19,8 @@ struct Emitter : public std::ostringstream {
   Errors& errors;
 };
 
-struct Checker : public StoppingExpressionVisitor {
+// Base of checkers, which are static visitors of one expression at a time.
+struct Checker {
   Checker(Errors& errors) : errors_(errors) {}
   Emitter emit() { return {errors_}; }
   Errors& errors_;
@@ -24,14 +28,16 @@ struct Checker : public StoppingExpressionVisitor {
 
 // Record literal field names, expression types, and the order
 // thereof must exactly match those of the given record type (2.3)
-struct RecordFieldChecker : Checker {
+struct RecordFieldChecker
+    : Checker,
+      StaticStoppingExpressionVisitor<RecordFieldChecker> {
   RecordFieldChecker(Errors& errors) : Checker(errors) {}
   bool VisitRecord(const std::string& type_id,
                    const std::vector<FieldValue>& field_values,
-                   const Expression& exp) override {
-    if (auto d = exp.GetTypeNameSpace().Lookup(type_id); !d) {
+                   const Expression& exp) {
+    if (auto d = exp.GetBinding().declaration; !d) {
       emit() << "Unknown record type " << type_id;
-    } else if (auto t = (*d)->GetType(); !t) {
+    } else if (auto t = d->GetType(); !t) {
       emit() << "Internal error: missing RHS for type declaration " << type_id;
     } else if (auto r = (*t)->recordType(); !r) {
       emit() << "Type " << type_id << " is not a record";
@@ -62,10 +68,12 @@ bool IsPrimitive(const std::string& type) {
 
 // Binary operators >, <, >=, and <= may be either both integer or both string
 // (2.5). Operators & and | are lazy logical operators on integers (2.5)
-struct BinaryOpChecker : Checker {
+struct BinaryOpChecker
+    : Checker,
+      StaticStoppingExpressionVisitor<BinaryOpChecker> {
   BinaryOpChecker(Errors& errors) : Checker(errors) {}
   bool VisitBinary(const Expression& left, BinaryOp op,
-                   const Expression& right) override {
+                   const Expression& right) {
     switch (op) {
     case kGreaterThan:
     case kLessThan:
@@ -106,17 +114,18 @@ struct BinaryOpChecker : Checker {
 };
 
 // Conditionals must evaluate to integers (2.8)
-struct ConditionalChecker : Checker {
+struct ConditionalChecker
+    : Checker,
+      StaticStoppingExpressionVisitor<ConditionalChecker> {
   ConditionalChecker(Errors& errors) : Checker(errors) {}
-  bool VisitIfThen(const Expression& condition, const Expression&) override {
+  bool VisitIfThen(const Expression& condition, const Expression&) {
     return CheckInt(condition);
   }
   bool VisitIfThenElse(const Expression& condition, const Expression&,
-                       const Expression&) override {
+                       const Expression&) {
     return CheckInt(condition);
   }
-  virtual bool VisitWhile(const Expression& condition,
-                          const Expression&) override {
+  bool VisitWhile(const Expression& condition, const Expression&) {
     return CheckInt(condition);
   }
   bool CheckInt(const Expression& condition) {
@@ -128,30 +137,99 @@ struct ConditionalChecker : Checker {
   }
 };
 
-#define CHECK_BUILDER(C)                                                       \
-  [](Errors& errors) { return std::make_unique<C>(errors); }
+// Checkers run on every expression, in order. Being distinct types, they
+// are called without virtual calls.
+using Checkers =
+    std::tuple<RecordFieldChecker, BinaryOpChecker, ConditionalChecker>;
 
-std::vector<CheckerBuilder> kCheckerBuilders = {
-    CHECK_BUILDER(RecordFieldChecker),
-    CHECK_BUILDER(BinaryOpChecker),
-    CHECK_BUILDER(ConditionalChecker),
+struct FunctionClassifier : public DeclarationVisitor {
+  bool VisitFunctionDeclaration(const std::string& id,
+                                const std::vector<TypeField>& params,
+                                const std::optional<std::string> type_id,
+                                const Expression& body) override {
+    is_function = true;
+    return true;
+  }
+
+  bool is_function = false;
 };
 
-void CheckBelow(const Expression& parent, Errors& errors,
-                std::vector<CheckerBuilder>& checker_builders) {
-  for (auto f : checker_builders) {
-    auto checker = f(errors);
-    parent.Accept(*checker);
-  }
-  for (auto* n : parent.Children()) {
-    if (auto e = n->expression(); e) CheckBelow(**e, errors, checker_builders);
-  }
+bool IsFunction(TreeNode& node) {
+  auto d = node.declaration();
+  if (!d) return false;
+  FunctionClassifier classifier;
+  (*d)->Accept(classifier);
+  return classifier.is_function;
 }
 
+// Body of a function, checked on its own.
+struct FunctionTask {
+  TreeNode* function;
+  // Number of errors before the function in source order.
+  size_t errors_before;
+  Errors errors;
+};
+
+// Runs all checkers on every expression. Given a vector for them, skips
+// and collects the outermost functions. Given a SourceMap, prefixes errors
+// with the position of the expression checked.
+class CheckingWalker : public TreeWalker {
+public:
+  CheckingWalker(Errors& errors, const SourceMap* sources,
+                 std::vector<FunctionTask>* functions = nullptr)
+      : errors_(errors), sources_(sources), functions_(functions),
+        checkers_(errors, errors, errors) {}
+
+protected:
+  bool Enter(TreeNode& node) override {
+    if (functions_ && IsFunction(node)) {
+      functions_->push_back({&node, errors_.size()});
+      return false;
+    }
+    if (auto e = node.expression(); e) {
+      size_t first_error = errors_.size();
+      std::apply([e](auto&... checker) { (checker.Visit(**e), ...); },
+                 checkers_);
+      for (size_t i = first_error; sources_ && i < errors_.size(); ++i) {
+        errors_[i] = sources_->Describe(node.source_offset()) + ": " +
+                     errors_[i];
+      }
+    }
+    return true;
+  }
+
+private:
+  Errors& errors_;
+  const SourceMap* sources_;
+  std::vector<FunctionTask>* functions_;
+  Checkers checkers_;
+};
+
 } // namespace
 
-Errors ListErrors(const Expression& root) {
+Errors ListErrors(const Expression& root, int threads,
+                  const SourceMap* sources) {
+  instrument::ScopedPhase phase(instrument::kCheck);
+  Errors outside;
+  std::vector<FunctionTask> functions;
+  CheckingWalker(outside, sources, &functions).Walk(root);
+  std::vector<std::function<void()>> tasks;
+  for (FunctionTask& f : functions) {
+    tasks.push_back([&f, sources] {
+      CheckingWalker(f.errors, sources).Walk(*f.function);
+    });
+  }
+  RunWorkStealing(tasks, threads);
+
+  // Merge errors in source order.
   Errors errors;
-  CheckBelow(root, errors, kCheckerBuilders);
+  auto next = outside.begin();
+  for (FunctionTask& f : functions) {
+    auto end = outside.begin() + f.errors_before;
+    errors.insert(errors.end(), next, end);
+    next = end;
+    std::move(f.errors.begin(), f.errors.end(), std::back_inserter(errors));
+  }
+  errors.insert(errors.end(), next, outside.end());
   return errors;
 }
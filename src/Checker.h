@@ -1,5 +1,6 @@
 #pragma once
 #include "Expression.h"
+#include "SourceMap.h"
 #include <string>
 #include <vector>
 // Checks Tiger program constraints statically. Specifically:
@@ -42,4 +43,11 @@
 // - (3.3) [Common sense indicates that values of a called function
 //   should have compatible types]
 
-std::vector<std::string> ListErrors(const Expression& e);
+// Returns errors in the tree with the given root, in source order. Bodies
+// of the outermost functions are checked as independent tasks on up to the
+// given number of threads. Given the SourceMap of the tree, each error
+// starts with the position of the offending expression, as in
+// `file:line.column: message`. Undefined behavior until SetTypesBelow has
+// been called.
+std::vector<std::string> ListErrors(const Expression& e, int threads = 1,
+                                    const SourceMap* sources = nullptr);
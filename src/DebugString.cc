@@ -1,21 +1,15 @@
 #include "DebugString.h"
 #include "BinaryOp.h"
 #include "ToString.h"
-#include <functional>
+#include "TreeWalker.h"
 #include <initializer_list>
-#include <sstream>
+#include <string_view>
 #include <utility>
 
 namespace {
 using KVPair = std::pair<std::string, std::string>;
 using KVPairs = std::vector<KVPair>;
 
-struct ExprVisitorPair {
-  const std::string_view key;
-  const Expression& expr;
-  ExpressionVisitor& visitor;
-};
-
 struct Appendable {
   Appendable& operator<<(const std::string_view s) {
     out += s;
@@ -37,14 +31,6 @@ struct Appendable {
   Appendable& operator<<(const KVPair& p) {
     return *this << p.first << ": " << p.second;
   }
-  Appendable& operator<<(ExprVisitorPair&& p) {
-    *this << p.key << ": ";
-    p.expr.Accept(p.visitor);
-    return *this;
-  }
-  Appendable& operator<<(const std::function<Appendable&(Appendable&)>& f) {
-    return f(*this);
-  }
   // So that returning an Appendable is like "return true" in a Visit* function.
   operator bool() { return true; }
   std::string& out;
@@ -75,147 +61,152 @@ private:
   std::string& out_;
 };
 
-class AppendLValueVisitor : public LValueVisitor {
+// Appends debug strings of expressions without recursion, like the Printer
+// of ToString.cc: the walker drives the traversal, and the visit methods
+// append the part of one node that step_ selects.
+class DebugPrinter : public TreeWalker, ExpressionVisitor, LValueVisitor {
 public:
-  AppendLValueVisitor(std::string& out, ExpressionVisitor& expression_visitor)
-      : out_(out), expression_visitor_(expression_visitor) {}
+  DebugPrinter(std::string& out) : out_(out) {}
 
-  bool VisitId(const std::string& id) override {
-    return emit(out_) << "Id{" << KVPair{"id", id} << "}";
-  }
-  bool VisitField(const LValue& value, const std::string& id) override {
-    out_ += "Field{l_value: ";
-    value.Accept(*this);
-    return emit(out_) << " " << KVPair{" id", id} << "}";
-  }
-  bool VisitIndex(const LValue& value, const Expression& expr) override {
-    out_ += "Index{l_value: ";
-    value.Accept(*this);
-    return emit(out_) << ExprVisitorPair{" expr", expr, expression_visitor_}
-                      << "}";
+protected:
+  bool Enter(TreeNode& node) override { return Print(node, kBefore); }
+  bool EnterChild(TreeNode& node, size_t index) override {
+    return Print(node, kBeforeChild, index);
   }
+  void Leave(TreeNode& node) override { Print(node, kAfter); }
 
 private:
-  std::string& out_;
-  ExpressionVisitor& expression_visitor_;
-};
+  enum Step { kBefore, kBeforeChild, kAfter };
 
-template <class T>
-std::function<Appendable&(Appendable&)>
-ArrayString(const std::vector<std::shared_ptr<T>>& v) {
-  return [&v](Appendable& a) -> Appendable& {
-    const char* sep = "";
-    a << "[";
-    for (const auto& i : v) {
-      a << sep << ToString(*i);
-      sep = "\n";
+  bool Print(TreeNode& node, Step step, size_t index = 0) {
+    step_ = step;
+    index_ = index;
+    if (auto e = node.expression(); e) {
+      return (*e)->Accept(static_cast<ExpressionVisitor&>(*this));
     }
-    return a << "]";
-  };
-}
+    return true;
+  }
+  bool Before() const { return step_ == kBefore; }
+  bool BeforeChild(size_t index) const {
+    return step_ == kBeforeChild && index_ == index;
+  }
+  bool After() const { return step_ == kAfter; }
+
+  // Appends text before and after the children, and optionally a key
+  // before every child, separated by spaces.
+  bool Join(std::string_view open, std::string_view close,
+            std::string_view key = "") {
+    if (Before()) out_ += open;
+    if (step_ == kBeforeChild && !key.empty()) {
+      (out_ += index_ > 0 ? " " : "") += key;
+    }
+    if (After()) out_ += close;
+    return true;
+  }
 
-class AppendExpressionVisitor : public ExpressionVisitor {
-public:
-  AppendExpressionVisitor(std::string& out) : out_(out) {}
   bool VisitStringConstant(const std::string& text) override {
-    return emit(out_) << "String{" << text << "}";
+    return Join("String{" + text + "}", "");
   }
   bool VisitIntegerConstant(int value) override {
-    std::ostringstream value_string;
-    value_string << value;
-    return emit(out_) << "Int{" << value_string.str() << "}";
+    return Join("Int{" + std::to_string(value) + "}", "");
   }
-  bool VisitNil() override { return emit(out_) << "Nil"; }
+  bool VisitNil() override { return Join("Nil", ""); }
   bool VisitLValue(const LValue& value) override {
-    AppendLValueVisitor l_value_visitor(out_, *this);
-    value.Accept(l_value_visitor);
-    return true;
+    return value.Accept(static_cast<LValueVisitor&>(*this));
   }
   bool VisitNegated(const Expression& value) override {
-    return emit(out_) << "Negated{" << ExprVisitorPair{"value", value, *this}
-                      << "}";
+    return Join("Negated{value: ", "}");
   }
   bool VisitBinary(const Expression& left, BinaryOp op,
                    const Expression& right) override {
-    return emit(out_) << "Binary{" << ExprVisitorPair{"left", left, *this}
-                      << KVPair{" op", ToString(op)}
-                      << ExprVisitorPair{" right", right, *this} << "}";
+    Join("Binary{left: ", "}");
+    if (BeforeChild(1)) out_ += " op: " + ToString(op) + " right: ";
+    return true;
   }
   bool VisitAssignment(const LValue& value, const Expression& expr) override {
-    out_ += "Assign{l_value: ";
-    AppendLValueVisitor l_value_visitor(out_, *this);
-    value.Accept(l_value_visitor);
-    return emit(out_) << ExprVisitorPair{" expr", expr, *this} << "}";
+    Join("Assign{l_value: ", "}");
+    if (BeforeChild(1)) out_ += " expr: ";
+    return true;
   }
   bool VisitFunctionCall(const std::string& id,
                          const std::vector<std::shared_ptr<Expression>>& args,
                          const Expression& exp) override {
-    return emit(out_) << "FunctionCall{" << KVPair{"id", id} << " "
-                      << Join("arg", args) << "}";
+    return Join("FunctionCall{id: " + id + " ", "}", "arg: ");
   }
   bool
   VisitBlock(const std::vector<std::shared_ptr<Expression>>& exprs) override {
-    return emit(out_) << "Block{" << Join("expr", exprs) << "}";
+    return Join("Block{", "}", "expr: ");
   }
   bool VisitRecord(const std::string& type_id,
                    const std::vector<FieldValue>& field_values,
                    const Expression& exp) override {
-    emit(out_) << "Record{";
-    const char* sep = "";
-    for (const auto& f : field_values) {
-      emit(out_) << sep << ExprVisitorPair{f.id, *f.expr, *this};
-      sep = " ";
+    Join("Record{", "}");
+    if (step_ == kBeforeChild) {
+      (out_ += index_ > 0 ? " " : "") += field_values[index_].id + ": ";
     }
-    return emit(out_) << "}";
+    return true;
   }
   bool VisitArray(const std::string& type_id, const Expression& size,
                   const Expression& value) override {
-    return emit(out_) << "Array{" << KVPair{"type_id", type_id}
-                      << ExprVisitorPair{" size", size, *this}
-                      << ExprVisitorPair{" value", value, *this} << "}";
+    Join("Array{type_id: " + type_id, "}");
+    if (BeforeChild(0)) out_ += " size: ";
+    if (BeforeChild(1)) out_ += " value: ";
+    return true;
   }
   bool VisitIfThen(const Expression& condition,
                    const Expression& expr) override {
-    return emit(out_) << "IfThen{"
-                      << ExprVisitorPair{"condition", condition, *this}
-                      << ExprVisitorPair{" expr", expr, *this} << "}";
+    Join("IfThen{condition: ", "}");
+    if (BeforeChild(1)) out_ += " expr: ";
+    return true;
   }
   bool VisitIfThenElse(const Expression& condition, const Expression& then_expr,
                        const Expression& else_expr) override {
-    return emit(out_) << "IfThen{"
-                      << ExprVisitorPair{"condition", condition, *this}
-                      << ExprVisitorPair{" then_expr", then_expr, *this}
-                      << ExprVisitorPair{" else_expr", else_expr, *this} << "}";
+    Join("IfThen{condition: ", "}");
+    if (BeforeChild(1)) out_ += " then_expr: ";
+    if (BeforeChild(2)) out_ += " else_expr: ";
+    return true;
   }
   bool VisitWhile(const Expression& condition,
                   const Expression& body) override {
-    return condition.Accept(*this) && body.Accept(*this);
+    return true;
   }
   bool VisitFor(const std::string& id, const Expression& first,
                 const Expression& last, const Expression& body) override {
-    return first.Accept(*this) && last.Accept(*this) && body.Accept(*this);
+    return true;
   }
   bool VisitBreak() override { return true; }
+  // Declarations appear in Tiger syntax, and are not walked.
   bool VisitLet(const std::vector<std::shared_ptr<Declaration>>& declarations,
                 const std::vector<std::shared_ptr<Expression>>& body) override {
-    return emit(out_) << "Let{declarations: " << ArrayString(declarations)
-                      << Join(" expr", body) << "}";
-  }
-  std::function<Appendable&(Appendable&)>
-  Join(const char* key, const std::vector<std::shared_ptr<Expression>>& v) {
-    return [key, &v, this](Appendable& out) -> Appendable& {
-      const char* sep = "";
-      for (const auto& e : v) {
-        out << sep;
-        out << ExprVisitorPair{key, *e, *this};
-        sep = " ";
-      }
-      return out;
-    };
+    if (Before()) out_ += "Let{declarations: [";
+    if (step_ == kBeforeChild && index_ < declarations.size()) {
+      if (index_ > 0) out_ += "\n";
+      out_ += ToString(*declarations[index_]);
+      return false;
+    }
+    if (step_ == kBeforeChild) {
+      out_ += index_ == declarations.size() ? "]" : " ";
+      out_ += " expr: ";
+    }
+    if (After()) out_ += body.empty() ? "]}" : "}";
+    return true;
+  }
+
+  bool VisitId(const std::string& id) override {
+    return Join("Id{id: " + id + "}", "");
+  }
+  bool VisitField(const LValue& value, const std::string& id) override {
+    return Join("Field{l_value: ", "  id: " + id + "}");
+  }
+  bool VisitIndex(const LValue& value, const Expression& expr) override {
+    Join("Index{l_value: ", "}");
+    if (BeforeChild(1)) out_ += " expr: ";
+    return true;
   }
 
-private:
   std::string& out_;
+  Step step_ = kBefore;
+  size_t index_ = 0;
 };
 } // namespace
 
@@ -232,8 +223,7 @@ std::string& AppendDebugString(std::string& out, const Type& t) {
 }
 
 std::string& AppendDebugString(std::string& out, const Expression& e) {
-  AppendExpressionVisitor visitor(out);
-  e.Accept(visitor);
+  DebugPrinter(out).Walk(e);
   return out;
 }
 std::string& AppendDebugString(std::string& out, const Declaration& d) {
@@ -1,30 +1,53 @@
+#include "BuiltIns.h"
 #include "DebugString.h"
-#include "StoppingExpressionVisitor.h"
+#include "Instrument.h"
+#include "StaticExpressionVisitor.h"
 #include "ToString.h"
+#include "TreeWalker.h"
+#include "WorkStealing.h"
 #include "syntax_nodes.h"
+#include <functional>
 #include <iostream>
+#include <iterator>
+#include <memory>
 
 namespace {
 
-NameSpace kBuiltInTypes;
-Declaration* kTypeDecls[2] = {new TypeDeclaration("int", new IntType()),
-                              new TypeDeclaration("string", new StringType())};
-
-NameSpace kBuiltInFunctions;
-void AddDecl(const FunctionDeclaration* f) { kBuiltInFunctions[f->Id()] = f; }
+// Declarations of the built-in types and functions of BuiltIns.h, made on
+// first use and shared read-only by all compilations.
+struct BuiltInDeclarations {
+  BuiltInDeclarations() {
+    for (const Declaration* d : {&int_type, &string_type}) {
+      types[d->Id()] = d;
+    }
+    functions.reserve(std::size(kBuiltInFunctions));
+    for (const BuiltInFunction& f : kBuiltInFunctions) {
+      std::vector<TypeField> params;
+      for (int i = 0; i < f.param_count; ++i) {
+        params.push_back({std::string(f.params[i].id),
+                          std::string(f.params[i].type_id)});
+      }
+      functions.push_back(
+          f.result_type.empty()
+              ? std::make_unique<FunctionDeclaration>(
+                    f.name, std::move(params), new Block({}))
+              : std::make_unique<FunctionDeclaration>(
+                    f.name, std::move(params), f.result_type,
+                    new Block({})));
+      function_names[std::string(f.name)] = functions.back().get();
+    }
+  }
 
-class BuiltInBody : public Expression {
-public:
-  bool Accept(ExpressionVisitor&) const override { return true; }
+  TypeDeclaration int_type{kBuiltInTypes[0], new IntType()};
+  TypeDeclaration string_type{kBuiltInTypes[1], new StringType()};
+  std::vector<std::unique_ptr<FunctionDeclaration>> functions;
+  NameSpace types;
+  NameSpace function_names;
 };
 
-void AddProc(std::string_view id, std::vector<TypeField> params) {
-  AddDecl(new FunctionDeclaration(id, std::move(params), new BuiltInBody()));
-}
-void AddFun(std::string_view id, std::vector<TypeField> params,
-            std::string_view type_id) {
-  AddDecl(new FunctionDeclaration(id, std::move(params), type_id,
-                                  new BuiltInBody()));
+const BuiltInDeclarations& BuiltIns() {
+  static const BuiltInDeclarations built_ins;
+  return built_ins;
 }
 
 // Type of expressions that lack a value, e.g. the `break` expression.
@@ -50,20 +73,7 @@ bool IsRecordType(const Type& type) {
   return classifier.is_record_type;
 }
 
-struct NilTypeClassifier : public StoppingExpressionVisitor {
-public:
-  virtual bool VisitNil() {
-    is_nil = true;
-    return false;
-  }
-  bool is_nil = false;
-};
-
-bool IsNil(const Expression& e) {
-  NilTypeClassifier classifier;
-  e.Accept(classifier);
-  return classifier.is_nil;
-}
+bool IsNil(const Expression& e) { return e.kind() == Expression::Kind::kNil; }
 
 } // namespace
 
@@ -72,81 +82,94 @@ bool IsNil(const Expression& e) {
 // Sets type_ for all Expression nodes with values, except for
 // Nil. Assumes that types of all child expression have already been
 // set.  Refrains from type checking.
-struct TypeSetter : public ExpressionVisitor, LValueVisitor {
+struct TypeSetter : public StaticExpressionVisitor<TypeSetter> {
   TypeSetter(const Expression& expr) : expr_(expr) {}
-  bool VisitStringConstant(const std::string& text) override {
-    return SetType(kTypeDecls[1]->Id());
+  bool VisitStringConstant(const std::string& text) {
+    return SetType(BuiltIns().string_type.Id());
   }
-  bool VisitIntegerConstant(int value) override {
-    return SetType(kTypeDecls[0]->Id());
+  bool VisitIntegerConstant(int value) {
+    return SetType(BuiltIns().int_type.Id());
   }
   // Nil requires a more complex traversal
-  bool VisitNil() override { return false; }
-  bool VisitLValue(const LValue& value) override {
-    value.Accept(*(LValueVisitor*)this);
-    return false;
-  }
-  bool VisitNegated(const Expression& value) override {
+  bool VisitNil() { return false; }
+  bool VisitNegated(const Expression& value) {
     return SetType(value.GetType());
   }
   bool VisitBinary(const Expression& left, BinaryOp op,
-                   const Expression& right) override {
+                   const Expression& right) {
+    // Comparisons of operands of one type, or with nil, e.g. of records,
+    // produce integers
+    if (op >= kEqual && op <= kNotLessThan &&
+        (left.GetType() == right.GetType() || IsNil(left) || IsNil(right))) {
+      return SetType(BuiltIns().int_type.Id());
+    }
     return SetType(right.GetType());
   }
-  bool VisitAssignment(const LValue& value, const Expression& expr) override {
+  bool VisitAssignment(const LValue& value, const Expression& expr) {
     // Type nil right hand side, if left hand side is record with known type
     if (auto r = RecordType(value); r && IsNil(expr)) expr.type_ = *r;
     return SetType(kNoneType);
   }
   bool VisitFunctionCall(const std::string& id,
                          const std::vector<std::shared_ptr<Expression>>& args,
-                         const Expression& exp) override {
-    if (auto d = expr_.non_types_->Lookup(id); d) {
-      if (auto vt = (*d)->GetValueType(); vt) return SetType(**vt);
+                         const Expression& exp) {
+    if (auto d = expr_.binding_.declaration; d) {
+      if (auto vt = d->GetValueType(); vt) return SetType(**vt);
     }
     return SetType(kUnknownType);
   }
-  bool
-  VisitBlock(const std::vector<std::shared_ptr<Expression>>& exprs) override {
+  bool VisitBlock(const std::vector<std::shared_ptr<Expression>>& exprs) {
     return SetType(exprs.empty() ? kNoneType : (*exprs.rbegin())->GetType());
   }
   bool VisitRecord(const std::string& type_id,
                    const std::vector<FieldValue>& field_values,
-                   const Expression& exp) override {
+                   const Expression& exp) {
+    // Type nil field values, if their fields are records of known type
+    if (auto d = exp.binding_.declaration; d && d->GetType()) {
+      if (auto r = (*d->GetType())->recordType(); r) {
+        const std::vector<TypeField>& fields = (*r)->Fields();
+        for (size_t i = 0; i < field_values.size() && i < fields.size(); ++i) {
+          const Expression& value = *field_values[i].expr;
+          if (!IsNil(value)) continue;
+          if (auto t = value.types_->Lookup(fields[i].type_id);
+              t && (*t)->GetType() && IsRecordType(**(*t)->GetType())) {
+            value.type_ = &fields[i].type_id;
+          }
+        }
+      }
+    }
     return SetType(type_id);
   }
   bool VisitArray(const std::string& type_id, const Expression& size,
-                  const Expression& value) override {
+                  const Expression& value) {
     return SetType(type_id);
   }
-  bool VisitIfThen(const Expression& condition,
-                   const Expression& expr) override {
+  bool VisitIfThen(const Expression& condition, const Expression& expr) {
     return SetType(kNoneType);
   }
   bool VisitIfThenElse(const Expression& condition, const Expression& then_expr,
-                       const Expression& else_expr) override {
+                       const Expression& else_expr) {
     return SetType(then_expr.GetType());
   }
-  bool VisitWhile(const Expression& condition,
-                  const Expression& body) override {
+  bool VisitWhile(const Expression& condition, const Expression& body) {
     return SetType(kNoneType);
   }
   bool VisitFor(const std::string& id, const Expression& first,
-                const Expression& last, const Expression& body) override {
+                const Expression& last, const Expression& body) {
     return SetType(kNoneType);
   }
-  bool VisitBreak() override { return SetType(kNoneType); }
+  bool VisitBreak() { return SetType(kNoneType); }
   bool VisitLet(const std::vector<std::shared_ptr<Declaration>>& declarations,
-                const std::vector<std::shared_ptr<Expression>>& body) override {
+                const std::vector<std::shared_ptr<Expression>>& body) {
     return SetType(body.empty() ? kNoneType : (*body.rbegin())->GetType());
   }
-  bool VisitId(const std::string& id) override {
-    if (auto found = expr_.non_types_->Lookup(id); found) {
-      return SetType(**(*found)->GetValueType());
+  bool VisitId(const std::string& id) {
+    if (auto d = expr_.binding_.declaration; d) {
+      if (auto vt = d->GetValueType(); vt) return SetType(**vt);
     }
     return SetType(kUnknownType);
   }
-  bool VisitField(const LValue& value, const std::string& id) override {
+  bool VisitField(const LValue& value, const std::string& id) {
     if (auto d = expr_.types_->Lookup(value.GetType()); d) {
       if (auto type = (*d)->GetType(); type) {
         if (auto field_type = (*type)->GetFieldType(id); field_type) {
@@ -156,7 +179,7 @@ struct TypeSetter : public ExpressionVisitor, LValueVisitor {
     }
     return SetType(kUnknownType);
   }
-  bool VisitIndex(const LValue& value, const Expression& expr) override {
+  bool VisitIndex(const LValue& value, const Expression& expr) {
     if (auto d = expr_.types_->Lookup(value.GetType()); d) {
       if (auto type = (*d)->GetType(); type) {
         if (auto element_type = (*type)->GetElementType(); element_type) {
@@ -184,28 +207,135 @@ struct TypeSetter : public ExpressionVisitor, LValueVisitor {
   const Expression& expr_;
 };
 
+// Sets the name spaces of every expression to those of its parent, as
+// extended by Let expressions and function declarations on the path.
+class NameSpaceSetter : public TreeWalker {
+public:
+  NameSpaceSetter(const NameSpace* types, const NameSpace* non_types)
+      : types_({types}), non_types_({non_types}) {}
+
+protected:
+  bool Enter(TreeNode& node) override {
+    const NameSpace* types = types_.back();
+    const NameSpace* non_types = non_types_.back();
+    if (auto e = node.expression(); e) {
+      (*e)->types_ = types;
+      (*e)->non_types_ = non_types;
+    }
+    auto n = node.GetTypeNameSpace(*types);
+    types_.push_back(n ? *n : types);
+    auto m = node.GetNonTypeNameSpace(*non_types);
+    non_types_.push_back(m ? *m : non_types);
+    return true;
+  }
+  void Leave(TreeNode& node) override {
+    types_.pop_back();
+    non_types_.pop_back();
+  }
+
+private:
+  // Name spaces for the children of the nodes on the path.
+  std::vector<const NameSpace*> types_;
+  std::vector<const NameSpace*> non_types_;
+};
+
+namespace {
+class Resolver : public TreeWalker {
+public:
+  Resolver(Scopes& scopes) : scopes_(scopes) {}
+
+protected:
+  bool Enter(TreeNode& node) override {
+    node.ResolveEnter(scopes_);
+    return true;
+  }
+  bool EnterChild(TreeNode& node, size_t index) override {
+    node.ResolveChild(scopes_, index);
+    return true;
+  }
+  void Leave(TreeNode& node) override { node.ResolveLeave(scopes_); }
+
+private:
+  Scopes& scopes_;
+};
+
+struct ResultTypeClassifier : public DeclarationVisitor {
+  bool VisitFunctionDeclaration(const std::string& id,
+                                const std::vector<TypeField>& params,
+                                const std::optional<std::string> type_id,
+                                const Expression& body) override {
+    has_result_type = type_id.has_value();
+    return true;
+  }
+
+  bool has_result_type = false;
+};
+
+// Returns true for functions with a declared result type. Nothing outside
+// their bodies depends on types set inside, as calls have the declared
+// type.
+bool IsTypedFunction(TreeNode& node) {
+  auto d = node.declaration();
+  if (!d) return false;
+  ResultTypeClassifier classifier;
+  (*d)->Accept(classifier);
+  return classifier.has_result_type;
+}
+
+// Sets types bottom up, as TypeSetter expects. Given a vector for them,
+// skips and collects the outermost typed functions.
+class TypeSetterWalker : public TreeWalker {
+public:
+  TypeSetterWalker(std::vector<TreeNode*>* functions = nullptr)
+      : functions_(functions) {}
+
+protected:
+  bool Enter(TreeNode& node) override {
+    if (functions_ && IsTypedFunction(node)) {
+      functions_->push_back(&node);
+      return false;
+    }
+    return true;
+  }
+  void Leave(TreeNode& node) override {
+    if (auto e = node.expression(); e) {
+      TypeSetter(**e).Visit(**e);
+    }
+  }
+
+private:
+  std::vector<TreeNode*>* functions_;
+};
+} // namespace
+
 void Expression::SetNameSpacesBelow(Expression& root) {
-  for (auto* d : kTypeDecls) kBuiltInTypes[d->Id()] = d;
-  AddProc("print", {{"s", "string"}});
-  AddProc("printi", {{"i", "int"}});
-  AddProc("flush", {});
-  AddFun("getchar", {}, "string");
-  AddFun("ord", {{"s", "string"}}, "int");
-  AddFun("chr", {{"i", "int"}}, "string");
-  AddFun("size", {{"s", "string"}}, "int");
-  AddFun("substring", {{"s", "string"}, {"f", "int"}, {"n", "int"}}, "string");
-  AddFun("concat", {{"s1", "string"}, {"s2", "string"}}, "string");
-  AddFun("not", {{"i", "int"}}, "int");
-  AddProc("exit", {{"i", "int"}});
-  root.SetNameSpacesBelow(&kBuiltInTypes, &kBuiltInFunctions);
+  instrument::ScopedPhase phase(instrument::kBind);
+  const BuiltInDeclarations& built_ins = BuiltIns();
+  NameSpaceSetter(&built_ins.types, &built_ins.function_names).Walk(root);
+  Scopes scopes;
+  built_ins.int_type.Bind(scopes);
+  built_ins.string_type.Bind(scopes);
+  for (const auto& f : built_ins.functions) f->Bind(scopes);
+  scopes.EnterScope();
+  Resolver(scopes).Walk(root);
 }
 
-void Expression::SetTypesBelow(TreeNode& root) {
-  for (auto c : root.Children()) SetTypesBelow(*c);
-  if (auto e = root.expression(); e) {
-    TypeSetter setter(**e);
-    (*e)->Accept(setter);
+void Expression::SetTypesBelow(TreeNode& root, int threads) {
+  instrument::ScopedPhase phase(instrument::kType);
+  std::vector<TreeNode*> functions;
+  TypeSetterWalker(&functions).Walk(root);
+  std::vector<std::function<void()>> tasks;
+  for (TreeNode* f : functions) {
+    tasks.push_back([f] { TypeSetterWalker().Walk(*f); });
   }
+  RunWorkStealing(tasks, threads);
+}
+
+const Declaration* Expression::BuiltInDeclaration(const std::string& id,
+                                                  bool is_type) {
+  const BuiltInDeclarations& built_ins = BuiltIns();
+  auto d = (is_type ? built_ins.types : built_ins.function_names).Lookup(id);
+  return d ? *d : nullptr;
 }
 
-Expression::Expression() : type_(&kUnsetType) {}
+Expression::Expression(Kind kind) : kind_(kind), type_(&kUnsetType) {}
@@ -1,10 +1,12 @@
 #pragma once
 #include "BinaryOp.h"
+#include "Binding.h"
 #include "DeclarationVisitor.h"
 #include "NameSpace.h"
 #include "TreeNode.h"
 #include "TypeVisitor.h"
 #include <algorithm>
+#include <cstdint>
 #include <memory>
 #include <optional>
 #include <string>
@@ -62,22 +64,54 @@ public:
   // Returns type of bound variable, parameter, or function return value.
   virtual std::optional<const std::string*> GetValueType() const { return {}; }
 
+  // Binds this declaration in the current scope.
+  virtual void Bind(Scopes& scopes) const {}
+
 private:
   std::string id_;
 };
 
 // Forward declaration of visitor to navigate abstract syntax tree Expression.
 class ExpressionVisitor;
+namespace ast_cache {
+class Loader;
+}
 
 // Base class for Expression nodes.
 class Expression : public TreeNode {
 public:
-  Expression();
+  // Concrete class of a node, for passes that dispatch without virtual
+  // calls, see StaticExpressionVisitor.h.
+  enum class Kind : uint8_t {
+    kStringConstant,
+    kIntegerConstant,
+    kNil,
+    kIdLValue,
+    kFieldLValue,
+    kIndexLValue,
+    kNegated,
+    kBinary,
+    kAssignment,
+    kFunctionCall,
+    kBlock,
+    kRecord,
+    kArray,
+    kIfThen,
+    kIfThenElse,
+    kWhile,
+    kFor,
+    kBreak,
+    kLet,
+  };
+
+  explicit Expression(Kind kind);
   virtual ~Expression() = default;
   std::optional<Expression*> expression() override { return this; }
 
   virtual bool Accept(ExpressionVisitor& visitor) const = 0;
 
+  Kind kind() const { return kind_; }
+
   // Returns type of this expression. Undefined behavior until SetTypesBelow has
   // been called on the root.
   const std::string& GetType() const { return *type_; }
@@ -91,26 +125,39 @@ public:
   // called on the tree.
   const NameSpace& GetNonTypeNameSpace() const { return *non_types_; }
 
+  // Returns declaration of the variable, function, or type this expression
+  // uses, if it is an IdLValue, FunctionCall, Record, or Array. Undefined
+  // behavior until SetNameSpacesBelow has been called on the tree.
+  const Binding& GetBinding() const { return binding_; }
+
   // Sets type and non_types name spaces for every expression in the tree with
-  // the given root.
+  // the given root, and binds every use of a name to its declaration.
   static void SetNameSpacesBelow(Expression& root);
 
   // Sets types in every expression in the tree with the given
   // root. Undefined behavior until SetNameSpacesBelow has been
-  // called.
-  static void SetTypesBelow(TreeNode& root);
+  // called. Bodies of the outermost functions with declared result types
+  // are typed last, as independent tasks on up to the given number of
+  // threads. SetNameSpacesBelow has created all name spaces, so that
+  // the tree is read only except for the types set here.
+  static void SetTypesBelow(TreeNode& root, int threads = 1);
+
+  // Returns the declaration of the built-in type, if is_type, or function
+  // with the given ID, to which SetNameSpacesBelow binds uses that no
+  // declaration in the tree shadows, or nullptr.
+  static const Declaration* BuiltInDeclaration(const std::string& id,
+                                               bool is_type);
 
 protected:
-  void SetNameSpacesBelow(const NameSpace* types,
-                          const NameSpace* non_types) override {
-    types_ = types;
-    non_types_ = non_types;
-    TreeNode::SetNameSpacesBelow(types, non_types);
-  }
+  // First, so that it fills the padding after TreeNode.
+  Kind kind_;
   const NameSpace* types_ = nullptr;
   const NameSpace* non_types_ = nullptr;
+  mutable Binding binding_;
 
+  friend class NameSpaceSetter;
   friend class TypeSetter;
+  friend class ast_cache::Loader;
   mutable const std::string* type_ = nullptr;
 };
 
@@ -125,6 +172,7 @@ class LValue;
 // successfully visiting all child Expressions.
 class ExpressionVisitor {
 public:
+  virtual ~ExpressionVisitor() = default;
   virtual bool VisitStringConstant(const std::string& text) { return true; }
   virtual bool VisitIntegerConstant(int value) { return true; }
   virtual bool VisitNil() { return true; }
@@ -190,6 +238,7 @@ class LValueVisitor;
 
 class LValue : public Expression {
 public:
+  using Expression::Expression;
   bool Accept(ExpressionVisitor& visitor) const override {
     return visitor.VisitLValue(*this);
   }
@@ -206,6 +255,7 @@ public:
 
 class LValueVisitor {
 public:
+  virtual ~LValueVisitor() = default;
   virtual bool VisitId(const std::string& id) { return true; }
   virtual bool VisitField(const LValue& value, const std::string& id) {
     return value.Accept(*this);
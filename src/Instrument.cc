@@ -0,0 +1,166 @@
+#include "Instrument.h"
+
+#ifdef TC_TIME_PASSES
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace instrument {
+namespace {
+using Clock = std::chrono::steady_clock;
+
+std::atomic<bool> recording{false};
+std::atomic<uint64_t> allocation_count{0};
+std::atomic<uint64_t> allocated_bytes{0};
+
+const char* kPhaseNames[kPhaseCount] = {"parse", "bind",    "type",
+                                        "check", "compile", "emit"};
+
+struct Totals {
+  uint64_t nanos = 0;
+  uint64_t allocations = 0;
+  uint64_t bytes = 0;
+  Totals& operator+=(const Totals& other) {
+    nanos += other.nanos;
+    allocations += other.allocations;
+    bytes += other.bytes;
+    return *this;
+  }
+  Totals& operator-=(const Totals& other) {
+    nanos -= other.nanos;
+    allocations -= other.allocations;
+    bytes -= other.bytes;
+    return *this;
+  }
+};
+
+Totals Now() {
+  return {static_cast<uint64_t>(std::chrono::duration_cast<
+                                    std::chrono::nanoseconds>(
+                                    Clock::now().time_since_epoch())
+                                    .count()),
+          allocation_count.load(std::memory_order_relaxed),
+          allocated_bytes.load(std::memory_order_relaxed)};
+}
+
+// Running phases, innermost last. Fixed size so that timing itself does not
+// allocate.
+struct Frame {
+  Phase phase;
+  Totals start;
+  Totals nested; // inclusive totals of finished nested phases
+};
+constexpr int kMaxDepth = 16;
+Frame frames[kMaxDepth];
+int depth = 0;
+
+Totals phase_totals[kPhaseCount];
+uint64_t phase_runs[kPhaseCount];
+std::vector<std::pair<std::string, size_t>> counts;
+
+} // namespace
+
+void Enable() { recording = true; }
+
+void Reset() {
+  recording = false;
+  depth = 0;
+  for (int p = 0; p < kPhaseCount; ++p) {
+    phase_totals[p] = {};
+    phase_runs[p] = 0;
+  }
+  counts.clear();
+}
+
+bool IsEnabled() { return recording; }
+
+ScopedPhase::ScopedPhase(Phase phase)
+    : active_(recording && depth < kMaxDepth) {
+  if (active_) frames[depth++] = {phase, Now(), {}};
+}
+
+ScopedPhase::~ScopedPhase() {
+  if (!active_ || depth == 0) return;
+  Frame& frame = frames[--depth];
+  Totals inclusive = Now();
+  inclusive -= frame.start;
+  Totals exclusive = inclusive;
+  exclusive -= frame.nested;
+  phase_totals[frame.phase] += exclusive;
+  ++phase_runs[frame.phase];
+  if (depth > 0) frames[depth - 1].nested += inclusive;
+}
+
+void SetCount(std::string_view name, size_t value) {
+  if (!recording) return;
+  for (auto& c : counts) {
+    if (c.first == name) {
+      c.second = value;
+      return;
+    }
+  }
+  counts.emplace_back(name, value);
+}
+
+void Report(std::ostream& os, Format format) {
+  Totals total;
+  for (const auto& t : phase_totals) total += t;
+  if (format == Format::kJson) {
+    os << "{\"phases\": [";
+    const char* sep = "";
+    for (int p = 0; p < kPhaseCount; ++p) {
+      const Totals& t = phase_totals[p];
+      os << sep << "{\"name\": \"" << kPhaseNames[p]
+         << "\", \"runs\": " << phase_runs[p] << ", \"ns\": " << t.nanos
+         << ", \"allocations\": " << t.allocations
+         << ", \"bytes\": " << t.bytes << "}";
+      sep = ", ";
+    }
+    os << "], \"counts\": {";
+    sep = "";
+    for (const auto& [name, value] : counts) {
+      os << sep << "\"" << name << "\": " << value;
+      sep = ", ";
+    }
+    return void(os << "}}\n");
+  }
+  auto row = [&os](std::string_view name, const Totals& t) {
+    os << std::left << std::setw(10) << name << std::right << std::fixed
+       << std::setprecision(3) << std::setw(12) << t.nanos / 1e6
+       << std::setw(12) << t.allocations << std::setw(14) << t.bytes << "\n";
+  };
+  os << std::left << std::setw(10) << "phase" << std::right << std::setw(12)
+     << "time (ms)" << std::setw(12) << "allocs" << std::setw(14) << "bytes"
+     << "\n";
+  for (int p = 0; p < kPhaseCount; ++p) row(kPhaseNames[p], phase_totals[p]);
+  row("total", total);
+  for (const auto& [name, value] : counts) {
+    os << name << ": " << value << "\n";
+  }
+}
+
+} // namespace instrument
+
+// Replacement global allocator. Only counts while recording; array and
+// sized forms forward here by default.
+void* operator new(std::size_t size) {
+  if (instrument::recording.load(std::memory_order_relaxed)) {
+    instrument::allocation_count.fetch_add(1, std::memory_order_relaxed);
+    instrument::allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  }
+  if (void* p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+#endif // TC_TIME_PASSES
@@ -0,0 +1,63 @@
+#pragma once
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <cstddef>
+#include <ostream>
+#include <string_view>
+
+// Per-phase instrumentation for `tc --time-passes`. Phases are timed with
+// ScopedPhase objects. While recording, a replacement global operator new
+// counts heap allocations and bytes, which are charged to the innermost
+// running phase. Time and allocations of nested phases are excluded from
+// their parent. Configure with --disable-time-passes to compile everything
+// here down to empty inline functions.
+namespace instrument {
+
+enum Phase { kParse, kBind, kType, kCheck, kCompile, kEmit, kPhaseCount };
+
+enum class Format { kTable, kJson };
+
+#ifdef TC_TIME_PASSES
+
+// Starts recording phases, allocations and counts.
+void Enable();
+
+// Stops recording and drops everything recorded so far.
+void Reset();
+
+bool IsEnabled();
+
+// Records time and allocations from construction to destruction for the given
+// phase, if recording is enabled.
+class ScopedPhase {
+public:
+  explicit ScopedPhase(Phase phase);
+  ~ScopedPhase();
+  ScopedPhase(const ScopedPhase&) = delete;
+  ScopedPhase& operator=(const ScopedPhase&) = delete;
+
+private:
+  bool active_;
+};
+
+// Records a named size, e.g. the number of AST nodes.
+void SetCount(std::string_view name, size_t value);
+
+// Writes recorded phases and counts to the given stream.
+void Report(std::ostream& os, Format format);
+
+#else
+
+inline void Enable() {}
+inline void Reset() {}
+inline bool IsEnabled() { return false; }
+class ScopedPhase {
+public:
+  explicit ScopedPhase(Phase) {}
+};
+inline void SetCount(std::string_view, size_t) {}
+inline void Report(std::ostream&, Format) {}
+
+#endif // TC_TIME_PASSES
+} // namespace instrument
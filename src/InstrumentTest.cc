@@ -0,0 +1,55 @@
+#include "Instrument.h"
+#include "testing/catch.h"
+#include <memory>
+#include <sstream>
+
+namespace {
+#ifdef TC_TIME_PASSES
+// Returns value for key `"name": ` in the one-line JSON report.
+long JsonValue(const std::string& json, const std::string& phase,
+               const std::string& key) {
+  size_t at = json.find("\"name\": \"" + phase + "\"");
+  REQUIRE(at != std::string::npos);
+  at = json.find("\"" + key + "\": ", at);
+  REQUIRE(at != std::string::npos);
+  return std::stol(json.substr(at + key.size() + 4));
+}
+
+SCENARIO("instrumentation records phases", "[instrument]") {
+  instrument::Reset();
+  GIVEN("Recording disabled") {
+    { instrument::ScopedPhase phase(instrument::kParse); }
+    REQUIRE(!instrument::IsEnabled());
+    std::ostringstream os;
+    instrument::Report(os, instrument::Format::kJson);
+    REQUIRE(JsonValue(os.str(), "parse", "runs") == 0);
+  }
+  GIVEN("Nested phases") {
+    instrument::Enable();
+    {
+      instrument::ScopedPhase compile(instrument::kCompile);
+      auto p = std::make_unique<int>(1);
+      {
+        instrument::ScopedPhase emit(instrument::kEmit);
+        auto q = std::make_unique<char[]>(1000);
+        auto r = std::make_unique<char[]>(1000);
+      }
+    }
+    instrument::SetCount("ast nodes", 42);
+    std::ostringstream os;
+    instrument::Report(os, instrument::Format::kJson);
+    std::string json = os.str();
+    REQUIRE(JsonValue(json, "compile", "runs") == 1);
+    REQUIRE(JsonValue(json, "compile", "allocations") == 1);
+    REQUIRE(JsonValue(json, "emit", "allocations") == 2);
+    REQUIRE(JsonValue(json, "emit", "bytes") == 2000);
+    REQUIRE(json.find("\"ast nodes\": 42") != std::string::npos);
+
+    std::ostringstream table;
+    instrument::Report(table, instrument::Format::kTable);
+    REQUIRE(table.str().find("ast nodes: 42") != std::string::npos);
+  }
+  instrument::Reset();
+}
+#endif
+} // namespace
@@ -0,0 +1,312 @@
+#include "Lexer.h"
+#include "driver.h"
+#include <array>
+#include <climits>
+#include <cstdint>
+#include <string>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define TC_LEXER_SIMD
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define TC_LEXER_SIMD
+#endif
+
+namespace {
+
+enum CharClass : uint8_t {
+  kBlank = 1,     // Skipped between tokens, including newlines
+  kWordStart = 2, // Starts an identifier or keyword
+  kWord = 4,      // Continues an identifier or keyword
+  kDigit = 8,
+};
+
+constexpr std::array<uint8_t, 256> MakeCharClasses() {
+  std::array<uint8_t, 256> classes = {};
+  for (char c : {' ', '\t', '\r', '\n'}) classes[uint8_t(c)] = kBlank;
+  for (int c = 'a'; c <= 'z'; ++c) {
+    classes[c] = classes[c - 'a' + 'A'] = kWordStart | kWord;
+  }
+  for (int c = '0'; c <= '9'; ++c) classes[c] = kWord | kDigit;
+  classes['_'] = kWord;
+  return classes;
+}
+
+constexpr std::array<uint8_t, 256> kCharClasses = MakeCharClasses();
+
+inline bool IsDigit(char c) { return kCharClasses[uint8_t(c)] & kDigit; }
+
+// Keywords are found in a table of 32 slots indexed by a hash of the first
+// two characters and the length, which happens to be collision free for
+// Tiger's keywords. A hit is confirmed by comparing the whole word.
+struct Keyword {
+  std::string_view text;
+  yy::Parser::symbol_type (*make)(const yy::location&);
+};
+
+#define KEYWORD(text, TOKEN)                                                   \
+  {text, [](const yy::location& l) { return yy::Parser::make_##TOKEN(l); }}
+constexpr Keyword kKeywords[] = {
+    KEYWORD("array", ARRAY), KEYWORD("break", BREAK), KEYWORD("do", DO),
+    KEYWORD("else", ELSE),   KEYWORD("end", END),     KEYWORD("for", FOR),
+    KEYWORD("function", FUNCTION), KEYWORD("if", IF), KEYWORD("in", IN),
+    KEYWORD("let", LET),     KEYWORD("nil", NIL),     KEYWORD("of", OF),
+    KEYWORD("then", THEN),   KEYWORD("to", TO),       KEYWORD("type", TYPE),
+    KEYWORD("var", VAR),     KEYWORD("while", WHILE),
+};
+#undef KEYWORD
+
+constexpr size_t kKeywordSlots = 32;
+
+// Words must have at least two characters.
+constexpr size_t KeywordHash(std::string_view word) {
+  return (7 * uint8_t(word[0]) + 29 * uint8_t(word[1]) + word.size()) &
+         (kKeywordSlots - 1);
+}
+
+constexpr std::array<Keyword, kKeywordSlots> MakeKeywordTable() {
+  std::array<Keyword, kKeywordSlots> table = {};
+  for (const Keyword& keyword : kKeywords) {
+    table[KeywordHash(keyword.text)] = keyword;
+  }
+  return table;
+}
+
+constexpr std::array<Keyword, kKeywordSlots> kKeywordTable =
+    MakeKeywordTable();
+
+constexpr bool KeywordHashIsPerfect() {
+  for (const Keyword& keyword : kKeywords) {
+    if (kKeywordTable[KeywordHash(keyword.text)].text != keyword.text) {
+      return false;
+    }
+  }
+  return true;
+}
+static_assert(KeywordHashIsPerfect(), "keywords collide, change the hash");
+
+#ifdef TC_LEXER_SIMD
+#ifdef __AVX2__
+using Vec = __m256i;
+constexpr size_t kWidth = 32;
+inline Vec Load(const char* p) {
+  return _mm256_loadu_si256(reinterpret_cast<const Vec*>(p));
+}
+inline Vec Splat(char c) { return _mm256_set1_epi8(c); }
+inline Vec Or(Vec a, Vec b) { return _mm256_or_si256(a, b); }
+inline Vec And(Vec a, Vec b) { return _mm256_and_si256(a, b); }
+inline Vec Eq(Vec a, Vec b) { return _mm256_cmpeq_epi8(a, b); }
+inline Vec Gt(Vec a, Vec b) { return _mm256_cmpgt_epi8(a, b); }
+inline uint32_t Bits(Vec v) { return _mm256_movemask_epi8(v); }
+#else
+using Vec = __m128i;
+constexpr size_t kWidth = 16;
+inline Vec Load(const char* p) {
+  return _mm_loadu_si128(reinterpret_cast<const Vec*>(p));
+}
+inline Vec Splat(char c) { return _mm_set1_epi8(c); }
+inline Vec Or(Vec a, Vec b) { return _mm_or_si128(a, b); }
+inline Vec And(Vec a, Vec b) { return _mm_and_si128(a, b); }
+inline Vec Eq(Vec a, Vec b) { return _mm_cmpeq_epi8(a, b); }
+inline Vec Gt(Vec a, Vec b) { return _mm_cmpgt_epi8(a, b); }
+inline uint32_t Bits(Vec v) { return _mm_movemask_epi8(v); }
+#endif
+constexpr uint32_t kAllBits = kWidth == 32 ? ~0u : (1u << kWidth) - 1;
+
+// Bytes from lo to hi. Comparisons are signed, so this only works for
+// ASCII bounds, and bytes of 128 and above are never in range.
+inline Vec InRange(Vec v, char lo, char hi) {
+  return And(Gt(v, Splat(lo - 1)), Gt(Splat(hi + 1), v));
+}
+#endif
+
+// Character sets for Lexer::Span. Each tests single bytes, and whole
+// vectors with a bit per byte.
+struct Blanks {
+  static bool In(uint8_t c) { return kCharClasses[c] & kBlank; }
+#ifdef TC_LEXER_SIMD
+  static uint32_t In(Vec v) {
+    return Bits(Or(Or(Eq(v, Splat(' ')), Eq(v, Splat('\t'))),
+                   Or(Eq(v, Splat('\r')), Eq(v, Splat('\n')))));
+  }
+#endif
+};
+
+struct WordChars {
+  static bool In(uint8_t c) { return kCharClasses[c] & kWord; }
+#ifdef TC_LEXER_SIMD
+  static uint32_t In(Vec v) {
+    Vec letters = InRange(Or(v, Splat(0x20)), 'a', 'z');
+    return Bits(Or(Or(letters, InRange(v, '0', '9')), Eq(v, Splat('_'))));
+  }
+#endif
+};
+
+struct StringChars {
+  static bool In(uint8_t c) { return c != '"'; }
+#ifdef TC_LEXER_SIMD
+  static uint32_t In(Vec v) { return ~Bits(Eq(v, Splat('"'))) & kAllBits; }
+#endif
+};
+
+// Bytes that cannot start or end a comment.
+struct CommentChars {
+  static bool In(uint8_t c) { return c != '*' && c != '/'; }
+#ifdef TC_LEXER_SIMD
+  static uint32_t In(Vec v) {
+    return ~Bits(Or(Eq(v, Splat('*')), Eq(v, Splat('/')))) & kAllBits;
+  }
+#endif
+};
+
+} // namespace
+
+Lexer::Lexer(std::string_view text, yy::position::filename_type* file)
+    : text_(text), file_(file) {}
+
+yy::position Lexer::Position(size_t i) const {
+  return yy::position(file_, line_, i - line_start_ + 1);
+}
+
+template <typename Class> size_t Lexer::Span(size_t i) {
+  const char* p = text_.data();
+#ifdef TC_LEXER_SIMD
+  for (; i + kWidth <= text_.size(); i += kWidth) {
+    Vec v = Load(p + i);
+    uint32_t stop = ~Class::In(v) & kAllBits;
+    uint32_t spanned = stop ? (stop & -stop) - 1 : kAllBits;
+    if (uint32_t lines = Bits(Eq(v, Splat('\n'))) & spanned) {
+      line_ += __builtin_popcount(lines);
+      line_start_ = i + (31 - __builtin_clz(lines)) + 1;
+    }
+    if (stop) return i + __builtin_ctz(stop);
+  }
+#endif
+  for (; i < text_.size() && Class::In(uint8_t(p[i])); ++i) {
+    if (p[i] == '\n') {
+      ++line_;
+      line_start_ = i + 1;
+    }
+  }
+  return i;
+}
+
+bool Lexer::SkipBlanksAndComments(Driver& driver) {
+  for (;;) {
+    pos_ = Span<Blanks>(pos_);
+    if (text_.compare(pos_, 2, "/*") != 0) return true;
+    size_t begin = pos_;
+    yy::position begin_position = Position(begin);
+    pos_ += 2;
+    for (int depth = 1; depth > 0;) {
+      pos_ = Span<CommentChars>(pos_);
+      if (pos_ == text_.size()) {
+        driver.error(yy::location(begin_position, Position(pos_)),
+                     "unterminated comment");
+        return false;
+      }
+      if (text_.compare(pos_, 2, "/*") == 0) {
+        ++depth;
+        pos_ += 2;
+      } else if (text_.compare(pos_, 2, "*/") == 0) {
+        --depth;
+        pos_ += 2;
+      } else {
+        ++pos_;
+      }
+    }
+  }
+}
+
+yy::Parser::symbol_type Lexer::Word(size_t begin, const yy::location& loc) {
+  std::string_view word = text_.substr(begin, pos_ - begin);
+  if (word.size() > 1) {
+    const Keyword& keyword = kKeywordTable[KeywordHash(word)];
+    if (keyword.text == word) return keyword.make(loc);
+  }
+  return yy::Parser::make_IDENTIFIER(std::string(word), loc);
+}
+
+yy::Parser::symbol_type Lexer::Number(Driver& driver, size_t begin,
+                                      const yy::location& loc) {
+  // Saturates and then truncates like strtol and the conversion to int in
+  // the flex scanner.
+  long n = 0;
+  for (size_t i = begin; i < pos_; ++i) {
+    int digit = text_[i] - '0';
+    n = n > (LONG_MAX - digit) / 10 ? LONG_MAX : n * 10 + digit;
+  }
+  if (n > INT_MAX) driver.error(loc, "integer is out of range");
+  return yy::Parser::make_NUMBER(static_cast<int>(n), loc);
+}
+
+yy::Parser::symbol_type Lexer::Next(Driver& driver) {
+  using P = yy::Parser;
+  for (;;) {
+    if (!SkipBlanksAndComments(driver)) {
+      return P::make_EOF(yy::location(Position(pos_)));
+    }
+    size_t begin = pos_;
+    yy::position start = Position(begin);
+    auto here = [&] { return yy::location(start, Position(pos_)); };
+    auto follows = [&](char c) {
+      if (pos_ < text_.size() && text_[pos_] == c) {
+        ++pos_;
+        return true;
+      }
+      return false;
+    };
+    if (begin == text_.size()) return P::make_EOF(here());
+    uint8_t c = text_[begin];
+    if (kCharClasses[c] & kWordStart) {
+      pos_ = Span<WordChars>(begin + 1);
+      return Word(begin, here());
+    }
+    if (kCharClasses[c] & kDigit) {
+      while (pos_ < text_.size() && IsDigit(text_[pos_])) ++pos_;
+      return Number(driver, begin, here());
+    }
+    pos_ = begin + 1;
+    switch (c) {
+    case '"': {
+      int line = line_;
+      size_t line_start = line_start_;
+      size_t end = Span<StringChars>(pos_);
+      if (end < text_.size()) {
+        pos_ = end + 1;
+        std::string text(text_.substr(begin, pos_ - begin));
+        return P::make_STRING_CONSTANT(text, here());
+      }
+      // Unterminated, so the quote is invalid like in the flex scanner.
+      line_ = line;
+      line_start_ = line_start;
+      break;
+    }
+    case '&': return P::make_AND(here());
+    case '(': return P::make_LPAREN(here());
+    case ')': return P::make_RPAREN(here());
+    case '{': return P::make_LBRACE(here());
+    case '}': return P::make_RBRACE(here());
+    case '*': return P::make_STAR(here());
+    case '+': return P::make_PLUS(here());
+    case ',': return P::make_COMMA(here());
+    case '-': return P::make_MINUS(here());
+    case '.': return P::make_DOT(here());
+    case '/': return P::make_SLASH(here());
+    case ';': return P::make_SEMICOLON(here());
+    case ':':
+      return follows('=') ? P::make_ASSIGN(here()) : P::make_COLON(here());
+    case '<':
+      if (follows('=')) return P::make_LE(here());
+      if (follows('>')) return P::make_NE(here());
+      return P::make_LT(here());
+    case '=': return P::make_EQUAL(here());
+    case '>': return follows('=') ? P::make_GE(here()) : P::make_GT(here());
+    case '[': return P::make_LBRACKET(here());
+    case ']': return P::make_RBRACKET(here());
+    case '|': return P::make_OR(here());
+    }
+    driver.error(here(), std::string("invalid character '") + char(c) + "'");
+  }
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "parser.hh"
+#include <cstddef>
+#include <string_view>
+
+// A hand written alternative to the flex scanner in scanner.ll, producing
+// the same tokens from a source held in memory. Runs of blanks, comments,
+// identifiers and strings are scanned 16 or 32 bytes at a time where SSE2
+// or AVX2 are available, and keywords are found through a perfect hash
+// instead of a DFA.
+class Lexer {
+public:
+  // Scans `text`, which must outlive the lexer. Locations refer to `file`.
+  Lexer(std::string_view text, yy::position::filename_type* file);
+
+  // Returns the next token, or "end of file". Reports malformed input to
+  // `driver` like the flex scanner does.
+  yy::Parser::symbol_type Next(Driver& driver);
+
+private:
+  // Returns the end of the run of bytes from `i` on that are in Class,
+  // noting the lines it spans.
+  template <typename Class> size_t Span(size_t i);
+  // Skips blanks and comments. Returns false on an unterminated comment.
+  bool SkipBlanksAndComments(Driver& driver);
+  // Returns the position of the byte at `i`.
+  yy::position Position(size_t i) const;
+  yy::Parser::symbol_type Word(size_t begin, const yy::location& loc);
+  yy::Parser::symbol_type Number(Driver& driver, size_t begin,
+                                 const yy::location& loc);
+
+  std::string_view text_;
+  yy::position::filename_type* file_;
+  size_t pos_ = 0;
+  int line_ = 1;
+  size_t line_start_ = 0; // Offset of the first byte of line_
+};
@@ -0,0 +1,191 @@
+#include "Lexer.h"
+#include "ToString.h"
+#include "driver.h"
+#include "testing/catch.h"
+#include "testing/generator.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+using P = yy::Parser;
+const yy::location kNowhere;
+
+int Kind(const P::symbol_type& token) { return token.type_get(); }
+
+// Tokens of `text` up to "end of file", which is included.
+struct Scanned {
+  std::vector<P::symbol_type> tokens;
+  std::string errors; // As reported to the driver
+};
+
+Scanned Scan(const std::string& text) {
+  Driver driver;
+  Lexer lexer(text, nullptr);
+  Scanned scanned;
+  std::ostringstream errors;
+  auto* cerr = std::cerr.rdbuf(errors.rdbuf());
+  do {
+    scanned.tokens.push_back(lexer.Next(driver));
+  } while (Kind(scanned.tokens.back()) != Kind(P::make_EOF(kNowhere)));
+  std::cerr.rdbuf(cerr);
+  scanned.errors = errors.str();
+  return scanned;
+}
+
+std::vector<int> Kinds(const Scanned& scanned) {
+  std::vector<int> kinds;
+  for (const auto& token : scanned.tokens) kinds.push_back(Kind(token));
+  return kinds;
+}
+
+std::vector<int> Kinds(const std::vector<P::symbol_type>& tokens) {
+  std::vector<int> kinds;
+  for (const auto& token : tokens) kinds.push_back(Kind(token));
+  kinds.push_back(Kind(P::make_EOF(kNowhere)));
+  return kinds;
+}
+
+std::string Location(const P::symbol_type& token) {
+  std::ostringstream os;
+  os << token.location;
+  return os.str();
+}
+
+SCENARIO("Lexer produces the tokens of the flex scanner", "[Lexer]") {
+  GIVEN("keywords and identifiers") {
+    Scanned scanned = Scan("if iff i array arrays x_1 let in end");
+    THEN("whole words are keywords") {
+      REQUIRE(Kinds(scanned) ==
+              Kinds({P::make_IF(kNowhere), P::make_IDENTIFIER("", kNowhere),
+                     P::make_IDENTIFIER("", kNowhere), P::make_ARRAY(kNowhere),
+                     P::make_IDENTIFIER("", kNowhere),
+                     P::make_IDENTIFIER("", kNowhere), P::make_LET(kNowhere),
+                     P::make_IN(kNowhere), P::make_END(kNowhere)}));
+      REQUIRE(scanned.tokens[1].value.as<std::string>() == "iff");
+      REQUIRE(scanned.tokens[2].value.as<std::string>() == "i");
+      REQUIRE(scanned.tokens[4].value.as<std::string>() == "arrays");
+      REQUIRE(scanned.tokens[5].value.as<std::string>() == "x_1");
+      REQUIRE(scanned.errors.empty());
+    }
+  }
+  GIVEN("every keyword") {
+    Scanned scanned = Scan("array break do else end for function if in let "
+                           "nil of then to type var while");
+    THEN("each gets its token") {
+      REQUIRE(Kinds(scanned) ==
+              Kinds({P::make_ARRAY(kNowhere), P::make_BREAK(kNowhere),
+                     P::make_DO(kNowhere), P::make_ELSE(kNowhere),
+                     P::make_END(kNowhere), P::make_FOR(kNowhere),
+                     P::make_FUNCTION(kNowhere), P::make_IF(kNowhere),
+                     P::make_IN(kNowhere), P::make_LET(kNowhere),
+                     P::make_NIL(kNowhere), P::make_OF(kNowhere),
+                     P::make_THEN(kNowhere), P::make_TO(kNowhere),
+                     P::make_TYPE(kNowhere), P::make_VAR(kNowhere),
+                     P::make_WHILE(kNowhere)}));
+    }
+  }
+  GIVEN("punctuation") {
+    Scanned scanned = Scan(":= : <= <> < >= > = & | ()[]{},.;+-*/");
+    THEN("the longest operators are taken") {
+      REQUIRE(Kinds(scanned) ==
+              Kinds({P::make_ASSIGN(kNowhere), P::make_COLON(kNowhere),
+                     P::make_LE(kNowhere), P::make_NE(kNowhere),
+                     P::make_LT(kNowhere), P::make_GE(kNowhere),
+                     P::make_GT(kNowhere), P::make_EQUAL(kNowhere),
+                     P::make_AND(kNowhere), P::make_OR(kNowhere),
+                     P::make_LPAREN(kNowhere), P::make_RPAREN(kNowhere),
+                     P::make_LBRACKET(kNowhere), P::make_RBRACKET(kNowhere),
+                     P::make_LBRACE(kNowhere), P::make_RBRACE(kNowhere),
+                     P::make_COMMA(kNowhere), P::make_DOT(kNowhere),
+                     P::make_SEMICOLON(kNowhere), P::make_PLUS(kNowhere),
+                     P::make_MINUS(kNowhere), P::make_STAR(kNowhere),
+                     P::make_SLASH(kNowhere)}));
+    }
+  }
+  GIVEN("numbers") {
+    Scanned scanned = Scan("0 42 2147483647 12ab 2147483648");
+    THEN("values are converted") {
+      REQUIRE(scanned.tokens[0].value.as<int>() == 0);
+      REQUIRE(scanned.tokens[1].value.as<int>() == 42);
+      REQUIRE(scanned.tokens[2].value.as<int>() == 2147483647);
+      REQUIRE(scanned.tokens[3].value.as<int>() == 12);
+      REQUIRE(scanned.tokens[4].value.as<std::string>() == "ab");
+    }
+    THEN("too large numbers are errors") {
+      REQUIRE(scanned.errors == "1.22-31: integer is out of range\n");
+    }
+  }
+  GIVEN("strings") {
+    Scanned scanned = Scan("\"\" \"a b\" \"two\nlines\" x");
+    THEN("values keep their quotes") {
+      REQUIRE(scanned.tokens[0].value.as<std::string>() == "\"\"");
+      REQUIRE(scanned.tokens[1].value.as<std::string>() == "\"a b\"");
+      REQUIRE(scanned.tokens[2].value.as<std::string>() == "\"two\nlines\"");
+    }
+    THEN("strings may span lines") {
+      REQUIRE(Location(scanned.tokens[2]) == "1.10-2.6");
+      REQUIRE(Location(scanned.tokens[3]) == "2.8");
+    }
+  }
+  GIVEN("comments") {
+    Scanned scanned = Scan("a /* b /* c */ d * / */ e/**/f /*\n\n*/ g");
+    THEN("they nest and are skipped") {
+      REQUIRE(scanned.tokens.size() == 5);
+      REQUIRE(scanned.tokens[1].value.as<std::string>() == "e");
+      REQUIRE(scanned.tokens[2].value.as<std::string>() == "f");
+      REQUIRE(Location(scanned.tokens[3]) == "3.4");
+      REQUIRE(scanned.errors.empty());
+    }
+  }
+  GIVEN("blanks of all sorts") {
+    std::string spaces(100, ' ');
+    std::string name(100, 'x');
+    Scanned scanned =
+        Scan("a\r\n\tb" + spaces + "\n" + spaces + name + "\n\n\nc");
+    THEN("locations count lines and columns") {
+      REQUIRE(Location(scanned.tokens[0]) == "1.1");
+      REQUIRE(Location(scanned.tokens[1]) == "2.2");
+      REQUIRE(Location(scanned.tokens[2]) == "3.101-200");
+      REQUIRE(scanned.tokens[2].value.as<std::string>() == name);
+      REQUIRE(Location(scanned.tokens[3]) == "6.1");
+      REQUIRE(Location(scanned.tokens[4]) == "6.2");
+    }
+  }
+  GIVEN("malformed input") {
+    Scanned scanned = Scan("_a ? \"open");
+    THEN("it is reported and skipped") {
+      REQUIRE(scanned.errors == "1.1: invalid character '_'\n"
+                                "1.4: invalid character '?'\n"
+                                "1.6: invalid character '\"'\n");
+      REQUIRE(Kinds(scanned) ==
+              Kinds({P::make_IDENTIFIER("", kNowhere),
+                     P::make_IDENTIFIER("", kNowhere)}));
+      REQUIRE(scanned.tokens[1].value.as<std::string>() == "open");
+    }
+  }
+  GIVEN("an unterminated comment") {
+    Scanned scanned = Scan("a /* b /* */");
+    THEN("it is reported") {
+      REQUIRE(scanned.errors == "1.3-12: unterminated comment\n");
+      REQUIRE(scanned.tokens.size() == 2);
+    }
+  }
+}
+
+SCENARIO("Driver parses alike with both scanners", "[Lexer]") {
+  for (const auto& shape : testing::ProgramShapes()) {
+    GIVEN(std::string("a program of shape ") + shape.name) {
+      const char file[] = "/tmp/LexerTest.tig";
+      std::ofstream(file) << "/* generated */\n" << shape.generate(20);
+      Driver flex, hand;
+      hand.hand_written_lexer = true;
+      REQUIRE(flex.parse(file) == 0);
+      REQUIRE(hand.parse(file) == 0);
+      REQUIRE(ToString(*hand.result) == ToString(*flex.result));
+    }
+  }
+}
+} // namespace
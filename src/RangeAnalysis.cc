@@ -0,0 +1,283 @@
+#include "RangeAnalysis.h"
+#include "DeclarationVisitor.h"
+#include "TreeWalker.h"
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+
+std::string PureKey::KeyOf(const Declaration& variable) {
+  return 'v' + std::to_string(reinterpret_cast<uintptr_t>(&variable)) + ' ';
+}
+
+bool PureKey::Visit(const Expression& e) {
+  operands_.assign(1, &e);
+  while (!operands_.empty()) {
+    const Expression* operand = operands_.back();
+    operands_.pop_back();
+    if (!StaticStoppingExpressionVisitor::Visit(*operand)) return false;
+  }
+  return true;
+}
+
+bool PureKey::VisitIntegerConstant(int value) {
+  key += std::to_string(value) + ' ';
+  return true;
+}
+
+bool PureKey::VisitLValue(const LValue& value) {
+  const Declaration* declaration = value.GetBinding().declaration;
+  if (value.kind() != Expression::Kind::kIdLValue || !declaration) {
+    return false;
+  }
+  key += KeyOf(*declaration);
+  variables.push_back(declaration);
+  return true;
+}
+
+bool PureKey::VisitNegated(const Expression& value) {
+  key += "- ";
+  operands_.push_back(&value);
+  return true;
+}
+
+bool PureKey::VisitBinary(const Expression& left, BinaryOp op,
+                          const Expression& right) {
+  key += 'b' + std::to_string(op) + ' ';
+  operands_.push_back(&right);
+  operands_.push_back(&left);
+  return true;
+}
+
+namespace {
+
+// An expression without side effects as the sum of a part that is not
+// constant, by its PureKey, if any, and a constant.
+struct Linear {
+  std::string key;
+  int64_t offset = 0;
+  std::vector<const Declaration*> variables;
+};
+
+// Depth of operators below which ToLinear splits no more constants off, so
+// that its recursion cannot overflow the stack.
+constexpr int kMaxLinearDepth = 64;
+
+std::optional<Linear> ToLinear(const Expression& e, int depth = 0);
+
+// Splits sums and differences with constants off expressions.
+class LinearSplitter : public StaticStoppingExpressionVisitor<LinearSplitter> {
+public:
+  explicit LinearSplitter(int depth) : depth_(depth) {}
+
+  std::optional<Linear> result;
+
+  bool VisitIntegerConstant(int value) {
+    result = Linear{"", value, {}};
+    return true;
+  }
+  bool VisitNegated(const Expression& value) {
+    std::optional<Linear> operand = ToLinear(value, depth_ + 1);
+    if (!operand || !operand->key.empty()) return false;
+    result = Linear{"", -operand->offset, {}};
+    return true;
+  }
+  bool VisitBinary(const Expression& left, BinaryOp op,
+                   const Expression& right) {
+    if (op != kPlus && op != kMinus) return false;
+    std::optional<Linear> l = ToLinear(left, depth_ + 1);
+    std::optional<Linear> r = ToLinear(right, depth_ + 1);
+    if (!l || !r) return false;
+    if (r->key.empty()) {
+      result = std::move(l);
+      result->offset += op == kPlus ? r->offset : -r->offset;
+    } else if (l->key.empty() && op == kPlus) {
+      result = std::move(r);
+      result->offset += l->offset;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+private:
+  int depth_;
+};
+
+std::optional<Linear> ToLinear(const Expression& e, int depth) {
+  LinearSplitter splitter(depth);
+  if (depth < kMaxLinearDepth && splitter.Visit(e)) return splitter.result;
+  PureKey pure;
+  if (!pure.Visit(e)) return {};
+  return Linear{std::move(pure.key), 0, std::move(pure.variables)};
+}
+
+// Finds the size of an array expression.
+class ArraySize : public StaticStoppingExpressionVisitor<ArraySize> {
+public:
+  const Expression* size = nullptr;
+
+  bool VisitArray(const std::string& type_id, const Expression& size,
+                  const Expression& value) {
+    this->size = &size;
+    return true;
+  }
+};
+
+// Collects the facts of one walk over the program: variables assigned,
+// sizes of arrays, and indexes of arrays by variables of loops.
+class RangeWalker : public TreeWalker,
+                    public StaticStoppingExpressionVisitor<RangeWalker>,
+                    public DeclarationVisitor {
+public:
+  struct Index {
+    const LValue* node;
+    const For* loop;
+    const Declaration* array;
+    int64_t offset;
+  };
+  struct Bounds {
+    const Expression* first;
+    const Expression* last;
+  };
+
+  std::unordered_set<const Declaration*> assigned;
+  // Of variables initialized by array expressions.
+  std::unordered_map<const Declaration*, const Expression*> sizes;
+  std::unordered_map<const For*, Bounds> loops;
+  std::unordered_set<const For*> outer_loops;
+  std::vector<Index> indexes;
+
+  bool VisitAssignment(const LValue& value, const Expression& expr) {
+    if (value.kind() == Expression::Kind::kIdLValue) {
+      assigned.insert(value.GetBinding().declaration);
+    }
+    return true;
+  }
+  bool VisitWhile(const Expression& condition, const Expression& body) {
+    outer_loops.insert(open_loops_.begin(), open_loops_.end());
+    return true;
+  }
+  bool VisitFor(const std::string& id, const Expression& first,
+                const Expression& last, const Expression& body) {
+    outer_loops.insert(open_loops_.begin(), open_loops_.end());
+    loops[loop_] = {&first, &last};
+    return true;
+  }
+  bool VisitLValue(const LValue& value) {
+    if (value.kind() != Expression::Kind::kIndexLValue) return true;
+    return StaticExpressionVisitor<RangeWalker>::VisitLValue(value);
+  }
+  bool VisitIndex(const LValue& value, const Expression& expr) {
+    const Declaration* array = value.GetBinding().declaration;
+    if (value.kind() != Expression::Kind::kIdLValue || !array) return true;
+    std::optional<Linear> index = ToLinear(expr);
+    if (!index || index->offset <= INT32_MIN || index->offset > INT32_MAX) {
+      return true;
+    }
+    for (const For* loop : open_loops_) {
+      if (PureKey::KeyOf(loop->Variable()) == index->key) {
+        indexes.push_back({index_, loop, array, index->offset});
+      }
+    }
+    return true;
+  }
+
+  bool VisitVariableDeclaration(const std::string& id,
+                                const std::optional<std::string>& type_id,
+                                const Expression& expr) override {
+    ArraySize array;
+    if (array.Visit(expr)) sizes[declaration_] = array.size;
+    return true;
+  }
+
+protected:
+  bool Enter(TreeNode& node) override {
+    if (auto d = node.declaration(); d) {
+      declaration_ = *d;
+      (*d)->Accept(static_cast<DeclarationVisitor&>(*this));
+    } else if (auto e = node.expression(); e) {
+      loop_ = (*e)->kind() == Expression::Kind::kFor
+                  ? static_cast<const For*>(*e)
+                  : nullptr;
+      index_ = (*e)->kind() == Expression::Kind::kIndexLValue
+                   ? static_cast<const LValue*>(*e)
+                   : nullptr;
+      Visit(**e);
+      if (loop_) open_loops_.push_back(loop_);
+    }
+    return true;
+  }
+  void Leave(TreeNode& node) override {
+    if (auto e = node.expression();
+        e && (*e)->kind() == Expression::Kind::kFor) {
+      open_loops_.pop_back();
+    }
+  }
+
+private:
+  // Node visited.
+  const Declaration* declaration_ = nullptr;
+  const For* loop_ = nullptr;
+  const LValue* index_ = nullptr;
+  // For loops around the node visited, innermost last.
+  std::vector<const For*> open_loops_;
+};
+} // namespace
+
+RangeAnalysis::RangeAnalysis(const Expression& program) {
+  RangeWalker walker;
+  walker.Walk(program);
+  auto unassigned = [&](const std::vector<const Declaration*>& variables) {
+    return std::none_of(variables.begin(), variables.end(),
+                        [&](auto v) { return walker.assigned.count(v); });
+  };
+  // Lengths of arrays, for those known.
+  std::unordered_map<const Declaration*, std::optional<Linear>> lengths;
+  for (const auto& [array, size] : walker.sizes) {
+    std::optional<Linear> length = ToLinear(*size);
+    if (!walker.assigned.count(array) && length &&
+        unassigned(length->variables)) {
+      lengths[array] = std::move(length);
+    }
+  }
+  for (const RangeWalker::Index& index : walker.indexes) {
+    if (walker.assigned.count(index.array) ||
+        !walker.sizes.count(index.array)) {
+      continue;
+    }
+    auto [facts, first_index] = loops_.try_emplace(index.loop);
+    ForLoop& loop = facts->second;
+    if (first_index) {
+      loop.in_bounds = true;
+      loop.innermost = !walker.outer_loops.count(index.loop);
+    }
+    auto array = std::find_if(
+        loop.arrays.begin(), loop.arrays.end(),
+        [&](const LoopArray& a) { return a.array == index.array; });
+    if (array == loop.arrays.end()) {
+      loop.arrays.push_back({index.array, int32_t(index.offset),
+                             int32_t(index.offset)});
+    } else {
+      array->min_offset = std::min<int32_t>(array->min_offset, index.offset);
+      array->max_offset = std::max<int32_t>(array->max_offset, index.offset);
+    }
+    // The loop variable takes values from first to last, if any.
+    const RangeWalker::Bounds& bounds = walker.loops.at(index.loop);
+    auto length = lengths.find(index.array);
+    std::optional<Linear> first = ToLinear(*bounds.first);
+    std::optional<Linear> last = ToLinear(*bounds.last);
+    if (length != lengths.end() && first && first->key.empty() &&
+        first->offset + index.offset >= 0 && last &&
+        last->key == length->second->key &&
+        last->offset + index.offset < length->second->offset) {
+      in_bounds_.insert(index.node);
+    } else {
+      loop.in_bounds = false;
+    }
+  }
+}
+
+const RangeAnalysis::ForLoop* RangeAnalysis::Find(const For& loop) const {
+  auto facts = loops_.find(&loop);
+  return facts == loops_.end() ? nullptr : &facts->second;
+}
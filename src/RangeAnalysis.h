@@ -0,0 +1,83 @@
+#pragma once
+#include "Expression.h"
+#include "StaticExpressionVisitor.h"
+#include "syntax_nodes.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Builds a key of an expression without side effects, i.e. of constants
+// and variables combined by operators, such that expressions with equal
+// keys have equal values when evaluated one after the other. Visit returns
+// false for other expressions.
+class PureKey : public StaticStoppingExpressionVisitor<PureKey> {
+public:
+  std::string key;
+  // Declarations of the variables read.
+  std::vector<const Declaration*> variables;
+
+  // Returns the key of a variable.
+  static std::string KeyOf(const Declaration& variable);
+
+  // Visits the operands of operators from a stack rather than by recursion,
+  // so that deeply nested expressions cannot overflow the call stack.
+  bool Visit(const Expression& e);
+
+  bool VisitIntegerConstant(int value);
+  bool VisitLValue(const LValue& value);
+  bool VisitNegated(const Expression& value);
+  bool VisitBinary(const Expression& left, BinaryOp op,
+                   const Expression& right);
+
+private:
+  // Operands left to visit, the next last.
+  std::vector<const Expression*> operands_;
+};
+
+// Proves indexes of arrays within bounds in for loops, e.g. of a in
+//
+//   let var a := intArray [n] of 0 in for i := 0 to n - 1 do a[i] := i end
+//
+// Arrays must be variables that are never assigned, initialized by an
+// array expression whose size reads only variables that are never
+// assigned either, so that the size is still the length of the array in
+// the loop. Indexes must be the loop variable plus a constant, and the
+// bounds of the loop a constant and the size plus a constant.
+class RangeAnalysis {
+public:
+  // Analyzes the given program, which must have its name spaces set.
+  explicit RangeAnalysis(const Expression& program);
+
+  // Array indexed by the variable of a for loop plus constants in its body,
+  // e.g. by i - 1 and i + 1, of a variable that is never assigned and
+  // initialized by an array expression, so never nil.
+  struct LoopArray {
+    const Declaration* array;
+    int32_t min_offset;
+    int32_t max_offset;
+  };
+
+  struct ForLoop {
+    // Arrays indexed in the body, by order of first index.
+    std::vector<LoopArray> arrays;
+    // Whether the bounds of the loop keep all those indexes in bounds.
+    bool in_bounds = false;
+    // Whether the body has no loops.
+    bool innermost = true;
+  };
+
+  // Returns facts about the given loop, or nullptr if its body indexes no
+  // arrays by its variable.
+  const ForLoop* Find(const For& loop) const;
+
+  // Returns whether the given index of an array is proven within bounds.
+  bool InBounds(const LValue& index) const {
+    return in_bounds_.count(&index);
+  }
+
+private:
+  std::unordered_map<const For*, ForLoop> loops_;
+  std::unordered_set<const LValue*> in_bounds_;
+};
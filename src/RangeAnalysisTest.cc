@@ -0,0 +1,116 @@
+#include "RangeAnalysis.h"
+#include "TreeWalker.h"
+#include "syntax_nodes.h"
+#include "testing/catch.h"
+#include "testing/testing.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Collects the for loops and indexes of arrays of a program.
+struct Collector : TreeWalker {
+  bool Enter(TreeNode& node) override {
+    if (auto e = node.expression(); e) {
+      if ((*e)->kind() == Expression::Kind::kFor) {
+        loops.push_back(static_cast<const For*>(*e));
+      } else if ((*e)->kind() == Expression::Kind::kIndexLValue) {
+        indexes.push_back(static_cast<const LValue*>(*e));
+      }
+    }
+    return true;
+  }
+  std::vector<const For*> loops;
+  std::vector<const LValue*> indexes;
+};
+
+std::shared_ptr<Expression> Resolved(const std::string& program) {
+  std::shared_ptr<Expression> e = testing::Parse(program);
+  Expression::SetNameSpacesBelow(*e);
+  return e;
+}
+
+// Analysis of the given expression with arrays a of size n and b of size 3.
+struct Analyzed {
+  explicit Analyzed(const std::string& body)
+      : program(Resolved("let type a = array of int var n := 10 var a := a "
+                         "[n] of 0 var b := a [3] of 0 in " +
+                         body + " end")),
+        ranges(*program) {
+    collector.Walk(*program);
+  }
+  const RangeAnalysis::ForLoop* loop() const {
+    return ranges.Find(*collector.loops.at(0));
+  }
+  bool index_in_bounds(size_t i) const {
+    return ranges.InBounds(*collector.indexes.at(i));
+  }
+
+  std::shared_ptr<Expression> program;
+  RangeAnalysis ranges;
+  Collector collector;
+};
+
+SCENARIO("RangeAnalysis proves indexes in bounds", "[range]") {
+  GIVEN("a loop from 0 to the size minus 1") {
+    Analyzed analyzed("for i := 0 to n - 1 do a[i] := i");
+    REQUIRE(analyzed.loop());
+    REQUIRE(analyzed.loop()->in_bounds);
+    REQUIRE(analyzed.index_in_bounds(0));
+    REQUIRE(analyzed.loop()->arrays.size() == 1);
+    REQUIRE(analyzed.loop()->arrays[0].min_offset == 0);
+    REQUIRE(analyzed.loop()->arrays[0].max_offset == 0);
+  }
+  GIVEN("offsets of the index") {
+    Analyzed analyzed("for i := 1 to n - 2 do a[i] := a[i - 1] + a[i + 1]");
+    REQUIRE(analyzed.loop()->in_bounds);
+    REQUIRE(analyzed.loop()->arrays[0].min_offset == -1);
+    REQUIRE(analyzed.loop()->arrays[0].max_offset == 1);
+  }
+  GIVEN("constant sizes") {
+    REQUIRE(Analyzed("for i := 0 to 2 do b[i] := 1").loop()->in_bounds);
+    REQUIRE(!Analyzed("for i := 0 to 3 do b[i] := 1").loop()->in_bounds);
+  }
+  GIVEN("a loop past the end") {
+    Analyzed analyzed("for i := 0 to n do a[i] := i");
+    REQUIRE(analyzed.loop());
+    REQUIRE(!analyzed.loop()->in_bounds);
+    REQUIRE(!analyzed.index_in_bounds(0));
+  }
+  GIVEN("a loop from below 0") {
+    REQUIRE(!Analyzed("for i := 0 to n - 1 do a[i - 1] := i")
+                 .loop()
+                 ->in_bounds);
+  }
+  GIVEN("a loop over one array and an index of another") {
+    Analyzed analyzed("for i := 0 to n - 1 do (a[i] := b[i])");
+    REQUIRE(!analyzed.loop()->in_bounds);
+    REQUIRE(analyzed.index_in_bounds(0));
+    REQUIRE(!analyzed.index_in_bounds(1));
+    REQUIRE(analyzed.loop()->arrays.size() == 2);
+  }
+  GIVEN("an assigned size") {
+    Analyzed analyzed("n := 20; for i := 0 to n - 1 do a[i] := i");
+    REQUIRE(!analyzed.loop()->in_bounds);
+  }
+  GIVEN("an assigned array") {
+    Analyzed analyzed("a := b; for i := 0 to n - 1 do a[i] := i");
+    REQUIRE(!analyzed.loop());
+  }
+  GIVEN("nested loops") {
+    Analyzed analyzed(
+        "for i := 0 to n - 1 do for j := 0 to 2 do a[i] := b[j]");
+    REQUIRE(analyzed.loop()->in_bounds);
+    REQUIRE(!analyzed.loop()->innermost);
+    const RangeAnalysis::ForLoop* inner =
+        analyzed.ranges.Find(*analyzed.collector.loops.at(1));
+    REQUIRE(inner->in_bounds);
+    REQUIRE(inner->innermost);
+  }
+  GIVEN("indexes by other expressions") {
+    Analyzed analyzed("for i := 0 to 4 do a[2 * i] := i");
+    REQUIRE(!analyzed.loop());
+  }
+}
+} // namespace
@@ -1,53 +1,130 @@
 #pragma once
-#include <optional>
+#include <cstdint>
+#include <functional>
 #include <ostream>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <vector>
 
 // Scoped map inserts new bindings in a given scope. When a scope exits
 // all its bindings are dropped.
+//
+// All keys ever bound share one open addressed hash table. Each key heads
+// a chain of its bindings from innermost to outermost scope, and the
+// bindings themselves are kept in binding order, which doubles as the
+// undo log for ExitScope. Entering and exiting scopes allocates nothing,
+// and a lookup is one probe sequence regardless of scope depth.
 template <class T> class ScopedMap {
 public:
+  ScopedMap() : slots_(kInitialSlots) {}
+
   // Pushes a new scope.
-  void EnterScope() { maps_.push_back({}); }
+  void EnterScope() { scope_starts_.push_back(bindings_.size()); }
 
   // Exits last scope and drops all entries bound since the last
   // EnterScope.
-  void ExitScope() { maps_.pop_back(); }
-
-  // Returns bound value from latest scope where the given key is bound.
-  std::optional<T> Lookup(const std::string& key) const {
-    for (auto i = maps_.rbegin(); i != maps_.rend(); ++i) {
-      if (auto j = i->find(key); j != i->end()) return j->second;
+  void ExitScope() {
+    for (size_t end = scope_starts_.back(); bindings_.size() > end;) {
+      const Entry& e = bindings_.back();
+      slots_[e.slot].top = e.shadowed;
+      bindings_.pop_back();
     }
-    return {};
+    scope_starts_.pop_back();
   }
 
-  // Returns true if the given key is bound in the currenr scope,
-  bool IsBound(const std::string& key) {
-    return maps_.rbegin()->count(key) == 1;
+  // Returns bound value from latest scope where the given key is bound, or
+  // nullptr. The pointer is valid until the next binding.
+  const T* Lookup(std::string_view key) const {
+    const Slot& slot = slots_[Find(key, std::hash<std::string_view>()(key))];
+    return slot.top == kNone ? nullptr : &bindings_[slot.top].value;
   }
 
-  // Adds or overwrites a new entry in the current scope
-  T& operator[](std::string key) { return (*maps_.rbegin())[key]; }
+  // Returns true if the given key is bound in the current scope.
+  bool IsBound(std::string_view key) const {
+    const Slot& slot = slots_[Find(key, std::hash<std::string_view>()(key))];
+    return slot.top != kNone && InCurrentScope(slot.top);
+  }
+
+  // Adds or overwrites a new entry in the current scope. The reference is
+  // valid until the next binding.
+  T& operator[](std::string_view key) {
+    size_t hash = std::hash<std::string_view>()(key);
+    size_t i = Find(key, hash);
+    if (!slots_[i].used) {
+      if (2 * (used_slots_ + 1) > slots_.size()) {
+        Grow();
+        i = Find(key, hash);
+      }
+      slots_[i] = {std::string(key), hash, kNone, true};
+      ++used_slots_;
+    }
+    Slot& slot = slots_[i];
+    if (slot.top != kNone && InCurrentScope(slot.top)) {
+      return bindings_[slot.top].value;
+    }
+    bindings_.push_back({T(), static_cast<uint32_t>(i), slot.top});
+    slot.top = bindings_.size() - 1;
+    return bindings_.back().value;
+  }
 
   template <class X>
   friend std::ostream& operator<<(std::ostream& os, const ScopedMap<X>& map);
 
 private:
-  std::vector<std::unordered_map<std::string, T>> maps_;
+  static constexpr int32_t kNone = -1;
+  static constexpr size_t kInitialSlots = 16; // A power of two
+
+  struct Slot {
+    std::string key;
+    size_t hash = 0;
+    int32_t top = kNone; // Innermost binding of key
+    bool used = false;
+  };
+  struct Entry {
+    T value;
+    uint32_t slot;
+    int32_t shadowed; // Binding of the same key in an outer scope
+  };
+
+  bool InCurrentScope(int32_t binding) const {
+    return scope_starts_.empty() || binding >= int32_t(scope_starts_.back());
+  }
+
+  // Returns slot of the given key, or the unused slot where it belongs.
+  size_t Find(std::string_view key, size_t hash) const {
+    size_t mask = slots_.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+      const Slot& slot = slots_[i];
+      if (!slot.used || (slot.hash == hash && slot.key == key)) return i;
+    }
+  }
+
+  // Doubles the table. Keys are never removed, as names recur.
+  void Grow() {
+    std::vector<Slot> old(slots_.size() * 2);
+    old.swap(slots_);
+    std::vector<uint32_t> moved(old.size());
+    for (size_t i = 0; i < old.size(); ++i) {
+      if (!old[i].used) continue;
+      moved[i] = Find(old[i].key, old[i].hash);
+      slots_[moved[i]] = std::move(old[i]);
+    }
+    for (Entry& e : bindings_) e.slot = moved[e.slot];
+  }
+
+  std::vector<Slot> slots_;
+  size_t used_slots_ = 0;
+  std::vector<Entry> bindings_;
+  std::vector<size_t> scope_starts_;
 };
 
 template <class T>
 std::ostream& operator<<(std::ostream& os, const ScopedMap<T>& map) {
   os << "{";
   const char* sep = "";
-  for (const auto& m : map.maps_) {
-    for (const auto& p : m) {
-      os << sep << p.first << ": " << p.second;
-      sep = ",\n";
-    }
+  for (const auto& e : map.bindings_) {
+    os << sep << map.slots_[e.slot].key << ": " << e.value;
+    sep = ",\n";
   }
   return os << "}";
 }
@@ -1,5 +1,7 @@
 #include "ScopedMap.h"
 #include "testing/catch.h"
+#include <sstream>
+#include <string>
 namespace {
 SCENARIO("ScopedMap handles binding in scopes", "[ScopedMap]") {
   GIVEN("A ScopedMap<int>") {
@@ -24,6 +26,49 @@ SCENARIO("ScopedMap handles binding in scopes", "[ScopedMap]") {
         auto v = map.Lookup("foo");
         REQUIRE(v);
         REQUIRE(*v == 7);
+        map.ExitScope();
+        REQUIRE(!map.Lookup("foo"));
+      }
+      THEN("Binding again in a scope overwrites") {
+        map["foo"] = 42;
+        REQUIRE(*map.Lookup("foo") == 42);
+        map.ExitScope();
+        REQUIRE(*map.Lookup("foo") == 7);
+      }
+      THEN("IsBound only sees the current scope") {
+        map.EnterScope();
+        REQUIRE(!map.IsBound("foo"));
+        map["bar"] = 1;
+        REQUIRE(map.IsBound("bar"));
+        map.ExitScope();
+        REQUIRE(map.IsBound("foo"));
+        REQUIRE(!map.IsBound("bar"));
+      }
+      THEN("All bindings print") {
+        std::ostringstream os;
+        os << map;
+        REQUIRE(os.str() == "{foo: 7,\nfoo: 666}");
+      }
+    }
+    WHEN("Many keys in many scopes") {
+      for (int i = 0; i < 1000; ++i) {
+        map.EnterScope();
+        map[std::to_string(i % 300)] = i;
+      }
+      map[""] = -1;
+      THEN("The innermost binding of each is found") {
+        REQUIRE(*map.Lookup("") == -1);
+        for (int i = 0; i < 300; ++i) {
+          REQUIRE(*map.Lookup(std::to_string(i)) == 900 + i - (i >= 100) * 300);
+        }
+        REQUIRE(!map.Lookup("300"));
+      }
+      THEN("Exits restore all of them") {
+        for (int i = 999; i >= 0; --i) {
+          REQUIRE(*map.Lookup(std::to_string(i % 300)) == i);
+          map.ExitScope();
+        }
+        REQUIRE(!map.Lookup("0"));
       }
     }
   }
@@ -0,0 +1,37 @@
+#include "SourceMap.h"
+#include <algorithm>
+#include <cstring>
+
+void SourceMap::Append(std::string_view text) {
+  const char* begin = text.data();
+  const char* end = begin + text.size();
+  for (const char* p = begin;
+       (p = static_cast<const char*>(memchr(p, '\n', end - p))); ++p) {
+    uint64_t start = size_ + (p - begin) + 1;
+    line_starts_.push_back(std::min<uint64_t>(start, kNoOffset));
+  }
+  size_ += text.size();
+}
+
+uint32_t SourceMap::Offset(int line, int column) const {
+  if (line < 1 || size_t(line) > line_starts_.size() || column < 1) {
+    return kNoOffset;
+  }
+  uint64_t offset = uint64_t(line_starts_[line - 1]) + column - 1;
+  return std::min<uint64_t>(offset, kNoOffset);
+}
+
+SourceMap::Position SourceMap::Locate(uint32_t offset) const {
+  // The last line starting at or before the offset.
+  auto line = std::upper_bound(line_starts_.begin(), line_starts_.end(),
+                               offset) - 1;
+  return {uint32_t(line - line_starts_.begin() + 1), offset - *line + 1};
+}
+
+std::string SourceMap::Describe(uint32_t offset) const {
+  if (offset == kNoOffset) return file_;
+  Position p = Locate(offset);
+  std::string position =
+      std::to_string(p.line) + "." + std::to_string(p.column);
+  return file_.empty() ? position : file_ + ":" + position;
+}
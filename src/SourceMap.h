@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Where AST nodes are in their source file. Each TreeNode keeps only the
+// 32 bit offset of its first byte, rather than a yy::location of two
+// positions and file names, and the line starts of the file are indexed
+// here once, so that lines and columns can be computed when a diagnostic
+// or line table needs them.
+class SourceMap {
+public:
+  // Offset of nodes not parsed from source, such as built-ins, and of
+  // bytes past 4 GB.
+  static constexpr uint32_t kNoOffset = UINT32_MAX;
+
+  // A line and column, both counted from 1 like in yy::position.
+  struct Position {
+    uint32_t line;
+    uint32_t column;
+  };
+
+  explicit SourceMap(std::string file = "") : file_(std::move(file)) {}
+
+  // Appends source text as scanned, indexing the lines it starts.
+  void Append(std::string_view text);
+
+  // Returns the offset of a line and column of the text appended so far,
+  // e.g. of the begin of a yy::location.
+  uint32_t Offset(int line, int column) const;
+
+  // Returns the line and column of the byte at the given offset.
+  Position Locate(uint32_t offset) const;
+
+  // Returns `file:line.column` of the byte at the given offset, like
+  // yy::location prints, or just the file for kNoOffset. Leaves out the
+  // file if it has no name.
+  std::string Describe(uint32_t offset) const;
+
+  const std::string& file() const { return file_; }
+
+private:
+  std::string file_;
+  uint64_t size_ = 0;
+  std::vector<uint32_t> line_starts_ = {0};
+};
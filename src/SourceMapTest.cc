@@ -0,0 +1,75 @@
+#include "SourceMap.h"
+#include "Checker.h"
+#include "driver.h"
+#include "syntax_nodes.h"
+#include "testing/catch.h"
+#include <fstream>
+#include <string>
+
+namespace {
+
+SCENARIO("SourceMap locates offsets", "[SourceMap]") {
+  GIVEN("text appended in pieces") {
+    SourceMap map("a.tig");
+    map.Append("let\n  var x");
+    map.Append(" := 1\n\nin");
+    map.Append(" x end\n");
+    THEN("offsets and positions agree") {
+      REQUIRE(map.Offset(1, 1) == 0);
+      REQUIRE(map.Offset(2, 7) == 10);
+      REQUIRE(map.Offset(4, 4) == 21);
+      REQUIRE(map.Offset(6, 1) == SourceMap::kNoOffset);
+      for (uint32_t offset : {0, 3, 4, 10, 21, 22, 27}) {
+        SourceMap::Position p = map.Locate(offset);
+        REQUIRE(map.Offset(p.line, p.column) == offset);
+      }
+      REQUIRE(map.Describe(10) == "a.tig:2.7");
+      REQUIRE(map.Describe(17) == "a.tig:3.1");
+      REQUIRE(map.Describe(SourceMap::kNoOffset) == "a.tig");
+      REQUIRE(SourceMap().Describe(0) == "1.1");
+    }
+  }
+}
+
+SCENARIO("Parsed nodes know their source offsets", "[SourceMap]") {
+  const std::string file = "/tmp/source_map.tig";
+  std::ofstream(file) << "let\n"
+                         "  var s := \"a\"\n"
+                         "in\n"
+                         "  if s < 1 then\n"
+                         "    s := \"b\"\n"
+                         "end";
+  for (bool hand_written_lexer : {false, true}) {
+    std::string lexer = hand_written_lexer ? "hand written" : "flex";
+    GIVEN("the " + lexer + " lexer") {
+      Driver driver;
+      driver.hand_written_lexer = hand_written_lexer;
+      REQUIRE(driver.parse(file) == 0);
+      const SourceMap& map = driver.source_map;
+      Expression& root = *driver.result;
+      THEN("expressions and declarations start at their first token") {
+        REQUIRE(map.Describe(root.source_offset()) == file + ":1.1");
+        TreeNode& let_body = *root.Children().back();
+        REQUIRE(map.Describe(root.Children()[0]->source_offset()) ==
+                file + ":2.3");
+        REQUIRE(map.Describe(let_body.source_offset()) == file + ":4.3");
+        TreeNode& then = *let_body.Children()[1];
+        REQUIRE(map.Describe(then.source_offset()) == file + ":5.5");
+      }
+      THEN("binary expressions are at their operator") {
+        TreeNode& condition = *root.Children().back()->Children()[0];
+        REQUIRE(map.Describe(condition.source_offset()) == file + ":4.8");
+      }
+      THEN("errors start with the position") {
+        Expression::SetNameSpacesBelow(root);
+        Expression::SetTypesBelow(root);
+        auto errors = ListErrors(root, 1, &map);
+        REQUIRE(errors.size() == 1);
+        REQUIRE(errors[0] == file + ":4.8: Types of < should match, but " +
+                                 "got string and int");
+      }
+    }
+  }
+}
+
+} // namespace
@@ -0,0 +1,202 @@
+#pragma once
+#include "Expression.h"
+#include "syntax_nodes.h"
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Visitor of Expression nodes that dispatches on Expression::kind instead
+// of calling the virtual Accept and Visit methods, so that handlers and
+// the recursion into children inline into one switch. Derived classes
+// pass themselves as the template argument, as in the curiously recurring
+// template pattern, and define the Visit methods they need with the
+// signatures of ExpressionVisitor and LValueVisitor, but without
+// `virtual`. Value `false` stops traversal early, as for those visitors.
+//
+// Default implementations return true after visiting all child
+// Expressions, like those of ExpressionVisitor, except that VisitLValue
+// calls VisitId, VisitField, or VisitIndex, like LValue::Accept with an
+// LValueVisitor.
+template <class Derived> class StaticExpressionVisitor {
+public:
+  // Calls the Visit method of the derived class for the given node.
+  bool Visit(const Expression& e) {
+    using Kind = Expression::Kind;
+    Derived& visitor = static_cast<Derived&>(*this);
+    switch (e.kind()) {
+    case Kind::kStringConstant:
+      return static_cast<const StringConstant&>(e).Dispatch(visitor);
+    case Kind::kIntegerConstant:
+      return static_cast<const IntegerConstant&>(e).Dispatch(visitor);
+    case Kind::kNil:
+      return static_cast<const Nil&>(e).Dispatch(visitor);
+    case Kind::kIdLValue:
+    case Kind::kFieldLValue:
+    case Kind::kIndexLValue:
+      return visitor.VisitLValue(static_cast<const LValue&>(e));
+    case Kind::kNegated:
+      return static_cast<const Negated&>(e).Dispatch(visitor);
+    case Kind::kBinary:
+      return static_cast<const Binary&>(e).Dispatch(visitor);
+    case Kind::kAssignment:
+      return static_cast<const Assignment&>(e).Dispatch(visitor);
+    case Kind::kFunctionCall:
+      return static_cast<const FunctionCall&>(e).Dispatch(visitor);
+    case Kind::kBlock:
+      return static_cast<const Block&>(e).Dispatch(visitor);
+    case Kind::kRecord:
+      return static_cast<const Record&>(e).Dispatch(visitor);
+    case Kind::kArray:
+      return static_cast<const Array&>(e).Dispatch(visitor);
+    case Kind::kIfThen:
+      return static_cast<const IfThen&>(e).Dispatch(visitor);
+    case Kind::kIfThenElse:
+      return static_cast<const IfThenElse&>(e).Dispatch(visitor);
+    case Kind::kWhile:
+      return static_cast<const While&>(e).Dispatch(visitor);
+    case Kind::kFor:
+      return static_cast<const For&>(e).Dispatch(visitor);
+    case Kind::kBreak:
+      return static_cast<const Break&>(e).Dispatch(visitor);
+    case Kind::kLet:
+      return static_cast<const Let&>(e).Dispatch(visitor);
+    }
+    return true;
+  }
+
+  bool VisitStringConstant(const std::string& text) { return true; }
+  bool VisitIntegerConstant(int value) { return true; }
+  bool VisitNil() { return true; }
+  bool VisitLValue(const LValue& value) {
+    using Kind = Expression::Kind;
+    Derived& visitor = static_cast<Derived&>(*this);
+    switch (value.kind()) {
+    case Kind::kIdLValue:
+      return static_cast<const IdLValue&>(value).Dispatch(visitor);
+    case Kind::kFieldLValue:
+      return static_cast<const FieldLValue&>(value).Dispatch(visitor);
+    case Kind::kIndexLValue:
+      return static_cast<const IndexLValue&>(value).Dispatch(visitor);
+    default:
+      return true;
+    }
+  }
+  bool VisitNegated(const Expression& value) { return Child(value); }
+  bool VisitBinary(const Expression& left, BinaryOp op,
+                   const Expression& right) {
+    return Child(left) && Child(right);
+  }
+  bool VisitAssignment(const LValue& value, const Expression& expr) {
+    return Child(expr);
+  }
+  bool VisitFunctionCall(const std::string& id,
+                         const std::vector<std::shared_ptr<Expression>>& args,
+                         const Expression& exp) {
+    return Children(args);
+  }
+  bool VisitBlock(const std::vector<std::shared_ptr<Expression>>& exprs) {
+    return Children(exprs);
+  }
+  bool VisitRecord(const std::string& type_id,
+                   const std::vector<FieldValue>& field_values,
+                   const Expression& exp) {
+    return true;
+  }
+  bool VisitArray(const std::string& type_id, const Expression& size,
+                  const Expression& value) {
+    return Child(size) && Child(value);
+  }
+  bool VisitIfThen(const Expression& condition, const Expression& expr) {
+    return Child(condition) && Child(expr);
+  }
+  bool VisitIfThenElse(const Expression& condition,
+                       const Expression& then_expr,
+                       const Expression& else_expr) {
+    return Child(condition) && Child(then_expr) && Child(else_expr);
+  }
+  bool VisitWhile(const Expression& condition, const Expression& body) {
+    return Child(condition) && Child(body);
+  }
+  bool VisitFor(const std::string& id, const Expression& first,
+                const Expression& last, const Expression& body) {
+    return Child(first) && Child(last) && Child(body);
+  }
+  bool VisitBreak() { return true; }
+  bool VisitLet(const std::vector<std::shared_ptr<Declaration>>& declarations,
+                const std::vector<std::shared_ptr<Expression>>& body) {
+    return Children(body);
+  }
+  bool VisitId(const std::string& id) { return true; }
+  bool VisitField(const LValue& value, const std::string& id) {
+    return static_cast<Derived&>(*this).VisitLValue(value);
+  }
+  bool VisitIndex(const LValue& value, const Expression& expr) {
+    return static_cast<Derived&>(*this).VisitLValue(value);
+  }
+
+private:
+  bool Child(const Expression& e) { return Visit(e); }
+  bool Children(const std::vector<std::shared_ptr<Expression>>& exprs) {
+    return std::all_of(exprs.begin(), exprs.end(),
+                       [this](const auto& e) { return Visit(*e); });
+  }
+};
+
+// Static expression visitor which returns false from all Visit methods,
+// like StoppingExpressionVisitor. Derived classes handle one node at a
+// time, e.g. when called from a TreeWalker.
+template <class Derived>
+class StaticStoppingExpressionVisitor
+    : public StaticExpressionVisitor<Derived> {
+public:
+  bool VisitStringConstant(const std::string& text) { return false; }
+  bool VisitIntegerConstant(int value) { return false; }
+  bool VisitNil() { return false; }
+  bool VisitLValue(const LValue& value) { return false; }
+  bool VisitNegated(const Expression& value) { return false; }
+  bool VisitBinary(const Expression& left, BinaryOp op,
+                   const Expression& right) {
+    return false;
+  }
+  bool VisitAssignment(const LValue& value, const Expression& expr) {
+    return false;
+  }
+  bool VisitFunctionCall(const std::string& id,
+                         const std::vector<std::shared_ptr<Expression>>& args,
+                         const Expression& exp) {
+    return false;
+  }
+  bool VisitBlock(const std::vector<std::shared_ptr<Expression>>& exprs) {
+    return false;
+  }
+  bool VisitRecord(const std::string& type_id,
+                   const std::vector<FieldValue>& field_values,
+                   const Expression& exp) {
+    return false;
+  }
+  bool VisitArray(const std::string& type_id, const Expression& size,
+                  const Expression& value) {
+    return false;
+  }
+  bool VisitIfThen(const Expression& condition, const Expression& expr) {
+    return false;
+  }
+  bool VisitIfThenElse(const Expression& condition,
+                       const Expression& then_expr,
+                       const Expression& else_expr) {
+    return false;
+  }
+  bool VisitWhile(const Expression& condition, const Expression& body) {
+    return false;
+  }
+  bool VisitFor(const std::string& id, const Expression& first,
+                const Expression& last, const Expression& body) {
+    return false;
+  }
+  bool VisitBreak() { return false; }
+  bool VisitLet(const std::vector<std::shared_ptr<Declaration>>& declarations,
+                const std::vector<std::shared_ptr<Expression>>& body) {
+    return false;
+  }
+};
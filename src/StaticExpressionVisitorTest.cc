@@ -0,0 +1,97 @@
+#include "StaticExpressionVisitor.h"
+#include "testing/catch.h"
+#include "testing/testing.h"
+#include <string>
+#include <vector>
+
+namespace {
+using testing::Parse;
+
+// Records constants and calls, which both kinds of visitors reach.
+struct VirtualRecorder : ExpressionVisitor {
+  bool VisitStringConstant(const std::string& text) override {
+    visits.push_back("string " + text);
+    return true;
+  }
+  bool VisitIntegerConstant(int value) override {
+    visits.push_back("int " + std::to_string(value));
+    return true;
+  }
+  bool VisitFunctionCall(const std::string& id,
+                         const std::vector<std::shared_ptr<Expression>>& args,
+                         const Expression& exp) override {
+    visits.push_back("call " + id);
+    return ExpressionVisitor::VisitFunctionCall(id, args, exp);
+  }
+  std::vector<std::string> visits;
+};
+
+// Records like VirtualRecorder, and also L-values.
+struct StaticRecorder : StaticExpressionVisitor<StaticRecorder> {
+  bool VisitStringConstant(const std::string& text) {
+    visits.push_back("string " + text);
+    return true;
+  }
+  bool VisitIntegerConstant(int value) {
+    visits.push_back("int " + std::to_string(value));
+    return true;
+  }
+  bool VisitFunctionCall(const std::string& id,
+                         const std::vector<std::shared_ptr<Expression>>& args,
+                         const Expression& exp) {
+    visits.push_back("call " + id);
+    return StaticExpressionVisitor::VisitFunctionCall(id, args, exp);
+  }
+  bool VisitId(const std::string& id) {
+    visits.push_back("id " + id);
+    return true;
+  }
+  bool VisitField(const LValue& value, const std::string& id) {
+    visits.push_back("field " + id);
+    return StaticExpressionVisitor::VisitField(value, id);
+  }
+  std::vector<std::string> visits;
+};
+
+// Stops at the first negation.
+struct NegationFinder : StaticStoppingExpressionVisitor<NegationFinder> {
+  bool VisitNegated(const Expression& value) {
+    found = true;
+    return false;
+  }
+  bool found = false;
+};
+
+SCENARIO("Static visitors dispatch like virtual ones", "[visitor]") {
+  GIVEN("expressions of all kinds") {
+    for (const char* text :
+         {"\"s\"", "42", "nil", "-1", "1 + 2 * 3", "f(1, g(\"a\"))",
+          "(1; \"b\"; 3)", "R {a = 1}", "T [3] of 4", "if 1 then 2",
+          "if 1 then 2 else 3", "while 1 do f(2)", "for i := 1 to 2 do 3",
+          "break", "let var x := 5 in 6; 7 end", "x := 8", "x[9] := 10"}) {
+      auto e = Parse(text);
+      VirtualRecorder virtual_recorder;
+      e->Accept(virtual_recorder);
+      StaticRecorder static_recorder;
+      REQUIRE(static_recorder.Visit(*e));
+      REQUIRE(static_recorder.visits == virtual_recorder.visits);
+    }
+  }
+  GIVEN("an L-value") {
+    auto e = Parse("a.b[1].c");
+    StaticRecorder recorder;
+    recorder.Visit(*e);
+    REQUIRE(recorder.visits ==
+            std::vector<std::string>{"field c", "field b", "id a"});
+  }
+  GIVEN("a stopping visitor") {
+    NegationFinder finder;
+    THEN("it only handles the node visited") {
+      REQUIRE_FALSE(finder.Visit(*Parse("1 + -2")));
+      REQUIRE_FALSE(finder.found);
+      REQUIRE_FALSE(finder.Visit(*Parse("-(1 + 2)")));
+      REQUIRE(finder.found);
+    }
+  }
+}
+} // namespace
@@ -1,4 +1,5 @@
 #include "ToString.h"
+#include "TreeWalker.h"
 #include "util.h"
 
 std::ostream& operator<<(std::ostream& os, const TypeField& f) {
@@ -44,156 +45,165 @@ private:
   std::ostream& os_;
 };
 
-class AppendLValueVisitor : public LValueVisitor {
+// Prints trees in Tiger syntax without recursion. The walker drives the
+// traversal, and the visit methods print the part of one node that step_
+// selects: the text before its children, before the child with index
+// index_, or after its children. They return false to skip children.
+class Printer : public TreeWalker,
+                ExpressionVisitor,
+                LValueVisitor,
+                DeclarationVisitor {
 public:
-  AppendLValueVisitor(std::ostream& os, ExpressionVisitor& expression_visitor)
-      : os_(os), expression_visitor_(expression_visitor) {}
+  Printer(std::ostream& os) : os_(os) {}
 
-  bool VisitId(const std::string& id) override {
-    os_ << id;
-    return true;
+protected:
+  bool Enter(TreeNode& node) override { return Print(node, kBefore); }
+  bool EnterChild(TreeNode& node, size_t index) override {
+    return Print(node, kBeforeChild, index);
   }
-  bool VisitField(const LValue& value, const std::string& id) override {
-    if (!value.Accept(*this)) return false;
-    os_ << '.' << id;
+  void Leave(TreeNode& node) override { Print(node, kAfter); }
+
+private:
+  enum Step { kBefore, kBeforeChild, kAfter };
+
+  bool Print(TreeNode& node, Step step, size_t index = 0) {
+    step_ = step;
+    index_ = index;
+    if (auto e = node.expression(); e) {
+      return (*e)->Accept(static_cast<ExpressionVisitor&>(*this));
+    }
+    if (auto d = node.declaration(); d) {
+      return (*d)->Accept(static_cast<DeclarationVisitor&>(*this));
+    }
     return true;
   }
-  bool VisitIndex(const LValue& value, const Expression& expr) override {
-    if (!value.Accept(*this)) return false;
-    os_ << '[';
-    expr.Accept(expression_visitor_);
-    os_ << ']';
-    return true;
+  bool Before() const { return step_ == kBefore; }
+  bool BeforeChild(size_t index) const {
+    return step_ == kBeforeChild && index_ == index;
   }
+  // Returns true before all children but the first.
+  bool Between() const { return step_ == kBeforeChild && index_ > 0; }
+  bool After() const { return step_ == kAfter; }
 
-private:
-  std::ostream& os_;
-  ExpressionVisitor& expression_visitor_;
-};
-
-class AppendExpressionVisitor : public ExpressionVisitor {
-public:
-  AppendExpressionVisitor(std::ostream& os) : os_(os) {}
   bool VisitStringConstant(const std::string& text) override {
     // TODO escape characters that need escaping
-    os_ << '"' << text << '"';
+    if (Before()) os_ << '"' << text << '"';
     return true;
   }
   bool VisitIntegerConstant(int value) override {
-    os_ << value;
+    if (Before()) os_ << value;
     return true;
   }
   bool VisitNil() override {
-    os_ << "nil";
+    if (Before()) os_ << "nil";
     return true;
   }
   bool VisitLValue(const LValue& value) override {
-    AppendLValueVisitor l_value_visitor(os_, *this);
-    value.Accept(l_value_visitor);
-    return true;
+    return value.Accept(static_cast<LValueVisitor&>(*this));
   }
   bool VisitNegated(const Expression& value) override {
-    os_ << '-';
-    return value.Accept(*this);
+    if (Before()) os_ << '-';
+    return true;
   }
   bool VisitBinary(const Expression& left, BinaryOp op,
                    const Expression& right) override {
-    if (!left.Accept(*this)) return false;
-    os_ << op;
-    return right.Accept(*this);
+    if (BeforeChild(1)) os_ << op;
+    return true;
   }
   bool VisitAssignment(const LValue& value, const Expression& expr) override {
-    AppendLValueVisitor l_value_visitor(os_, *this);
-    value.Accept(l_value_visitor);
-    os_ << ":=";
-    return expr.Accept(*this);
+    if (BeforeChild(1)) os_ << ":=";
+    return true;
   }
   bool VisitFunctionCall(const std::string& id,
                          const std::vector<std::shared_ptr<Expression>>& args,
                          const Expression& exp) override {
-    os_ << id << "(";
-    Join(args, ", ");
-    os_ << ")";
-    return true;
+    return Join(id + "(", ", ", ")");
   }
   bool
   VisitBlock(const std::vector<std::shared_ptr<Expression>>& exprs) override {
-    os_ << "(";
-    Join(exprs, "; ");
-    os_ << ")";
-    return true;
+    return Join("(", "; ", ")");
   }
   bool VisitRecord(const std::string& type_id,
                    const std::vector<FieldValue>& field_values,
                    const Expression& exp) override {
-    os_ << "{" << (field_values | join(", ")) << "}";
+    Join("{", ", ", "}");
+    if (step_ == kBeforeChild) os_ << field_values[index_].id << ": ";
     return true;
   }
   bool VisitArray(const std::string& type_id, const Expression& size,
                   const Expression& value) override {
-    return size.Accept(*this) && value.Accept(*this);
+    return true;
   }
   bool VisitIfThen(const Expression& condition,
                    const Expression& expr) override {
-    return condition.Accept(*this) && expr.Accept(*this);
+    return true;
   }
   bool VisitIfThenElse(const Expression& condition, const Expression& then_expr,
                        const Expression& else_expr) override {
-    return condition.Accept(*this) && then_expr.Accept(*this) &&
-           else_expr.Accept(*this);
+    return true;
   }
   bool VisitWhile(const Expression& condition,
                   const Expression& body) override {
-    return condition.Accept(*this) && body.Accept(*this);
+    return true;
   }
   bool VisitFor(const std::string& id, const Expression& first,
                 const Expression& last, const Expression& body) override {
-    return first.Accept(*this) && last.Accept(*this) && body.Accept(*this);
+    return true;
   }
   bool VisitBreak() override { return true; }
+  // Prints only the body.
   bool VisitLet(const std::vector<std::shared_ptr<Declaration>>& declarations,
                 const std::vector<std::shared_ptr<Expression>>& body) override {
-    return std::all_of(body.begin(), body.end(),
-                       [this](const auto& arg) { return arg->Accept(*this); });
-  }
-  void Join(const std::vector<std::shared_ptr<Expression>>& expressions,
-            const char* join_text) {
-    const char* sep = "";
-    for (const auto& e : expressions) {
-      os_ << sep;
-      e->Accept(*this);
-      sep = join_text;
-    }
+    return step_ != kBeforeChild || index_ >= declarations.size();
   }
 
-private:
-  std::ostream& os_;
-};
+  bool VisitId(const std::string& id) override {
+    if (Before()) os_ << id;
+    return true;
+  }
+  bool VisitField(const LValue& value, const std::string& id) override {
+    if (After()) os_ << '.' << id;
+    return true;
+  }
+  bool VisitIndex(const LValue& value, const Expression& expr) override {
+    if (BeforeChild(1)) os_ << '[';
+    if (After()) os_ << ']';
+    return true;
+  }
 
-class AppendDeclarationVisitor : public DeclarationVisitor {
-public:
-  AppendDeclarationVisitor(std::ostream& os) : os_(os) {}
   bool VisitTypeDeclaration(const std::string& id, const Type& type) override {
-    os_ << "type " << id << " = " << type;
+    if (Before()) os_ << "type " << id << " = " << type;
     return true;
   }
   bool VisitVariableDeclaration(const std::string& id,
                                 const std::optional<std::string>& type_id,
                                 const Expression& expr) override {
-    os_ << "var " << id << (type_id ? ": " + *type_id : "") << " = " << expr;
+    if (Before()) {
+      os_ << "var " << id << (type_id ? ": " + *type_id : "") << " = ";
+    }
     return true;
   }
   bool VisitFunctionDeclaration(const std::string& id,
                                 const std::vector<TypeField>& params,
                                 const std::optional<std::string> type_id,
                                 const Expression& body) override {
-    os_ << "function " << id << (type_id ? ": " + *type_id : "") << " = "
-        << body;
+    if (Before()) {
+      os_ << "function " << id << (type_id ? ": " + *type_id : "") << " = ";
+    }
+    return true;
+  }
+
+  // Prints children between open and close text, separated by sep.
+  bool Join(const std::string& open, const char* sep, const char* close) {
+    if (Before()) os_ << open;
+    if (Between()) os_ << sep;
+    if (After()) os_ << close;
     return true;
   }
 
-private:
   std::ostream& os_;
+  Step step_ = kBefore;
+  size_t index_ = 0;
 };
 } // namespace
 
@@ -204,13 +214,11 @@ std::ostream& operator<<(std::ostream& os, const Type& t) {
 }
 
 std::ostream& operator<<(std::ostream& os, const Expression& e) {
-  AppendExpressionVisitor visitor(os);
-  e.Accept(visitor);
+  Printer(os).Walk(e);
   return os;
 }
 
 std::ostream& operator<<(std::ostream& os, const Declaration& d) {
-  AppendDeclarationVisitor visitor(os);
-  d.Accept(visitor);
+  Printer(os).Walk(d);
   return os;
 }
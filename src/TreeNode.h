@@ -1,14 +1,20 @@
 #pragma once
+#include "SourceMap.h"
+#include <cstddef>
+#include <cstdint>
 #include <optional>
 #include <vector>
 
 class Expression;
 class Declaration;
 class NameSpace;
+class Scopes;
 // Base class for abstract syntax tree, which is shared by Expression
 // and Declaration.
 class TreeNode {
 public:
+  virtual ~TreeNode() = default;
+
   virtual std::vector<TreeNode*> Children() const {
     static std::vector<TreeNode*> kNoChildren;
     return kNoChildren;
@@ -32,11 +38,20 @@ public:
   // Returns this, if a Declaration
   virtual std::optional<Declaration*> declaration() { return {}; }
 
-protected:
-  virtual void SetNameSpacesBelow(const NameSpace* types,
-                                  const NameSpace* non_types) {
-    if (auto n = GetTypeNameSpace(*types); n) types = *n;
-    if (auto n = GetNonTypeNameSpace(*non_types); n) non_types = *n;
-    for (auto c : Children()) c->SetNameSpacesBelow(types, non_types);
-  }
+  // Steps for binding uses of names to declarations in the given scopes,
+  // as taken by Expression::SetNameSpacesBelow. ResolveEnter binds names
+  // used by this node, and opens scopes for its children. ResolveChild
+  // opens scopes for the child with the given index only. ResolveLeave
+  // closes the scopes again.
+  virtual void ResolveEnter(Scopes& scopes) const {}
+  virtual void ResolveChild(Scopes& scopes, size_t index) const {}
+  virtual void ResolveLeave(Scopes& scopes) const {}
+
+  // Offset of the node in its source, or SourceMap::kNoOffset. See
+  // SourceMap for its line and column.
+  uint32_t source_offset() const { return source_offset_; }
+  void set_source_offset(uint32_t offset) { source_offset_ = offset; }
+
+private:
+  uint32_t source_offset_ = SourceMap::kNoOffset;
 };
@@ -0,0 +1,28 @@
+#include "TreeWalker.h"
+
+void TreeWalker::Walk(const TreeNode& root) {
+  TreeNode& node = const_cast<TreeNode&>(root);
+  if (!Enter(node)) return;
+  Push(node);
+  while (!path_.empty()) {
+    Frame& top = path_.back();
+    // Children of the top frame are the last ones in children_.
+    if (top.next_child == children_.size()) {
+      TreeNode& done = *top.node;
+      children_.resize(top.first_child);
+      path_.pop_back();
+      Leave(done);
+      continue;
+    }
+    size_t index = top.next_child - top.first_child;
+    TreeNode& parent = *top.node;
+    TreeNode& child = *children_[top.next_child++];
+    if (EnterChild(parent, index) && Enter(child)) Push(child);
+  }
+}
+
+void TreeWalker::Push(TreeNode& node) {
+  size_t first = children_.size();
+  for (TreeNode* child : node.Children()) children_.push_back(child);
+  path_.push_back({&node, first, first});
+}
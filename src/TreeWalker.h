@@ -0,0 +1,46 @@
+#pragma once
+#include "TreeNode.h"
+#include <cstddef>
+#include <vector>
+
+// Depth first walk over a tree of TreeNodes. Rather than recursing, Walk
+// keeps the path from the root and the children still to visit in vectors
+// on the heap, so that the depth of a tree is limited by memory and not by
+// the native stack. Machine generated programs easily nest a million
+// levels deep, e.g. as a long chain of binary operators.
+//
+// Subclasses implement whole-tree passes by overriding the hooks, and
+// often dispatch on the kind of node by visiting it.
+class TreeWalker {
+public:
+  virtual ~TreeWalker() = default;
+
+  // Calls the hooks for all nodes of the tree with the given root. Like
+  // TreeNode::Children, passes nodes as mutable.
+  void Walk(const TreeNode& root);
+
+protected:
+  // Called before the children of the given node. Returns false to skip
+  // them, and Leave.
+  virtual bool Enter(TreeNode& node) { return true; }
+
+  // Called before the child with the given index. Returns false to skip
+  // that child.
+  virtual bool EnterChild(TreeNode& node, size_t index) { return true; }
+
+  // Called after the children of the given node.
+  virtual void Leave(TreeNode& node) {}
+
+private:
+  struct Frame {
+    TreeNode* node;
+    size_t first_child; // Index in children_
+    size_t next_child;  // Index in children_
+  };
+
+  void Push(TreeNode& node);
+
+  std::vector<Frame> path_;
+  // Children of all nodes on the path, in order of the path.
+  std::vector<TreeNode*> children_;
+};
@@ -0,0 +1,118 @@
+#include "TreeWalker.h"
+#include "Checker.h"
+#include "DebugString.h"
+#include "ToString.h"
+#include "compiler.h"
+#include "syntax_nodes.h"
+#include "testing/catch.h"
+#include "testing/testing.h"
+#include <pthread.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+using testing::Parse;
+
+// Records calls of the hooks, and skips children of negations.
+struct RecordingWalker : TreeWalker {
+  bool Enter(TreeNode& node) override {
+    calls.push_back("enter " + ToString(**node.expression()));
+    return calls.back() != "enter -2";
+  }
+  bool EnterChild(TreeNode& node, size_t index) override {
+    calls.push_back("child " + std::to_string(index));
+    return true;
+  }
+  void Leave(TreeNode& node) override {
+    calls.push_back("leave " + ToString(**node.expression()));
+  }
+  std::vector<std::string> calls;
+};
+
+SCENARIO("TreeWalker calls hooks in order", "[TreeWalker]") {
+  GIVEN("a binary expression") {
+    auto e = Parse("1+-2");
+    RecordingWalker walker;
+    walker.Walk(*e);
+    REQUIRE(walker.calls ==
+            std::vector<std::string>{"enter 1+-2", "child 0", "enter 1",
+                                     "leave 1", "child 1", "enter -2",
+                                     "leave 1+-2"});
+  }
+}
+
+// Results of compiling a program on a thread with a small stack.
+struct Compiled {
+  const std::string* text;
+  size_t errors = 0;
+  std::string type;
+  size_t to_string_size = 0;
+  std::string debug_string_start;
+  // Of the whole pipeline, to a class file and to bytecode, which runs.
+  std::vector<std::string> class_diagnostics;
+  std::vector<std::string> bytecode_diagnostics;
+  int status = -1;
+  std::string output;
+  bool done = false;
+};
+
+void* Compile(void* arg) {
+  Compiled& compiled = *static_cast<Compiled*>(arg);
+  {
+    std::shared_ptr<Expression> e = Parse(*compiled.text);
+    Expression::SetNameSpacesBelow(*e);
+    Expression::SetTypesBelow(*e);
+    compiled.errors = ListErrors(*e).size();
+    compiled.type = e->GetType();
+    compiled.to_string_size = ToString(*e).size();
+    compiled.debug_string_start = DebugString(*e).substr(0, 63);
+    compiled.class_diagnostics = ::Compile(*e).diagnostics;
+    CompiledBytecode bytecode = CompileToBytecode(*e);
+    compiled.bytecode_diagnostics = std::move(bytecode.diagnostics);
+    std::istringstream in;
+    std::ostringstream out;
+    compiled.status = vm::Run(bytecode.program, in, out, out);
+    compiled.output = out.str();
+  }
+  compiled.done = true;
+  return nullptr;
+}
+
+SCENARIO("Whole-tree passes do not recurse", "[TreeWalker]") {
+  GIVEN("an expression nested a million levels deep") {
+    // Half a million right nested conditionals, ending in a left leaning
+    // chain of half a million additions.
+    const size_t n = 500000;
+    std::string text = "let var x := 1 in ";
+    for (size_t i = 0; i < n; ++i) text += "if x then x else ";
+    text += "x";
+    for (size_t i = 1; i < n; ++i) text += "+x";
+    text += " end";
+    THEN("it compiles and runs on a stack of one megabyte") {
+      Compiled compiled;
+      compiled.text = &text;
+      pthread_attr_t attributes;
+      pthread_attr_init(&attributes);
+      pthread_attr_setstacksize(&attributes, 1 << 20);
+      pthread_t thread;
+      REQUIRE(pthread_create(&thread, &attributes, Compile, &compiled) == 0);
+      pthread_join(thread, nullptr);
+      pthread_attr_destroy(&attributes);
+      REQUIRE(compiled.done);
+      REQUIRE(compiled.errors == 0);
+      REQUIRE(compiled.type == "int");
+      REQUIRE(compiled.to_string_size == 4 * n - 1);
+      REQUIRE(compiled.debug_string_start ==
+              "Let{declarations: [var x = 1] expr: IfThen{condition: Id{id: "
+              "x}");
+      // The JVM limits methods to 64 kilobytes of code.
+      REQUIRE(compiled.class_diagnostics ==
+              std::vector<std::string>{"Main program too large"});
+      REQUIRE(compiled.bytecode_diagnostics.empty());
+      REQUIRE(compiled.status == 0);
+      REQUIRE(compiled.output.empty());
+    }
+  }
+}
+} // namespace
@@ -0,0 +1,56 @@
+#include "WorkStealing.h"
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+namespace {
+// Indices of tasks not started yet.
+struct TaskDeque {
+  std::optional<size_t> PopFront() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (tasks.empty()) return {};
+    size_t task = tasks.front();
+    tasks.pop_front();
+    return task;
+  }
+  std::optional<size_t> PopBack() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (tasks.empty()) return {};
+    size_t task = tasks.back();
+    tasks.pop_back();
+    return task;
+  }
+
+  std::mutex mutex;
+  std::deque<size_t> tasks;
+};
+} // namespace
+
+void RunWorkStealing(const std::vector<std::function<void()>>& tasks,
+                     int threads) {
+  if (threads > int(tasks.size())) threads = tasks.size();
+  if (threads <= 1) {
+    for (const auto& task : tasks) task();
+    return;
+  }
+  std::vector<TaskDeque> deques(threads);
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    deques[i * threads / tasks.size()].tasks.push_back(i);
+  }
+  // Tasks add no tasks, so a thread is done once all deques are empty.
+  auto work = [&](int self) {
+    for (;;) {
+      std::optional<size_t> task = deques[self].PopFront();
+      for (int k = 1; !task && k < threads; ++k) {
+        task = deques[(self + k) % threads].PopBack();
+      }
+      if (!task) return;
+      tasks[*task]();
+    }
+  };
+  std::vector<std::thread> workers;
+  for (int t = 1; t < threads; ++t) workers.emplace_back(work, t);
+  work(0);
+  for (auto& worker : workers) worker.join();
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include <functional>
+#include <vector>
+
+// Runs independent tasks on the given number of threads, the calling thread
+// included, and returns when all are done. Tasks start out split in order
+// and evenly between one deque per thread. Each thread runs tasks from the
+// front of its own deque, and once that is empty steals from the back of
+// the others, so that a few large tasks do not leave threads idle.
+void RunWorkStealing(const std::vector<std::function<void()>>& tasks,
+                     int threads);
@@ -0,0 +1,77 @@
+#include "WorkStealing.h"
+#include "Checker.h"
+#include "ToString.h"
+#include "syntax_nodes.h"
+#include "testing/catch.h"
+#include "testing/generator.h"
+#include "testing/testing.h"
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace {
+using testing::Parse;
+
+SCENARIO("RunWorkStealing runs each task once", "[WorkStealing]") {
+  GIVEN("more tasks than threads, of uneven sizes") {
+    const size_t n = 1000;
+    std::vector<std::atomic<int>> runs(n);
+    std::vector<std::function<void()>> tasks;
+    for (size_t i = 0; i < n; ++i) {
+      tasks.push_back([&runs, i] {
+        std::atomic<size_t> spin = 0;
+        for (size_t k = 0; k < (i % 7 == 0 ? 10000 : 10); ++k) ++spin;
+        runs[i] += spin > 0;
+      });
+    }
+    for (int threads : {1, 2, 4, 16}) {
+      for (auto& r : runs) r = 0;
+      RunWorkStealing(tasks, threads);
+      size_t once = 0;
+      for (auto& r : runs) once += r == 1;
+      REQUIRE(once == n);
+    }
+  }
+  GIVEN("no tasks") {
+    RunWorkStealing({}, 4);
+  }
+}
+
+// Types and checks the given program on the given number of threads and
+// returns its ToString with types, followed by its errors.
+std::vector<std::string> Compile(const std::string& text, int threads) {
+  std::shared_ptr<Expression> e = Parse(text);
+  Expression::SetNameSpacesBelow(*e);
+  Expression::SetTypesBelow(*e, threads);
+  std::vector<std::string> result = {ToString(*e), e->GetType()};
+  for (const std::string& error : ListErrors(*e, threads)) {
+    result.push_back(error);
+  }
+  return result;
+}
+
+SCENARIO("Parallel passes agree with serial ones", "[WorkStealing]") {
+  GIVEN("many well typed functions") {
+    std::string text = testing::ManyFunctions(200);
+    std::vector<std::string> serial = Compile(text, 1);
+    REQUIRE(serial.size() == 2);
+    REQUIRE(serial[1] == "unset");
+    REQUIRE(Compile(text, 4) == serial);
+  }
+  GIVEN("errors inside and outside of many functions") {
+    std::string text = "let ";
+    for (int i = 0; i < 50; ++i) {
+      const char* bodies[] = {"if \"s\" then x else 1", "x + 1",
+                              "if x < \"t\" then x else 1"};
+      text += "function f" + std::to_string(i) + "(x: int): int = " +
+              bodies[i % 3] + " var v" + std::to_string(i) + " := " +
+              (i % 5 ? "1 " : "1 & \"u\" ");
+    }
+    text += "in if \"s\" then f1(1) else 1 end";
+    std::vector<std::string> serial = Compile(text, 1);
+    // Mismatched comparisons are also not int conditions.
+    REQUIRE(serial.size() == 2 + 17 + 2 * 16 + 10 + 1);
+    for (int threads : {2, 4, 8}) REQUIRE(Compile(text, threads) == serial);
+  }
+}
+} // namespace
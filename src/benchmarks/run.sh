@@ -0,0 +1,140 @@
+#!/bin/bash
+# Runtime benchmarks for code generated by tc. Compiles every *.tig file in
+# this directory, checks its output against NAME.expected, then runs it in a
+# fresh JVM after warm-up runs and records the median wall time, the size of
+# Main.class and the JVM uptime when Main was loaded. Results are compared
+# with baseline.tsv; the script exits with status 1 on wrong output or when
+# a benchmark got slower or bigger than the threshold allows. A baseline
+# wall time of - is not compared. Without java in PATH, it checks the output
+# of tc --run instead, and compares only the sizes of the classes.
+#
+# Usage: run.sh [--tc=PATH] [--runs=N] [--warmup=N] [--threshold=PERCENT]
+#               [--baseline=FILE] [--update-baseline] [NAME...]
+
+set -u
+here=$(cd "$(dirname "$0")" && pwd)
+tc=./tc
+runs=5
+warmup=2
+threshold=10
+baseline=$here/baseline.tsv
+update=0
+names=()
+for arg in "$@"; do
+  case $arg in
+    --tc=*) tc=${arg#*=} ;;
+    --runs=*) runs=${arg#*=} ;;
+    --warmup=*) warmup=${arg#*=} ;;
+    --threshold=*) threshold=${arg#*=} ;;
+    --baseline=*) baseline=${arg#*=} ;;
+    --update-baseline) update=1 ;;
+    -*) sed -n '2,14s/^# \{0,1\}//p' "$0"; exit 2 ;;
+    *) names+=("$arg") ;;
+  esac
+done
+if [ ${#names[@]} -eq 0 ]; then
+  for f in "$here"/*.tig; do names+=("$(basename "$f" .tig)"); done
+fi
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+cp "$here/../Std.class" "$work/"
+results=$work/results.tsv
+
+now_ns() { date +%s%N; }
+
+# Prints the median of the numbers on stdin.
+median() { sort -n | awk '{v[NR] = $1} END {print v[int((NR + 1) / 2)]}'; }
+
+# Prints how the given benchmark, wall time (or -) and class size compare
+# with the baseline: ok, no baseline, or the regressions.
+compare() {
+  local base base_ms base_bytes
+  if ! base=$(awk -v n="$1" '$1 == n' "$baseline" 2> /dev/null | grep .); then
+    echo "no baseline"
+    return
+  fi
+  read -r _ base_ms base_bytes <<< "$base"
+  awk -v t="$threshold" -v ms="$2" -v bms="$base_ms" -v b="$3" \
+    -v bb="$base_bytes" 'BEGIN {
+      s = ""
+      if (ms != "-" && bms != "-" && ms > bms * (1 + t / 100))
+        s = s sprintf("SLOWER %+.0f%% ", 100 * (ms / bms - 1))
+      if (b > bb * (1 + t / 100))
+        s = s sprintf("BIGGER %+.0f%% ", 100 * (b / bb - 1))
+      print s == "" ? "ok" : s }'
+}
+
+java=1
+if ! command -v java > /dev/null; then
+  java=0
+  echo "no java in PATH: checking output with tc --run, and class sizes only"
+fi
+
+failed=0
+printf '%-12s %10s %10s %12s  %s\n' name wall_ms class_bytes class_load_ms \
+  status
+for name in "${names[@]}"; do
+  dir=$work/$name
+  mkdir -p "$dir"
+  if ! "$tc" --class="$dir/Main.class" "$here/$name.tig" > "$dir/tc.log" \
+    2>&1; then
+    printf '%-12s %10s %10s %12s  %s\n' "$name" - - - "COMPILE FAILED"
+    failed=1
+    continue
+  fi
+  class_bytes=$(wc -c < "$dir/Main.class")
+  if [ $java -eq 0 ]; then
+    if [ "$("$tc" --run "$here/$name.tig" 2> "$dir/stderr")" != \
+      "$(cat "$here/$name.expected")" ]; then
+      status="WRONG OUTPUT"
+    else
+      status=$(compare "$name" - "$class_bytes")
+      # Keeps wall times measured before, for --update-baseline.
+      base_ms=$(awk -v n="$name" '$1 == n {print $2}' "$baseline" 2> /dev/null)
+      printf '%s\t%s\t%s\n' "$name" "${base_ms:--}" "$class_bytes" \
+        >> "$results"
+    fi
+    [ "$status" = ok ] || [ "$status" = "no baseline" ] || failed=1
+    printf '%-12s %10s %10s %12s  %s\n' "$name" - "$class_bytes" - "$status"
+    continue
+  fi
+  run() { java -cp "$dir:$work" "$@" Main; }
+
+  output=$(run -Xlog:class+load=info:file="$dir/load.log":uptimenanos \
+    2> "$dir/stderr")
+  if [ "$output" != "$(cat "$here/$name.expected")" ]; then
+    printf '%-12s %10s %10s %12s  %s\n' "$name" - "$class_bytes" - \
+      "WRONG OUTPUT"
+    failed=1
+    continue
+  fi
+  class_load_ms=$(awk '/ Main source:/ {
+    gsub(/[^0-9]/, "", $1); printf "%.1f", $1 / 1e6; exit }' "$dir/load.log")
+
+  for ((i = 0; i < warmup; ++i)); do run > /dev/null; done
+  for ((i = 0; i < runs; ++i)); do
+    start=$(now_ns)
+    run > /dev/null
+    echo $(( ($(now_ns) - start) / 1000 ))
+  done > "$dir/times"
+  wall_ms=$(median < "$dir/times" | awk '{printf "%.1f", $1 / 1000}')
+  printf '%s\t%s\t%s\n' "$name" "$wall_ms" "$class_bytes" >> "$results"
+
+  status=$(compare "$name" "$wall_ms" "$class_bytes")
+  [ "$status" = ok ] || [ "$status" = "no baseline" ] || failed=1
+  printf '%-12s %10s %10s %12s  %s\n' "$name" "$wall_ms" "$class_bytes" \
+    "$class_load_ms" "$status"
+done
+
+if [ $update -eq 1 ] && [ -f "$results" ]; then
+  # Keep comments and entries of benchmarks that did not run.
+  touch "$baseline"
+  { grep '^#' "$baseline"
+    awk 'NR == FNR { ran[$1] = 1; next } !/^#/ && !($1 in ran)' \
+      "$results" "$baseline"
+    cat "$results"; } > "$work/baseline.new"
+  cp "$work/baseline.new" "$baseline"
+  echo "updated $baseline"
+fi
+exit $failed
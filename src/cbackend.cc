@@ -0,0 +1,581 @@
+#include "cbackend.h"
+#include "BuiltIns.h"
+#include <cstdint>
+#include <sstream>
+#include <vector>
+
+namespace ir {
+namespace {
+
+// The functions of Std.java, and helpers for what the JVM checks, inline so
+// that compilers drop those that programs do not use.
+const char kRuntime[] = R"c(#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct {
+  int32_t length;
+  const uint16_t* chars;
+} TigerString;
+
+typedef struct {
+  int32_t length;
+  int32_t* elements;
+} TigerInts;
+
+typedef struct {
+  int32_t length;
+  TigerString** elements;
+} TigerStrings;
+
+/* A field of a record, which holds an int or a reference. */
+typedef union {
+  int32_t i;
+  void* p;
+} TigerWord;
+
+typedef struct {
+  int32_t length;
+  TigerWord fields[];
+} TigerRecord;
+
+/* Ends the program like an uncaught exception of the given class. */
+static inline void tiger_throw(const char* exception, const char* message) {
+  fflush(stdout);
+  fprintf(stderr, "Exception in thread \"main\" java.lang.%s%s%s\n",
+          exception, message ? ": " : "", message ? message : "");
+  exit(1);
+}
+
+static inline void* tiger_alloc(size_t size) {
+  void* p = calloc(1, size ? size : 1);
+  if (!p) tiger_throw("OutOfMemoryError", NULL);
+  return p;
+}
+
+/* Returns the int with the given bits, without overflow. */
+static inline int32_t tiger_int(uint32_t bits) {
+  return bits <= INT32_MAX ? (int32_t)bits : -(int32_t)~bits - 1;
+}
+
+static inline int32_t tiger_neg(int32_t a) {
+  return tiger_int(0u - (uint32_t)a);
+}
+static inline int32_t tiger_add(int32_t a, int32_t b) {
+  return tiger_int((uint32_t)a + (uint32_t)b);
+}
+static inline int32_t tiger_sub(int32_t a, int32_t b) {
+  return tiger_int((uint32_t)a - (uint32_t)b);
+}
+static inline int32_t tiger_mul(int32_t a, int32_t b) {
+  return tiger_int((uint32_t)a * (uint32_t)b);
+}
+static inline int32_t tiger_div(int32_t a, int32_t b) {
+  if (b == 0) tiger_throw("ArithmeticException", "/ by zero");
+  if (b == -1) return tiger_neg(a);
+  return a / b;
+}
+static inline int32_t tiger_shl(int32_t a, int32_t b) {
+  return tiger_int((uint32_t)a << (b & 31));
+}
+static inline int32_t tiger_shr(int32_t a, int32_t b) {
+  return a < 0 ? ~(~a >> (b & 31)) : a >> (b & 31);
+}
+static inline int32_t tiger_ushr(int32_t a, int32_t b) {
+  return tiger_int((uint32_t)a >> (b & 31));
+}
+
+static inline TigerString* tiger_new_string(int32_t length, uint16_t** chars) {
+  TigerString* s =
+      tiger_alloc(sizeof(TigerString) + (size_t)length * sizeof(uint16_t));
+  s->length = length;
+  s->chars = *chars = (uint16_t*)(s + 1);
+  return s;
+}
+
+/* Like String.compareTo. */
+static inline int32_t tiger_compare(const TigerString* s,
+                                    const TigerString* t) {
+  int32_t n = s->length < t->length ? s->length : t->length;
+  for (int32_t i = 0; i < n; ++i) {
+    if (s->chars[i] != t->chars[i]) return s->chars[i] - t->chars[i];
+  }
+  return s->length - t->length;
+}
+
+static inline void tiger_print(const TigerString* s) {
+  for (int32_t i = 0; i < s->length; ++i) {
+    uint32_t c = s->chars[i];
+    if (c >= 0xd800 && c < 0xdc00 && i + 1 < s->length &&
+        s->chars[i + 1] >= 0xdc00 && s->chars[i + 1] < 0xe000) {
+      c = 0x10000 + ((c - 0xd800) << 10) + (s->chars[++i] - 0xdc00);
+    } else if (c >= 0xd800 && c < 0xe000) {
+      c = '?';
+    }
+    if (c < 0x80) {
+      putchar((int)c);
+    } else if (c < 0x800) {
+      putchar((int)(0xc0 | c >> 6));
+      putchar((int)(0x80 | (c & 0x3f)));
+    } else if (c < 0x10000) {
+      putchar((int)(0xe0 | c >> 12));
+      putchar((int)(0x80 | (c >> 6 & 0x3f)));
+      putchar((int)(0x80 | (c & 0x3f)));
+    } else {
+      putchar((int)(0xf0 | c >> 18));
+      putchar((int)(0x80 | (c >> 12 & 0x3f)));
+      putchar((int)(0x80 | (c >> 6 & 0x3f)));
+      putchar((int)(0x80 | (c & 0x3f)));
+    }
+  }
+}
+
+static inline void tiger_printi(int32_t i) { printf("%" PRId32, i); }
+
+static inline void tiger_flush(void) { fflush(stdout); }
+
+static inline TigerString* tiger_chr(int32_t i) {
+  uint16_t* chars;
+  TigerString* s = tiger_new_string(1, &chars);
+  chars[0] = (uint16_t)i;
+  return s;
+}
+
+static inline TigerString* tiger_getchar(void) {
+  static TigerString empty = {0, NULL};
+  int c = getchar();
+  return c == EOF ? &empty : tiger_chr(c);
+}
+
+static inline int32_t tiger_ord(const TigerString* s) {
+  return s->length > 0 ? s->chars[0] : -1;
+}
+
+static inline int32_t tiger_size(const TigerString* s) { return s->length; }
+
+static inline TigerString* tiger_substring(const TigerString* s, int32_t f,
+                                           int32_t n) {
+  int32_t end = tiger_add(f, n);
+  if (f < 0 || end > s->length || f > end) {
+    char message[80];
+    snprintf(message, sizeof message,
+             "begin %" PRId32 ", end %" PRId32 ", length %" PRId32, f, end,
+             s->length);
+    tiger_throw("StringIndexOutOfBoundsException", message);
+  }
+  uint16_t* chars;
+  TigerString* t = tiger_new_string(n, &chars);
+  for (int32_t i = 0; i < n; ++i) chars[i] = s->chars[f + i];
+  return t;
+}
+
+static inline TigerString* tiger_concat(const TigerString* s,
+                                        const TigerString* t) {
+  uint16_t* chars;
+  TigerString* u = tiger_new_string(s->length + t->length, &chars);
+  for (int32_t i = 0; i < s->length; ++i) chars[i] = s->chars[i];
+  for (int32_t i = 0; i < t->length; ++i) chars[s->length + i] = t->chars[i];
+  return u;
+}
+
+static inline int32_t tiger_not(int32_t i) { return i == 0; }
+
+static inline void tiger_exit(int32_t i) {
+  fflush(stdout);
+  exit(i);
+}
+
+static inline void tiger_check_length(int32_t length) {
+  if (length < 0) {
+    char message[16];
+    snprintf(message, sizeof message, "%" PRId32, length);
+    tiger_throw("NegativeArraySizeException", message);
+  }
+}
+
+static inline void tiger_check_index(const void* array, int32_t length,
+                                     int32_t index) {
+  if (!array) tiger_throw("NullPointerException", NULL);
+  if (index < 0 || index >= length) {
+    char message[80];
+    snprintf(message, sizeof message,
+             "Index %" PRId32 " out of bounds for length %" PRId32, index,
+             length);
+    tiger_throw("ArrayIndexOutOfBoundsException", message);
+  }
+}
+
+static inline TigerInts* tiger_new_ints(int32_t length, int32_t value) {
+  tiger_check_length(length);
+  TigerInts* a = tiger_alloc(sizeof(TigerInts));
+  a->length = length;
+  a->elements = tiger_alloc((size_t)length * sizeof(int32_t));
+  for (int32_t i = 0; i < length; ++i) a->elements[i] = value;
+  return a;
+}
+
+static inline int32_t* tiger_int_at(TigerInts* a, int32_t i) {
+  tiger_check_index(a, a ? a->length : 0, i);
+  return &a->elements[i];
+}
+
+static inline int32_t tiger_ints_length(const TigerInts* a) {
+  if (!a) tiger_throw("NullPointerException", NULL);
+  return a->length;
+}
+
+static inline TigerStrings* tiger_new_strings(int32_t length,
+                                              TigerString* value) {
+  tiger_check_length(length);
+  TigerStrings* a = tiger_alloc(sizeof(TigerStrings));
+  a->length = length;
+  a->elements = tiger_alloc((size_t)length * sizeof(TigerString*));
+  for (int32_t i = 0; i < length; ++i) a->elements[i] = value;
+  return a;
+}
+
+static inline TigerString** tiger_string_at(TigerStrings* a, int32_t i) {
+  tiger_check_index(a, a ? a->length : 0, i);
+  return &a->elements[i];
+}
+
+static inline int32_t tiger_strings_length(const TigerStrings* a) {
+  if (!a) tiger_throw("NullPointerException", NULL);
+  return a->length;
+}
+
+static inline TigerRecord* tiger_new_record(int32_t length) {
+  TigerRecord* r =
+      tiger_alloc(sizeof(TigerRecord) + (size_t)length * sizeof(TigerWord));
+  r->length = length;
+  return r;
+}
+
+static inline TigerWord* tiger_field(TigerRecord* r, int32_t i) {
+  if (!r) tiger_throw("NullPointerException", NULL);
+  return &r->fields[i];
+}
+)c";
+
+// Writes an int literal, which in C has no negative form.
+std::string Int(int32_t value) {
+  if (value == INT32_MIN) return "(-2147483647 - 1)";
+  return std::to_string(value);
+}
+
+const char* CType(Type type) {
+  switch (type) {
+  case Type::kInt:
+    return "int32_t";
+  case Type::kString:
+    return "TigerString*";
+  case Type::kIntArray:
+    return "TigerInts*";
+  case Type::kStringArray:
+    return "TigerStrings*";
+  default:
+    return "TigerRecord*";
+  }
+}
+
+// Returns the member of TigerWord for values of the given type.
+const char* Member(Type type) { return type == Type::kInt ? "i" : "p"; }
+
+const char* Operator(Cmp cmp) {
+  switch (cmp) {
+  case Cmp::kEq:
+    return "==";
+  case Cmp::kNe:
+    return "!=";
+  case Cmp::kLt:
+    return "<";
+  case Cmp::kGe:
+    return ">=";
+  case Cmp::kGt:
+    return ">";
+  default:
+    return "<=";
+  }
+}
+
+// Returns the blocks that the code of the given terminator goes to, rather
+// than falls through to the given next block.
+std::vector<BlockId> Gotos(const Terminator& t, BlockId next) {
+  switch (t.kind) {
+  case Terminator::kJump:
+    if (t.targets[0] != next) return t.targets;
+    return {};
+  case Terminator::kBranch:
+    if (t.targets[0] == next) return {t.targets[1]};
+    if (t.targets[1] == next) return {t.targets[0]};
+    return t.targets;
+  case Terminator::kSwitch:
+    return t.targets;
+  default:
+    return {};
+  }
+}
+
+class CEmitter {
+public:
+  explicit CEmitter(const Module& module) : module_(module) {}
+
+  std::string Emit() {
+    os_ << kRuntime;
+    if (module_.functions.size() > 1) os_ << "\n";
+    for (size_t k = 1; k < module_.functions.size(); ++k) {
+      os_ << Signature(k) << ";\n";
+    }
+    for (size_t k = 0; k < module_.functions.size(); ++k) EmitFunction(k);
+    return os_.str();
+  }
+
+private:
+  // Returns the C declaration of the function with the given index, or of
+  // main for 0.
+  std::string Signature(size_t k) const {
+    if (k == 0) return "int main(void)";
+    const ir::Function& f = module_.functions[k];
+    std::string signature = "static ";
+    signature += f.result ? CType(*f.result) : "void";
+    signature += " " + FunctionName(k) + "(";
+    for (Reg r = 0; r < f.param_count; ++r) {
+      signature += (r ? ", " : "") + std::string(CType(f.registers[r])) +
+                   " " + Name(f, r);
+    }
+    return signature + (f.param_count ? ")" : "void)");
+  }
+
+  // Returns the name of the function with the given index, which has it
+  // even if other scopes declare functions of the same Tiger name.
+  std::string FunctionName(size_t k) const {
+    return "tiger_f" + std::to_string(k) + "_" + module_.functions[k].name;
+  }
+
+  // Writes the function with the given index, with its string constants.
+  void EmitFunction(size_t k) {
+    f_ = &module_.functions[k];
+    k_ = k;
+    std::vector<bool> used(f_->registers.size());
+    std::vector<bool> strings(f_->strings.size());
+    std::vector<bool> targeted(f_->blocks.size());
+    for (BlockId b = 0; b < f_->blocks.size(); ++b) {
+      const Block& block = f_->blocks[b];
+      for (const Instruction& i : block.instructions) {
+        if (i.dest != kNoReg) used[i.dest] = true;
+        for (Reg r : i.operands) used[r] = true;
+        if (i.op == Op::kString) strings[i.imm] = true;
+      }
+      for (Reg r : block.terminator.operands) used[r] = true;
+      for (BlockId target : Gotos(block.terminator, b + 1)) {
+        targeted[target] = true;
+      }
+    }
+    for (size_t s = 0; s < f_->strings.size(); ++s) {
+      if (strings[s]) String(s);
+    }
+    os_ << "\n" << Signature(k) << " {\n";
+    for (Reg r = f_->param_count; r < f_->registers.size(); ++r) {
+      if (!used[r]) continue;
+      os_ << "  " << CType(f_->registers[r]) << " " << Name(r) << " = "
+          << (f_->registers[r] == Type::kInt ? "0" : "NULL") << ";\n";
+    }
+    for (BlockId b = 0; b < f_->blocks.size(); ++b) {
+      if (targeted[b]) os_ << "b" << b << ":;\n";
+      for (const Instruction& i : f_->blocks[b].instructions) Emit(i);
+      Emit(f_->blocks[b].terminator, b + 1);
+    }
+    os_ << "}\n";
+  }
+
+  // Writes a string constant, which is one object, as in the JVM, so that
+  // comparisons by identity agree.
+  void String(size_t k) {
+    std::vector<uint16_t> units = Utf16(f_->strings[k]);
+    os_ << "\nstatic const uint16_t tiger_chars" << k_ << "_" << k << "[] = {";
+    for (size_t u = 0; u < units.size(); ++u) {
+      os_ << (u ? ", " : "") << units[u];
+    }
+    if (units.empty()) os_ << "0";
+    os_ << "};\nstatic TigerString " << StringName(k) << " = {"
+        << units.size() << ", tiger_chars" << k_ << "_" << k << "};\n";
+  }
+
+  // Returns the name of the string constant with the given index in the
+  // function being written.
+  std::string StringName(size_t k) const {
+    return "tiger_string" + std::to_string(k_) + "_" + std::to_string(k);
+  }
+
+  static std::string Name(const ir::Function& f, Reg r) {
+    std::string name = "r" + std::to_string(r);
+    if (r < f.register_names.size() && !f.register_names[r].empty()) {
+      name += "_" + f.register_names[r];
+    }
+    return name;
+  }
+
+  std::string Name(Reg r) const { return Name(*f_, r); }
+
+  // Returns the names of the given registers, separated by commas.
+  std::string List(const std::vector<Reg>& operands) const {
+    std::string list;
+    for (Reg r : operands) list += (list.empty() ? "" : ", ") + Name(r);
+    return list;
+  }
+
+  // Returns whether the array an instruction makes or reads is of ints.
+  bool IntArray(const Instruction& i) const {
+    switch (i.op) {
+    case Op::kNewArray:
+      return f_->registers[i.dest] == Type::kIntArray;
+    case Op::kLoadElement:
+    case Op::kStoreElement:
+    case Op::kLength:
+      return f_->registers[i.operands[0]] == Type::kIntArray;
+    default:
+      return false;
+    }
+  }
+
+  void Emit(const Instruction& i) {
+    if (i.op == Op::kNewRecord) {
+      // Fills the record before it replaces the destination, which may hold
+      // one of its fields.
+      os_ << "  {\n    TigerRecord* record = tiger_new_record("
+          << i.operands.size() << ");\n";
+      for (size_t k = 0; k < i.operands.size(); ++k) {
+        os_ << "    record->fields[" << k << "]."
+            << Member(f_->registers[i.operands[k]]) << " = "
+            << Name(i.operands[k]) << ";\n";
+      }
+      os_ << "    " << Name(i.dest) << " = record;\n  }\n";
+      return;
+    }
+    os_ << "  ";
+    if (i.dest != kNoReg && i.op != Op::kStoreElement) {
+      os_ << Name(i.dest) << " = ";
+    }
+    bool ints = IntArray(i);
+    switch (i.op) {
+    case Op::kConst:
+      os_ << Int(i.imm);
+      break;
+    case Op::kString:
+      os_ << "&" << StringName(i.imm);
+      break;
+    case Op::kNil:
+      os_ << "NULL";
+      break;
+    case Op::kMove:
+      os_ << Name(i.operands[0]);
+      break;
+    case Op::kIncrement:
+      os_ << "tiger_add(" << Name(i.dest) << ", " << Int(i.imm) << ")";
+      break;
+    case Op::kCall:
+      os_ << "tiger_" << f_->strings[i.imm] << "(" << List(i.operands) << ")";
+      break;
+    case Op::kNewArray:
+      os_ << (ints ? "tiger_new_ints(" : "tiger_new_strings(")
+          << Name(i.operands[0]) << ", "
+          << (i.operands.size() == 2 ? Name(i.operands[1])
+                                     : ints ? "0" : "NULL")
+          << ")";
+      break;
+    case Op::kLoadElement:
+      os_ << (ints ? "*tiger_int_at(" : "*tiger_string_at(")
+          << List(i.operands) << ")";
+      break;
+    case Op::kStoreElement:
+      os_ << (ints ? "*tiger_int_at(" : "*tiger_string_at(")
+          << Name(i.operands[0]) << ", " << Name(i.operands[1])
+          << ") = " << Name(i.operands[2]);
+      break;
+    case Op::kLength:
+      os_ << (ints ? "tiger_ints_length(" : "tiger_strings_length(")
+          << Name(i.operands[0]) << ")";
+      break;
+    case Op::kCompareStrings:
+      os_ << "tiger_compare(" << List(i.operands) << ")";
+      break;
+    case Op::kCallFunction:
+      os_ << FunctionName(i.imm) << "(" << List(i.operands) << ")";
+      break;
+    case Op::kLoadField:
+      os_ << "tiger_field(" << Name(i.operands[0]) << ", " << i.imm << ")->"
+          << Member(f_->registers[i.dest]);
+      break;
+    case Op::kStoreField:
+      os_ << "tiger_field(" << Name(i.operands[0]) << ", " << i.imm << ")->"
+          << Member(f_->registers[i.operands[1]]) << " = "
+          << Name(i.operands[1]);
+      break;
+    default:
+      // Arithmetic, by the functions of the runtime with the names of the
+      // operations.
+      os_ << "tiger_" << ir::Name(i.op) << "(" << List(i.operands) << ")";
+      break;
+    }
+    os_ << ";\n";
+  }
+
+  void Emit(const Terminator& t, BlockId next) {
+    switch (t.kind) {
+    case Terminator::kNone:
+    case Terminator::kReturn:
+      if (k_ == 0) {
+        os_ << "  return 0;\n";
+      } else if (!t.operands.empty()) {
+        os_ << "  return " << Name(t.operands[0]) << ";\n";
+      } else {
+        os_ << "  return;\n";
+      }
+      break;
+    case Terminator::kJump:
+      if (t.targets[0] != next) os_ << "  goto b" << t.targets[0] << ";\n";
+      break;
+    case Terminator::kBranch: {
+      auto condition = [&](Cmp cmp) {
+        if (t.operands.size() == 1) {
+          return Name(t.operands[0]) + " " + Operator(cmp) + " 0";
+        }
+        if (f_->registers[t.operands[0]] == Type::kInt) {
+          return Name(t.operands[0]) + " " + Operator(cmp) + " " +
+                 Name(t.operands[1]);
+        }
+        return "(const void*)" + Name(t.operands[0]) + " " + Operator(cmp) +
+               " (const void*)" + Name(t.operands[1]);
+      };
+      if (t.targets[0] == next) {
+        os_ << "  if (" << condition(Negate(t.cmp)) << ") goto b"
+            << t.targets[1] << ";\n";
+      } else {
+        os_ << "  if (" << condition(t.cmp) << ") goto b" << t.targets[0]
+            << ";\n";
+        if (t.targets[1] != next) os_ << "  goto b" << t.targets[1] << ";\n";
+      }
+      break;
+    }
+    case Terminator::kSwitch:
+      os_ << "  switch (" << Name(t.operands[0]) << ") {\n";
+      for (size_t k = 0; k < t.values.size(); ++k) {
+        os_ << "  case " << Int(t.values[k]) << ":\n    goto b"
+            << t.targets[k + 1] << ";\n";
+      }
+      os_ << "  default:\n    goto b" << t.targets[0] << ";\n  }\n";
+      break;
+    }
+  }
+
+  const Module& module_;
+  // The function being written, and its index.
+  const ir::Function* f_ = nullptr;
+  size_t k_ = 0;
+  std::ostringstream os_;
+};
+} // namespace
+
+std::string EmitC(const Module& module) { return CEmitter(module).Emit(); }
+} // namespace ir
@@ -0,0 +1,19 @@
+#pragma once
+#include "ir.h"
+#include <string>
+
+namespace ir {
+
+// Returns a C11 program, for a hosted implementation with 32-bit ints, that
+// runs the first function of the given module as main, and has a C function
+// for each other one, with a runtime that mirrors Std.java.
+// Programs print what the class file of EmitJvm would, and fail like it,
+// with the name of the Java exception on stderr and exit status 1.
+//
+// Strings are arrays of UTF-16 code units, as in Java, which print as
+// UTF-8. Records, including the frames of static links, are TigerRecords
+// of int or reference fields. Arithmetic wraps around, as on the JVM.
+// Nothing is freed, as programs are short-lived. Unlike on the JVM, deep
+// recursion overflows the stack of the process rather than throwing.
+std::string EmitC(const Module& module);
+} // namespace ir
@@ -0,0 +1,528 @@
+#include "codegen.h"
+#include "instruction.h"
+#include <algorithm>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace ir {
+namespace {
+using emit::Code;
+using Label = Code::Label;
+
+// Returns the instruction that branches if the comparison of two ints holds.
+::Instruction IntBranch(Cmp cmp) {
+  switch (cmp) {
+  case Cmp::kEq:
+    return _if_icmpeq;
+  case Cmp::kNe:
+    return _if_icmpne;
+  case Cmp::kLt:
+    return _if_icmplt;
+  case Cmp::kGe:
+    return _if_icmpge;
+  case Cmp::kGt:
+    return _if_icmpgt;
+  default:
+    return _if_icmple;
+  }
+}
+
+// Returns the instruction that branches if the comparison of an int with 0
+// holds, e.g. of the result of String.compareTo.
+::Instruction ZeroBranch(Cmp cmp) {
+  switch (cmp) {
+  case Cmp::kEq:
+    return _ifeq;
+  case Cmp::kNe:
+    return _ifne;
+  case Cmp::kLt:
+    return _iflt;
+  case Cmp::kGe:
+    return _ifge;
+  case Cmp::kGt:
+    return _ifgt;
+  default:
+    return _ifle;
+  }
+}
+
+// Returns the JVM descriptor of values of the given type. Records are arrays
+// of objects.
+std::string_view TypeDescriptor(Type type) {
+  switch (type) {
+  case Type::kInt:
+    return "I";
+  case Type::kString:
+    return "Ljava/lang/String;";
+  case Type::kIntArray:
+    return "[I";
+  case Type::kStringArray:
+    return "[Ljava/lang/String;";
+  default:
+    return "[Ljava/lang/Object;";
+  }
+}
+
+// Returns whether an instruction only defines its destination, which it
+// need not when nothing uses that.
+bool IsPure(Op op) {
+  return op == Op::kConst || op == Op::kString || op == Op::kNil ||
+         op == Op::kMove;
+}
+
+class JvmEmitter {
+public:
+  JvmEmitter(const Function& f, emit::Program& program,
+             uint16_t parameter_words, const Module* module)
+      : f_(f), program_(program), module_(module),
+        defs_(f.registers.size()), uses_(f.registers.size()),
+        stacked_(f.registers.size()), locals_(f.registers.size(), kNoLocal),
+        next_local_(parameter_words) {
+    // Parameters arrive in the first local variables.
+    for (Reg r = 0; r < f.param_count; ++r) locals_[r] = r;
+  }
+
+  std::optional<JvmCode> Emit() {
+    Count();
+    std::vector<Label> labels;
+    for (size_t b = 0; b < f_.blocks.size(); ++b) {
+      labels.push_back(code_.NewLabel());
+    }
+    for (BlockId b = 0; b < f_.blocks.size(); ++b) {
+      const Block& block = f_.blocks[b];
+      std::vector<size_t> stacked = Stackify(block);
+      code_.Bind(labels[b]);
+      for (size_t i = 0; i < block.instructions.size(); ++i) {
+        Emit(block.instructions[i], stacked[i]);
+      }
+      Emit(block.terminator, stacked.back(), b + 1, labels);
+    }
+    std::optional<std::string> bytes = code_.Finish();
+    if (!bytes || next_local_ > UINT16_MAX) return {};
+    return JvmCode{std::move(*bytes), uint16_t(max_depth_),
+                   uint16_t(next_local_)};
+  }
+
+private:
+  static constexpr uint32_t kNoLocal = UINT32_MAX;
+
+  void Count() {
+    for (const Block& block : f_.blocks) {
+      for (const Instruction& i : block.instructions) {
+        if (i.dest != kNoReg) ++defs_[i.dest];
+        for (Reg r : i.operands) ++uses_[r];
+        // Increments also read their destination.
+        if (i.op == Op::kIncrement) ++uses_[i.dest];
+      }
+      for (Reg r : block.terminator.operands) ++uses_[r];
+    }
+    for (const Block& block : f_.blocks) {
+      for (const Instruction& i : block.instructions) {
+        if (i.op == Op::kConst && defs_[i.dest] == 1) {
+          constants_[i.dest] = i.imm;
+        }
+      }
+    }
+  }
+
+  // Marks the registers of the given block that stay on the stack, and
+  // returns how many leading operands of each instruction, and then of the
+  // terminator, do.
+  std::vector<size_t> Stackify(const Block& block) {
+    size_t n = block.instructions.size();
+    // Position of the first instruction of the tree of each instruction,
+    // i.e. of the instructions that compute its stacked operands.
+    std::vector<size_t> tree_start(n);
+    std::vector<size_t> stacked(n + 1);
+    for (size_t i = 0; i <= n; ++i) {
+      const std::vector<Reg>& operands =
+          i < n ? block.instructions[i].operands : block.terminator.operands;
+      size_t max = operands.size();
+      if (i < n && block.instructions[i].op == Op::kNewArray) {
+        // The elements follow a copy of the new array.
+        max = std::min<size_t>(max, 1);
+      } else if (i < n && block.instructions[i].op == Op::kNewRecord) {
+        // So do the fields.
+        max = 0;
+      }
+      size_t start = i;
+      for (size_t count = max; count > 0; --count) {
+        std::optional<size_t> matched =
+            MatchTrees(block, tree_start, operands, count, i);
+        if (matched) {
+          start = *matched;
+          stacked[i] = count;
+          for (size_t k = 0; k < count; ++k) stacked_[operands[k]] = true;
+          break;
+        }
+      }
+      if (i < n) tree_start[i] = start;
+    }
+    return stacked;
+  }
+
+  // Returns the start of the trees of the given count of leading operands
+  // if they end right before the given position, in order.
+  std::optional<size_t> MatchTrees(const Block& block,
+                                   const std::vector<size_t>& tree_start,
+                                   const std::vector<Reg>& operands,
+                                   size_t count, size_t position) {
+    for (size_t k = count; k-- > 0;) {
+      if (position == 0) return {};
+      const Instruction& def = block.instructions[position - 1];
+      if (def.dest != operands[k] || def.op == Op::kIncrement ||
+          defs_[def.dest] != 1 || uses_[def.dest] != 1) {
+        return {};
+      }
+      position = tree_start[position - 1];
+    }
+    return position;
+  }
+
+  void Emit(const Instruction& i, size_t stacked) {
+    if (i.dest != kNoReg && !uses_[i.dest] && !stacked && IsPure(i.op)) {
+      return;
+    }
+    // Uses push constants, rather than load them.
+    if (i.op == Op::kConst && constants_.count(i.dest) && !stacked_[i.dest]) {
+      return;
+    }
+    size_t loaded = i.op == Op::kNewArray    ? 1
+                    : i.op == Op::kNewRecord ? 0
+                                             : i.operands.size();
+    for (size_t k = stacked; k < loaded; ++k) Load(i.operands[k]);
+    std::ostream& os = code_.os();
+    switch (i.op) {
+    case Op::kConst:
+      PushInt(i.imm);
+      break;
+    case Op::kString:
+      program_.DefineStringConstant(f_.strings[i.imm])->Push(os);
+      Stack(1);
+      break;
+    case Op::kNil:
+      Put(_aconst_null, 1);
+      break;
+    case Op::kMove:
+      break;
+    case Op::kNeg:
+      Put(_ineg, 0);
+      break;
+    case Op::kAdd:
+      Put(_iadd, -1);
+      break;
+    case Op::kSub:
+      Put(_isub, -1);
+      break;
+    case Op::kMul:
+      Put(_imul, -1);
+      break;
+    case Op::kDiv:
+      Put(_idiv, -1);
+      break;
+    case Op::kShl:
+      Put(_ishl, -1);
+      break;
+    case Op::kShr:
+      Put(_ishr, -1);
+      break;
+    case Op::kUShr:
+      Put(_iushr, -1);
+      break;
+    case Op::kIncrement:
+      Increment(i.dest, i.imm);
+      return;
+    case Op::kCompareStrings:
+      program_
+          .LookupMethod("java/lang/String", "compareTo",
+                        "(Ljava/lang/String;)I")
+          ->Invoke(os);
+      Stack(-1);
+      break;
+    case Op::kCall:
+      program_.LookupLibraryFunction(f_.strings[i.imm])->Invoke(os);
+      Stack(-int(i.operands.size()) + (i.dest != kNoReg));
+      break;
+    case Op::kNewArray: {
+      bool ints = f_.registers[i.dest] == Type::kIntArray;
+      program_.NewArray(os, ints ? "" : "java/lang/String");
+      if (i.operands.size() == 2) {
+        Put(_dup, 1);
+        Load(i.operands[1]);
+        program_
+            .LookupStaticMethod(
+                "java/util/Arrays", "fill",
+                ints ? "([II)V" : "([Ljava/lang/Object;Ljava/lang/Object;)V")
+            ->Invoke(os);
+        Stack(-2);
+      }
+      break;
+    }
+    case Op::kLoadElement:
+      Put(f_.registers[i.dest] == Type::kInt ? _iaload : _aaload, -1);
+      break;
+    case Op::kStoreElement:
+      Put(f_.registers[i.operands[0]] == Type::kIntArray ? _iastore
+                                                           : _aastore,
+          -3);
+      break;
+    case Op::kLength:
+      Put(_arraylength, 0);
+      break;
+    case Op::kCallFunction: {
+      const Function& callee = module_->functions[i.imm];
+      program_
+          .LookupStaticMethod(program_.ClassName(), callee.name,
+                              JvmDescriptor(callee))
+          ->Invoke(os);
+      Stack(-int(i.operands.size()) + (i.dest != kNoReg));
+      break;
+    }
+    case Op::kNewRecord:
+      PushInt(i.operands.size());
+      program_.NewArray(os, "java/lang/Object");
+      for (size_t k = 0; k < i.operands.size(); ++k) {
+        Put(_dup, 1);
+        PushInt(k);
+        Load(i.operands[k]);
+        Box(i.operands[k]);
+        Put(_aastore, -3);
+      }
+      break;
+    case Op::kLoadField:
+      PushInt(i.imm);
+      Put(_aaload, -1);
+      Unbox(f_.registers[i.dest]);
+      break;
+    case Op::kStoreField:
+      Box(i.operands[1]);
+      PushInt(i.imm);
+      Put(_swap, 0);
+      Put(_aastore, -3);
+      break;
+    }
+    if (i.dest == kNoReg || stacked_[i.dest]) return;
+    if (uses_[i.dest]) {
+      Store(i.dest);
+    } else {
+      Put(_pop, -1);
+    }
+  }
+
+  void Emit(const Terminator& t, size_t stacked, BlockId next,
+            const std::vector<Label>& labels) {
+    for (size_t k = stacked; k < t.operands.size(); ++k) Load(t.operands[k]);
+    switch (t.kind) {
+    case Terminator::kNone:
+    case Terminator::kReturn:
+      if (t.operands.empty()) {
+        Put(_return, 0);
+      } else {
+        Put(f_.registers[t.operands[0]] == Type::kInt ? _ireturn : _areturn,
+            -1);
+      }
+      break;
+    case Terminator::kJump:
+      if (t.targets[0] != next) code_.Branch(_goto, labels[t.targets[0]]);
+      break;
+    case Terminator::kBranch: {
+      auto branch = [&](Cmp cmp) -> ::Instruction {
+        if (t.operands.size() == 1) return ZeroBranch(cmp);
+        if (f_.registers[t.operands[0]] == Type::kInt) return IntBranch(cmp);
+        return cmp == Cmp::kEq ? _if_acmpeq : _if_acmpne;
+      };
+      if (t.targets[1] == next) {
+        code_.Branch(branch(t.cmp), labels[t.targets[0]]);
+      } else if (t.targets[0] == next) {
+        code_.Branch(branch(Negate(t.cmp)), labels[t.targets[1]]);
+      } else {
+        code_.Branch(branch(t.cmp), labels[t.targets[0]]);
+        code_.Branch(_goto, labels[t.targets[1]]);
+      }
+      Stack(-int(t.operands.size()));
+      break;
+    }
+    case Terminator::kSwitch:
+      Switch(t, labels);
+      Stack(-1);
+      break;
+    }
+  }
+
+  // Writes a tableswitch if the values are dense, or a lookupswitch if not.
+  void Switch(const Terminator& t, const std::vector<Label>& labels) {
+    Label otherwise = labels[t.targets[0]];
+    std::vector<std::pair<int32_t, Label>> sorted;
+    for (size_t i = 0; i < t.values.size(); ++i) {
+      sorted.emplace_back(t.values[i], labels[t.targets[i + 1]]);
+    }
+    std::sort(sorted.begin(), sorted.end());
+    if (sorted.empty()) {
+      code_.LookupSwitch(sorted, otherwise);
+      return;
+    }
+    // Chooses like javac, by space plus 3 times time, in words and
+    // comparisons.
+    int64_t range = int64_t(sorted.back().first) - sorted.front().first + 1;
+    int64_t n = sorted.size();
+    if (4 + range + 3 * 3 <= 3 + 2 * n + 3 * n) {
+      std::vector<Label> table(range, otherwise);
+      for (const auto& [value, label] : sorted) {
+        table[int64_t(value) - sorted.front().first] = label;
+      }
+      code_.TableSwitch(sorted.front().first, table, otherwise);
+    } else {
+      code_.LookupSwitch(sorted, otherwise);
+    }
+  }
+
+  void PushInt(int32_t value) {
+    std::ostream& os = code_.os();
+    if (value >= -1 && value <= 5) {
+      os.put(_iconst_0 + value);
+    } else if (value >= INT8_MIN && value <= INT8_MAX) {
+      os.put(_bipush);
+      os.put(value);
+    } else if (value >= INT16_MIN && value <= INT16_MAX) {
+      os.put(_sipush);
+      os.put(value >> 8);
+      os.put(value & 255);
+    } else {
+      program_.DefineIntegerConstant(value)->Push(os);
+    }
+    Stack(1);
+  }
+
+  // Replaces an int on the stack from the given register, if it holds one,
+  // by an Integer, for a field of a record.
+  void Box(Reg r) {
+    if (f_.registers[r] != Type::kInt) return;
+    program_
+        .LookupStaticMethod("java/lang/Integer", "valueOf",
+                            "(I)Ljava/lang/Integer;")
+        ->Invoke(code_.os());
+  }
+
+  // Casts an object on the stack, from a field of a record, to the given
+  // type, and unboxes ints.
+  void Unbox(Type type) {
+    std::ostream& os = code_.os();
+    if (type != Type::kInt) {
+      std::string_view descriptor = TypeDescriptor(type);
+      // Class names of arrays are their descriptors.
+      program_.CheckCast(os, type == Type::kString
+                                 ? "java/lang/String"
+                                 : descriptor);
+      return;
+    }
+    program_.CheckCast(os, "java/lang/Integer");
+    program_.LookupMethod("java/lang/Integer", "intValue", "()I")
+        ->Invoke(os);
+  }
+
+  // Returns the local variable of the given register, numbering it on
+  // first use.
+  uint32_t Local(Reg r) {
+    if (locals_[r] == kNoLocal) locals_[r] = next_local_++;
+    return locals_[r];
+  }
+
+  void Load(Reg r) {
+    if (auto constant = constants_.find(r); constant != constants_.end()) {
+      PushInt(constant->second);
+      return;
+    }
+    LocalInstruction(f_.registers[r] == Type::kInt ? _iload : _aload,
+                     Local(r));
+    Stack(1);
+  }
+
+  void Store(Reg r) {
+    LocalInstruction(f_.registers[r] == Type::kInt ? _istore : _astore,
+                     Local(r));
+    Stack(-1);
+  }
+
+  void Increment(Reg r, int32_t value) {
+    uint32_t index = Local(r);
+    std::ostream& os = code_.os();
+    if (index <= 255 && value >= INT8_MIN && value <= INT8_MAX) {
+      LocalInstruction(_iinc, index);
+      os.put(value);
+    } else if (value >= INT16_MIN && value <= INT16_MAX) {
+      os.put(_wide);
+      os.put(_iinc);
+      os.put(index >> 8 & 255);
+      os.put(index & 255);
+      os.put(value >> 8);
+      os.put(value & 255);
+    } else {
+      Load(r);
+      PushInt(value);
+      Put(_iadd, -1);
+      Store(r);
+    }
+  }
+
+  // Writes an instruction with the index of a local variable, widened for
+  // indexes over 255.
+  void LocalInstruction(::Instruction op, uint32_t index) {
+    std::ostream& os = code_.os();
+    if (index > 255) {
+      os.put(_wide);
+      os.put(op);
+      os.put(index >> 8 & 255);
+    } else {
+      os.put(op);
+    }
+    os.put(index & 255);
+  }
+
+  // Writes an instruction that changes the depth of the stack by the given
+  // number of words.
+  void Put(::Instruction op, int stack) {
+    code_.os().put(op);
+    Stack(stack);
+  }
+
+  void Stack(int words) {
+    depth_ += words;
+    max_depth_ = std::max(max_depth_, depth_);
+  }
+
+  const Function& f_;
+  emit::Program& program_;
+  // Of the functions that the function calls, if any.
+  const Module* module_;
+  Code code_;
+  // Numbers of definitions and uses of each register.
+  std::vector<uint32_t> defs_;
+  std::vector<uint32_t> uses_;
+  // Whether each register stays on the stack.
+  std::vector<bool> stacked_;
+  // Values of registers defined only by constants.
+  std::unordered_map<Reg, int32_t> constants_;
+  std::vector<uint32_t> locals_;
+  uint32_t next_local_;
+  int depth_ = 0;
+  int max_depth_ = 0;
+};
+} // namespace
+
+std::string JvmDescriptor(const Function& f) {
+  std::string descriptor = "(";
+  for (Reg r = 0; r < f.param_count; ++r) {
+    descriptor += TypeDescriptor(f.registers[r]);
+  }
+  descriptor += ")";
+  descriptor += f.result ? TypeDescriptor(*f.result) : "V";
+  return descriptor;
+}
+
+std::optional<JvmCode> EmitJvm(const Function& f, emit::Program& program,
+                               uint16_t parameter_words,
+                               const Module* module) {
+  return JvmEmitter(f, program, parameter_words, module).Emit();
+}
+} // namespace ir
@@ -0,0 +1,39 @@
+#pragma once
+#include "emit.h"
+#include "ir.h"
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace ir {
+
+// Code of a JVM method, with its sizes for emit::Program::DefineFunction.
+struct JvmCode {
+  std::string bytes;
+  uint16_t max_stack;
+  uint16_t max_locals;
+};
+
+// Returns the JVM descriptor of a static method that runs the given
+// function, e.g. "([Ljava/lang/Object;I)I" for one with a static link, an
+// int parameter, and an int result. Records are arrays of objects, with
+// ints boxed as Integers.
+std::string JvmDescriptor(const Function& f);
+
+// Returns the code of a static method of the given program that runs the
+// given function, whose first local variable follows the given number of
+// words of parameters, e.g. 1 for the arguments of main, or the
+// parameters of the function. Calls of functions of the given module, if
+// any, invoke the static methods of the program named after them. Returns
+// none if the function needs more local variables or longer branches than
+// a method allows.
+//
+// Registers with one definition and one use, by an instruction in the same
+// block whose other operands leave them next on the operand stack, stay on
+// the stack, e.g. all of a tree of arithmetic lowered as in lower.h. Uses
+// of other registers defined only by a constant push it. Other registers
+// take a local variable each. Branches to the next block fall through.
+std::optional<JvmCode> EmitJvm(const Function& f, emit::Program& program,
+                               uint16_t parameter_words = 1,
+                               const Module* module = nullptr);
+} // namespace ir
@@ -1,133 +1,187 @@
 #include "compiler.h"
+#include "Instrument.h"
+#include "cbackend.h"
+#include "codegen.h"
 #include "emit.h"
 #include "instruction.h"
-#include <cassert>
-#include <fstream>
-#include <iostream>
+#include "ir.h"
+#include "lower.h"
+#include "passes.h"
+#include "profile.h"
+#include "vm.h"
+#include <optional>
+#include <sstream>
+#include <string>
+#include <utility>
 #include <vector>
 
 namespace {
-using emit::Invocable;
-using emit::Program;
-using emit::Pushable;
 
-bool CheckFunctionArgs(const Declaration& declaration,
-                       const std::vector<std::shared_ptr<Expression>>& args) {
-  return true;
+// Returns the passes run between lowering and emitting code, which use the
+// given profiles, if any, and add warnings about them to the given ones.
+ir::PassManager Passes(const std::vector<ir::Profile>& profiles,
+                       std::vector<std::string>& warnings) {
+  ir::PassManager passes;
+  passes.Add("simplify", ir::Simplify);
+  passes.Add("remove-dead-instructions", ir::RemoveDeadInstructions);
+  passes.Add("hoist-loop-invariants", ir::HoistLoopInvariants);
+  passes.Add("thread-jumps", ir::ThreadJumps);
+  passes.Add("remove-unreachable-blocks", ir::RemoveUnreachableBlocks);
+  // Profiles count the function as the passes above leave it.
+  passes.Add("apply-profile", [&profiles, &warnings](ir::Function& f) {
+    return ir::ApplyProfile(profiles, f, warnings);
+  });
+  passes.Add("peel-hot-cases", ir::PeelHotCases);
+  passes.Add("lay-out-blocks", ir::LayOutBlocks);
+  return passes;
 }
 
-class CompileExpressionVisitor : public ExpressionVisitor {
-public:
-  CompileExpressionVisitor(Program& program, std::ostream& main_os)
-      : program_(program) {
-    instruction_streams_.push_back(&main_os);
-  }
-  bool VisitStringConstant(const std::string& text) override {
-    pushables_.push_back(program_.DefineStringConstant(text));
-    return true;
-  }
-  bool VisitIntegerConstant(int value) override {
-    pushables_.push_back(program_.DefineIntegerConstant(value));
-    return true;
-  }
-  bool VisitNil() override { return true; }
-  bool VisitLValue(const LValue& value) override { return true; }
-  bool VisitNegated(const Expression& value) override {
-    return value.Accept(*this);
-  }
-  bool VisitBinary(const Expression& left, BinaryOp op,
-                   const Expression& right) override {
-    return left.Accept(*this) && right.Accept(*this);
-  }
-  bool VisitAssignment(const LValue& value, const Expression& expr) override {
-    return expr.Accept(*this);
-  }
-  bool VisitFunctionCall(const std::string& id,
-                         const std::vector<std::shared_ptr<Expression>>& args,
-                         const Expression& exp) override {
-    auto d = exp.GetNonTypeNameSpace().Lookup(id);
-    if (!d) {
-      std::cerr << "No declaration for function " << id << std::endl;
-      return false;
+// Returns the IR of the given expression, after the passes, or none if a
+// pass broke it, and adds diagnostics and warnings to the given ones.
+// Writes the IR after each pass to dump, if any.
+std::optional<ir::Module> Optimize(const Expression& e,
+                                   const std::vector<ir::Profile>& profiles,
+                                   std::vector<std::string>& diagnostics,
+                                   std::vector<std::string>& warnings,
+                                   std::ostream* dump = nullptr) {
+  ir::Module module = ir::Lower(e, diagnostics);
+  ir::PassManager passes = Passes(profiles, warnings);
+  bool broken = false;
+  for (ir::Function& f : module.functions) {
+    for (const std::string& error : passes.Run(f, dump, &module)) {
+      diagnostics.push_back("Internal error: invalid IR of " + f.name +
+                            " after " + error);
+      broken = true;
     }
-    if (!CheckFunctionArgs(**d, args)) return false;
+  }
+  if (broken) return {};
+  return module;
+}
 
-    // save the size of pushables for later - will make argument counting
-    // easier.
-    for (const auto& a : args) a->Accept(*this);
+// Returns a module whose main does nothing, for programs that do not
+// compile.
+ir::Module EmptyModule() {
+  ir::Module module;
+  ir::Function& f = module.functions.emplace_back();
+  f.NewBlock();
+  f.blocks[0].terminator.kind = ir::Terminator::kReturn;
+  return module;
+}
 
-    if (auto f = program_.LookupLibraryFunction(id); f) {
-      return EmitFunctionCall(*f, args.size());
-    }
-    std::cerr << "Non-library function calls not yet implemented";
-    return true;
-  }
-  bool
-  VisitBlock(const std::vector<std::shared_ptr<Expression>>& exprs) override {
-    return std::all_of(exprs.begin(), exprs.end(),
-                       [this](const auto& arg) { return arg->Accept(*this); });
-  }
-  bool VisitRecord(const std::string& type_id,
-                   const std::vector<FieldValue>& field_values,
-                   const Expression& exp) override {
-    return true;
-  }
-  bool VisitArray(const std::string& type_id, const Expression& size,
-                  const Expression& value) override {
-    return size.Accept(*this) && value.Accept(*this);
-  }
-  bool VisitIfThen(const Expression& condition,
-                   const Expression& expr) override {
-    return condition.Accept(*this) && expr.Accept(*this);
-  }
-  bool VisitIfThenElse(const Expression& condition, const Expression& then_expr,
-                       const Expression& else_expr) override {
-    return condition.Accept(*this) && then_expr.Accept(*this) &&
-           else_expr.Accept(*this);
-  }
-  bool VisitWhile(const Expression& condition,
-                  const Expression& body) override {
-    return condition.Accept(*this) && body.Accept(*this);
-  }
-  bool VisitFor(const std::string& id, const Expression& first,
-                const Expression& last, const Expression& body) override {
-    return first.Accept(*this) && last.Accept(*this) && body.Accept(*this);
-  }
-  bool VisitBreak() override { return true; }
-  bool VisitLet(const std::vector<std::shared_ptr<Declaration>>& declarations,
-                const std::vector<std::shared_ptr<Expression>>& body) override {
-    return std::all_of(body.begin(), body.end(),
-                       [this](const auto& arg) { return arg->Accept(*this); });
-  }
+// Returns Optimize, or else EmptyModule.
+ir::Module OptimizeOrEmpty(const Expression& e,
+                           const std::vector<ir::Profile>& profiles,
+                           std::vector<std::string>& diagnostics,
+                           std::vector<std::string>& warnings) {
+  std::optional<ir::Module> module =
+      Optimize(e, profiles, diagnostics, warnings);
+  return module ? std::move(*module) : EmptyModule();
+}
 
-  bool EmitFunctionCall(const Invocable& invocable, int arg_count) {
-    assert(!instruction_streams_.empty());
-    auto& os = **instruction_streams_.rbegin();
-    while (--arg_count >= 0) {
-      assert(!pushables_.empty());
-      const Pushable* arg = *pushables_.rbegin();
-      pushables_.pop_back();
-      arg->Push(os);
+// Returns program whose main method executes the given expression, and adds
+// diagnostics and warnings to the given ones.
+std::unique_ptr<emit::Program>
+CompileProgram(const Expression& e, std::string_view class_name,
+               const std::vector<ir::Profile>& profiles,
+               std::vector<std::string>& diagnostics,
+               std::vector<std::string>& warnings) {
+  instrument::ScopedPhase phase(instrument::kCompile);
+  auto program = emit::Program::JavaProgram(class_name);
+  std::optional<ir::JvmCode> main;
+  if (std::optional<ir::Module> module =
+          Optimize(e, profiles, diagnostics, warnings);
+      module) {
+    main = ir::EmitJvm(module->functions[0], *program, 1, &*module);
+    if (!main) diagnostics.push_back("Main program too large");
+    for (size_t i = 1; main && i < module->functions.size(); ++i) {
+      const ir::Function& f = module->functions[i];
+      std::optional<ir::JvmCode> code =
+          ir::EmitJvm(f, *program, f.param_count, &*module);
+      if (!code) {
+        diagnostics.push_back("Function " + f.name + " too large");
+        main.reset();
+        break;
+      }
+      program->DefineFunction(emit::ACC_PRIVATE | emit::ACC_STATIC, f.name,
+                              ir::JvmDescriptor(f), code->bytes,
+                              code->max_stack, code->max_locals);
     }
-    invocable.Invoke(os);
-    return true;
   }
-
-  Program& program_;
-  std::vector<const Pushable*> pushables_;
-  std::vector<std::ostream*> instruction_streams_;
-};
+  if (!main) main = ir::JvmCode{std::string(1, Instruction::_return), 0, 1};
+  program->DefineFunction(emit::ACC_PUBLIC | emit::ACC_STATIC, "main",
+                          "([Ljava/lang/String;)V", main->bytes,
+                          main->max_stack, main->max_locals);
+  return program;
+}
 } // namespace
 
-// Given a tiger expression, create a java class file to execute.
-void Compile(const Expression& e) {
-  auto program = Program::JavaProgram();
-  std::ostringstream main_os;
-  CompileExpressionVisitor visitor(*program, main_os);
-  e.Accept(visitor);
-  main_os.put(Instruction::_return);
-  program->DefineFunction(emit::ACC_PUBLIC | emit::ACC_STATIC, "main",
-                          "([Ljava/lang/String;)V", main_os.str());
-  std::ofstream out("/tmp/Main.class");
-  program->Emit(out);
+CompiledClass Compile(const Expression& e, std::string_view class_name) {
+  CompiledClass result;
+  std::ostringstream os;
+  result.diagnostics = Compile(e, class_name, os, {});
+  result.bytes = os.str();
+  return result;
+}
+
+std::vector<std::string> Compile(const Expression& e,
+                                 std::string_view class_name,
+                                 std::ostream& os,
+                                 const std::vector<ir::Profile>& profiles,
+                                 std::vector<std::string>* warnings) {
+  std::vector<std::string> diagnostics;
+  std::vector<std::string> ignored;
+  CompileProgram(e, class_name, profiles, diagnostics,
+                 warnings ? *warnings : ignored)
+      ->Emit(os);
+  return diagnostics;
+}
+
+std::vector<std::string>
+CompileToJar(const Expression& e, std::ostream& os,
+             const std::vector<std::pair<std::string_view, std::string_view>>&
+                 extra_entries,
+             std::string_view class_name,
+             const std::vector<ir::Profile>& profiles,
+             std::vector<std::string>* warnings) {
+  std::vector<std::string> diagnostics;
+  std::vector<std::string> ignored;
+  CompileProgram(e, class_name, profiles, diagnostics,
+                 warnings ? *warnings : ignored)
+      ->EmitJar(os, extra_entries);
+  return diagnostics;
+}
+
+CompiledC CompileToC(const Expression& e,
+                     const std::vector<ir::Profile>& profiles) {
+  instrument::ScopedPhase phase(instrument::kCompile);
+  CompiledC result;
+  result.source = ir::EmitC(
+      OptimizeOrEmpty(e, profiles, result.diagnostics, result.warnings));
+  return result;
+}
+
+CompiledBytecode CompileToBytecode(const Expression& e,
+                                   const std::vector<ir::Profile>& profiles) {
+  instrument::ScopedPhase phase(instrument::kCompile);
+  CompiledBytecode result;
+  result.program = vm::Assemble(
+      OptimizeOrEmpty(e, profiles, result.diagnostics, result.warnings));
+  return result;
+}
+
+CompiledBytecode CompileToInstrumentedBytecode(const Expression& e) {
+  instrument::ScopedPhase phase(instrument::kCompile);
+  CompiledBytecode result;
+  result.program = vm::Assemble(
+      OptimizeOrEmpty(e, {}, result.diagnostics, result.warnings), true);
+  return result;
+}
+
+std::vector<std::string> DumpIr(const Expression& e, std::ostream& os,
+                                const std::vector<ir::Profile>& profiles,
+                                std::vector<std::string>* warnings) {
+  std::vector<std::string> diagnostics;
+  std::vector<std::string> ignored;
+  Optimize(e, profiles, diagnostics, warnings ? *warnings : ignored, &os);
+  return diagnostics;
 }
@@ -1,5 +1,80 @@
 #pragma once
 #include "Expression.h"
+#include "profile.h"
+#include "vm.h"
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
-// Given a tiger expression, create a java class file to execute.
-void Compile(const Expression&);
+// Class file compiled from a Tiger expression.
+struct CompiledClass {
+  std::string bytes;
+  // Messages about parts of the expression without code, e.g. arrays of
+  // records, which are not implemented yet.
+  std::vector<std::string> diagnostics;
+};
+
+// Given a typed tiger expression, returns a java class with the given name
+// whose main method executes it. Compiling shares no state but the tree, so
+// that threads can compile trees at once.
+CompiledClass Compile(const Expression&, std::string_view class_name = "Main");
+
+// Like Compile, but writes the class file to the given stream, and returns
+// the diagnostics. Here and below, functions are optimized with their
+// profiles among the given ones, if any, see profile.h. Profiles of other
+// versions of functions are ignored, with warnings, added to the given
+// ones if any, which unlike diagnostics leave the code complete.
+std::vector<std::string> Compile(const Expression&,
+                                 std::string_view class_name,
+                                 std::ostream& os,
+                                 const std::vector<ir::Profile>& profiles = {},
+                                 std::vector<std::string>* warnings = nullptr);
+
+// Given a tiger expression, write a jar to the given stream whose Main-Class
+// executes it, followed by the given (path, bytes) entries, and returns the
+// diagnostics.
+std::vector<std::string>
+CompileToJar(const Expression&, std::ostream& os,
+             const std::vector<std::pair<std::string_view, std::string_view>>&
+                 extra_entries = {},
+             std::string_view class_name = "Main",
+             const std::vector<ir::Profile>& profiles = {},
+             std::vector<std::string>* warnings = nullptr);
+
+// C program compiled from a Tiger expression, see ir::EmitC.
+struct CompiledC {
+  std::string source;
+  std::vector<std::string> diagnostics;
+  std::vector<std::string> warnings;
+};
+
+// Given a typed tiger expression, returns a C program that executes it like
+// the class of Compile.
+CompiledC CompileToC(const Expression&,
+                     const std::vector<ir::Profile>& profiles = {});
+
+// Bytecode compiled from a Tiger expression, see vm.h.
+struct CompiledBytecode {
+  vm::Program program;
+  std::vector<std::string> diagnostics;
+  std::vector<std::string> warnings;
+};
+
+// Given a typed tiger expression, returns bytecode that executes it like the
+// class of Compile, when given to vm::Run.
+CompiledBytecode
+CompileToBytecode(const Expression&,
+                  const std::vector<ir::Profile>& profiles = {});
+
+// Like CompileToBytecode, but for a profile of the program, which
+// vm::Run measures, with counters, and without using profiles.
+CompiledBytecode CompileToInstrumentedBytecode(const Expression&);
+
+// Writes the IR of the given expression, see ir.h, as lowered and after
+// each pass that changes it, to the given stream, and returns the
+// diagnostics.
+std::vector<std::string> DumpIr(const Expression&, std::ostream& os,
+                                const std::vector<ir::Profile>& profiles = {},
+                                std::vector<std::string>* warnings = nullptr);
@@ -1,18 +1,52 @@
 #include "compiler.h"
 #include "testing/catch.h"
+#include "testing/generator.h"
 #include "testing/testing.h"
+#include "vm.h"
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace {
 
+std::shared_ptr<Expression> Typed(const std::string& program) {
+  std::shared_ptr<Expression> e = testing::Parse(program);
+  Expression::SetNameSpacesBelow(*e);
+  Expression::SetTypesBelow(*e);
+  return e;
+}
+
+// Runs the given tree compiled to bytecode, without input.
+testing::JavaRun RunBytecode(const Expression& e) {
+  std::istringstream in;
+  std::ostringstream out, err;
+  testing::JavaRun run;
+  run.exit_code = vm::Run(CompileToBytecode(e).program, in, out, err);
+  run.out = out.str();
+  run.err = err.str();
+  return run;
+}
+
+// Returns the runs of the given program compiled to a class file, to a
+// native program through C, and to bytecode.
+std::vector<testing::JavaRun> RunAll(const char* program) {
+  auto e = Typed(program);
+  return {testing::RunClass(Compile(*e).bytes),
+          testing::RunC(CompileToC(*e).source), RunBytecode(*e)};
+}
+
+// Returns the output of the given program, which must be the same from all
+// backends.
 std::string CompileAndRun(const char* program) {
-  if (auto exp = testing::Parse(program); !exp) {
-    return "Parse Failed";
-  } else {
-    Expression::SetNameSpacesBelow(*exp);
-    Expression::SetTypesBelow(*exp);
-    Compile(*exp);
-    return testing::RunJava();
+  std::vector<testing::JavaRun> runs = RunAll(program);
+  INFO(program);
+  for (const testing::JavaRun& run : runs) {
+    REQUIRE(run.out == runs[0].out);
+    REQUIRE(run.exit_code == runs[0].exit_code);
   }
+  return runs[0].out;
 }
 
 SCENARIO("compiles to class file", "[compile]") {
@@ -20,5 +54,265 @@ SCENARIO("compiles to class file", "[compile]") {
     REQUIRE(CompileAndRun("print(\"Hello World\")") == "Hello World");
   }
   GIVEN("printi") { REQUIRE(CompileAndRun("printi(666)") == "666"); }
+  GIVEN("a class name") {
+    auto compiled = Compile(*Typed("print(\"named\")"), "Named");
+    REQUIRE(testing::RunClass(compiled.bytes).out == "named");
+  }
+  GIVEN("conditions") {
+    REQUIRE(CompileAndRun("if 1 < 2 then print(\"y\") else print(\"n\")") ==
+            "y");
+    REQUIRE(CompileAndRun("if 2 <= 1 then print(\"y\") else print(\"n\")") ==
+            "n");
+    REQUIRE(CompileAndRun("if not(1 > 2) then print(\"y\")") == "y");
+    REQUIRE(CompileAndRun("if \"a\" < \"b\" then print(\"y\")") == "y");
+    REQUIRE(CompileAndRun("(printi(3 >= 3); printi(1 & 0); printi(0 | 2))") ==
+            "101");
+  }
+  GIVEN("short-circuit operators") {
+    REQUIRE(CompileAndRun("if 0 & (print(\"x\"); 1) then print(\"y\")") ==
+            "");
+    REQUIRE(CompileAndRun("if 1 | (print(\"x\"); 1) then print(\"y\")") ==
+            "y");
+    REQUIRE(CompileAndRun("if 1 & (print(\"x\"); 1) then print(\"y\")") ==
+            "xy");
+  }
+  GIVEN("arithmetic") {
+    REQUIRE(CompileAndRun("for i := -9 to 9 do (printi(i / 4 + i * 8 - i * 1); "
+                          "print(\" \"))") ==
+            "-65 -58 -50 -43 -36 -29 -21 -14 -7 0 7 14 21 29 36 43 50 58 65 ");
+  }
+  GIVEN("loops") {
+    REQUIRE(CompileAndRun("for i := 1 to 3 do printi(i)") == "123");
+    REQUIRE(CompileAndRun("for i := 3 to 1 do printi(i)") == "");
+    REQUIRE(CompileAndRun("let var i := 0 in while i < 3 do (printi(i); "
+                          "i := i + 1) end") == "012");
+    REQUIRE(CompileAndRun("for i := 1 to 9 do (printi(i); if i = 2 then "
+                          "break)") == "12");
+  }
+  GIVEN("if-else chains on one variable") {
+    const char* dense = "let var s := \"\" in for i := 0 to 4 do (s := if "
+                        "i = 1 then \"a\" else if i = 2 then \"b\" else if "
+                        "i = 3 then \"c\" else \"-\"; print(s)) end";
+    REQUIRE(CompileAndRun(dense) == "-abc-");
+    const char* sparse = "for i := -1 to 1000 do if i = 1000 then print(\"a\")"
+                         " else if i = -1 then print(\"b\") else if i = 7 "
+                         "then print(\"c\")";
+    REQUIRE(CompileAndRun(sparse) == "bca");
+    const char* repeated = "for i := 1 to 4 do if i = 1 then print(\"a\") else"
+                           " if i = 2 then print(\"b\") else if i = 3 then "
+                           "print(\"c\") else if i = 1 then print(\"x\") "
+                           "else if i = 4 then print(\"d\")";
+    REQUIRE(CompileAndRun(repeated) == "abcd");
+  }
+  GIVEN("arrays") {
+    const char* ints = "let type ints = array of int var a := ints [5] of 1 in "
+                       "for i := 0 to 4 do a[i] := a[i] * i; for i := 0 to 4 "
+                       "do printi(a[i]) end";
+    REQUIRE(CompileAndRun(ints) == "01234");
+    const char* strings = "let type strings = array of string var s := "
+                          "strings [2] of \"x\" in s[1] := \"y\"; print(s[0]);"
+                          " print(s[1]) end";
+    REQUIRE(CompileAndRun(strings) == "xy");
+  }
+  GIVEN("loops over arrays") {
+    const char* sums = "let type ints = array of int var n := 5 var a := ints "
+                       "[n] of 1 var s := 0 in for i := 1 to n - 2 do s := s "
+                       "+ a[i - 1] + a[i + 1]; for i := 1 to 3 do s := s + "
+                       "a[i]; for i := 4 to 1 do s := s + a[i]; printi(s) end";
+    REQUIRE(CompileAndRun(sums) == "9");
+    const char* breaks = "let type ints = array of int var a := ints [5] of 0 "
+                         "in for i := 0 to 4 do (printi(a[i] + i); if i = 2 "
+                         "then break) end";
+    REQUIRE(CompileAndRun(breaks) == "012");
+  }
+  GIVEN("an index out of bounds") {
+    const char* program = "let type ints = array of int var a := ints [2] of 0"
+                          " in for i := 0 to 2 do (printi(i); a[i] := i) end";
+    for (const testing::JavaRun& run : RunAll(program)) {
+      REQUIRE(run.out == "012");
+      REQUIRE(run.exit_code == 1);
+      REQUIRE(run.err.find("ArrayIndexOutOfBoundsException") !=
+              std::string::npos);
+    }
+  }
+  GIVEN("failures of built-in functions and arithmetic") {
+    const std::pair<const char*, const char*> failures[] = {
+        {"(print(\"a\"); print(substring(\"abc\", 2, 2)))",
+         "StringIndexOutOfBoundsException"},
+        {"let var x := 0 in (print(\"a\"); printi(1 / x)) end",
+         "ArithmeticException"},
+        {"let type ints = array of int var n := -1 in (print(\"a\"); ints "
+         "[n] of 0) end",
+         "NegativeArraySizeException"}};
+    for (const auto& [program, exception] : failures) {
+      INFO(program);
+      for (const testing::JavaRun& run : RunAll(program)) {
+        REQUIRE(run.out == "a");
+        REQUIRE(run.exit_code == 1);
+        REQUIRE(run.err.find(exception) != std::string::npos);
+      }
+    }
+  }
+  GIVEN("functions and records") {
+    const char* program =
+        "let type list = {head: int, tail: list} var total := 0 function "
+        "fib(n: int): int = if n < 2 then n else fib(n - 1) + fib(n - 2) "
+        "function sum(l: list): int = if l = nil then 0 else l.head + "
+        "sum(l.tail) function build(n: int): list = let var l: list := nil "
+        "in for i := 1 to n do (l := list {head = i, tail = l}; total := "
+        "total + i); l end in printi(fib(10)); print(\" \"); "
+        "printi(sum(build(10))); print(\" \"); printi(total) end";
+    REQUIRE(CompileAndRun(program) == "55 55 55");
+  }
+  GIVEN("functions that use variables of the functions around them") {
+    REQUIRE(CompileAndRun("let function f(n: int): int = let var k := n * 2 "
+                          "function g(m: int): int = let function h(): int "
+                          "= k + m in k := k + 1; h() end in g(1) + k end in "
+                          "printi(f(5)) end") == "23");
+  }
+  GIVEN("a field of nil") {
+    auto e = Typed("let type r = {a: int} var x: r := nil in (print(\"a\"); "
+                   "printi(x.a)) end");
+    for (const testing::JavaRun& run :
+         {testing::RunClass(Compile(*e).bytes),
+          testing::RunC(CompileToC(*e).source), RunBytecode(*e)}) {
+      REQUIRE(run.out == "a");
+      REQUIRE(run.err.find("java.lang.NullPointerException") !=
+              std::string::npos);
+      REQUIRE(run.exit_code == 1);
+    }
+  }
+  GIVEN("strings beyond ASCII") {
+    // As UTF-16 code units, i.e. \u00e9 and \u20ac.
+    REQUIRE(CompileAndRun("let var s := \"\xc3\xa9\xe2\x82\xac\" in "
+                          "(printi(size(s)); print(\" \"); printi(ord("
+                          "substring(s, 1, 1))); print(\" \"); printi(ord("
+                          "chr(233)))) end") == "2 8364 233");
+  }
+}
+
+SCENARIO("compiles in memory", "[compiler]") {
+  GIVEN("a program") {
+    auto e = Typed("(printi(1); print(\"a\"))");
+    CompiledClass compiled = Compile(*e);
+    THEN("it returns a class file") {
+      REQUIRE(compiled.bytes.substr(0, 4) == "\xca\xfe\xba\xbe");
+      REQUIRE(compiled.diagnostics.empty());
+    }
+    THEN("it names the class as asked") {
+      REQUIRE(compiled.bytes.find("Main") != std::string::npos);
+      std::string named = Compile(*e, "Other").bytes;
+      REQUIRE(named.find("Other") != std::string::npos);
+      REQUIRE(named.find("Main") == std::string::npos);
+    }
+  }
+  GIVEN("a call of a function that is not built in") {
+    auto e = Typed("let function f() = print(\"f\") in f() end");
+    CompiledClass compiled = Compile(*e);
+    THEN("it compiles the function to a static method") {
+      REQUIRE(compiled.diagnostics.empty());
+      REQUIRE(compiled.bytes.find("([Ljava/lang/Object;)V") !=
+              std::string::npos);
+    }
+    THEN("it compiles the function to C") {
+      REQUIRE(CompileToC(*e).diagnostics.empty());
+      REQUIRE(CompileToC(*e).source.find("static void tiger_f1_f(") !=
+              std::string::npos);
+    }
+    THEN("it compiles the function to bytecode") {
+      CompiledBytecode compiled = CompileToBytecode(*e);
+      REQUIRE(compiled.diagnostics.empty());
+      REQUIRE(compiled.program.functions.size() == 2);
+    }
+  }
+  GIVEN("a comparison in a condition") {
+    auto e = Typed("let var a := ord(\"a\") in if a < 2 then print(\"y\") "
+                   "end");
+    CompiledClass compiled = Compile(*e);
+    THEN("it branches on the comparison without materializing a value") {
+      REQUIRE(compiled.diagnostics.empty());
+      const char if_icmpge = '\xa2';
+      const std::string iconst_1_goto = "\x04\xa7";
+      REQUIRE(compiled.bytes.find(if_icmpge) != std::string::npos);
+      REQUIRE(compiled.bytes.find(iconst_1_goto) == std::string::npos);
+    }
+  }
+  GIVEN("an if-else chain on one variable") {
+    const std::string chain =
+        "let var x := 2 in if x = 1 then print(\"a\") else if x = 2 then "
+        "print(\"b\") else if x = %1 then print(\"c\") end";
+    auto with_last = [&](const char* value) {
+      std::string program = chain;
+      return Compile(*Typed(program.replace(program.find("%1"), 2, value)));
+    };
+    const char tableswitch = '\xaa';
+    const char lookupswitch = '\xab';
+    THEN("it switches on dense constants with a table") {
+      CompiledClass compiled = with_last("3");
+      REQUIRE(compiled.diagnostics.empty());
+      REQUIRE(compiled.bytes.find(tableswitch) != std::string::npos);
+    }
+    THEN("it looks up sparse constants") {
+      CompiledClass compiled = with_last("1000");
+      REQUIRE(compiled.diagnostics.empty());
+      REQUIRE(compiled.bytes.find(lookupswitch) != std::string::npos);
+    }
+  }
+  GIVEN("an if-else chain on a call") {
+    auto e = Typed("if ord(\"a\") = 1 then print(\"a\") else if ord(\"a\") ="
+                   " 2 then print(\"b\") else if ord(\"a\") = 3 then "
+                   "print(\"c\")");
+    THEN("it compares the value of each call") {
+      std::string bytes = Compile(*e).bytes;
+      REQUIRE(bytes.find('\xaa') == std::string::npos);
+      REQUIRE(bytes.find('\xab') == std::string::npos);
+    }
+  }
+  GIVEN("a loop over an array") {
+    const std::string loop = "let type ints = array of int var n := 5 var a := "
+                             "ints [n] of 0 in for i := 0 to %1 do a[i] := i "
+                             "end";
+    auto with_last = [&](const char* last) {
+      std::string program = loop;
+      return Compile(*Typed(program.replace(program.find("%1"), 2, last)));
+    };
+    const char arraylength = '\xbe';
+    const char iastore = '\x4f';
+    auto count = [](const std::string& bytes, char c) {
+      return std::count(bytes.begin(), bytes.end(), c);
+    };
+    CompiledClass proven = with_last("n - 1");
+    CompiledClass unproven = with_last("n");
+    THEN("it checks the bounds once before a copy of the loop if not proven") {
+      REQUIRE(proven.diagnostics.empty());
+      REQUIRE(unproven.diagnostics.empty());
+      REQUIRE(count(unproven.bytes, arraylength) ==
+              count(proven.bytes, arraylength) + 1);
+      REQUIRE(count(unproven.bytes, iastore) ==
+              count(proven.bytes, iastore) + 1);
+    }
+  }
+  GIVEN("a record") {
+    auto e = Typed("let type r = {a: int} var x := r{a = 1} in printi(x.a) "
+                   "end");
+    CompiledClass compiled = Compile(*e);
+    THEN("it makes an array of objects with boxed ints") {
+      REQUIRE(compiled.diagnostics.empty());
+      REQUIRE(compiled.bytes.find("java/lang/Integer") != std::string::npos);
+      const char anewarray = '\xbd';
+      REQUIRE(compiled.bytes.find(anewarray) != std::string::npos);
+    }
+  }
+  GIVEN("many compilations at once") {
+    auto e = Typed(testing::StringConstants(1000));
+    std::string serial = Compile(*e).bytes;
+    std::vector<std::string> results(8);
+    std::vector<std::thread> threads;
+    for (auto& result : results) {
+      threads.emplace_back([&] { result = Compile(*e).bytes; });
+    }
+    for (auto& thread : threads) thread.join();
+    for (const auto& result : results) REQUIRE(result == serial);
+  }
 }
 } // namespace
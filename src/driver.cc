@@ -1,5 +1,33 @@
 #include "driver.h"
+#include "Instrument.h"
 #include "parser.hh"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+// Reads all of the driver's file, or stdin, into its text.
+void ReadSource(Driver& driver) {
+  FILE* in = driver.file.empty() || driver.file == "-"
+                 ? stdin
+                 : fopen(driver.file.c_str(), "rb");
+  if (!in) {
+    driver.error("cannot open " + driver.file + ": " + strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  driver.text.clear();
+  char buffer[1 << 16];
+  while (size_t n = fread(buffer, 1, sizeof(buffer), in)) {
+    driver.text.append(buffer, n);
+  }
+  if (in != stdin) fclose(in);
+}
+} // namespace
+
+yy::Parser::symbol_type yylex(Driver& driver) {
+  return driver.lexer ? driver.lexer->Next(driver) : FlexLex(driver);
+}
 
 Driver::Driver() : trace_scanning(false), trace_parsing(false) {
   variables["one"] = 1;
@@ -9,12 +37,25 @@ Driver::Driver() : trace_scanning(false), trace_parsing(false) {
 Driver::~Driver() = default;
 
 int Driver::parse(const std::string& f) {
+  instrument::ScopedPhase phase(instrument::kParse);
   file = f;
-  scan_begin();
+  source_map = SourceMap(f);
+  if (hand_written_lexer) {
+    ReadSource(*this);
+    source_map.Append(text);
+    lexer = std::make_unique<Lexer>(text, &file);
+  } else {
+    scan_begin();
+  }
   yy::Parser parser(*this);
   parser.set_debug_level(trace_parsing);
   int res = parser.parse();
-  scan_end();
+  if (hand_written_lexer) {
+    lexer.reset();
+    text.clear();
+  } else {
+    scan_end();
+  }
   return res;
 }
 
@@ -1,13 +1,18 @@
 #ifndef DRIVER_HH
 #define DRIVER_HH
 #include "Expression.h"
+#include "Lexer.h"
+#include "SourceMap.h"
 #include "parser.hh"
 #include <map>
+#include <memory>
 #include <string>
 // Tell Flex the lexer's prototype ...
-#define YY_DECL yy::Parser::symbol_type yylex(Driver& driver)
-// ... and declare it for the parser's sake.
+#define YY_DECL yy::Parser::symbol_type FlexLex(Driver& driver)
+// ... and declare it, and the parser's entry point, which dispatches to it
+// or to the hand written Lexer.
 YY_DECL;
+yy::Parser::symbol_type yylex(Driver& driver);
 // Conducting the whole scanning and parsing of Calc++.
 class Driver {
 public:
@@ -21,6 +26,14 @@ public:
   void scan_begin();
   void scan_end();
   bool trace_scanning;
+  // Whether to scan with the hand written Lexer instead of flex.
+  bool hand_written_lexer = false;
+  // The source and its scanner, if hand_written_lexer.
+  std::string text;
+  std::unique_ptr<Lexer> lexer;
+  // Lines of the file, filled in by the scanner, for the source offsets
+  // of the nodes in result.
+  SourceMap source_map;
   // Run the parser on file F.
   // Return 0 on success.
   int parse(const std::string& f);
@@ -1,7 +1,9 @@
 #include "emit.h"
+#include "BuiltIns.h"
+#include "Instrument.h"
+#include "jar.h"
 #include <functional>
 #include <optional>
-#include <unordered_map>
 
 // Implementation following
 // https://docs.oracle.com/javase/specs/jvms/se7/html/jvms-4.html and example
@@ -68,8 +70,10 @@ struct AttributeInfo {
 
 // https://docs.oracle.com/javase/specs/jvms/se7/html/jvms-4.html#jvms-4.7.3
 struct CodeAttribute : AttributeInfo {
-  CodeAttribute(u2 code_name_index, std::string_view instructions)
-      : max_stack(10), max_locals(10), code_bytes(instructions) {
+  CodeAttribute(u2 code_name_index, std::string_view instructions,
+                u2 max_stack, u2 max_locals)
+      : max_stack(max_stack), max_locals(max_locals),
+        code_bytes(instructions) {
     attribute_name_index = code_name_index;
   }
 
@@ -176,6 +180,16 @@ struct MethodRefConstant : Ref, public Invocable {
   }
 };
 
+// Instance method, which MethodRefConstant invokes as a static one.
+struct VirtualMethod : Invocable {
+  explicit VirtualMethod(const MethodRefConstant& ref) : ref(ref) {}
+  void Invoke(std::ostream& os) const override {
+    os.put(Instruction::_invokevirtual);
+    Put2(os, ref.index);
+  }
+  const MethodRefConstant& ref;
+};
+
 struct StringConstant : Constant, Pushable {
   u2 string_index;
   Tag tag() const override { return kString; }
@@ -248,7 +262,9 @@ struct NameAndTypeConstant : Constant {
   u2 name_index;
   u2 descriptor_index;
   Tag tag() const override { return kNameAndType; }
-  bool Matches(u2 first, u2 second) const override { return false; }
+  bool Matches(u2 first, u2 second) const override {
+    return name_index == first && descriptor_index == second;
+  }
   std::optional<NameAndTypeConstant*> nameAndType() override { return this; }
   void Emit(std::ostream& os) const override {
     os.put(tag());
@@ -259,32 +275,12 @@ struct NameAndTypeConstant : Constant {
 
 class LibraryFunction : public Invocable {};
 
-const std::unordered_map<std::string_view, const char*>
-    kTypeByLibraryFunctionName = {
-        {"print", "(Ljava/lang/String;)V"},
-        {"printi", "(I)V"},
-        {"flush", "()V"},
-        {"getChar", "()Ljava/lang/String;"},
-        {"ord", "(Ljava/lang/String;)I"},
-        {"chr", "(I)Ljava/lang/String;"},
-        {"size", "(Ljava/lang/String;)I"},
-        {"substring", "(Ljava/lang/String;II)Ljava/lang/String;"},
-        {"concat", "(Ljava/lang/String;Ljava/lang/String;)Ljava/lang/String;"},
-        {"not", "(I)I"},
-        {"exit", "(I)V"}};
-
-std::optional<const char*> LibraryFunctionType(std::string_view name) {
-  if (auto found = kTypeByLibraryFunctionName.find(name);
-      found != kTypeByLibraryFunctionName.end()) {
-    return found->second;
-  }
-  return {};
-}
-
 struct JvmProgram : Program {
-  JvmProgram() = default;
+  explicit JvmProgram(std::string_view class_name) : class_name(class_name) {}
   ~JvmProgram() override = default;
 
+  const std::string& ClassName() const override { return class_name; }
+
   const Pushable* DefineStringConstant(std::string_view text) override {
     return stringConstant(text);
   }
@@ -293,18 +289,53 @@ struct JvmProgram : Program {
   }
 
   const Invocable* LookupLibraryFunction(std::string_view name) override {
-    if (auto found = LibraryFunctionType(name); found) {
-      return methodRefConstant("Std", name, *found);
+    if (const BuiltInFunction* f = FindBuiltInFunction(name); f) {
+      return methodRefConstant(kBuiltInClass, f->jvm_name, f->descriptor);
     }
     return nullptr;
   }
 
+  const Invocable* LookupMethod(std::string_view class_name,
+                                std::string_view name,
+                                std::string_view descriptor) override {
+    const MethodRefConstant* ref =
+        methodRefConstant(class_name, name, descriptor);
+    for (const auto& m : virtual_methods) {
+      if (&m->ref == ref) return m.get();
+    }
+    virtual_methods.push_back(std::make_unique<VirtualMethod>(*ref));
+    return virtual_methods.back().get();
+  }
+
+  const Invocable* LookupStaticMethod(std::string_view class_name,
+                                      std::string_view name,
+                                      std::string_view descriptor) override {
+    return methodRefConstant(class_name, name, descriptor);
+  }
+
+  void NewArray(std::ostream& os, std::string_view element_class) override {
+    if (element_class.empty()) {
+      constexpr uint8_t T_INT = 10;
+      os.put(Instruction::_newarray);
+      os.put(T_INT);
+    } else {
+      os.put(Instruction::_anewarray);
+      Put2(os, classConstant(element_class)->index);
+    }
+  }
+
+  void CheckCast(std::ostream& os, std::string_view class_name) override {
+    os.put(Instruction::_checkcast);
+    Put2(os, classConstant(class_name)->index);
+  }
+
   void DefineFunction(u2 flags, std::string_view name,
-                      std::string_view descriptor,
-                      std::string_view code_bytes) override {
+                      std::string_view descriptor, std::string_view code_bytes,
+                      u2 max_stack, u2 max_locals) override {
     methods.push_back(methodInfo(flags, name, descriptor));
     methods.rbegin()->attributes.emplace_back(
-        new CodeAttribute(utf8Constant("Code")->index, code_bytes));
+        new CodeAttribute(utf8Constant("Code")->index, code_bytes, max_stack,
+                          max_locals));
   };
 
   void DefineConstructor() {
@@ -313,12 +344,14 @@ struct JvmProgram : Program {
     os.put(Instruction::_invokespecial);
     Put2(os, methodRefConstant("java/lang/Object", "<init>", "()V")->index);
     os.put(Instruction::_return);
-    DefineFunction(0, "<init>", "()V", os.str());
+    DefineFunction(0, "<init>", "()V", os.str(), /*max_stack=*/1,
+                   /*max_locals=*/1);
   }
 
   void Emit(std::ostream& os) override {
+    instrument::ScopedPhase phase(instrument::kEmit);
     DefineConstructor();
-    u2 this_class = classConstant("Main")->index;
+    u2 this_class = classConstant(class_name)->index;
     u2 super_class = classConstant("java/lang/Object")->index;
 
     Put4(os, 0xcafebabe);
@@ -334,6 +367,7 @@ struct JvmProgram : Program {
     Put2(os, methods.size());
     for (const auto& m : methods) m.Emit(os);
     Put2(os, 0); // attributes count
+    instrument::SetCount("constant pool entries", constant_pool.size());
   }
 
   template <class T> T* Adopt(T* t) {
@@ -426,13 +460,88 @@ struct JvmProgram : Program {
     return {flags, utf8Constant(name)->index, utf8Constant(descriptor)->index};
   }
 
+  std::string class_name;
   std::vector<std::unique_ptr<Constant>> constant_pool;
   std::vector<MethodInfo> methods;
+  std::vector<std::unique_ptr<VirtualMethod>> virtual_methods;
 };
 } // namespace
 
-std::unique_ptr<Program> Program::JavaProgram() {
-  return std::make_unique<JvmProgram>();
+Code::Label Code::NewLabel() {
+  labels_.emplace_back();
+  return labels_.size() - 1;
+}
+
+void Code::Bind(Label label) { labels_[label] = os_.tellp(); }
+
+void Code::Branch(uint8_t opcode, Label label) {
+  branches_.emplace_back(os_.tellp(), label);
+  os_.put(opcode);
+  Put2(os_, 0);
+}
+
+void Code::TableSwitch(int32_t low, const std::vector<Label>& labels,
+                       Label otherwise) {
+  size_t instruction = os_.tellp();
+  os_.put(Instruction::_tableswitch);
+  // Operands start at a multiple of 4 bytes from the start of the code.
+  while (os_.tellp() % 4 != 0) os_.put(0);
+  PutSwitchOffset(instruction, otherwise);
+  Put4(os_, low);
+  Put4(os_, low + int32_t(labels.size()) - 1);
+  for (Label label : labels) PutSwitchOffset(instruction, label);
+}
+
+void Code::LookupSwitch(const std::vector<std::pair<int32_t, Label>>& cases,
+                        Label otherwise) {
+  size_t instruction = os_.tellp();
+  os_.put(Instruction::_lookupswitch);
+  while (os_.tellp() % 4 != 0) os_.put(0);
+  PutSwitchOffset(instruction, otherwise);
+  Put4(os_, cases.size());
+  for (const auto& [value, label] : cases) {
+    Put4(os_, value);
+    PutSwitchOffset(instruction, label);
+  }
+}
+
+void Code::PutSwitchOffset(size_t instruction, Label label) {
+  switch_offsets_.push_back({instruction, size_t(os_.tellp()), label});
+  Put4(os_, 0);
+}
+
+std::optional<std::string> Code::Finish() const {
+  std::string code = os_.str();
+  for (const auto& [position, label] : branches_) {
+    // Offsets are relative to the branch instruction.
+    long offset = long(*labels_[label]) - long(position);
+    if (offset < INT16_MIN || offset > INT16_MAX) return {};
+    code[position + 1] = char(uint16_t(offset) >> 8);
+    code[position + 2] = char(offset & 255);
+  }
+  for (const auto& [instruction, position, label] : switch_offsets_) {
+    uint32_t offset = *labels_[label] - instruction;
+    for (int i = 0; i < 4; ++i) {
+      code[position + i] = char(offset >> (24 - 8 * i));
+    }
+  }
+  return code;
+}
+
+std::unique_ptr<Program> Program::JavaProgram(std::string_view class_name) {
+  return std::make_unique<JvmProgram>(class_name);
+}
+
+void Program::EmitJar(
+    std::ostream& os,
+    const std::vector<std::pair<std::string_view, std::string_view>>&
+        extra_entries) {
+  std::ostringstream class_bytes;
+  Emit(class_bytes);
+  JarWriter jar(os, ClassName());
+  jar.Add(ClassName() + ".class", class_bytes.str());
+  for (const auto& [name, bytes] : extra_entries) jar.Add(name, bytes);
+  jar.Finish();
 }
 
 } // namespace emit
@@ -1,8 +1,12 @@
 #pragma once
+#include <cstdint>
 #include <memory>
+#include <optional>
 #include <ostream>
 #include <sstream>
+#include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 namespace emit {
@@ -29,6 +33,53 @@ public:
   }
 };
 
+// Code of a method under construction, with labels for branches to code
+// not emitted yet.
+class Code {
+public:
+  using Label = size_t;
+
+  // Stream to write instructions to.
+  std::ostream& os() { return os_; }
+
+  Label NewLabel();
+  // Binds the given label to the next instruction.
+  void Bind(Label label);
+  // Writes a branch instruction, e.g. _goto or _if_icmpge, to the given
+  // label.
+  void Branch(uint8_t opcode, Label label);
+  // Writes a tableswitch that branches to labels[i] for value low + i, and
+  // to otherwise for other values.
+  void TableSwitch(int32_t low, const std::vector<Label>& labels,
+                   Label otherwise);
+  // Writes a lookupswitch that branches to the label of the given value, and
+  // to otherwise for other values. Cases are in increasing order of values.
+  void LookupSwitch(const std::vector<std::pair<int32_t, Label>>& cases,
+                    Label otherwise);
+
+  // Returns the code, with the offsets of branches filled in, or none if a
+  // branch is too long for the 2 byte offsets of branch instructions.
+  // Undefined behavior if labels branched to are not bound.
+  std::optional<std::string> Finish() const;
+
+private:
+  std::ostringstream os_;
+  // Positions of labels, by label, if bound.
+  std::vector<std::optional<size_t>> labels_;
+  // Positions of branch instructions, and their labels.
+  std::vector<std::pair<size_t, Label>> branches_;
+  // 4 byte offsets of switch instructions to labels.
+  struct SwitchOffset {
+    size_t instruction;
+    size_t position;
+    Label label;
+  };
+  std::vector<SwitchOffset> switch_offsets_;
+
+  // Writes a 4 byte offset from the given switch instruction to the label.
+  void PutSwitchOffset(size_t instruction, Label label);
+};
+
 // https://docs.oracle.com/javase/specs/jvms/se7/html/jvms-4.html#jvms-4.6
 enum Flag {
   ACC_PUBLIC =
@@ -51,18 +102,53 @@ enum Flag {
 };
 
 struct Program {
-  // Returns Program instance for Java class files.
-  static std::unique_ptr<Program> JavaProgram();
+  // Returns Program instance for Java class files, of a class with the
+  // given name in the unnamed package.
+  static std::unique_ptr<Program>
+  JavaProgram(std::string_view class_name = "Main");
 
   virtual ~Program() = default;
 
+  virtual const std::string& ClassName() const = 0;
+
   // Writes Java class file to given stream
   virtual void Emit(std::ostream& os) = 0;
+
+  // Writes a jar to the given stream with the Java class file, e.g. as
+  // Main.class, named as Main-Class in the manifest, followed by the given
+  // (path, bytes) entries, e.g. the Std runtime class.
+  void EmitJar(std::ostream& os,
+               const std::vector<std::pair<std::string_view, std::string_view>>&
+                   extra_entries = {});
   virtual const Pushable* DefineStringConstant(std::string_view text) = 0;
   virtual const Pushable* DefineIntegerConstant(int i) = 0;
+  // Returns the method implementing the built-in Tiger function with the
+  // given name, or nullptr.
   virtual const Invocable* LookupLibraryFunction(std::string_view name) = 0;
+  // Returns the instance method of the given class with the given name and
+  // descriptor, e.g. java/lang/String compareTo.
+  virtual const Invocable* LookupMethod(std::string_view class_name,
+                                        std::string_view name,
+                                        std::string_view descriptor) = 0;
+  // Returns the static method of the given class with the given name and
+  // descriptor, e.g. java/util/Arrays fill.
+  virtual const Invocable* LookupStaticMethod(std::string_view class_name,
+                                              std::string_view name,
+                                              std::string_view descriptor) = 0;
+  // Writes an instruction that replaces the length on the stack by a new
+  // array of ints, for an empty element class, or else of references to
+  // the given class, e.g. java/lang/String.
+  virtual void NewArray(std::ostream& os, std::string_view element_class) = 0;
+  // Writes an instruction that checks that the reference on the stack is
+  // null or of the given class, e.g. java/lang/Integer, or array type,
+  // e.g. [I, for the verifier.
+  virtual void CheckCast(std::ostream& os, std::string_view class_name) = 0;
+  // Defines a method whose code needs at most max_stack words of operand
+  // stack and max_locals words of local variables, including parameters.
   virtual void DefineFunction(uint16_t flags, std::string_view name,
                               std::string_view descriptor,
-                              std::string_view code_bytes) = 0;
+                              std::string_view code_bytes,
+                              uint16_t max_stack = 10,
+                              uint16_t max_locals = 10) = 0;
 };
 } // namespace emit
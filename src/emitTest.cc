@@ -2,59 +2,74 @@
 #include "instruction.h"
 #include "testing/catch.h"
 #include "testing/testing.h"
-#include <fstream>
 #include <iostream>
 #include <sstream>
-#include <streambuf>
 #include <string>
 
 namespace {
 using emit::Program;
 using emit::Pushable;
-using testing::RunJava;
-
-std::string ReadFile(const char* path) {
-  std::ifstream t(path);
-  return {std::istreambuf_iterator<char>(t), std::istreambuf_iterator<char>()};
-}
+using testing::RunClass;
 
 // Finishes the given instructions for the method body of "main" with a return
-// statement, defines the "main" method using these instructions, and outputs
-// the resulting program as class file /tmp/Main.class.
-void EmitAsMain(std::ostringstream& main_instructions, Program& program) {
+// statement, defines the "main" method using these instructions, and returns
+// the resulting program as a class file.
+std::string EmitAsMain(std::ostringstream& main_instructions,
+                       Program& program) {
   main_instructions.put(Instruction::_return);
   program.DefineFunction(emit::ACC_PUBLIC | emit::ACC_STATIC, "main",
                          "([Ljava/lang/String;)V", main_instructions.str());
-  std::ofstream out("/tmp/Main.class");
+  std::ostringstream out;
   program.Emit(out);
+  return out.str();
 }
 
 SCENARIO("emits class file", "[emit]") {
   GIVEN("Hello World") {
     const char* msg = "Hello, World!\n";
+    std::string class_file;
     auto program = Program::JavaProgram();
     if (auto f = program->LookupLibraryFunction("print"); f) {
       const Pushable* text = program->DefineStringConstant(msg);
       std::ostringstream main_instructions;
       f->Call(main_instructions, {text});
-      EmitAsMain(main_instructions, *program);
+      class_file = EmitAsMain(main_instructions, *program);
     } else {
       FAIL("Library function print not found");
     }
-    REQUIRE(RunJava() == msg);
+    REQUIRE(RunClass(class_file).out == msg);
   }
 
   GIVEN("printint") {
+    std::string class_file;
     auto program = Program::JavaProgram();
     if (auto f = program->LookupLibraryFunction("printi"); f) {
       const Pushable* int_constant = program->DefineIntegerConstant(20202020);
       std::ostringstream main_instructions;
       f->Call(main_instructions, {int_constant});
-      EmitAsMain(main_instructions, *program);
+      class_file = EmitAsMain(main_instructions, *program);
     } else {
       FAIL("Library function printi not found");
     }
-    REQUIRE(RunJava() == "20202020");
+    REQUIRE(RunClass(class_file).out == "20202020");
+  }
+
+  GIVEN("exit") {
+    auto program = Program::JavaProgram();
+    auto print = program->LookupLibraryFunction("print");
+    auto exit = program->LookupLibraryFunction("exit");
+    REQUIRE(print);
+    REQUIRE(exit);
+    std::ostringstream main_instructions;
+    print->Call(main_instructions, {program->DefineStringConstant("bye")});
+    exit->Call(main_instructions, {program->DefineIntegerConstant(3)});
+    std::string class_file = EmitAsMain(main_instructions, *program);
+    testing::JavaRun run = RunClass(class_file);
+    REQUIRE(run.out == "bye");
+    REQUIRE(run.exit_code == 3);
+    THEN("classes still run afterwards") {
+      REQUIRE(RunClass(class_file).out == "bye");
+    }
   }
 }
 } // namespace
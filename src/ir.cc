@@ -0,0 +1,768 @@
+#include "ir.h"
+#include "BuiltIns.h"
+#include <algorithm>
+#include <optional>
+#include <sstream>
+#include <unordered_set>
+
+namespace ir {
+
+Cmp Negate(Cmp cmp) {
+  switch (cmp) {
+  case Cmp::kEq:
+    return Cmp::kNe;
+  case Cmp::kNe:
+    return Cmp::kEq;
+  case Cmp::kLt:
+    return Cmp::kGe;
+  case Cmp::kGe:
+    return Cmp::kLt;
+  case Cmp::kGt:
+    return Cmp::kLe;
+  default:
+    return Cmp::kGt;
+  }
+}
+
+bool Converts(Type from, Type to) {
+  return from == to ||
+         (from != Type::kInt && to != Type::kInt &&
+          (from == Type::kRecord || to == Type::kRecord));
+}
+
+Reg Function::NewRegister(Type type, std::string_view name) {
+  registers.push_back(type);
+  register_names.emplace_back(name);
+  return registers.size() - 1;
+}
+
+BlockId Function::NewBlock() {
+  blocks.emplace_back();
+  return blocks.size() - 1;
+}
+
+int32_t Function::AddString(std::string_view text) {
+  strings.emplace_back(text);
+  return strings.size() - 1;
+}
+
+std::vector<uint16_t> Utf16(std::string_view text) {
+  std::vector<uint16_t> units;
+  for (size_t i = 0; i < text.size();) {
+    auto byte = [&](size_t k) { return uint8_t(text[i + k]); };
+    uint32_t c = byte(0);
+    size_t length = c < 0x80 ? 1 : c >> 5 == 6 ? 2 : c >> 4 == 14 ? 3
+                                 : c >> 3 == 30 ? 4 : 0;
+    bool valid = length && i + length <= text.size();
+    for (size_t k = 1; valid && k < length; ++k) {
+      valid = byte(k) >> 6 == 2;
+    }
+    if (!valid) {
+      units.push_back(0xfffd);
+      ++i;
+      continue;
+    }
+    if (length > 1) c &= 0x7f >> length;
+    for (size_t k = 1; k < length; ++k) c = c << 6 | (byte(k) & 0x3f);
+    if (c >= 0x10000) {
+      units.push_back(0xd800 + ((c - 0x10000) >> 10));
+      units.push_back(0xdc00 + ((c - 0x10000) & 0x3ff));
+    } else {
+      units.push_back(c);
+    }
+    i += length;
+  }
+  return units;
+}
+
+std::vector<BlockId> Successors(const Block& block) {
+  return block.terminator.targets;
+}
+
+std::vector<std::vector<BlockId>> Predecessors(const Function& f) {
+  std::vector<std::vector<BlockId>> predecessors(f.blocks.size());
+  for (BlockId b = 0; b < f.blocks.size(); ++b) {
+    for (BlockId s : Successors(f.blocks[b])) {
+      if (s < f.blocks.size() &&
+          (predecessors[s].empty() || predecessors[s].back() != b)) {
+        predecessors[s].push_back(b);
+      }
+    }
+  }
+  return predecessors;
+}
+
+std::vector<BlockId> Dominators(const Function& f) {
+  // Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm", over
+  // blocks in reverse postorder.
+  std::vector<BlockId> order;
+  std::vector<uint32_t> rank(f.blocks.size(), UINT32_MAX);
+  if (!f.blocks.empty()) {
+    std::vector<std::pair<BlockId, size_t>> stack = {{0, 0}};
+    rank[0] = 0;
+    while (!stack.empty()) {
+      auto& [b, next] = stack.back();
+      const std::vector<BlockId>& targets = f.blocks[b].terminator.targets;
+      if (next < targets.size()) {
+        BlockId s = targets[next++];
+        if (s < f.blocks.size() && rank[s] == UINT32_MAX) {
+          rank[s] = 0;
+          stack.push_back({s, 0});
+        }
+      } else {
+        order.push_back(b);
+        stack.pop_back();
+      }
+    }
+    std::reverse(order.begin(), order.end());
+    for (size_t i = 0; i < order.size(); ++i) rank[order[i]] = i;
+  }
+  std::vector<std::vector<BlockId>> predecessors = Predecessors(f);
+  std::vector<BlockId> idom(f.blocks.size(), kNoBlock);
+  auto intersect = [&](BlockId a, BlockId b) {
+    while (a != b) {
+      while (rank[a] > rank[b]) a = idom[a];
+      while (rank[b] > rank[a]) b = idom[b];
+    }
+    return a;
+  };
+  if (!order.empty()) idom[0] = 0;
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (size_t i = 1; i < order.size(); ++i) {
+      BlockId b = order[i];
+      BlockId dominator = kNoBlock;
+      for (BlockId p : predecessors[b]) {
+        if (idom[p] == kNoBlock) continue;
+        dominator = dominator == kNoBlock ? p : intersect(p, dominator);
+      }
+      if (dominator != idom[b]) {
+        idom[b] = dominator;
+        changed = true;
+      }
+    }
+  }
+  if (!order.empty()) idom[0] = kNoBlock;
+  return idom;
+}
+
+bool Loop::Contains(BlockId block) const {
+  return std::binary_search(blocks.begin(), blocks.end(), block);
+}
+
+std::vector<Loop> FindLoops(const Function& f) {
+  std::vector<BlockId> idom = Dominators(f);
+  auto reached = [&](BlockId b) { return b == 0 || idom[b] != kNoBlock; };
+  // Numbers the blocks reached in preorder of the dominator tree, so that
+  // the blocks that a block dominates are those numbered from its number to
+  // the last number in its subtree.
+  std::vector<std::vector<BlockId>> children(f.blocks.size());
+  for (BlockId b = 1; b < f.blocks.size(); ++b) {
+    if (idom[b] != kNoBlock) children[idom[b]].push_back(b);
+  }
+  std::vector<uint32_t> first(f.blocks.size());
+  std::vector<uint32_t> last(f.blocks.size());
+  if (!f.blocks.empty()) {
+    uint32_t number = 0;
+    std::vector<std::pair<BlockId, size_t>> stack = {{0, 0}};
+    first[0] = number++;
+    while (!stack.empty()) {
+      auto& [b, next] = stack.back();
+      if (next < children[b].size()) {
+        BlockId child = children[b][next++];
+        first[child] = number++;
+        stack.push_back({child, 0});
+      } else {
+        last[b] = number - 1;
+        stack.pop_back();
+      }
+    }
+  }
+  // For b reached.
+  auto dominates = [&](BlockId a, BlockId b) {
+    return reached(a) && first[a] <= first[b] && first[b] <= last[a];
+  };
+  std::vector<std::vector<BlockId>> predecessors = Predecessors(f);
+  std::vector<Loop> loops;
+  for (BlockId header = 0; header < f.blocks.size(); ++header) {
+    std::vector<BlockId> work;
+    for (BlockId p : predecessors[header]) {
+      if (reached(p) && dominates(header, p)) work.push_back(p);
+    }
+    if (work.empty()) continue;
+    std::vector<bool> in_loop(f.blocks.size());
+    in_loop[header] = true;
+    Loop loop = {header, {header}};
+    while (!work.empty()) {
+      BlockId b = work.back();
+      work.pop_back();
+      if (in_loop[b] || !reached(b)) continue;
+      in_loop[b] = true;
+      loop.blocks.push_back(b);
+      work.insert(work.end(), predecessors[b].begin(), predecessors[b].end());
+    }
+    std::sort(loop.blocks.begin(), loop.blocks.end());
+    loops.push_back(std::move(loop));
+  }
+  return loops;
+}
+
+const char* Name(Type type) {
+  switch (type) {
+  case Type::kInt:
+    return "int";
+  case Type::kString:
+    return "string";
+  case Type::kIntArray:
+    return "int[]";
+  case Type::kStringArray:
+    return "string[]";
+  default:
+    return "record";
+  }
+}
+
+const char* Name(Op op) {
+  switch (op) {
+  case Op::kConst:
+    return "const";
+  case Op::kString:
+    return "string";
+  case Op::kNil:
+    return "nil";
+  case Op::kMove:
+    return "move";
+  case Op::kNeg:
+    return "neg";
+  case Op::kAdd:
+    return "add";
+  case Op::kSub:
+    return "sub";
+  case Op::kMul:
+    return "mul";
+  case Op::kDiv:
+    return "div";
+  case Op::kShl:
+    return "shl";
+  case Op::kShr:
+    return "shr";
+  case Op::kUShr:
+    return "ushr";
+  case Op::kIncrement:
+    return "increment";
+  case Op::kCompareStrings:
+    return "compare";
+  case Op::kCall:
+    return "call";
+  case Op::kNewArray:
+    return "newarray";
+  case Op::kLoadElement:
+    return "load";
+  case Op::kStoreElement:
+    return "store";
+  case Op::kLength:
+    return "length";
+  case Op::kCallFunction:
+    return "callf";
+  case Op::kNewRecord:
+    return "record";
+  case Op::kLoadField:
+    return "loadfield";
+  default:
+    return "storefield";
+  }
+}
+
+const char* Name(Cmp cmp) {
+  switch (cmp) {
+  case Cmp::kEq:
+    return "eq";
+  case Cmp::kNe:
+    return "ne";
+  case Cmp::kLt:
+    return "lt";
+  case Cmp::kGe:
+    return "ge";
+  case Cmp::kGt:
+    return "gt";
+  default:
+    return "le";
+  }
+}
+
+namespace {
+
+// Writes strings quoted, with escapes as in Tiger.
+void Quote(std::ostream& os, const std::string& text) {
+  os << '"';
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      os << '\\' << c;
+    } else if (c == '\n') {
+      os << "\\n";
+    } else if (c == '\t') {
+      os << "\\t";
+    } else if (static_cast<unsigned char>(c) < ' ') {
+      os << '\\' << char('0' + (c >> 6 & 7)) << char('0' + (c >> 3 & 7))
+         << char('0' + (c & 7));
+    } else {
+      os << c;
+    }
+  }
+  os << '"';
+}
+
+class Printer {
+public:
+  Printer(const Function& f, std::ostream& os, const Module* module)
+      : f_(f), os_(os), module_(module) {}
+
+  void Print() {
+    os_ << "function " << f_.name;
+    if (f_.param_count > 0) {
+      os_ << "(";
+      for (Reg r = 0; r < f_.param_count; ++r) {
+        if (r > 0) os_ << ", ";
+        Register(r);
+        if (r < f_.registers.size()) os_ << ":" << Name(f_.registers[r]);
+      }
+      os_ << ")";
+    }
+    if (f_.result) os_ << ": " << Name(*f_.result);
+    os_ << "\n";
+    for (BlockId b = 0; b < f_.blocks.size(); ++b) {
+      os_ << "b" << b << ":\n";
+      for (const Instruction& i : f_.blocks[b].instructions) {
+        os_ << "  ";
+        Print(i);
+        os_ << "\n";
+      }
+      os_ << "  ";
+      Print(f_.blocks[b].terminator);
+      os_ << "\n";
+    }
+  }
+
+private:
+  void Print(const Instruction& i) {
+    if (i.dest != kNoReg) {
+      Register(i.dest);
+      if (i.dest < f_.registers.size()) {
+        os_ << ":" << Name(f_.registers[i.dest]);
+      }
+      os_ << " = ";
+    }
+    os_ << Name(i.op);
+    if (i.op == Op::kConst || i.op == Op::kIncrement ||
+        i.op == Op::kLoadField || i.op == Op::kStoreField) {
+      os_ << " " << i.imm;
+    } else if (i.op == Op::kCallFunction) {
+      if (module_ && i.imm >= 0 &&
+          size_t(i.imm) < module_->functions.size()) {
+        os_ << " " << module_->functions[i.imm].name;
+      } else {
+        os_ << " #" << i.imm;
+      }
+    } else if (i.op == Op::kString || i.op == Op::kCall) {
+      os_ << " ";
+      if (i.imm >= 0 && size_t(i.imm) < f_.strings.size()) {
+        if (i.op == Op::kCall) {
+          os_ << f_.strings[i.imm];
+        } else {
+          Quote(os_, f_.strings[i.imm]);
+        }
+      } else {
+        os_ << "?" << i.imm;
+      }
+    }
+    Operands(i.operands);
+  }
+
+  void Print(const Terminator& t) {
+    switch (t.kind) {
+    case Terminator::kNone:
+      os_ << "<unterminated>";
+      return;
+    case Terminator::kJump:
+      os_ << "jump";
+      break;
+    case Terminator::kBranch:
+      os_ << "br " << Name(t.cmp);
+      Operands(t.operands);
+      if (t.operands.size() == 1) os_ << ", 0";
+      os_ << " ?";
+      break;
+    case Terminator::kSwitch:
+      os_ << "switch";
+      Operands(t.operands);
+      break;
+    case Terminator::kReturn:
+      os_ << "return";
+      Operands(t.operands);
+      break;
+    }
+    for (size_t i = 0; i < t.targets.size(); ++i) {
+      if (t.kind == Terminator::kBranch && i == 1) {
+        os_ << " :";
+      } else if (t.kind == Terminator::kSwitch) {
+        os_ << (i == 0 ? " default" : ",");
+        if (i > 0 && i - 1 < t.values.size()) os_ << " " << t.values[i - 1];
+        if (i > 0) os_ << " ->";
+      }
+      os_ << " b" << t.targets[i];
+    }
+    if (!t.counts.empty()) {
+      os_ << " ; counts";
+      for (uint64_t count : t.counts) os_ << " " << count;
+    }
+  }
+
+  // Writes operands separated by commas.
+  void Operands(const std::vector<Reg>& operands) {
+    for (size_t i = 0; i < operands.size(); ++i) {
+      os_ << (i > 0 ? ", " : " ");
+      Register(operands[i]);
+    }
+  }
+
+  void Register(Reg r) {
+    os_ << "%" << r;
+    if (r < f_.register_names.size() && !f_.register_names[r].empty()) {
+      os_ << "." << f_.register_names[r];
+    }
+  }
+
+  const Function& f_;
+  std::ostream& os_;
+  const Module* module_;
+};
+
+bool IsArray(Type type) {
+  return type == Type::kIntArray || type == Type::kStringArray;
+}
+
+Type ElementType(Type array) {
+  return array == Type::kIntArray ? Type::kInt : Type::kString;
+}
+
+class Verifier {
+public:
+  Verifier(const Function& f, const Module* module)
+      : f_(f), module_(module) {}
+
+  std::vector<std::string> Verify() {
+    block_ = f_.blocks.size();
+    if (f_.blocks.empty()) Error() << "no blocks";
+    if (f_.register_names.size() != f_.registers.size()) {
+      Error() << "register names do not match registers";
+    }
+    if (f_.param_count > f_.registers.size()) {
+      Error() << f_.param_count << " parameters of " << f_.registers.size()
+              << " registers";
+    }
+    for (block_ = 0; block_ < f_.blocks.size(); ++block_) {
+      const Block& block = f_.blocks[block_];
+      for (index_ = 0; index_ < block.instructions.size(); ++index_) {
+        Verify(block.instructions[index_]);
+      }
+      Verify(block.terminator);
+    }
+    return std::move(errors_);
+  }
+
+private:
+  // Adds its text to the errors on destruction.
+  struct Emitter : std::ostringstream {
+    Emitter(std::vector<std::string>& errors, const std::string& location)
+        : errors(errors) {
+      *this << location;
+    }
+    ~Emitter() { errors.push_back(str()); }
+    std::vector<std::string>& errors;
+  };
+
+  Emitter Error() { return Emitter(errors_, Location()); }
+
+  // Returns the instruction or terminator verified, e.g. "b1[0] add: ".
+  std::string Location() {
+    if (block_ >= f_.blocks.size()) return "";
+    std::string location = "b" + std::to_string(block_);
+    if (index_ < f_.blocks[block_].instructions.size()) {
+      location += "[" + std::to_string(index_) + "] " +
+                  Name(f_.blocks[block_].instructions[index_].op);
+    } else {
+      location += " terminator";
+    }
+    return location + ": ";
+  }
+
+  // Returns the type of a register, or none if out of range.
+  std::optional<Type> TypeOf(Reg r) {
+    if (r < f_.registers.size()) return f_.registers[r];
+    Error() << "no register %" << r;
+    return {};
+  }
+
+  void Expect(Reg r, Type type) {
+    if (auto t = TypeOf(r); t && !Converts(*t, type)) {
+      Error() << "%" << r << " is " << Name(*t) << ", not " << Name(type);
+    }
+  }
+
+  void Verify(const Instruction& i) {
+    const std::vector<Reg>& a = i.operands;
+    size_t operands = 0;
+    bool has_dest = true;
+    std::optional<Type> dest =
+        i.dest == kNoReg ? std::nullopt : TypeOf(i.dest);
+    std::optional<Type> expected;
+    switch (i.op) {
+    case Op::kConst:
+    case Op::kIncrement:
+      expected = Type::kInt;
+      break;
+    case Op::kString:
+      expected = Type::kString;
+      if (i.imm < 0 || size_t(i.imm) >= f_.strings.size()) {
+        Error() << "no string " << i.imm;
+      }
+      break;
+    case Op::kNil:
+      if (dest == Type::kInt) Error() << "nil int";
+      break;
+    case Op::kMove:
+      operands = 1;
+      if (a.size() == 1 && dest) Expect(a[0], *dest);
+      break;
+    case Op::kNeg:
+      operands = 1;
+      expected = Type::kInt;
+      if (a.size() == 1) Expect(a[0], Type::kInt);
+      break;
+    case Op::kAdd:
+    case Op::kSub:
+    case Op::kMul:
+    case Op::kDiv:
+    case Op::kShl:
+    case Op::kShr:
+    case Op::kUShr:
+      operands = 2;
+      expected = Type::kInt;
+      for (Reg r : a) Expect(r, Type::kInt);
+      break;
+    case Op::kCompareStrings:
+      operands = 2;
+      expected = Type::kInt;
+      for (Reg r : a) Expect(r, Type::kString);
+      break;
+    case Op::kCall:
+      operands = a.size();
+      VerifyCall(i);
+      has_dest = i.dest != kNoReg;
+      break;
+    case Op::kNewArray:
+      operands = a.size() == 2 ? 2 : 1;
+      if (dest && !IsArray(*dest)) Error() << "not an array type";
+      if (!a.empty()) Expect(a[0], Type::kInt);
+      if (a.size() == 2 && dest && IsArray(*dest)) {
+        Expect(a[1], ElementType(*dest));
+      }
+      break;
+    case Op::kLoadElement:
+    case Op::kStoreElement:
+      operands = i.op == Op::kLoadElement ? 2 : 3;
+      has_dest = i.op == Op::kLoadElement;
+      if (a.size() == operands) {
+        auto array = TypeOf(a[0]);
+        Expect(a[1], Type::kInt);
+        if (array && !IsArray(*array)) {
+          Error() << "%" << a[0] << " is not an array";
+        } else if (array) {
+          expected = ElementType(*array);
+          if (i.op == Op::kStoreElement) Expect(a[2], *expected);
+        }
+      }
+      break;
+    case Op::kLength:
+      operands = 1;
+      expected = Type::kInt;
+      if (a.size() == 1) {
+        if (auto t = TypeOf(a[0]); t && !IsArray(*t)) {
+          Error() << "%" << a[0] << " is not an array";
+        }
+      }
+      break;
+    case Op::kCallFunction:
+      operands = a.size();
+      has_dest = VerifyCallFunction(i, dest);
+      break;
+    case Op::kNewRecord:
+      operands = a.size();
+      expected = Type::kRecord;
+      break;
+    case Op::kLoadField:
+    case Op::kStoreField:
+      operands = i.op == Op::kLoadField ? 1 : 2;
+      has_dest = i.op == Op::kLoadField;
+      if (i.imm < 0) Error() << "no field " << i.imm;
+      if (!a.empty()) {
+        if (auto t = TypeOf(a[0]); t && *t != Type::kRecord) {
+          Error() << "%" << a[0] << " is not a record";
+        }
+      }
+      if (a.size() == 2) TypeOf(a[1]);
+      break;
+    }
+    if (a.size() != operands) {
+      Error() << a.size() << " operands, not " << operands;
+    }
+    if (has_dest != (i.dest != kNoReg)) {
+      Error() << (has_dest ? "no destination" : "unexpected destination");
+    } else if (expected && dest && *dest != *expected) {
+      Error() << "destination is " << Name(*dest) << ", not "
+              << Name(*expected);
+    }
+  }
+
+  void VerifyCall(const Instruction& i) {
+    if (i.imm < 0 || size_t(i.imm) >= f_.strings.size()) {
+      Error() << "no string " << i.imm;
+      return;
+    }
+    const BuiltInFunction* function = FindBuiltInFunction(f_.strings[i.imm]);
+    if (!function) {
+      Error() << f_.strings[i.imm] << " is not built in";
+      return;
+    }
+    if (i.operands.size() != size_t(function->param_count)) {
+      Error() << function->name << " takes " << function->param_count
+              << " arguments";
+      return;
+    }
+    auto type = [](std::string_view id) {
+      return id == "int" ? Type::kInt : Type::kString;
+    };
+    for (size_t p = 0; p < i.operands.size(); ++p) {
+      Expect(i.operands[p], type(function->params[p].type_id));
+    }
+    if (function->result_type.empty()) {
+      if (i.dest != kNoReg) Error() << function->name << " returns no value";
+    } else if (i.dest != kNoReg) {
+      Expect(i.dest, type(function->result_type));
+    }
+  }
+
+  // Checks a call of a function of the module, if known, with the given
+  // type of destination, and returns whether the call should have one.
+  bool VerifyCallFunction(const Instruction& i,
+                          std::optional<Type> dest) {
+    for (Reg r : i.operands) TypeOf(r);
+    if (!module_) return i.dest != kNoReg;
+    if (i.imm < 0 || size_t(i.imm) >= module_->functions.size()) {
+      Error() << "no function #" << i.imm;
+      return i.dest != kNoReg;
+    }
+    const Function& callee = module_->functions[i.imm];
+    if (i.operands.size() != callee.param_count ||
+        callee.param_count > callee.registers.size()) {
+      Error() << callee.name << " takes " << callee.param_count
+              << " arguments";
+      return bool(callee.result);
+    }
+    for (size_t p = 0; p < i.operands.size(); ++p) {
+      Expect(i.operands[p], callee.registers[p]);
+    }
+    if (dest && callee.result && !Converts(*callee.result, *dest)) {
+      Error() << callee.name << " returns " << Name(*callee.result)
+              << ", not " << Name(*dest);
+    }
+    return bool(callee.result);
+  }
+
+  void Verify(const Terminator& t) {
+    index_ = f_.blocks[block_].instructions.size();
+    size_t targets = 0;
+    switch (t.kind) {
+    case Terminator::kNone:
+      Error() << "missing";
+      return;
+    case Terminator::kJump:
+      targets = 1;
+      if (!t.operands.empty()) Error() << "unexpected operands";
+      break;
+    case Terminator::kBranch:
+      targets = 2;
+      if (t.operands.size() == 1) {
+        Expect(t.operands[0], Type::kInt);
+      } else if (t.operands.size() == 2) {
+        auto left = TypeOf(t.operands[0]);
+        auto right = TypeOf(t.operands[1]);
+        if (left && right && (*left == Type::kInt) != (*right == Type::kInt)) {
+          Error() << "compares " << Name(*left) << " and " << Name(*right);
+        } else if (left && *left != Type::kInt && t.cmp != Cmp::kEq &&
+                   t.cmp != Cmp::kNe) {
+          Error() << "orders references";
+        }
+      } else {
+        Error() << t.operands.size() << " operands";
+      }
+      break;
+    case Terminator::kSwitch: {
+      targets = t.values.size() + 1;
+      if (t.operands.size() == 1) {
+        Expect(t.operands[0], Type::kInt);
+      } else {
+        Error() << t.operands.size() << " operands";
+      }
+      std::unordered_set<int32_t> values(t.values.begin(), t.values.end());
+      if (values.size() != t.values.size()) Error() << "repeated values";
+      break;
+    }
+    case Terminator::kReturn:
+      if (t.operands.size() != (f_.result ? 1 : 0)) {
+        Error() << t.operands.size() << " operands";
+      } else if (f_.result) {
+        Expect(t.operands[0], *f_.result);
+      }
+      break;
+    }
+    if (t.targets.size() != targets) {
+      Error() << t.targets.size() << " targets, not " << targets;
+    }
+    if (!t.counts.empty() && t.counts.size() != t.targets.size()) {
+      Error() << t.counts.size() << " counts of " << t.targets.size()
+              << " targets";
+    }
+    for (BlockId target : t.targets) {
+      if (target >= f_.blocks.size()) Error() << "no block b" << target;
+    }
+  }
+
+  const Function& f_;
+  const Module* module_;
+  std::vector<std::string> errors_;
+  // Instruction verified, or the terminator for the index past them, or
+  // the function for a block past the blocks.
+  BlockId block_ = 0;
+  size_t index_ = 0;
+};
+} // namespace
+
+void Dump(const Function& f, std::ostream& os, const Module* module) {
+  Printer(f, os, module).Print();
+}
+
+std::string ToString(const Function& f, const Module* module) {
+  std::ostringstream os;
+  Dump(f, os, module);
+  return os.str();
+}
+
+void Dump(const Module& m, std::ostream& os) {
+  for (const Function& f : m.functions) Dump(f, os, &m);
+}
+
+std::vector<std::string> Verify(const Function& f, const Module* module) {
+  return Verifier(f, module).Verify();
+}
+} // namespace ir
@@ -0,0 +1,183 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Three-address intermediate representation of programs, between the
+// typed tree and JVM bytecode: lower.h builds it, passes.h transforms it,
+// and codegen.h emits bytecode from it. A Function is a control flow graph
+// of basic blocks, whose instructions read and write virtual registers of
+// one Type each. Registers of Tiger variables are written more than once,
+// so the IR is not in SSA form. A Module holds the functions of a program,
+// which call each other by their index in it.
+namespace ir {
+
+// Types of values. kRecord is also the type of references of unknown type,
+// e.g. nil, which convert to all types but kInt. Records are arrays of
+// fields of any type, as they are on the JVM.
+enum class Type : uint8_t { kInt, kString, kIntArray, kStringArray, kRecord };
+
+// Returns whether values of type from are also values of type to.
+bool Converts(Type from, Type to);
+
+// Virtual register, an index in Function::registers.
+using Reg = uint32_t;
+constexpr Reg kNoReg = UINT32_MAX;
+
+// Basic block, an index in Function::blocks.
+using BlockId = uint32_t;
+constexpr BlockId kNoBlock = UINT32_MAX;
+
+enum class Op : uint8_t {
+  kConst,          // dest = imm
+  kString,         // dest = strings[imm]
+  kNil,            // dest = nil, of a type other than int
+  kMove,           // dest = a
+  kNeg,            // dest = -a
+  kAdd,            // dest = a + b
+  kSub,            // dest = a - b
+  kMul,            // dest = a * b
+  kDiv,            // dest = a / b
+  kShl,            // dest = a << b
+  kShr,            // dest = a >> b, with the sign of a
+  kUShr,           // dest = a >> b, with zeros
+  kIncrement,      // dest = dest + imm, without operands
+  kCompareStrings, // dest = a.compareTo(b), < 0, 0, or > 0
+  kCall,           // [dest =] strings[imm](operands), a built-in function
+  kNewArray,       // dest = array of length a, of elements b, or 0 if none
+  kLoadElement,    // dest = a[b]
+  kStoreElement,   // a[b] = c
+  kLength,         // dest = length of array a
+  kCallFunction,   // [dest =] functions[imm](operands), in the module
+  kNewRecord,      // dest = record of fields operands, in order
+  kLoadField,      // dest = a.fields[imm]
+  kStoreField,     // a.fields[imm] = b
+};
+
+enum class Cmp : uint8_t { kEq, kNe, kLt, kGe, kGt, kLe };
+
+// Returns the comparison that holds when the given one does not.
+Cmp Negate(Cmp cmp);
+
+struct Instruction {
+  Op op;
+  Reg dest = kNoReg;
+  int32_t imm = 0;
+  std::vector<Reg> operands;
+};
+
+struct Terminator {
+  enum Kind : uint8_t {
+    // Of a block still under construction.
+    kNone,
+    kJump,
+    // To targets[0] if operands[0] cmp operands[1], or operands[0] cmp 0
+    // for one operand, else to targets[1]. Operands other than ints
+    // compare only by kEq and kNe, by identity.
+    kBranch,
+    // To the target of the case of operands[0] in values, i.e. to
+    // targets[i + 1] for values[i], or else to targets[0].
+    kSwitch,
+    // With the value of operands[0] for functions with a result.
+    kReturn,
+  };
+  Kind kind = kNone;
+  Cmp cmp = Cmp::kEq;
+  std::vector<Reg> operands;
+  std::vector<BlockId> targets;
+  std::vector<int32_t> values;
+  // Times that each target was taken, from a profile, see profile.h, or
+  // empty if unknown.
+  std::vector<uint64_t> counts;
+};
+
+struct Block {
+  std::vector<Instruction> instructions;
+  Terminator terminator;
+};
+
+struct Function {
+  std::string name;
+  // Blocks in the order of their code, starting with the entry.
+  std::vector<Block> blocks;
+  // Registers, of which the first param_count hold the arguments.
+  std::vector<Type> registers;
+  uint32_t param_count = 0;
+  // Type of the value returned, if any.
+  std::optional<Type> result;
+  // Names of the Tiger variables of registers, for dumps, or empty.
+  std::vector<std::string> register_names;
+  std::vector<std::string> strings;
+
+  Reg NewRegister(Type type, std::string_view name = "");
+  BlockId NewBlock();
+  int32_t AddString(std::string_view text);
+};
+
+// Functions of a program: main, which runs it, first, and then the
+// functions that it declares.
+struct Module {
+  std::vector<Function> functions;
+};
+
+// Returns the UTF-16 code units of the given UTF-8 text, as the JVM reads
+// string constants, with U+FFFD for malformed bytes.
+std::vector<uint16_t> Utf16(std::string_view text);
+
+// Returns the blocks that the given block may branch to.
+std::vector<BlockId> Successors(const Block& block);
+
+// Returns the blocks that may branch to each block.
+std::vector<std::vector<BlockId>> Predecessors(const Function& f);
+
+// Returns the immediate dominator of each block, i.e. the last block but
+// itself on every path from the entry to it, or kNoBlock for the entry and
+// for blocks that the entry does not reach.
+std::vector<BlockId> Dominators(const Function& f);
+
+// Natural loop: the blocks that reach a back edge, to a header that
+// dominates its source, without passing the header.
+struct Loop {
+  BlockId header;
+  // In increasing order, including the header.
+  std::vector<BlockId> blocks;
+
+  bool Contains(BlockId block) const;
+};
+
+// Returns the loops of the function, one for all back edges to each
+// header, by increasing header.
+std::vector<Loop> FindLoops(const Function& f);
+
+const char* Name(Type type);
+const char* Name(Op op);
+const char* Name(Cmp cmp);
+
+// Writes the function as text, e.g.
+//
+//   function main
+//   b0:
+//     %0:int = const 1
+//     %1:string = string "a"
+//     call print %1
+//     br lt %0, 0 ? b1 : b2
+//
+// Registers of variables show their names, as in %2.x, and terminators
+// their counts, if any, as in "br lt %0, 0 ? b1 : b2 ; counts 9 1".
+// Functions with parameters or a result show them after the name, as in
+// "function f(%0.link:record, %1.n:int): int", and calls their callee by
+// name if given the module, as in "callf f %2, %3", and else by index.
+void Dump(const Function& f, std::ostream& os,
+          const Module* module = nullptr);
+std::string ToString(const Function& f, const Module* module = nullptr);
+void Dump(const Module& m, std::ostream& os);
+
+// Returns descriptions of violations of the invariants of the IR, e.g.
+// operands of the wrong type, or blocks without terminators. Calls of
+// other functions are checked against them if given their module.
+std::vector<std::string> Verify(const Function& f,
+                                const Module* module = nullptr);
+} // namespace ir
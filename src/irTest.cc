@@ -0,0 +1,233 @@
+#include "ir.h"
+#include "passes.h"
+#include "testing/catch.h"
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+using namespace ir;
+
+// Returns a function that prints whether a is below 2, i.e.
+//
+//   b0: a = 1; if a < 2 goto b1 else b2
+//   b1: printi(a); goto b2
+//   b2: return
+Function Example() {
+  Function f;
+  f.name = "main";
+  BlockId entry = f.NewBlock();
+  BlockId then_block = f.NewBlock();
+  BlockId end = f.NewBlock();
+  Reg a = f.NewRegister(Type::kInt, "a");
+  Reg two = f.NewRegister(Type::kInt);
+  f.blocks[entry].instructions = {{Op::kConst, a, 1},
+                                  {Op::kConst, two, 2}};
+  f.blocks[entry].terminator = {Terminator::kBranch, Cmp::kLt, {a, two},
+                                {then_block, end}};
+  f.blocks[then_block].instructions = {
+      {Op::kCall, kNoReg, f.AddString("printi"), {a}}};
+  f.blocks[then_block].terminator = {Terminator::kJump, Cmp::kEq, {}, {end}};
+  f.blocks[end].terminator = {Terminator::kReturn};
+  return f;
+}
+
+SCENARIO("IR functions verify and print", "[ir]") {
+  GIVEN("a well formed function") {
+    Function f = Example();
+    REQUIRE(Verify(f).empty());
+    REQUIRE(ToString(f) == "function main\n"
+                           "b0:\n"
+                           "  %0.a:int = const 1\n"
+                           "  %1:int = const 2\n"
+                           "  br lt %0.a, %1 ? b1 : b2\n"
+                           "b1:\n"
+                           "  call printi %0.a\n"
+                           "  jump b2\n"
+                           "b2:\n"
+                           "  return\n");
+    REQUIRE(Predecessors(f) ==
+            std::vector<std::vector<BlockId>>{{}, {0}, {0, 1}});
+  }
+  GIVEN("a block without terminator") {
+    Function f = Example();
+    f.blocks[2].terminator = {};
+    REQUIRE(Verify(f) == std::vector<std::string>{"b2 terminator: missing"});
+  }
+  GIVEN("operands of the wrong type") {
+    Function f = Example();
+    Reg s = f.NewRegister(Type::kString);
+    f.blocks[0].instructions.push_back(
+        {Op::kString, s, f.AddString("a")});
+    f.blocks[1].instructions[0].operands = {s};
+    REQUIRE(Verify(f) ==
+            std::vector<std::string>{"b1[0] call: %2 is string, not int"});
+  }
+  GIVEN("a branch to no block") {
+    Function f = Example();
+    f.blocks[1].terminator.targets = {7};
+    REQUIRE(Verify(f) ==
+            std::vector<std::string>{"b1 terminator: no block b7"});
+  }
+  GIVEN("a call of a function that is not built in") {
+    Function f = Example();
+    f.strings[0] = "f";
+    REQUIRE(Verify(f) ==
+            std::vector<std::string>{"b1[0] call: f is not built in"});
+  }
+  GIVEN("nil, which converts to references") {
+    Function f = Example();
+    Reg nil = f.NewRegister(Type::kRecord);
+    Reg array = f.NewRegister(Type::kIntArray);
+    f.blocks[0].instructions.push_back({Op::kNil, nil});
+    f.blocks[0].instructions.push_back({Op::kMove, array, 0, {nil}});
+    REQUIRE(Verify(f).empty());
+    f.blocks[0].instructions.push_back({Op::kMove, 0, 0, {nil}});
+    REQUIRE(Verify(f) ==
+            std::vector<std::string>{"b0[4] move: %2 is record, not int"});
+  }
+  GIVEN("a call of a function of a module") {
+    // f(link, n) returns n; main prints f(nil, 1).
+    Module module;
+    module.functions.resize(2);
+    Function& f = module.functions[0];
+    Function& callee = module.functions[1];
+    f = Example();
+    callee.name = "f";
+    callee.NewRegister(Type::kRecord, "link");
+    Reg n = callee.NewRegister(Type::kInt, "n");
+    callee.param_count = 2;
+    callee.result = Type::kInt;
+    callee.blocks[callee.NewBlock()].terminator = {Terminator::kReturn,
+                                                   Cmp::kEq, {n}};
+    Reg link = f.NewRegister(Type::kRecord);
+    Reg result = f.NewRegister(Type::kInt);
+    f.blocks[0].instructions.push_back({Op::kNil, link});
+    f.blocks[0].instructions.push_back(
+        {Op::kCallFunction, result, 1, {link, 0}});
+    REQUIRE(Verify(f, &module).empty());
+    REQUIRE(Verify(callee, &module).empty());
+    REQUIRE(ToString(callee, &module) ==
+            "function f(%0.link:record, %1.n:int): int\n"
+            "b0:\n"
+            "  return %1.n\n");
+    REQUIRE(ToString(f, &module).find("%3:int = callf f %2, %0.a\n") !=
+            std::string::npos);
+    f.blocks[0].instructions.back().operands = {link};
+    REQUIRE(Verify(f, &module) ==
+            std::vector<std::string>{"b0[3] callf: f takes 2 arguments"});
+  }
+  GIVEN("records") {
+    Function f = Example();
+    Reg record = f.NewRegister(Type::kRecord);
+    Reg field = f.NewRegister(Type::kInt);
+    f.blocks[0].instructions.push_back({Op::kNewRecord, record, 0, {0}});
+    f.blocks[0].instructions.push_back({Op::kLoadField, field, 0, {record}});
+    f.blocks[0].instructions.push_back(
+        {Op::kStoreField, kNoReg, 0, {record, field}});
+    REQUIRE(Verify(f).empty());
+    REQUIRE(ToString(f).find("%2:record = record %0.a\n"
+                             "  %3:int = loadfield 0 %2\n"
+                             "  storefield 0 %2, %3\n") != std::string::npos);
+    f.blocks[0].instructions.back().operands = {0, field};
+    REQUIRE(Verify(f) ==
+            std::vector<std::string>{"b0[4] storefield: %0 is not a record"});
+  }
+  GIVEN("a switch") {
+    Function f = Example();
+    f.blocks[0].terminator = {Terminator::kSwitch, Cmp::kEq, {0}, {2, 1, 1},
+                              {5, -1}};
+    REQUIRE(Verify(f).empty());
+    REQUIRE(ToString(f).find("switch %0.a default b2, 5 -> b1, -1 -> b1") !=
+            std::string::npos);
+    f.blocks[0].terminator.values = {5, 5};
+    REQUIRE(Verify(f) ==
+            std::vector<std::string>{"b0 terminator: repeated values"});
+  }
+}
+
+SCENARIO("IR functions have dominators and loops", "[ir]") {
+  GIVEN("a loop") {
+    // b0: goto b1; b1: if a < 2 goto b2 else b3; b2: goto b1; b3: return;
+    // b4: goto b1
+    Function f = Example();
+    f.blocks[0].terminator = {Terminator::kJump, Cmp::kEq, {}, {1}};
+    f.blocks[2].terminator = {Terminator::kJump, Cmp::kEq, {}, {1}};
+    BlockId end = f.NewBlock();
+    BlockId unreachable = f.NewBlock();
+    f.blocks[end].terminator = {Terminator::kReturn};
+    f.blocks[1].terminator = {Terminator::kBranch, Cmp::kLt, {0, 1},
+                              {2, end}};
+    f.blocks[unreachable].terminator = {Terminator::kJump, Cmp::kEq, {}, {1}};
+    REQUIRE(Verify(f).empty());
+    REQUIRE(Dominators(f) ==
+            std::vector<BlockId>{kNoBlock, 0, 1, 1, kNoBlock});
+    std::vector<Loop> loops = FindLoops(f);
+    REQUIRE(loops.size() == 1);
+    REQUIRE(loops[0].header == 1);
+    REQUIRE(loops[0].blocks == std::vector<BlockId>{1, 2});
+  }
+  GIVEN("no loop") {
+    REQUIRE(FindLoops(Example()).empty());
+    REQUIRE(Dominators(Example()) == std::vector<BlockId>{kNoBlock, 0, 0});
+  }
+}
+
+SCENARIO("Passes transform verified functions", "[ir]") {
+  GIVEN("unreachable blocks") {
+    Function f = Example();
+    f.blocks[0].terminator = {Terminator::kJump, Cmp::kEq, {}, {2}};
+    REQUIRE(RemoveUnreachableBlocks(f));
+    REQUIRE(f.blocks.size() == 2);
+    REQUIRE(f.blocks[0].terminator.targets == std::vector<BlockId>{1});
+    REQUIRE(f.blocks[1].terminator.kind == Terminator::kReturn);
+    REQUIRE(!RemoveUnreachableBlocks(f));
+  }
+  GIVEN("jumps to empty blocks") {
+    Function f = Example();
+    f.blocks[1].instructions.clear();
+    REQUIRE(ThreadJumps(f));
+    REQUIRE(f.blocks[0].terminator.targets == std::vector<BlockId>{2, 2});
+    REQUIRE(RemoveUnreachableBlocks(f));
+    REQUIRE(f.blocks.size() == 2);
+    REQUIRE(!ThreadJumps(f));
+  }
+  GIVEN("an empty infinite loop") {
+    Function f;
+    BlockId loop = f.NewBlock();
+    f.blocks[loop].terminator = {Terminator::kJump, Cmp::kEq, {}, {loop}};
+    REQUIRE(!ThreadJumps(f));
+  }
+  GIVEN("a pass manager") {
+    PassManager passes;
+    passes.Add("unchanged", [](Function&) { return false; });
+    passes.Add("unreachable", RemoveUnreachableBlocks);
+    passes.Add("breaking", [](Function& f) {
+      f.blocks[0].terminator.targets.push_back(0);
+      return true;
+    });
+    passes.Add("never run", [](Function& f) -> bool { throw f.name; });
+    Function f = Example();
+    f.blocks[0].terminator = {Terminator::kJump, Cmp::kEq, {}, {2}};
+    std::ostringstream dump;
+    THEN("it reports the pass that broke the function") {
+      REQUIRE(passes.Run(f, &dump) ==
+              std::vector<std::string>{
+                  "breaking: b0 terminator: 2 targets, not 1"});
+    }
+    THEN("it dumps the function after each pass that changed it") {
+      passes.Run(f, &dump);
+      std::string text = dump.str();
+      REQUIRE(text.find("; input\nfunction main\n") == 0);
+      REQUIRE(text.find("; after unchanged") == std::string::npos);
+      REQUIRE(text.find("; after unreachable\n") != std::string::npos);
+      REQUIRE(text.find("; after breaking\n") != std::string::npos);
+    }
+    THEN("it verifies its input") {
+      f.blocks[1].terminator = {};
+      REQUIRE(passes.Run(f) ==
+              std::vector<std::string>{"input: b1 terminator: missing"});
+    }
+  }
+}
+} // namespace
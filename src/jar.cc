@@ -0,0 +1,110 @@
+#include "jar.h"
+#include <array>
+
+namespace emit {
+namespace {
+
+constexpr std::array<uint32_t, 256> MakeCrcTable() {
+  std::array<uint32_t, 256> table = {};
+  for (uint32_t i = 0; i < 256; ++i) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+    table[i] = c;
+  }
+  return table;
+}
+
+constexpr std::array<uint32_t, 256> kCrcTable = MakeCrcTable();
+
+// Zip headers are little endian, unlike class files.
+inline void Put2(std::ostream& os, uint16_t v) {
+  os.put(v & 255);
+  os.put(v >> 8);
+}
+
+inline void Put4(std::ostream& os, uint32_t v) {
+  Put2(os, v & 0xffff);
+  Put2(os, v >> 16);
+}
+
+constexpr uint32_t kLocalHeader = 0x04034b50;
+constexpr uint32_t kCentralHeader = 0x02014b50;
+constexpr uint32_t kEndOfCentralDirectory = 0x06054b50;
+constexpr uint16_t kVersion = 10; // 1.0 suffices for stored entries
+constexpr uint16_t kStored = 0;
+// MS-DOS time and date of 1980-01-01 00:00, so that output is reproducible.
+constexpr uint16_t kDosTime = 0;
+constexpr uint16_t kDosDate = (1 << 5) | 1;
+constexpr uint16_t kUtf8Names = 1 << 11;
+
+} // namespace
+
+uint32_t Crc32(std::string_view bytes) {
+  uint32_t c = 0xffffffff;
+  for (unsigned char b : bytes) c = kCrcTable[(c ^ b) & 255] ^ (c >> 8);
+  return c ^ 0xffffffff;
+}
+
+JarWriter::JarWriter(std::ostream& os, std::string_view main_class) : os_(os) {
+  std::string manifest = "Manifest-Version: 1.0\r\nMain-Class: ";
+  manifest.append(main_class);
+  // Lets the JVM find Std.class next to the jar, unless it is added as an
+  // entry.
+  manifest.append("\r\nClass-Path: ./\r\nCreated-By: tc\r\n\r\n");
+  Add("META-INF/MANIFEST.MF", manifest);
+}
+
+void JarWriter::Add(std::string_view name, std::string_view bytes) {
+  entries_.push_back({std::string(name), Crc32(bytes),
+                      static_cast<uint32_t>(bytes.size()), offset_});
+  const Entry& e = entries_.back();
+  Put4(os_, kLocalHeader);
+  Put2(os_, kVersion);
+  Put2(os_, kUtf8Names);
+  Put2(os_, kStored);
+  Put2(os_, kDosTime);
+  Put2(os_, kDosDate);
+  Put4(os_, e.crc);
+  Put4(os_, e.size); // compressed size
+  Put4(os_, e.size);
+  Put2(os_, e.name.size());
+  Put2(os_, 0); // extra field length
+  os_.write(e.name.data(), e.name.size());
+  os_.write(bytes.data(), bytes.size());
+  offset_ += 30 + e.name.size() + e.size;
+}
+
+void JarWriter::Finish() {
+  uint32_t directory_offset = offset_;
+  for (const Entry& e : entries_) {
+    Put4(os_, kCentralHeader);
+    Put2(os_, kVersion); // version made by
+    Put2(os_, kVersion); // version needed to extract
+    Put2(os_, kUtf8Names);
+    Put2(os_, kStored);
+    Put2(os_, kDosTime);
+    Put2(os_, kDosDate);
+    Put4(os_, e.crc);
+    Put4(os_, e.size);
+    Put4(os_, e.size);
+    Put2(os_, e.name.size());
+    Put2(os_, 0); // extra field length
+    Put2(os_, 0); // comment length
+    Put2(os_, 0); // disk number start
+    Put2(os_, 0); // internal attributes
+    Put4(os_, 0); // external attributes
+    Put4(os_, e.offset);
+    os_.write(e.name.data(), e.name.size());
+    offset_ += 46 + e.name.size();
+  }
+  Put4(os_, kEndOfCentralDirectory);
+  Put2(os_, 0); // number of this disk
+  Put2(os_, 0); // disk with central directory
+  Put2(os_, entries_.size());
+  Put2(os_, entries_.size());
+  Put4(os_, offset_ - directory_offset);
+  Put4(os_, directory_offset);
+  Put2(os_, 0); // comment length
+}
+
+} // namespace emit
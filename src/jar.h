@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace emit {
+
+// Returns the CRC-32 (ISO-HDLC, as used by zip) of the given bytes.
+uint32_t Crc32(std::string_view bytes);
+
+// Writes a jar file to a stream. All entries are STORED, i.e. not
+// compressed, so the JVM can map class bytes straight from the archive
+// without inflating them. See
+// https://pkware.cachefly.net/webdocs/casestudies/APPNOTE.TXT for the
+// format.
+class JarWriter {
+public:
+  // Starts a jar on the given stream with a manifest naming the given
+  // Main-Class.
+  JarWriter(std::ostream& os, std::string_view main_class);
+
+  // Appends an entry with the given path, e.g. "Main.class".
+  void Add(std::string_view name, std::string_view bytes);
+
+  // Writes the central directory. No entries may be added afterwards.
+  void Finish();
+
+private:
+  struct Entry {
+    std::string name;
+    uint32_t crc;
+    uint32_t size;
+    uint32_t offset;
+  };
+  std::ostream& os_;
+  uint32_t offset_ = 0;
+  std::vector<Entry> entries_;
+};
+
+} // namespace emit
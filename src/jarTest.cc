@@ -0,0 +1,72 @@
+#include "emit.h"
+#include "jar.h"
+#include "testing/catch.h"
+#include <sstream>
+#include <string>
+
+namespace {
+using emit::Crc32;
+using emit::JarWriter;
+using emit::Program;
+
+uint32_t Get2(const std::string& s, size_t at) {
+  return uint8_t(s[at]) | uint8_t(s[at + 1]) << 8;
+}
+
+uint32_t Get4(const std::string& s, size_t at) {
+  return Get2(s, at) | Get2(s, at + 2) << 16;
+}
+
+// Returns data of the stored entry with the given name, found through the
+// central directory, or "<missing>".
+std::string FindEntry(const std::string& jar, const std::string& name) {
+  size_t end = jar.size() - 22;
+  REQUIRE(Get4(jar, end) == 0x06054b50);
+  size_t at = Get4(jar, end + 16);
+  for (uint32_t n = Get2(jar, end + 10); n > 0; --n) {
+    REQUIRE(Get4(jar, at) == 0x02014b50);
+    uint32_t name_length = Get2(jar, at + 28);
+    if (jar.substr(at + 46, name_length) == name) {
+      size_t local = Get4(jar, at + 42);
+      REQUIRE(Get4(jar, local) == 0x04034b50);
+      REQUIRE(Get2(jar, local + 8) == 0); // STORED
+      uint32_t size = Get4(jar, local + 22);
+      std::string data =
+          jar.substr(local + 30 + Get2(jar, local + 26) + Get2(jar, local + 28),
+                     size);
+      REQUIRE(Crc32(data) == Get4(jar, local + 14));
+      return data;
+    }
+    at += 46 + name_length + Get2(jar, at + 30) + Get2(jar, at + 32);
+  }
+  return "<missing>";
+}
+
+SCENARIO("writes jar files", "[jar]") {
+  GIVEN("Known CRC-32 check values") {
+    REQUIRE(Crc32("") == 0);
+    REQUIRE(Crc32("123456789") == 0xcbf43926);
+  }
+  GIVEN("A jar with one entry") {
+    std::ostringstream os;
+    JarWriter jar(os, "Main");
+    jar.Add("Std.class", "not really a class");
+    jar.Finish();
+    std::string bytes = os.str();
+    REQUIRE(FindEntry(bytes, "Std.class") == "not really a class");
+    REQUIRE(FindEntry(bytes, "META-INF/MANIFEST.MF").find(
+                "Main-Class: Main\r\n") != std::string::npos);
+    REQUIRE(FindEntry(bytes, "Main.class") == "<missing>");
+  }
+  GIVEN("A program") {
+    auto program = Program::JavaProgram();
+    std::ostringstream jar;
+    program->EmitJar(jar, {{"Std.class", "runtime"}});
+    auto other = Program::JavaProgram();
+    std::ostringstream class_file;
+    other->Emit(class_file);
+    REQUIRE(FindEntry(jar.str(), "Main.class") == class_file.str());
+    REQUIRE(FindEntry(jar.str(), "Std.class") == "runtime");
+  }
+}
+} // namespace
@@ -0,0 +1,1394 @@
+#include "lower.h"
+#include "BuiltIns.h"
+#include "DeclarationVisitor.h"
+#include "RangeAnalysis.h"
+#include "StaticExpressionVisitor.h"
+#include "TreeWalker.h"
+#include "syntax_nodes.h"
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace ir {
+namespace {
+
+bool IsComparison(BinaryOp op) { return op >= kEqual && op <= kNotLessThan; }
+
+Cmp ToCmp(BinaryOp op) {
+  switch (op) {
+  case kEqual:
+    return Cmp::kEq;
+  case kUnequal:
+    return Cmp::kNe;
+  case kLessThan:
+    return Cmp::kLt;
+  case kNotLessThan:
+    return Cmp::kGe;
+  case kGreaterThan:
+    return Cmp::kGt;
+  default:
+    return Cmp::kLe;
+  }
+}
+
+Op ToOp(BinaryOp op) {
+  switch (op) {
+  case kPlus:
+    return Op::kAdd;
+  case kMinus:
+    return Op::kSub;
+  case kTimes:
+    return Op::kMul;
+  default:
+    return Op::kDiv;
+  }
+}
+
+// Returns the type of Tiger values of the given built-in type.
+Type BuiltInType(std::string_view type_id) {
+  return type_id == "int" ? Type::kInt : Type::kString;
+}
+
+bool IsArray(Type type) {
+  return type == Type::kIntArray || type == Type::kStringArray;
+}
+
+bool IsBuiltIn(const Expression& call, const std::string& id) {
+  return call.GetBinding().declaration &&
+         call.GetBinding().declaration ==
+             Expression::BuiltInDeclaration(id, false);
+}
+
+// Tiger type, as classified by Resolve.
+struct TypeClassifier : public TypeVisitor {
+  bool VisitTypeReference(const std::string& id) override {
+    reference = &id;
+    return true;
+  }
+  bool VisitRecordType(const std::vector<TypeField>& fields) override {
+    this->fields = &fields;
+    return true;
+  }
+  bool VisitArrayType(const std::string& type_id) override {
+    element = &type_id;
+    return true;
+  }
+  bool VisitInt() override {
+    type = Type::kInt;
+    return true;
+  }
+  bool VisitString() override {
+    type = Type::kString;
+    return true;
+  }
+
+  // Set for int and string.
+  std::optional<Type> type;
+  // Of a record type.
+  const std::vector<TypeField>* fields = nullptr;
+  // Type ID of the elements of an array type.
+  const std::string* element = nullptr;
+  // Type ID of the type that this one names.
+  const std::string* reference = nullptr;
+  // Scope of the declaration of the type, where the IDs above are bound.
+  const struct TypeScope* scope = nullptr;
+};
+
+// Types that a Let expression declares, whose scope is the Let, and those
+// of the Let expressions around it, through parent. Lowering tracks types
+// itself, as trees read from AST caches have no name spaces.
+struct TypeScope {
+  const TypeScope* parent = nullptr;
+  std::unordered_map<std::string, const ::Type*> types;
+};
+
+// Classifies the Tiger type with the given ID in the given scope, or else
+// built in, following references to other types, up to a limit for cycles.
+// Leaves all unset if there is no such type.
+TypeClassifier Resolve(const TypeScope* scope, const std::string& id) {
+  constexpr int kMaxReferences = 64;
+  TypeClassifier type;
+  const std::string* name = &id;
+  for (int i = 0; i < kMaxReferences && name; ++i) {
+    type = TypeClassifier();
+    const ::Type* found = nullptr;
+    for (; scope && !found; scope = found ? scope : scope->parent) {
+      if (auto t = scope->types.find(*name); t != scope->types.end()) {
+        found = t->second;
+      }
+    }
+    if (!found) {
+      if (*name == "int") type.type = Type::kInt;
+      if (*name == "string") type.type = Type::kString;
+      break;
+    }
+    found->Accept(type);
+    type.scope = scope;
+    name = type.reference;
+  }
+  return type;
+}
+
+// Returns the type of values of the Tiger type with the given ID in the
+// given scope, or none for types without values, e.g. "none". Arrays of
+// arrays and records, which have no code yet, are references of unknown
+// type.
+std::optional<Type> ValueType(const TypeScope* scope, const std::string& id) {
+  TypeClassifier type = Resolve(scope, id);
+  if (type.fields) return Type::kRecord;
+  if (!type.element) return type.type;
+  std::optional<Type> element = Resolve(type.scope, *type.element).type;
+  if (element == Type::kInt) return Type::kIntArray;
+  if (element == Type::kString) return Type::kStringArray;
+  return Type::kRecord;
+}
+
+// Function of a program, as FunctionFinder finds it.
+struct FunctionInfo {
+  // Or nullptr for main.
+  const FunctionDeclaration* declaration = nullptr;
+  const Expression* body = nullptr;
+  // Of the types that the body sees.
+  const TypeScope* scope = nullptr;
+  // Unique in the program.
+  std::string name;
+  // Number of functions declared around the body, including this one,
+  // i.e. Binding::depth of its variables.
+  int depth = 0;
+  // Types of the parameters, and of the result, if any.
+  std::vector<Type> params;
+  std::optional<Type> result;
+  // Whether the function keeps a frame: a record of its static link, in
+  // field 0, followed by the variables that functions nested in it use.
+  bool has_frame = false;
+  // Those variables, by field - 1.
+  std::vector<const Declaration*> frame;
+};
+
+// Field of a frame that holds a variable.
+struct Slot {
+  int32_t field;
+  Type type;
+};
+
+// Finds the functions of a program, and their variables that functions
+// nested in them use, which live in frames rather than registers. Each
+// function but main takes a static link, the frame of the function that
+// declares it, or nil if that is main and keeps none. Functions keep a
+// frame if they declare other functions, for the static links of those,
+// and main only if some variable of its lives there.
+class FunctionFinder : public TreeWalker, public DeclarationVisitor {
+public:
+  explicit FunctionFinder(const Expression& program) {
+    functions.emplace_back();
+    functions[0].body = &program;
+    functions[0].name = UniqueName("main");
+    path_.push_back(0);
+    Walk(program);
+    for (const Declaration* variable : escaping_) {
+      auto owner = owners_.find(variable);
+      if (owner == owners_.end()) continue;
+      FunctionInfo& function = functions[owner->second.function];
+      function.frame.push_back(variable);
+      function.has_frame = true;
+      slots[variable] = {int32_t(function.frame.size()), owner->second.type};
+    }
+  }
+
+  // Main first, and then the others in the order of their declarations.
+  std::vector<FunctionInfo> functions;
+  // Indexes in functions of declarations of functions.
+  std::unordered_map<const Declaration*, size_t> indexes;
+  std::unordered_map<const Declaration*, Slot> slots;
+  // Scopes of the Let expressions that declare types.
+  std::unordered_map<const Expression*, std::unique_ptr<TypeScope>> scopes;
+
+protected:
+  bool Enter(TreeNode& node) override {
+    if (auto e = node.expression(); e) {
+      if ((*e)->kind() == Expression::Kind::kLet) {
+        auto scope = std::make_unique<TypeScope>();
+        scope->parent = scope_;
+        for (TreeNode* child : node.Children()) {
+          auto d = child->declaration();
+          if (d && (*d)->GetType()) scope->types[(*d)->Id()] = *(*d)->GetType();
+        }
+        if (!scope->types.empty()) {
+          scope_ = scope.get();
+          scopes[*e] = std::move(scope);
+        }
+      } else if ((*e)->kind() == Expression::Kind::kIdLValue) {
+        const Binding& binding = (*e)->GetBinding();
+        if (binding.declaration && binding.slot != Binding::kNoSlot &&
+            binding.depth != functions[path_.back()].depth &&
+            escaped_.insert(binding.declaration).second) {
+          escaping_.push_back(binding.declaration);
+        }
+      } else if ((*e)->kind() == Expression::Kind::kFor) {
+        Own(static_cast<const For&>(**e).Variable(), Type::kInt);
+      }
+    } else if (auto d = node.declaration(); d) {
+      declaration_ = *d;
+      (*d)->Accept(*this);
+    }
+    return true;
+  }
+  void Leave(TreeNode& node) override {
+    if (&node == functions[path_.back()].declaration) path_.pop_back();
+    if (auto e = node.expression(); e) {
+      if (auto scope = scopes.find(*e); scope != scopes.end()) {
+        scope_ = scope->second->parent;
+      }
+    }
+  }
+
+  bool VisitVariableDeclaration(const std::string& id,
+                                const std::optional<std::string>& type_id,
+                                const Expression& expr) override {
+    Own(*declaration_, ValueType(scope_, **declaration_->GetValueType())
+                           .value_or(Type::kRecord));
+    return true;
+  }
+  bool VisitFunctionDeclaration(const std::string& id,
+                                const std::vector<TypeField>& params,
+                                const std::optional<std::string> type_id,
+                                const Expression& body) override {
+    const auto& declaration =
+        static_cast<const FunctionDeclaration&>(*declaration_);
+    if (path_.back() != 0) functions[path_.back()].has_frame = true;
+    FunctionInfo function;
+    function.declaration = &declaration;
+    function.body = &body;
+    function.name = UniqueName(id);
+    function.depth = functions[path_.back()].depth + 1;
+    function.scope = scope_;
+    function.result = ValueType(scope_, **declaration.GetValueType());
+    indexes[&declaration] = functions.size();
+    path_.push_back(functions.size());
+    for (const ParamDeclaration& p : declaration.ParamDeclarations()) {
+      function.params.push_back(
+          ValueType(scope_, **p.GetValueType()).value_or(Type::kRecord));
+      Own(p, function.params.back());
+    }
+    functions.push_back(std::move(function));
+    return true;
+  }
+
+private:
+  // Function that declares a variable, and the type of its values.
+  struct Owner {
+    size_t function;
+    Type type;
+  };
+
+  // Notes that the innermost function on the path declares the given
+  // variable.
+  void Own(const Declaration& variable, Type type) {
+    owners_[&variable] = {path_.back(), type};
+  }
+
+  // Returns the given name, or if taken, that name with the first suffix
+  // _2, _3, ... that makes it unique.
+  std::string UniqueName(const std::string& id) {
+    std::string name = id;
+    for (int n = 2; !names_.insert(name).second; ++n) {
+      name = id + "_" + std::to_string(n);
+    }
+    return name;
+  }
+
+  // Indexes of the functions around the node walked, innermost last.
+  std::vector<size_t> path_;
+  const TypeScope* scope_ = nullptr;
+  const Declaration* declaration_ = nullptr;
+  std::unordered_map<const Declaration*, Owner> owners_;
+  // Variables used by functions other than their own, by first use.
+  std::vector<const Declaration*> escaping_;
+  std::unordered_set<const Declaration*> escaped_;
+  std::unordered_set<std::string> names_;
+};
+
+// Finds the value of an integer constant, possibly negated, e.g. -1.
+class ConstantFinder : public StaticStoppingExpressionVisitor<ConstantFinder> {
+public:
+  int32_t value = 0;
+
+  // Visits negations in a loop rather than by recursion, so that many
+  // cannot overflow the stack.
+  bool Visit(const Expression& e) {
+    bool negated = false;
+    const Expression* next = &e;
+    for (;;) {
+      negated_ = nullptr;
+      if (!StaticStoppingExpressionVisitor::Visit(*next)) return false;
+      if (!negated_) break;
+      negated = !negated;
+      next = negated_;
+    }
+    if (negated) value = int32_t(-uint32_t(value));
+    return true;
+  }
+  bool VisitIntegerConstant(int v) {
+    value = v;
+    return true;
+  }
+  bool VisitNegated(const Expression& e) {
+    negated_ = &e;
+    return true;
+  }
+
+private:
+  // Operand of the negation visited last, if any.
+  const Expression* negated_ = nullptr;
+};
+
+// Finds the parts of an if expression whose condition compares an integer
+// expression without side effects with a constant, e.g. if x = 1 then a else
+// b, a link of a chain that a switch can replace. Visit returns false for
+// other expressions.
+class SwitchCase : public StaticStoppingExpressionVisitor<SwitchCase> {
+public:
+  // The expression compared, and its key, see PureKey.
+  const Expression* scrutinee = nullptr;
+  std::string key;
+  int32_t value = 0;
+  const Expression* then_expr = nullptr;
+  // Or nullptr for if-then.
+  const Expression* else_expr = nullptr;
+
+  bool VisitIfThen(const Expression& condition, const Expression& expr) {
+    if (then_expr) return false;
+    then_expr = &expr;
+    return Visit(condition);
+  }
+  bool VisitIfThenElse(const Expression& condition,
+                       const Expression& then_expr,
+                       const Expression& else_expr) {
+    if (this->then_expr) return false;
+    this->then_expr = &then_expr;
+    this->else_expr = &else_expr;
+    return Visit(condition);
+  }
+  bool VisitBinary(const Expression& left, BinaryOp op,
+                   const Expression& right) {
+    if (op != kEqual || !then_expr) return false;
+    ConstantFinder constant;
+    if (constant.Visit(right)) {
+      scrutinee = &left;
+    } else if (constant.Visit(left)) {
+      scrutinee = &right;
+    } else {
+      return false;
+    }
+    value = constant.value;
+    PureKey pure;
+    if (scrutinee->GetType() != "int" || !pure.Visit(*scrutinee)) {
+      return false;
+    }
+    key = std::move(pure.key);
+    return true;
+  }
+};
+
+// Lowers the body of a function to instructions appended to the current
+// block.
+//
+// Lowering runs steps from a work list rather than recursing, so that deeply
+// nested expressions, e.g. 1 + 1 + ... + 1, cannot overflow the stack: Lower
+// schedules the steps that lower an expression, which end by pushing the
+// register of its value, or kNoReg if it has none, to a stack of values, and
+// Then schedules a step that continues after them. The steps that a step
+// schedules run in order, before those scheduled earlier, i.e. where the
+// recursive calls would have run.
+class Lowerer : public StaticExpressionVisitor<Lowerer>,
+                public DeclarationVisitor {
+public:
+  // Starts the function with the given index among those found, with the
+  // static link and arguments in registers, and its frame, if it keeps
+  // one, made.
+  Lowerer(const RangeAnalysis& ranges, const FunctionFinder& functions,
+          size_t index, std::vector<std::string>& diagnostics)
+      : ranges_(ranges), functions_(functions),
+        function_(functions.functions[index]), diagnostics_(diagnostics),
+        scope_(function_.scope) {
+    f_.name = function_.name;
+    f_.result = function_.result;
+    std::unordered_map<const Declaration*, Reg> params;
+    if (function_.declaration) {
+      f_.NewRegister(Type::kRecord, "link");
+      const std::vector<ParamDeclaration>& declarations =
+          function_.declaration->ParamDeclarations();
+      for (size_t p = 0; p < declarations.size(); ++p) {
+        params[&declarations[p]] =
+            f_.NewRegister(function_.params[p], declarations[p].Id());
+      }
+      f_.param_count = f_.registers.size();
+    }
+    Start(f_.NewBlock());
+    if (function_.has_frame) {
+      std::vector<Reg> fields = {function_.declaration
+                                     ? Read(kStaticLink)
+                                     : Emit(Op::kNil, Type::kRecord)};
+      for (const Declaration* variable : function_.frame) {
+        auto param = params.find(variable);
+        fields.push_back(param != params.end()
+                             ? Read(param->second)
+                             : Default(functions_.slots.at(variable).type));
+      }
+      frame_ = f_.NewRegister(Type::kRecord, "frame");
+      Append({Op::kNewRecord, frame_, 0, std::move(fields)});
+    }
+    for (const auto& [param, r] : params) {
+      if (!functions_.slots.count(param)) variables_[param] = r;
+    }
+  }
+
+  // Returns the function, which returns after the code lowered, with its
+  // blocks in the order that lowering started them, so that most branches
+  // fall through to the next block.
+  Function Finish() {
+    Terminate({Terminator::kReturn, Cmp::kEq,
+               result_ == kNoReg ? std::vector<Reg>{}
+                                 : std::vector<Reg>{result_}});
+    std::vector<BlockId> number(f_.blocks.size(), UINT32_MAX);
+    for (size_t i = 0; i < order_.size(); ++i) number[order_[i]] = i;
+    for (BlockId b = 0; b < f_.blocks.size(); ++b) {
+      if (number[b] == UINT32_MAX) {
+        number[b] = order_.size();
+        order_.push_back(b);
+      }
+    }
+    Function f = std::move(f_);
+    std::vector<Block> blocks(f.blocks.size());
+    for (BlockId b = 0; b < f.blocks.size(); ++b) {
+      for (BlockId& target : f.blocks[b].terminator.targets) {
+        target = number[target];
+      }
+      blocks[number[b]] = std::move(f.blocks[b]);
+    }
+    f.blocks = std::move(blocks);
+    return f;
+  }
+
+  // Runs the steps scheduled, and those they schedule, until none are left.
+  void Run() {
+    std::reverse(work_.begin(), work_.end());
+    while (!work_.empty()) {
+      std::function<void()> step = std::move(work_.back());
+      work_.pop_back();
+      size_t scheduled = work_.size();
+      step();
+      std::reverse(work_.begin() + scheduled, work_.end());
+    }
+  }
+
+  // Schedules the given step.
+  template <class F> void Then(F step) { work_.emplace_back(std::move(step)); }
+
+  // Schedules instructions that compute the value of the given expression,
+  // which push the register of that value, or kNoReg if it has none.
+  void Lower(const Expression& e) {
+    Then([this, &e] {
+      node_ = &e;
+      Visit(e);
+    });
+  }
+
+  // Pops the register of the value of the expression lowered last.
+  Reg Pop() {
+    Reg value = values_.back();
+    values_.pop_back();
+    return value;
+  }
+
+  // Schedules instructions that evaluate the given expression for its side
+  // effects.
+  void Discard(const Expression& e) {
+    Lower(e);
+    Then([this] { Pop(); });
+  }
+
+  // Schedules instructions that evaluate the body of the function, whose
+  // value it returns, if it has a result.
+  void Return(const Expression& body) {
+    if (!f_.result) {
+      Discard(body);
+      return;
+    }
+    Operand(body, *f_.result, "Result of " + f_.name);
+    Then([this] { result_ = Pop(); });
+  }
+
+  // Schedules the end of the current block with branches to if_true if the
+  // given expression is true, i.e. not 0, and else to if_false.
+  void Condition(const Expression& e, BlockId if_true, BlockId if_false);
+
+  // Like Condition, for a binary operator that is a comparison, &, or |.
+  void BinaryCondition(const Expression& left, BinaryOp op,
+                       const Expression& right, BlockId if_true,
+                       BlockId if_false) {
+    if (op == kAnd || op == kOr) {
+      // Branches on the left operand alone, if it decides the value.
+      BlockId right_block = f_.NewBlock();
+      if (op == kAnd) {
+        Condition(left, right_block, if_false);
+      } else {
+        Condition(left, if_true, right_block);
+      }
+      Then([this, &right, right_block, if_true, if_false] {
+        Start(right_block);
+        Condition(right, if_true, if_false);
+      });
+      return;
+    }
+    Lower(left);
+    Lower(right);
+    Then([this, &left, op, &right, if_true, if_false] {
+      Reg r = Pop();
+      Reg l = Pop();
+      Type left_type = l == kNoReg ? Type::kInt : f_.registers[l];
+      Type right_type = r == kNoReg ? Type::kInt : f_.registers[r];
+      Cmp cmp = ToCmp(op);
+      if (l == kNoReg || r == kNoReg ||
+          (left_type == Type::kInt) != (right_type == Type::kInt) ||
+          (left_type != Type::kInt && cmp != Cmp::kEq && cmp != Cmp::kNe &&
+           (left_type != Type::kString || right_type != Type::kString))) {
+        std::ostringstream message;
+        message << "Types of " << op << " should match, but got "
+                << left.GetType() << " and " << right.GetType();
+        diagnostics_.push_back(message.str());
+        Jump(if_false);
+      } else if (left_type == Type::kString && right_type == Type::kString) {
+        Reg order = Emit(Op::kCompareStrings, Type::kInt, {l, r});
+        Branch(cmp, {order}, if_true, if_false);
+      } else {
+        Branch(cmp, {l, r}, if_true, if_false);
+      }
+    });
+  }
+
+  void Jump(BlockId target) {
+    Terminate({Terminator::kJump, Cmp::kEq, {}, {target}});
+  }
+
+  // Starts appending to the given block, whose code follows the current
+  // block's, which must be terminated.
+  void Start(BlockId block) {
+    current_ = block;
+    order_.push_back(block);
+  }
+
+  bool VisitStringConstant(const std::string& text) {
+    return Produce(Emit(Op::kString, Type::kString, {}, f_.AddString(text)));
+  }
+  bool VisitIntegerConstant(int value) { return Produce(Const(value)); }
+  bool VisitNil() { return Produce(Emit(Op::kNil, Type::kRecord)); }
+  bool VisitLValue(const LValue& value) {
+    if (value.kind() != Expression::Kind::kIdLValue) {
+      return StaticExpressionVisitor::VisitLValue(value);
+    }
+    const Binding& binding = value.GetBinding();
+    if (auto variable = variables_.find(binding.declaration);
+        variable != variables_.end()) {
+      return Produce(Read(variable->second));
+    }
+    if (auto slot = functions_.slots.find(binding.declaration);
+        slot != functions_.slots.end()) {
+      return Produce(Emit(Op::kLoadField, slot->second.type,
+                          {Frame(binding.depth)}, slot->second.field));
+    }
+    return Fail("Variable " + *value.GetId() + " has no value",
+                value.GetType());
+  }
+  bool VisitField(const LValue& value, const std::string& id) {
+    const Expression& e = *node_;
+    Lower(value);
+    Then([this, &e, &value, &id] {
+      Reg record = Pop();
+      std::optional<Slot> field = Field(value, id);
+      if (!field || record == kNoReg ||
+          f_.registers[record] != Type::kRecord) {
+        Fail("No field " + id + " in " + value.GetType(), e.GetType());
+        return;
+      }
+      Produce(Emit(Op::kLoadField, field->type, {record}, field->field));
+    });
+    return true;
+  }
+  bool VisitIndex(const LValue& value, const Expression& expr) {
+    const Expression& e = *node_;
+    Lower(value);
+    Then([this, &e, &expr] {
+      Reg array = Pop();
+      if (array == kNoReg || !IsArray(f_.registers[array])) {
+        Unsupported("Elements of arrays of arrays and records", e.GetType());
+        return;
+      }
+      Operand(expr, Type::kInt, "Index");
+      Then([this, array] {
+        Reg index = Pop();
+        Produce(Emit(Op::kLoadElement, ElementType(array), {array, index}));
+      });
+    });
+    return true;
+  }
+  bool VisitNegated(const Expression& value) {
+    Operand(value, Type::kInt, "Operand type for -");
+    Then([this] { Produce(Emit(Op::kNeg, Type::kInt, {Pop()})); });
+    return true;
+  }
+  bool VisitBinary(const Expression& left, BinaryOp op,
+                   const Expression& right) {
+    if (IsComparison(op) || op == kAnd || op == kOr) {
+      return Materialize([&](BlockId if_true, BlockId if_false) {
+        BinaryCondition(left, op, right, if_true, if_false);
+      });
+    }
+    std::ostringstream what;
+    what << "Operand type for " << op;
+    Operand(left, Type::kInt, what.str());
+    Operand(right, Type::kInt, what.str());
+    Then([this, op] {
+      Reg r = Pop();
+      Reg l = Pop();
+      Produce(Emit(ToOp(op), Type::kInt, {l, r}));
+    });
+    return true;
+  }
+  bool VisitAssignment(const LValue& value, const Expression& expr) {
+    if (value.kind() == Expression::Kind::kIndexLValue) {
+      Lower(**value.GetChild());
+      Then([this, &value, &expr] {
+        Reg array = Pop();
+        if (array == kNoReg || !IsArray(f_.registers[array])) {
+          Unsupported(
+              "Assignments to elements of arrays of arrays and records",
+              "none");
+          return;
+        }
+        Operand(**value.GetIndexValue(), Type::kInt, "Index");
+        Operand(expr, ElementType(array), "Assigned value");
+        Then([this, array] {
+          Reg element = Pop();
+          Reg index = Pop();
+          Append({Op::kStoreElement, kNoReg, 0, {array, index, element}});
+          Produce(kNoReg);
+        });
+      });
+      return true;
+    }
+    if (value.kind() == Expression::Kind::kFieldLValue) {
+      const LValue& child = **value.GetChild();
+      Lower(child);
+      Then([this, &value, &child, &expr] {
+        Reg record = Pop();
+        std::optional<Slot> field = Field(child, *value.GetField());
+        if (!field || record == kNoReg ||
+            f_.registers[record] != Type::kRecord) {
+          Fail("No field " + *value.GetField() + " in " + child.GetType(),
+               "none");
+          return;
+        }
+        Store(record, *field, expr);
+      });
+      return true;
+    }
+    const Binding& binding = value.GetBinding();
+    if (auto variable = variables_.find(binding.declaration);
+        variable != variables_.end()) {
+      Reg v = variable->second;
+      Operand(expr, f_.registers[v], "Assigned value");
+      Then([this, v] {
+        Append({Op::kMove, v, 0, {Pop()}});
+        Produce(kNoReg);
+      });
+      return true;
+    }
+    if (auto slot = functions_.slots.find(binding.declaration);
+        slot != functions_.slots.end()) {
+      Store(Frame(binding.depth), slot->second, expr);
+      return true;
+    }
+    return Fail("Variable " + *value.GetId() + " has no value", "none");
+  }
+  bool VisitFunctionCall(const std::string& id,
+                         const std::vector<std::shared_ptr<Expression>>& args,
+                         const Expression& exp) {
+    if (!exp.GetBinding().declaration) {
+      diagnostics_.push_back("No declaration for function " + id);
+      return Produce(kNoReg);
+    }
+    if (!IsBuiltIn(exp, id)) return Call(id, args, exp);
+    if (id == "not" && args.size() == 1) {
+      return Materialize([&](BlockId if_true, BlockId if_false) {
+        Condition(*args[0], if_false, if_true);
+      });
+    }
+    const BuiltInFunction* function = FindBuiltInFunction(id);
+    for (size_t i = 0; i < args.size(); ++i) {
+      if (i < size_t(function->param_count)) {
+        Operand(*args[i], BuiltInType(function->params[i].type_id),
+                "Argument " + std::to_string(i + 1) + " of " + id);
+      } else {
+        Lower(*args[i]);
+      }
+    }
+    Then([this, &id, function, count = args.size()] {
+      std::vector<Reg> operands(count);
+      for (size_t i = count; i-- > 0;) operands[i] = Pop();
+      int32_t name = f_.AddString(id);
+      if (function->result_type.empty()) {
+        Append({Op::kCall, kNoReg, name, std::move(operands)});
+        Produce(kNoReg);
+        return;
+      }
+      Produce(Emit(Op::kCall, BuiltInType(function->result_type),
+                   std::move(operands), name));
+    });
+    return true;
+  }
+  bool VisitBlock(const std::vector<std::shared_ptr<Expression>>& exprs) {
+    return Sequence(exprs);
+  }
+  bool VisitRecord(const std::string& type_id,
+                   const std::vector<FieldValue>& field_values,
+                   const Expression& exp) {
+    TypeClassifier type = Resolve(scope_, type_id);
+    if (!type.fields || type.fields->size() != field_values.size()) {
+      return Fail("Fields of " + type_id + " should match its type",
+                  type_id);
+    }
+    for (size_t k = 0; k < field_values.size(); ++k) {
+      const TypeField& field = (*type.fields)[k];
+      Operand(*field_values[k].expr,
+              ValueType(type.scope, field.type_id).value_or(Type::kRecord),
+              "Field " + field.id + " of " + type_id);
+    }
+    Then([this, count = field_values.size()] {
+      std::vector<Reg> fields(count);
+      for (size_t k = count; k-- > 0;) fields[k] = Pop();
+      Produce(Emit(Op::kNewRecord, Type::kRecord, std::move(fields)));
+    });
+    return true;
+  }
+  bool VisitArray(const std::string& type_id, const Expression& size,
+                  const Expression& value) {
+    const std::string& element = value.GetType();
+    if (element != "int" && element != "string") {
+      return Unsupported("Arrays of arrays and records", type_id);
+    }
+    bool ints = element == "int";
+    Operand(size, Type::kInt, "Size");
+    // New arrays hold 0 or nil.
+    ConstantFinder zero;
+    bool fill = !ints || !zero.Visit(value) || zero.value != 0;
+    if (fill) Operand(value, BuiltInType(element), "Element");
+    Then([this, ints, fill] {
+      std::vector<Reg> operands(fill ? 2 : 1);
+      for (size_t i = operands.size(); i-- > 0;) operands[i] = Pop();
+      Produce(Emit(Op::kNewArray, ints ? Type::kIntArray : Type::kStringArray,
+                   std::move(operands)));
+    });
+    return true;
+  }
+  bool VisitIfThen(const Expression& condition, const Expression& expr) {
+    if (Switch(*node_)) return true;
+    BlockId then_block = f_.NewBlock();
+    BlockId end = f_.NewBlock();
+    Condition(condition, then_block, end);
+    Then([this, then_block] { Start(then_block); });
+    Discard(expr);
+    Then([this, end] {
+      Bind(end);
+      Produce(kNoReg);
+    });
+    return true;
+  }
+  bool VisitIfThenElse(const Expression& condition,
+                       const Expression& then_expr,
+                       const Expression& else_expr) {
+    if (Switch(*node_)) return true;
+    BlockId then_block = f_.NewBlock();
+    BlockId else_block = f_.NewBlock();
+    BlockId end = f_.NewBlock();
+    // The value, see Assign.
+    Produce(kNoReg);
+    Condition(condition, then_block, else_block);
+    Then([this, then_block] { Start(then_block); });
+    Assign(then_expr);
+    Then([this, else_block, end] {
+      Jump(end);
+      Start(else_block);
+    });
+    Assign(else_expr);
+    Then([this, end] { Bind(end); });
+    return true;
+  }
+  bool VisitWhile(const Expression& condition, const Expression& body) {
+    // Tests at the bottom, so that each iteration takes one branch.
+    BlockId body_block = f_.NewBlock();
+    BlockId test = f_.NewBlock();
+    BlockId end = f_.NewBlock();
+    Jump(test);
+    Start(body_block);
+    Loop(body, end);
+    Then([this, test] { Bind(test); });
+    Condition(condition, body_block, end);
+    Then([this, end] {
+      Start(end);
+      Produce(kNoReg);
+    });
+    return true;
+  }
+  bool VisitFor(const std::string& id, const Expression& first,
+                const Expression& last, const Expression& body) {
+    const For& loop = static_cast<const For&>(*node_);
+    Operand(first, Type::kInt, "Lower bound");
+    Then([this, &id, &loop, &last, &body] {
+      Reg i = f_.NewRegister(Type::kInt, id);
+      Append({Op::kMove, i, 0, {Pop()}});
+      variables_[&loop.Variable()] = i;
+      Operand(last, Type::kInt, "Upper bound");
+      Then([this, &loop, &body, i] {
+        Reg limit = f_.NewRegister(Type::kInt);
+        Append({Op::kMove, limit, 0, {Pop()}});
+        ForLoop(loop, i, limit, body);
+      });
+    });
+    return true;
+  }
+  bool VisitBreak() {
+    if (loops_.empty()) return Produce(kNoReg);
+    Jump(loops_.back());
+    // Code up to the end of the loop is unreachable.
+    Start(f_.NewBlock());
+    return Produce(kNoReg);
+  }
+  bool VisitLet(const std::vector<std::shared_ptr<Declaration>>& declarations,
+                const std::vector<std::shared_ptr<Expression>>& body) {
+    const TypeScope* outer = scope_;
+    if (auto scope = functions_.scopes.find(node_);
+        scope != functions_.scopes.end()) {
+      scope_ = scope->second.get();
+    }
+    for (const auto& d : declarations) {
+      Declaration* declaration = d.get();
+      Then([this, declaration] {
+        declaration_ = declaration;
+        declaration->Accept(static_cast<DeclarationVisitor&>(*this));
+      });
+    }
+    Sequence(body);
+    Then([this, outer] { scope_ = outer; });
+    return true;
+  }
+
+  bool VisitVariableDeclaration(const std::string& id,
+                                const std::optional<std::string>& type_id,
+                                const Expression& expr) override {
+    const Declaration* declaration = declaration_;
+    if (auto slot = functions_.slots.find(declaration);
+        slot != functions_.slots.end()) {
+      Store(Read(frame_), slot->second, expr, "Value of " + id);
+      Then([this] { Pop(); });
+      return true;
+    }
+    Lower(expr);
+    Then([this, &id, declaration] {
+      Reg value = Pop();
+      if (value == kNoReg) return;
+      Reg variable = f_.NewRegister(f_.registers[value], id);
+      Append({Op::kMove, variable, 0, {value}});
+      variables_[declaration] = variable;
+    });
+    return true;
+  }
+
+private:
+  bool Produce(Reg value) {
+    values_.push_back(value);
+    return true;
+  }
+
+  Reg Emit(Op op, Type type, std::vector<Reg> operands = {},
+           int32_t imm = 0) {
+    Reg dest = f_.NewRegister(type);
+    Append({op, dest, imm, std::move(operands)});
+    return dest;
+  }
+
+  void Append(Instruction instruction) {
+    f_.blocks[current_].instructions.push_back(std::move(instruction));
+  }
+
+  Reg Const(int32_t value) { return Emit(Op::kConst, Type::kInt, {}, value); }
+
+  // Copies a variable, see Lower.
+  Reg Read(Reg variable) {
+    return Emit(Op::kMove, f_.registers[variable], {variable});
+  }
+
+  Type ElementType(Reg array) {
+    return f_.registers[array] == Type::kIntArray ? Type::kInt
+                                                  : Type::kString;
+  }
+
+  void Terminate(Terminator terminator) {
+    f_.blocks[current_].terminator = std::move(terminator);
+  }
+
+  void Branch(Cmp cmp, std::vector<Reg> operands, BlockId if_true,
+              BlockId if_false) {
+    Terminate({Terminator::kBranch, cmp, std::move(operands),
+               {if_true, if_false}});
+  }
+
+  // Starts the given block, which the current one falls through to unless
+  // terminated.
+  void Bind(BlockId block) {
+    if (f_.blocks[current_].terminator.kind == Terminator::kNone) {
+      Jump(block);
+    }
+    Start(block);
+  }
+
+  // Produces a register set to 1 if the steps that the given function,
+  // called with blocks if_true and if_false, schedules end the current
+  // block with branches to if_true, and else to 0.
+  template <class F> bool Materialize(F branch) {
+    BlockId if_true = f_.NewBlock();
+    BlockId if_false = f_.NewBlock();
+    BlockId end = f_.NewBlock();
+    branch(if_true, if_false);
+    Then([this, if_true, if_false, end] {
+      Reg value = f_.NewRegister(Type::kInt);
+      Start(if_true);
+      Append({Op::kConst, value, 1});
+      Jump(end);
+      Start(if_false);
+      Append({Op::kConst, value, 0});
+      Bind(end);
+      Produce(value);
+    });
+    return true;
+  }
+
+  // Schedules one branch of a conditional expression, whose value, if any,
+  // moves to the register of the value of the conditional on top of the
+  // stack of values, set to a new register for the first branch with a
+  // value.
+  void Assign(const Expression& e) {
+    Lower(e);
+    Then([this] {
+      Reg value = Pop();
+      if (value == kNoReg) return;
+      Reg& result = values_.back();
+      if (result == kNoReg) {
+        result = f_.NewRegister(f_.registers[value]);
+      } else if (!Converts(f_.registers[value], f_.registers[result])) {
+        diagnostics_.push_back("Types of branches should match, but got " +
+                               std::string(Name(f_.registers[result])) +
+                               " and " + Name(f_.registers[value]));
+        value = Default(f_.registers[result]);
+      }
+      Append({Op::kMove, result, 0, {value}});
+    });
+  }
+
+  bool Sequence(const std::vector<std::shared_ptr<Expression>>& exprs) {
+    if (exprs.empty()) return Produce(kNoReg);
+    for (size_t i = 0; i + 1 < exprs.size(); ++i) Discard(*exprs[i]);
+    Lower(*exprs.back());
+    return true;
+  }
+
+  // Lowers a chain of if expressions that compare one integer expression
+  // without side effects with distinct constants, e.g. if x = 1 then a else
+  // if x = 2 then b else c, to one evaluation of the expression and a
+  // switch. Returns false for other if expressions and for chains too short
+  // to gain.
+  bool Switch(const Expression& e) {
+    constexpr size_t kMinCases = 3;
+    std::vector<SwitchCase> cases;
+    std::unordered_set<int32_t> values;
+    // Expression for values without a case, if any.
+    const Expression* otherwise = &e;
+    while (otherwise) {
+      SwitchCase link;
+      if (!link.Visit(*otherwise) ||
+          (!cases.empty() && link.key != cases[0].key) ||
+          !values.insert(link.value).second) {
+        break;
+      }
+      cases.push_back(link);
+      otherwise = link.else_expr;
+    }
+    if (cases.size() < kMinCases) return false;
+
+    Lower(*cases[0].scrutinee);
+    Then([this, cases = std::move(cases), otherwise] {
+      Terminator terminator = {Terminator::kSwitch, Cmp::kEq, {Pop()}};
+      BlockId otherwise_block = f_.NewBlock();
+      BlockId end = f_.NewBlock();
+      terminator.targets.push_back(otherwise_block);
+      for (const auto& c : cases) {
+        terminator.values.push_back(c.value);
+        terminator.targets.push_back(f_.NewBlock());
+      }
+      std::vector<BlockId> targets = terminator.targets;
+      Terminate(std::move(terminator));
+      // The value, see Assign. Without an else branch, the chain has none.
+      Produce(kNoReg);
+      for (size_t i = 0; i < cases.size(); ++i) {
+        Then([this, target = targets[i + 1]] { Start(target); });
+        if (otherwise) {
+          Assign(*cases[i].then_expr);
+        } else {
+          Discard(*cases[i].then_expr);
+        }
+        Then([this, end] { Jump(end); });
+      }
+      Then([this, otherwise_block] { Start(otherwise_block); });
+      if (otherwise) Assign(*otherwise);
+      Then([this, end] { Bind(end); });
+    });
+    return true;
+  }
+
+  // Schedules the rest of a for loop from the value of i to limit.
+  void ForLoop(const For& loop, Reg i, Reg limit, const Expression& body) {
+    BlockId end = f_.NewBlock();
+    // The JVM checks indexes of arrays anyway, but its JIT compilers drop
+    // the checks from counted loops, in the shape javac emits, that they
+    // prove within bounds. That shape takes a limit below INT_MAX.
+    const RangeAnalysis::ForLoop* facts = ranges_.Find(loop);
+    const Declaration& variable = loop.Variable();
+    if (facts && facts->in_bounds) {
+      CountedLoop(variable, i, limit, body, end);
+    } else if (facts && facts->innermost &&
+               std::all_of(facts->arrays.begin(), facts->arrays.end(),
+                           [this](const auto& a) {
+                             return variables_.count(a.array);
+                           })) {
+      // Checks the bounds of all indexes once, and runs a copy of the loop
+      // in that shape if they hold.
+      BlockId unchecked = f_.NewBlock();
+      for (const auto& array : facts->arrays) {
+        CheckBounds(i, limit, array, unchecked);
+      }
+      CountedLoop(variable, i, limit, body, end);
+      Then([this, &variable, i, limit, &body, end, unchecked] {
+        Start(unchecked);
+        CheckedLoop(variable, i, limit, body, end);
+      });
+    } else {
+      CheckedLoop(variable, i, limit, body, end);
+    }
+    Then([this, end] {
+      Start(end);
+      Produce(kNoReg);
+    });
+  }
+
+  // Lowers a for loop of the given variable from the value of i to limit,
+  // which tests at the bottom after incrementing i, like javac, so i
+  // overflows for limit INT_MAX.
+  void CountedLoop(const Declaration& variable, Reg i, Reg limit,
+                   const Expression& body, BlockId end) {
+    BlockId body_block = f_.NewBlock();
+    BlockId test = f_.NewBlock();
+    Jump(test);
+    Start(body_block);
+    Publish(variable, i);
+    Loop(body, end);
+    Then([this, i, limit, body_block, test, end] {
+      Append({Op::kIncrement, i, 1});
+      Bind(test);
+      Branch(Cmp::kLe, {Read(i), Read(limit)}, body_block, end);
+    });
+  }
+
+  // Lowers a for loop of the given variable from the value of i to limit
+  // that compares before incrementing, so that the variable cannot
+  // overflow.
+  void CheckedLoop(const Declaration& variable, Reg i, Reg limit,
+                   const Expression& body, BlockId end) {
+    BlockId body_block = f_.NewBlock();
+    BlockId next = f_.NewBlock();
+    Branch(Cmp::kGt, {Read(i), Read(limit)}, end, body_block);
+    Start(body_block);
+    Publish(variable, i);
+    Loop(body, end);
+    Then([this, i, limit, body_block, next, end] {
+      Branch(Cmp::kGe, {Read(i), Read(limit)}, end, next);
+      Start(next);
+      Append({Op::kIncrement, i, 1});
+      Jump(body_block);
+    });
+  }
+
+  // Branches to fail unless indexes of the given array from the value of i
+  // to limit, plus its offsets, are within its bounds, and limit is below
+  // INT_MAX.
+  void CheckBounds(Reg i, Reg limit, const RangeAnalysis::LoopArray& array,
+                   BlockId fail) {
+    Reg a = variables_.at(array.array);
+    BlockId next = f_.NewBlock();
+    Branch(Cmp::kLt, {Read(i), Const(-array.min_offset)}, fail, next);
+    Start(next);
+    next = f_.NewBlock();
+    if (array.max_offset >= 0) {
+      // Compares with length - offset, which cannot overflow.
+      Reg l = Read(limit);
+      Reg length = Emit(Op::kLength, Type::kInt, {Read(a)});
+      Reg bound = Emit(Op::kSub, Type::kInt, {length, Const(array.max_offset)});
+      Branch(Cmp::kGe, {l, bound}, fail, next);
+    } else {
+      // Compares limit + offset, which wraps to a large value only if it
+      // would be below INT_MIN.
+      Reg l =
+          Emit(Op::kAdd, Type::kInt, {Read(limit), Const(array.max_offset)});
+      Reg length = Emit(Op::kLength, Type::kInt, {Read(a)});
+      Branch(Cmp::kGe, {l, length}, fail, next);
+    }
+    Start(next);
+    if (array.max_offset < 0) {
+      next = f_.NewBlock();
+      Branch(Cmp::kEq, {Read(limit), Const(INT32_MAX)}, fail, next);
+      Start(next);
+    }
+  }
+
+  void Loop(const Expression& body, BlockId end) {
+    Then([this, end] { loops_.push_back(end); });
+    Discard(body);
+    Then([this] { loops_.pop_back(); });
+  }
+
+  // Lowers an operand that must have the given type, or reports it and
+  // produces a default value of that type in its place.
+  void Operand(const Expression& e, Type type, std::string what) {
+    Lower(e);
+    Then([this, &e, type, what = std::move(what)] {
+      Reg value = Pop();
+      if (value != kNoReg && Converts(f_.registers[value], type)) {
+        Produce(value);
+        return;
+      }
+      diagnostics_.push_back(what + " must be " + Name(type) + ", but got " +
+                             e.GetType());
+      Produce(Default(type));
+    });
+  }
+
+  // Returns a register set to 0 or nil.
+  Reg Default(Type type) {
+    return type == Type::kInt ? Const(0) : Emit(Op::kNil, type);
+  }
+
+  // Returns a register set to the frame of the function around the one
+  // lowered with the given depth, found by following static links.
+  Reg Frame(int depth) {
+    if (depth == function_.depth) {
+      return frame_ == kNoReg ? Emit(Op::kNil, Type::kRecord) : Read(frame_);
+    }
+    Reg frame = Read(kStaticLink);
+    for (int d = function_.depth - 1; d > depth; --d) {
+      frame = Emit(Op::kLoadField, Type::kRecord, {frame}, 0);
+    }
+    return frame;
+  }
+
+  // Copies the given register to the frame if it holds a variable that
+  // lives there, i.e. a loop variable, which is also kept in a register.
+  void Publish(const Declaration& variable, Reg r) {
+    auto slot = functions_.slots.find(&variable);
+    if (slot == functions_.slots.end()) return;
+    Append({Op::kStoreField, kNoReg, slot->second.field,
+            {Read(frame_), Read(r)}});
+  }
+
+  // Returns the field with the given ID of records of the type of the given
+  // expression, if any.
+  std::optional<Slot> Field(const Expression& record, const std::string& id) {
+    TypeClassifier type = Resolve(scope_, record.GetType());
+    if (!type.fields) return std::nullopt;
+    for (size_t k = 0; k < type.fields->size(); ++k) {
+      const TypeField& field = (*type.fields)[k];
+      if (field.id == id) {
+        return Slot{int32_t(k),
+                    ValueType(type.scope, field.type_id)
+                        .value_or(Type::kRecord)};
+      }
+    }
+    return std::nullopt;
+  }
+
+  // Schedules instructions that store the value of the given expression to
+  // the given field of the record in the given register.
+  void Store(Reg record, Slot field, const Expression& expr,
+             std::string what = "Assigned value") {
+    Operand(expr, field.type, std::move(what));
+    Then([this, record, field] {
+      Append({Op::kStoreField, kNoReg, field.field, {record, Pop()}});
+      Produce(kNoReg);
+    });
+  }
+
+  // Schedules a call of a function of the program, which passes it the
+  // frame of the function that declares it as the static link.
+  bool Call(const std::string& id,
+            const std::vector<std::shared_ptr<Expression>>& args,
+            const Expression& exp) {
+    auto index = functions_.indexes.find(exp.GetBinding().declaration);
+    if (index == functions_.indexes.end()) {
+      return Fail("No code for function " + id, exp.GetType());
+    }
+    const FunctionInfo& callee = functions_.functions[index->second];
+    if (args.size() != callee.params.size()) {
+      return Fail("Call of " + id + " should pass " +
+                      std::to_string(callee.params.size()) + " arguments",
+                  exp.GetType());
+    }
+    Reg link = Frame(callee.depth - 1);
+    for (size_t i = 0; i < args.size(); ++i) {
+      Operand(*args[i], callee.params[i],
+              "Argument " + std::to_string(i + 1) + " of " + id);
+    }
+    Then([this, link, &callee, index = int32_t(index->second)] {
+      std::vector<Reg> operands(callee.params.size() + 1);
+      for (size_t i = operands.size(); i-- > 1;) operands[i] = Pop();
+      operands[0] = link;
+      if (!callee.result) {
+        Append({Op::kCallFunction, kNoReg, index, std::move(operands)});
+        Produce(kNoReg);
+        return;
+      }
+      Produce(Emit(Op::kCallFunction, *callee.result, std::move(operands),
+                   index));
+    });
+    return true;
+  }
+
+  // Reports an expression without code, and returns a default value of its
+  // type in its place, if it has one.
+  bool Unsupported(const std::string& what, const std::string& type) {
+    return Fail(what + " not yet implemented", type);
+  }
+
+  // Reports the given message about an expression, and returns a default
+  // value of its type in its place, if it has one.
+  bool Fail(const std::string& message, const std::string& type) {
+    diagnostics_.push_back(message);
+    if (type == "none" || type == "unset" || type == "???") {
+      return Produce(kNoReg);
+    }
+    return Produce(Default(type == "int"      ? Type::kInt
+                           : type == "string" ? Type::kString
+                                              : Type::kRecord));
+  }
+
+  // Register of the static link of functions other than main.
+  static constexpr Reg kStaticLink = 0;
+
+  const RangeAnalysis& ranges_;
+  const FunctionFinder& functions_;
+  const FunctionInfo& function_;
+  std::vector<std::string>& diagnostics_;
+  Function f_;
+  // Frame of the function, if it keeps one, else kNoReg.
+  Reg frame_ = kNoReg;
+  // Value returned, if any.
+  Reg result_ = kNoReg;
+  BlockId current_ = 0;
+  // Blocks by the order that lowering started them.
+  std::vector<BlockId> order_;
+  // Steps scheduled, the next last.
+  std::vector<std::function<void()>> work_;
+  // Registers of the values of the expressions lowered, the last on top.
+  std::vector<Reg> values_;
+  // Node whose Visit method runs.
+  const Expression* node_ = nullptr;
+  // Declaration visited by VisitLet.
+  const Declaration* declaration_ = nullptr;
+  std::unordered_map<const Declaration*, Reg> variables_;
+  // Ends of the loops around the node lowered, innermost last.
+  std::vector<BlockId> loops_;
+  // Of the types that the node lowered sees.
+  const TypeScope* scope_;
+};
+
+// Lowers conditions that need not compute their value, see
+// Lowerer::Condition. Visit returns false for others.
+class ConditionLowerer
+    : public StaticStoppingExpressionVisitor<ConditionLowerer> {
+public:
+  ConditionLowerer(Lowerer& lowerer, BlockId if_true, BlockId if_false)
+      : lowerer_(lowerer), if_true_(if_true), if_false_(if_false) {}
+
+  bool VisitIntegerConstant(int value) {
+    lowerer_.Jump(value != 0 ? if_true_ : if_false_);
+    return true;
+  }
+  bool VisitBinary(const Expression& left, BinaryOp op,
+                   const Expression& right) {
+    if (!IsComparison(op) && op != kAnd && op != kOr) return false;
+    lowerer_.BinaryCondition(left, op, right, if_true_, if_false_);
+    return true;
+  }
+  bool VisitFunctionCall(const std::string& id,
+                         const std::vector<std::shared_ptr<Expression>>& args,
+                         const Expression& exp) {
+    if (id != "not" || args.size() != 1 || !IsBuiltIn(exp, id)) return false;
+    lowerer_.Condition(*args[0], if_false_, if_true_);
+    return true;
+  }
+  bool VisitBlock(const std::vector<std::shared_ptr<Expression>>& exprs) {
+    if (exprs.empty()) return false;
+    for (size_t i = 0; i + 1 < exprs.size(); ++i) {
+      lowerer_.Discard(*exprs[i]);
+    }
+    lowerer_.Condition(*exprs.back(), if_true_, if_false_);
+    return true;
+  }
+
+private:
+  Lowerer& lowerer_;
+  BlockId if_true_;
+  BlockId if_false_;
+};
+
+void Lowerer::Condition(const Expression& e, BlockId if_true,
+                        BlockId if_false) {
+  Then([this, &e, if_true, if_false] {
+    if (ConditionLowerer(*this, if_true, if_false).Visit(e)) return;
+    Operand(e, Type::kInt, "Condition");
+    Then([this, if_true, if_false] {
+      Branch(Cmp::kNe, {Pop()}, if_true, if_false);
+    });
+  });
+}
+} // namespace
+
+Module Lower(const Expression& program,
+             std::vector<std::string>& diagnostics) {
+  RangeAnalysis ranges(program);
+  FunctionFinder functions(program);
+  Module module;
+  for (size_t i = 0; i < functions.functions.size(); ++i) {
+    Lowerer lowerer(ranges, functions, i, diagnostics);
+    if (i == 0) {
+      lowerer.Discard(program);
+    } else {
+      lowerer.Return(*functions.functions[i].body);
+    }
+    lowerer.Run();
+    module.functions.push_back(lowerer.Finish());
+  }
+  return module;
+}
+} // namespace ir
@@ -0,0 +1,26 @@
+#pragma once
+#include "Expression.h"
+#include "ir.h"
+#include <string>
+#include <vector>
+
+namespace ir {
+
+// Given a typed tiger expression, returns a module of a function named main
+// that evaluates it, followed by one for each function that it declares,
+// and adds messages about parts of the expression without code, e.g.
+// arrays of records, to diagnostics.
+//
+// Variables are registers named after them. Reading a variable copies it
+// to a new register, so that the operands of each instruction are computed
+// right before it, in order, where nothing can assign the variable in
+// between; see codegen.h. Variables that nested functions use live in
+// frames instead, records whose field 0 holds the static link: functions
+// other than main take the frame of the function that declares them in
+// register 0, named link, and reach those further out through field 0.
+// Conditions, i.e. comparisons, & and |, and calls of the built-in not,
+// lower to branches, and chains of if expressions that compare one integer
+// with constants to switches.
+Module Lower(const Expression& program,
+             std::vector<std::string>& diagnostics);
+} // namespace ir
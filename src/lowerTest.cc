@@ -0,0 +1,407 @@
+#include "lower.h"
+#include "ir.h"
+#include "passes.h"
+#include "testing/catch.h"
+#include "testing/testing.h"
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Lowered {
+  explicit Lowered(const std::string& program) {
+    std::shared_ptr<Expression> e = testing::Parse(program);
+    Expression::SetNameSpacesBelow(*e);
+    Expression::SetTypesBelow(*e);
+    module = ir::Lower(*e, diagnostics);
+    f = module.functions[0];
+  }
+  bool Has(const std::string& text) const {
+    return ir::ToString(f, &module).find(text) != std::string::npos;
+  }
+  // Returns the dump of the function with the given name.
+  std::string Function(const std::string& name) const {
+    for (const ir::Function& function : module.functions) {
+      if (function.name == name) return ir::ToString(function, &module);
+    }
+    return "";
+  }
+
+  ir::Module module;
+  // Main, which tests may change.
+  ir::Function f;
+  std::vector<std::string> diagnostics;
+};
+
+// Returns the names of the instructions that move out of the first loop of
+// the given function, which must have one.
+std::string Hoisted(ir::Function& f) {
+  auto in_loop = [&f] {
+    std::vector<ir::Loop> loops = ir::FindLoops(f);
+    REQUIRE(!loops.empty());
+    size_t count = 0;
+    for (ir::BlockId b : loops[0].blocks) {
+      count += f.blocks[b].instructions.size();
+    }
+    return count;
+  };
+  size_t before = in_loop();
+  ir::HoistLoopInvariants(f);
+  REQUIRE(ir::Verify(f).empty());
+  size_t moved = before - in_loop();
+  ir::Loop loop = ir::FindLoops(f)[0];
+  std::vector<std::vector<ir::BlockId>> predecessors = ir::Predecessors(f);
+  for (ir::BlockId p : predecessors[loop.header]) {
+    if (loop.Contains(p)) continue;
+    const std::vector<ir::Instruction>& instructions =
+        f.blocks[p].instructions;
+    std::string text;
+    for (size_t k = instructions.size() - moved; k < instructions.size();
+         ++k) {
+      text += ir::Name(instructions[k].op);
+      text += ' ';
+    }
+    return text;
+  }
+  return "";
+}
+
+// Returns the output of the given function, which may only compute and
+// print ints, followed by "error" if it divides by 0, as on the JVM.
+std::string Run(const ir::Function& f) {
+  std::vector<int32_t> registers(f.registers.size());
+  std::string out;
+  auto wrap = [](int64_t value) { return int32_t(uint32_t(value)); };
+  ir::BlockId b = 0;
+  for (;;) {
+    const ir::Block& block = f.blocks[b];
+    for (const ir::Instruction& i : block.instructions) {
+      std::vector<int32_t> a;
+      for (ir::Reg r : i.operands) a.push_back(registers[r]);
+      int32_t& dest = registers[i.dest == ir::kNoReg ? 0 : i.dest];
+      switch (i.op) {
+      case ir::Op::kConst:
+        dest = i.imm;
+        break;
+      case ir::Op::kMove:
+        dest = a[0];
+        break;
+      case ir::Op::kNeg:
+        dest = wrap(-int64_t(a[0]));
+        break;
+      case ir::Op::kAdd:
+        dest = wrap(int64_t(a[0]) + a[1]);
+        break;
+      case ir::Op::kSub:
+        dest = wrap(int64_t(a[0]) - a[1]);
+        break;
+      case ir::Op::kMul:
+        dest = wrap(int64_t(a[0]) * a[1]);
+        break;
+      case ir::Op::kDiv:
+        if (a[1] == 0) return out + "error";
+        dest = wrap(int64_t(a[0]) / a[1]);
+        break;
+      case ir::Op::kShl:
+        dest = wrap(int64_t(uint32_t(a[0]) << (a[1] & 31)));
+        break;
+      case ir::Op::kShr:
+        dest = a[0] >> (a[1] & 31);
+        break;
+      case ir::Op::kUShr:
+        dest = wrap(uint32_t(a[0]) >> (a[1] & 31));
+        break;
+      case ir::Op::kIncrement:
+        dest = wrap(int64_t(dest) + i.imm);
+        break;
+      case ir::Op::kCall:
+        REQUIRE(f.strings[i.imm] == "printi");
+        out += std::to_string(a[0]) + " ";
+        break;
+      default:
+        FAIL("unexpected " << ir::Name(i.op));
+      }
+    }
+    const ir::Terminator& t = block.terminator;
+    switch (t.kind) {
+    case ir::Terminator::kJump:
+      b = t.targets[0];
+      break;
+    case ir::Terminator::kBranch: {
+      int32_t a = registers[t.operands[0]];
+      int32_t c = t.operands.size() == 2 ? registers[t.operands[1]] : 0;
+      bool holds = t.cmp == ir::Cmp::kEq   ? a == c
+                   : t.cmp == ir::Cmp::kNe ? a != c
+                   : t.cmp == ir::Cmp::kLt ? a < c
+                   : t.cmp == ir::Cmp::kGe ? a >= c
+                   : t.cmp == ir::Cmp::kGt ? a > c
+                                           : a <= c;
+      b = t.targets[holds ? 0 : 1];
+      break;
+    }
+    case ir::Terminator::kReturn:
+      return out;
+    default:
+      FAIL("unexpected terminator");
+    }
+  }
+}
+
+// Returns a random expression on ints, of x, y and constants that the
+// simplifier looks for, of at most the given depth.
+std::string RandomExpression(std::mt19937& random, int depth) {
+  static const std::vector<std::string> kLeaves = {
+      "x", "y", "0",  "1",    "2",     "3",          "4",
+      "8", "7", "-1", "-8",   "1024",  "65536",      "1073741824"};
+  static const char* const kOperators[] = {" + ", " - ", " * ", " / "};
+  std::uniform_int_distribution<size_t> leaf(0, kLeaves.size() - 1);
+  std::uniform_int_distribution<int> kind(0, 6);
+  int k = depth ? kind(random) : 0;
+  if (k < 2) return kLeaves[leaf(random)];
+  std::string a = RandomExpression(random, depth - 1);
+  if (k == 2) return "-(" + a + ")";
+  std::string b = RandomExpression(random, depth - 1);
+  return "(" + a + kOperators[k - 3] + b + ")";
+}
+
+SCENARIO("Lowering to IR", "[lower]") {
+  GIVEN("variables, conditions and calls") {
+    Lowered lowered("let var x := 1 in if x < 2 & x > 0 then printi(x + 2) "
+                    "else print(\"no\") end");
+    REQUIRE(lowered.diagnostics.empty());
+    REQUIRE(ir::Verify(lowered.f).empty());
+    REQUIRE(ir::ToString(lowered.f) == "function main\n"
+                                       "b0:\n"
+                                       "  %0:int = const 1\n"
+                                       "  %1.x:int = move %0\n"
+                                       "  %2:int = move %1.x\n"
+                                       "  %3:int = const 2\n"
+                                       "  br lt %2, %3 ? b1 : b3\n"
+                                       "b1:\n"
+                                       "  %4:int = move %1.x\n"
+                                       "  %5:int = const 0\n"
+                                       "  br gt %4, %5 ? b2 : b3\n"
+                                       "b2:\n"
+                                       "  %6:int = move %1.x\n"
+                                       "  %7:int = const 2\n"
+                                       "  %8:int = add %6, %7\n"
+                                       "  call printi %8\n"
+                                       "  jump b4\n"
+                                       "b3:\n"
+                                       "  %9:string = string \"no\"\n"
+                                       "  call print %9\n"
+                                       "  jump b4\n"
+                                       "b4:\n"
+                                       "  return\n");
+  }
+  GIVEN("comparisons of strings") {
+    Lowered lowered("if \"a\" < \"b\" then print(\"y\")");
+    REQUIRE(lowered.Has("%2:int = compare %0, %1\n  br lt %2, 0 ?"));
+  }
+  GIVEN("conditions as values") {
+    Lowered lowered("printi(not(1 > 2))");
+    REQUIRE(ir::Verify(lowered.f).empty());
+    REQUIRE(lowered.Has("br gt %0, %1 ? b2 : b1"));
+    REQUIRE(lowered.Has("%2:int = const 1"));
+    REQUIRE(lowered.Has("%2:int = const 0"));
+  }
+  GIVEN("a chain of ifs on one variable") {
+    Lowered lowered("let var x := 2 in if x = 1 then print(\"a\") else if "
+                    "x = 2 then print(\"b\") else if x = 7 then print(\"c\") "
+                    "end");
+    REQUIRE(ir::Verify(lowered.f).empty());
+    REQUIRE(lowered.Has("switch %2 default b"));
+    REQUIRE(lowered.Has(", 1 -> b"));
+    REQUIRE(lowered.Has(", 7 -> b"));
+  }
+  GIVEN("a loop over an array") {
+    Lowered lowered("let type a = array of int var a := a [10] of 1 in for "
+                    "i := 0 to 9 do a[i] := i end");
+    REQUIRE(ir::Verify(lowered.f).empty());
+    REQUIRE(lowered.Has("%3.a:int[] = move %2\n"));
+    REQUIRE(lowered.Has("%5.i:int = increment 1\n"));
+    REQUIRE(lowered.Has("store %"));
+    REQUIRE(!lowered.Has("length"));
+  }
+  GIVEN("a break") {
+    Lowered lowered("while 1 do (break; print(\"unreachable\"))");
+    REQUIRE(ir::Verify(lowered.f).empty());
+    auto predecessors = ir::Predecessors(lowered.f);
+    REQUIRE(std::count(predecessors.begin() + 1, predecessors.end(),
+                       std::vector<ir::BlockId>{}) == 1);
+    REQUIRE(ir::RemoveUnreachableBlocks(lowered.f));
+    REQUIRE(!lowered.Has("unreachable"));
+  }
+  GIVEN("invariants in the condition of a loop") {
+    Lowered lowered("let var s := \"abc\" var i := 0 in while i < size(s) "
+                    "do i := i + 1 end");
+    REQUIRE(Hoisted(lowered.f) == "move call ");
+    REQUIRE(!ir::HoistLoopInvariants(lowered.f));
+  }
+  GIVEN("invariants in the body of a loop") {
+    Lowered lowered("let var n := 3 in for i := 0 to n do printi(n * 2 + i) "
+                    "end");
+    REQUIRE(Hoisted(lowered.f) == "move const mul ");
+  }
+  GIVEN("substring in the body of a loop, which might fail") {
+    Lowered lowered("let var s := \"abc\" in while 1 do (print(\"a\"); "
+                    "print(substring(s, 0, 1))) end");
+    REQUIRE(Hoisted(lowered.f) == "");
+  }
+  GIVEN("substring in the condition of a loop") {
+    Lowered lowered("let var s := \"abc\" in while substring(s, 0, 1) = "
+                    "\"a\" do print(s) end");
+    REQUIRE(Hoisted(lowered.f) == "move const const call string compare ");
+  }
+  GIVEN("loads from arrays stored to in the loop") {
+    Lowered lowered("let type a = array of int var a := a [10] of 1 var b "
+                    ":= a [10] of 2 in while a[0] < 5 do b[1] := a[0] + 1 "
+                    "end");
+    REQUIRE(Hoisted(lowered.f).find("load") == std::string::npos);
+  }
+  GIVEN("loads from arrays not stored to in the loop") {
+    Lowered lowered("let type a = array of int var a := a [10] of 1 var i "
+                    ":= 0 in while i < a[0] do i := i + 1 end");
+    REQUIRE(Hoisted(lowered.f) == "move const load ");
+    REQUIRE(!ir::HoistLoopInvariants(lowered.f));
+  }
+  GIVEN("operands of the wrong type, which the checker allows") {
+    Lowered lowered("printi(1 + \"a\")");
+    REQUIRE(lowered.diagnostics ==
+            std::vector<std::string>{
+                "Operand type for + must be int, but got string"});
+    REQUIRE(ir::Verify(lowered.f).empty());
+  }
+  GIVEN("expressions without code") {
+    Lowered lowered("let type r = {a: int} type rs = array of r var x := rs "
+                    "[2] of nil in end");
+    REQUIRE(lowered.diagnostics ==
+            std::vector<std::string>{
+                "Arrays of arrays and records not yet implemented"});
+    REQUIRE(ir::Verify(lowered.f).empty());
+  }
+  GIVEN("records") {
+    Lowered lowered("let type r = {a: int, s: string, next: r} var x := r "
+                    "{a = 1, s = \"s\", next = nil} in x.next := x; "
+                    "printi(x.next.a) end");
+    REQUIRE(lowered.diagnostics.empty());
+    REQUIRE(ir::Verify(lowered.f, &lowered.module).empty());
+    REQUIRE(lowered.Has("%3:record = record %0, %1, %2\n"));
+    REQUIRE(lowered.Has("storefield 2 %5, %6\n"));
+    REQUIRE(lowered.Has("%8:record = loadfield 2 %7\n"
+                        "  %9:int = loadfield 0 %8\n"));
+  }
+  GIVEN("functions") {
+    Lowered lowered("let function f(n: int): int = if n < 2 then n else "
+                    "f(n - 1) + 1 function p() = printi(f(3)) in p() end");
+    REQUIRE(lowered.diagnostics.empty());
+    REQUIRE(lowered.module.functions.size() == 3);
+    for (const ir::Function& f : lowered.module.functions) {
+      REQUIRE(ir::Verify(f, &lowered.module).empty());
+    }
+    // Main keeps no frame, as no function uses its variables.
+    REQUIRE(lowered.Has("%0:record = nil\n  callf p %0\n"));
+    std::string f = lowered.Function("f");
+    REQUIRE(f.rfind("function f(%0.link:record, %1.n:int): int\n", 0) == 0);
+    REQUIRE(f.find("callf f %") != std::string::npos);
+    REQUIRE(f.find("  return %") != std::string::npos);
+  }
+  GIVEN("variables of functions that nested functions use") {
+    Lowered lowered("let var n := 1 function f(k: int): int = let function "
+                    "g(): int = n + k in g() end in for i := 1 to 2 do "
+                    "printi(f(i)) end");
+    REQUIRE(lowered.diagnostics.empty());
+    // The frames of main and of f hold n and k after the static link.
+    REQUIRE(lowered.Has("%2.frame:record = record %0, %1\n"));
+    std::string f = lowered.Function("f");
+    REQUIRE(f.find("%4.frame:record = record %2, %3\n") !=
+            std::string::npos);
+    REQUIRE(f.find("callf g %") != std::string::npos);
+    // g finds n in main's frame through f's.
+    std::string g = lowered.Function("g");
+    REQUIRE(g.find("%1:record = move %0.link\n"
+                   "  %2:record = loadfield 0 %1\n"
+                   "  %3:int = loadfield 1 %2\n") != std::string::npos);
+    REQUIRE(g.find("%4:record = move %0.link\n"
+                   "  %5:int = loadfield 1 %4\n") != std::string::npos);
+  }
+  GIVEN("loop variables that functions use") {
+    Lowered lowered("for i := 1 to 3 do let function f(): int = i in "
+                    "printi(f()) end");
+    REQUIRE(lowered.diagnostics.empty());
+    REQUIRE(lowered.Has("storefield 1 %"));
+    REQUIRE(lowered.Function("f").find("loadfield 1 %") != std::string::npos);
+  }
+}
+
+SCENARIO("Simplifying keeps results", "[lower]") {
+  GIVEN("random arithmetic") {
+    std::mt19937 random(47);
+    for (int n = 0; n < 300; ++n) {
+      std::string expression = RandomExpression(random, 4);
+      INFO(expression);
+      Lowered lowered("for x := -20 to 20 do let var y := x * 7 - 3 in "
+                      "printi(" +
+                      expression + ") end");
+      REQUIRE(lowered.diagnostics.empty());
+      std::string expected = Run(lowered.f);
+      ir::Simplify(lowered.f);
+      ir::RemoveDeadInstructions(lowered.f);
+      REQUIRE(ir::Verify(lowered.f).empty());
+      REQUIRE(Run(lowered.f) == expected);
+    }
+  }
+  GIVEN("multiplications and divisions by powers of 2") {
+    Lowered lowered("for x := 0 to 3 do printi(x * 8 + x / 4)");
+    ir::Simplify(lowered.f);
+    REQUIRE(!lowered.Has("mul"));
+    REQUIRE(!lowered.Has("div"));
+    REQUIRE(lowered.Has("shl"));
+    REQUIRE(lowered.Has("ushr"));
+  }
+  GIVEN("comparisons with 0") {
+    Lowered lowered("for x := 0 to 3 do if 0 > x then print(\"n\")");
+    REQUIRE(ir::Simplify(lowered.f));
+    REQUIRE(lowered.Has(", 0 ? b"));
+    REQUIRE(lowered.Has("br lt %"));
+  }
+  GIVEN("arithmetic on constants") {
+    Lowered lowered("let var x := 3 in printi(-(-x) * 1 + 0 + (2 * 8)) end");
+    ir::Simplify(lowered.f);
+    ir::RemoveDeadInstructions(lowered.f);
+    REQUIRE(ir::ToString(lowered.f) == "function main\n"
+                                       "b0:\n"
+                                       "  %12:int = const 19\n"
+                                       "  call printi %12\n"
+                                       "  return\n");
+  }
+}
+
+SCENARIO("Lowering does not recurse", "[lower]") {
+  // Deep enough to overflow a stack of 8 megabytes by recursion.
+  const size_t n = 200000;
+  GIVEN("a sum of many operands") {
+    std::string text = "printi(1";
+    for (size_t i = 1; i < n; ++i) text += "+1";
+    Lowered lowered(text + ")");
+    REQUIRE(lowered.diagnostics.empty());
+    REQUIRE(Run(lowered.f) == std::to_string(n) + " ");
+  }
+  GIVEN("many nested parentheses") {
+    Lowered lowered("printi(" + std::string(n, '(') + "-1" +
+                    std::string(n, ')') + ")");
+    REQUIRE(lowered.diagnostics.empty());
+    REQUIRE(Run(lowered.f) == "-1 ");
+  }
+  GIVEN("a long chain of additions whose value is unused") {
+    std::string text = "let var x := 1 in x";
+    for (size_t i = 1; i < n; ++i) text += "+x";
+    Lowered lowered(text + " end");
+    REQUIRE(ir::RemoveDeadInstructions(lowered.f));
+    REQUIRE(!lowered.Has("add"));
+  }
+}
+} // namespace
@@ -24,6 +24,13 @@ class Driver;
 %code
 {
 #include "driver.h"
+// Returns node, noting in it the offset of the location where it starts.
+template <typename Node>
+Node* At(Driver& driver, const yy::location& l, Node* node) {
+  node->set_source_offset(
+      driver.source_map.Offset(l.begin.line, l.begin.column));
+  return node;
+}
 inline void AppendFieldValue(const std::string& id, Expression* expr,
                              std::vector<FieldValue>& out) {
   out.emplace_back();
@@ -111,9 +118,13 @@ inline void AppendFieldValue(const std::string& id, Expression* expr,
 unit: expr  { driver.result.reset($1); };
 
 l_value:
-  "identifier" { $$ = new IdLValue($1); }
-| l_value "." "identifier" { $$ = new FieldLValue($1, $3); }
-| l_value "[" expr "]" {$$ = new IndexLValue($1, $3); }
+  "identifier" { $$ = At(driver, @$, new IdLValue($1)); }
+  // Spelled out, since `identifier [` is always shifted for array literals.
+| "identifier" "[" expr "]" {
+    $$ = At(driver, @$, new IndexLValue(At(driver, @1, new IdLValue($1)), $3));
+  }
+| l_value "." "identifier" { $$ = At(driver, @$, new FieldLValue($1, $3)); }
+| l_value "[" expr "]" {$$ = At(driver, @$, new IndexLValue($1, $3)); }
 ;
 
 expr_list:
@@ -132,34 +143,38 @@ field_list:
 ;
 field_list_opt: %empty {} | field_list {$$ = std::move($1);};
 expr:
-  "string"    { $$ = new StringConstant($1.substr(1, $1.size()-2));}
-| "number"    { $$ = new IntegerConstant($1); }
-| "nil"       { $$ = new Nil(); }
+  "string"    { $$ = At(driver, @$, new StringConstant($1.substr(1, $1.size()-2))); }
+| "number"    { $$ = At(driver, @$, new IntegerConstant($1)); }
+| "nil"       { $$ = At(driver, @$, new Nil()); }
 | l_value     { $$ = $1; }
-| "-" expr     { $$ = new Negated($2); }
-| expr "+" expr { $$ = new Binary($1, BinaryOp::kPlus, $3);}
-| expr "-" expr { $$ = new Binary($1, BinaryOp::kMinus, $3);}
-| expr "*" expr { $$ = new Binary($1, BinaryOp::kTimes, $3);}
-| expr "/" expr { $$ = new Binary($1, BinaryOp::kDivide, $3);}
-| expr "=" expr { $$ = new Binary($1, BinaryOp::kEqual, $3);}
-| expr "<>" expr { $$ = new Binary($1, BinaryOp::kUnequal, $3);}
-| expr "<" expr { $$ = new Binary($1, BinaryOp::kLessThan, $3);}
-| expr ">" expr { $$ = new Binary($1, BinaryOp::kGreaterThan, $3);}
-| expr "<=" expr { $$ = new Binary($1, BinaryOp::kNotGreaterThan, $3);}
-| expr ">=" expr { $$ = new Binary($1, BinaryOp::kNotLessThan, $3);}
-| expr "&" expr { $$ = new Binary($1, BinaryOp::kAnd, $3);}
-| expr "|" expr { $$ = new Binary($1, BinaryOp::kOr, $3);}
-| l_value ":=" expr { $$ = new Assignment(std::shared_ptr<LValue>($1), $3); }
-| "identifier" "(" expr_list_opt ")" {$$ = new FunctionCall($1, std::move($3));}
-| "(" expr_seq_opt ")" {$$ = new Block(std::move($2));}
-| "identifier" "{" field_list_opt "}" {$$ = new Record($1, std::move($3));}
-| "identifier" "[" expr "]" "of" expr {$$ = new Array($1, $3, $6);}
-| "if" expr "then" expr {$$ = new IfThen($2, $4);}
-| "if" expr "then" expr "else" expr {$$ = new IfThenElse($2, $4, $6);}
-| "while" expr "do" expr {$$ = new While($2, $4);}
-| "for" "identifier" ":=" expr "to" expr "do" expr {$$ = new For($2, $4, $6, $8);}
-| "break" {$$ = new Break();}
-| "let" declaration_list "in" expr_seq_opt "end" {$$ = new Let(std::move($2), std::move($4));}
+| "-" expr     { $$ = At(driver, @$, new Negated($2)); }
+| expr "+" expr { $$ = At(driver, @2, new Binary($1, BinaryOp::kPlus, $3)); }
+| expr "-" expr { $$ = At(driver, @2, new Binary($1, BinaryOp::kMinus, $3)); }
+| expr "*" expr { $$ = At(driver, @2, new Binary($1, BinaryOp::kTimes, $3)); }
+| expr "/" expr { $$ = At(driver, @2, new Binary($1, BinaryOp::kDivide, $3)); }
+| expr "=" expr { $$ = At(driver, @2, new Binary($1, BinaryOp::kEqual, $3)); }
+| expr "<>" expr { $$ = At(driver, @2, new Binary($1, BinaryOp::kUnequal, $3)); }
+| expr "<" expr { $$ = At(driver, @2, new Binary($1, BinaryOp::kLessThan, $3)); }
+| expr ">" expr { $$ = At(driver, @2, new Binary($1, BinaryOp::kGreaterThan, $3)); }
+| expr "<=" expr { $$ = At(driver, @2, new Binary($1, BinaryOp::kNotGreaterThan, $3)); }
+| expr ">=" expr { $$ = At(driver, @2, new Binary($1, BinaryOp::kNotLessThan, $3)); }
+| expr "&" expr { $$ = At(driver, @2, new Binary($1, BinaryOp::kAnd, $3)); }
+| expr "|" expr { $$ = At(driver, @2, new Binary($1, BinaryOp::kOr, $3)); }
+| l_value ":=" expr { $$ = At(driver, @$, new Assignment(std::shared_ptr<LValue>($1), $3)); }
+| "identifier" "(" expr_list_opt ")" {$$ = At(driver, @$, new FunctionCall($1, std::move($3))); }
+| "(" expr_seq_opt ")" {$$ = At(driver, @$, new Block(std::move($2))); }
+| "identifier" "{" field_list_opt "}" {$$ = At(driver, @$, new Record($1, std::move($3))); }
+| "identifier" "[" expr "]" "of" expr {$$ = At(driver, @$, new Array($1, $3, $6)); }
+| "if" expr "then" expr {$$ = At(driver, @$, new IfThen($2, $4)); }
+| "if" expr "then" expr "else" expr {$$ = At(driver, @$, new IfThenElse($2, $4, $6)); }
+| "while" expr "do" expr {$$ = At(driver, @$, new While($2, $4)); }
+| "for" "identifier" ":=" expr "to" expr "do" expr {
+    $$ = At(driver, @$, new For($2, $4, $6, $8));
+  }
+| "break" {$$ = At(driver, @$, new Break()); }
+| "let" declaration_list "in" expr_seq_opt "end" {
+    $$ = At(driver, @$, new Let(std::move($2), std::move($4)));
+  }
 ;
 declaration_list:
   declaration {$$.emplace_back($1);}
@@ -171,7 +186,7 @@ declaration:
 | function_declaration {$$ = $1;}
 ;
 type_declaration:
-  "type" "identifier" "=" type {$$ = new TypeDeclaration($2, $4);}
+  "type" "identifier" "=" type {$$ = At(driver, @$, new TypeDeclaration($2, $4)); }
 ;
 type:
   "identifier" {$$ = new TypeReference($1);}
@@ -187,15 +202,17 @@ type_field:
 ;
 type_fields_opt: %empty {} | type_fields {$$ = std::move($1);};
 variable_declaration:
-  "var" "identifier" ":=" expr {$$ = new VariableDeclaration($2, $4);}
-| "var" "identifier" ":" "identifier" ":=" expr {$$ = new VariableDeclaration($2, $4, $6);}
+  "var" "identifier" ":=" expr {$$ = At(driver, @$, new VariableDeclaration($2, $4)); }
+| "var" "identifier" ":" "identifier" ":=" expr {
+    $$ = At(driver, @$, new VariableDeclaration($2, $4, $6));
+  }
 ;
 function_declaration:
   "function" "identifier" "(" type_fields_opt ")" "=" expr {
-    $$ = new FunctionDeclaration($2, std::move($4), $7);
+    $$ = At(driver, @$, new FunctionDeclaration($2, std::move($4), $7));
   }
 | "function" "identifier" "(" type_fields_opt ")" ":" "identifier" "=" expr {
-    $$ = new FunctionDeclaration($2, std::move($4), $7, $9);
+    $$ = At(driver, @$, new FunctionDeclaration($2, std::move($4), $7, $9));
   }
 ;
 %%
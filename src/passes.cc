@@ -0,0 +1,833 @@
+#include "passes.h"
+#include "BuiltIns.h"
+#include <algorithm>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace ir {
+
+void PassManager::Add(std::string name, Pass pass) {
+  passes_.emplace_back(std::move(name), std::move(pass));
+}
+
+std::vector<std::string> PassManager::Run(Function& f, std::ostream* dump,
+                                          const Module* module) const {
+  auto verify = [&](const std::string& after) {
+    std::vector<std::string> errors = Verify(f, module);
+    for (std::string& error : errors) error = after + ": " + error;
+    return errors;
+  };
+  if (dump) {
+    *dump << "; input\n";
+    Dump(f, *dump, module);
+  }
+  if (auto errors = verify("input"); !errors.empty()) return errors;
+  for (const auto& [name, pass] : passes_) {
+    if (!pass(f)) continue;
+    if (dump) {
+      *dump << "; after " << name << "\n";
+      Dump(f, *dump, module);
+    }
+    if (auto errors = verify(name); !errors.empty()) return errors;
+  }
+  return {};
+}
+
+namespace {
+
+// Whether an instruction might fail, or has effects, besides defining its
+// destination, so that it must run even if nothing uses that, and in its
+// place among others that might.
+bool MayFailOrHaveEffects(const Function& f, const Instruction& i) {
+  switch (i.op) {
+  case Op::kDiv:
+  case Op::kNewArray:
+  case Op::kLoadElement:
+  case Op::kStoreElement:
+  case Op::kLength:
+  case Op::kCallFunction:
+  case Op::kLoadField:
+  case Op::kStoreField:
+    return true;
+  case Op::kCall:
+    return FindBuiltInFunction(f.strings[i.imm])->effects !=
+           BuiltInEffects::kNone;
+  default:
+    return false;
+  }
+}
+} // namespace
+
+bool RemoveUnreachableBlocks(Function& f) {
+  if (f.blocks.empty()) return false;
+  std::vector<bool> reached(f.blocks.size());
+  std::vector<BlockId> work = {0};
+  reached[0] = true;
+  while (!work.empty()) {
+    BlockId b = work.back();
+    work.pop_back();
+    for (BlockId s : Successors(f.blocks[b])) {
+      if (s < f.blocks.size() && !reached[s]) {
+        reached[s] = true;
+        work.push_back(s);
+      }
+    }
+  }
+  // New numbers of the blocks reached.
+  std::vector<BlockId> number(f.blocks.size());
+  BlockId count = 0;
+  for (BlockId b = 0; b < f.blocks.size(); ++b) {
+    if (reached[b]) number[b] = count++;
+  }
+  if (count == f.blocks.size()) return false;
+  std::vector<Block> blocks;
+  blocks.reserve(count);
+  for (BlockId b = 0; b < f.blocks.size(); ++b) {
+    if (!reached[b]) continue;
+    blocks.push_back(std::move(f.blocks[b]));
+    for (BlockId& target : blocks.back().terminator.targets) {
+      target = number[target];
+    }
+  }
+  f.blocks = std::move(blocks);
+  return true;
+}
+
+bool RemoveDeadInstructions(Function& f) {
+  // Counts the uses of registers, then removes the instructions that define
+  // registers without uses, from a work list, and with each the uses by its
+  // operands, so that a chain of dead instructions goes in one pass.
+  std::vector<uint32_t> uses(f.registers.size());
+  // Blocks and indexes of the instructions that define each register.
+  std::vector<std::vector<std::pair<BlockId, size_t>>> definitions(
+      f.registers.size());
+  std::vector<std::vector<bool>> dead(f.blocks.size());
+  for (BlockId b = 0; b < f.blocks.size(); ++b) {
+    const std::vector<Instruction>& instructions = f.blocks[b].instructions;
+    for (size_t k = 0; k < instructions.size(); ++k) {
+      for (Reg r : instructions[k].operands) ++uses[r];
+      if (instructions[k].dest != kNoReg) {
+        definitions[instructions[k].dest].push_back({b, k});
+      }
+    }
+    for (Reg r : f.blocks[b].terminator.operands) ++uses[r];
+    dead[b].resize(instructions.size());
+  }
+  std::vector<Reg> work;
+  for (Reg r = 0; r < f.registers.size(); ++r) {
+    if (!uses[r]) work.push_back(r);
+  }
+  bool changed = false;
+  while (!work.empty()) {
+    Reg r = work.back();
+    work.pop_back();
+    for (auto [b, k] : definitions[r]) {
+      const Instruction& i = f.blocks[b].instructions[k];
+      if (dead[b][k] || MayFailOrHaveEffects(f, i)) continue;
+      dead[b][k] = true;
+      changed = true;
+      for (Reg operand : i.operands) {
+        if (!--uses[operand]) work.push_back(operand);
+      }
+    }
+  }
+  for (BlockId b = 0; b < f.blocks.size(); ++b) {
+    std::vector<Instruction>& instructions = f.blocks[b].instructions;
+    size_t kept = 0;
+    for (size_t k = 0; k < instructions.size(); ++k) {
+      if (dead[b][k]) continue;
+      if (kept != k) instructions[kept] = std::move(instructions[k]);
+      ++kept;
+    }
+    instructions.resize(kept);
+  }
+  return changed;
+}
+
+namespace {
+
+// Returns the value of an int with the given bits, as the JVM does.
+int32_t Wrap(int64_t value) { return int32_t(uint32_t(value)); }
+
+// Returns k if value is 2 to the k, for k > 0, or else 0.
+int Log2(int32_t value) {
+  int k = 0;
+  while (k < 30 && (int32_t(1) << (k + 1)) <= value) ++k;
+  return value > 1 && value == int32_t(1) << k ? k : 0;
+}
+
+// Returns the result of the given operation on constants, or none if it
+// fails.
+std::optional<int32_t> Fold(Op op, int32_t a, int32_t b) {
+  switch (op) {
+  case Op::kAdd:
+    return Wrap(int64_t(a) + b);
+  case Op::kSub:
+    return Wrap(int64_t(a) - b);
+  case Op::kMul:
+    return Wrap(int64_t(a) * b);
+  case Op::kDiv:
+    if (b == 0) return {};
+    return Wrap(int64_t(a) / b);
+  case Op::kShl:
+    return Wrap(int64_t(uint32_t(a) << (b & 31)));
+  case Op::kShr:
+    return a >> (b & 31);
+  default:
+    return Wrap(uint32_t(a) >> (b & 31));
+  }
+}
+
+bool Holds(Cmp cmp, int32_t a, int32_t b) {
+  switch (cmp) {
+  case Cmp::kEq:
+    return a == b;
+  case Cmp::kNe:
+    return a != b;
+  case Cmp::kLt:
+    return a < b;
+  case Cmp::kGe:
+    return a >= b;
+  case Cmp::kGt:
+    return a > b;
+  default:
+    return a <= b;
+  }
+}
+
+// Returns the comparison that holds for b and a when the given one holds
+// for a and b.
+Cmp Swap(Cmp cmp) {
+  switch (cmp) {
+  case Cmp::kLt:
+    return Cmp::kGt;
+  case Cmp::kGe:
+    return Cmp::kLe;
+  case Cmp::kGt:
+    return Cmp::kLt;
+  case Cmp::kLe:
+    return Cmp::kGe;
+  default:
+    return cmp;
+  }
+}
+
+// Rewrites instructions on ints, see Simplify.
+class Simplifier {
+public:
+  explicit Simplifier(Function& f) : f_(f), defs_(f.registers.size()) {
+    for (const Block& block : f.blocks) {
+      for (const Instruction& i : block.instructions) {
+        if (i.dest != kNoReg) ++defs_[i.dest];
+      }
+    }
+    for (const Block& block : f.blocks) {
+      for (const Instruction& i : block.instructions) {
+        if (i.op == Op::kConst && defs_[i.dest] == 1) {
+          constants_[i.dest] = i.imm;
+        }
+      }
+    }
+  }
+
+  bool Run() {
+    bool changed = Rewrite(&Simplifier::Simplify);
+    return Rewrite(&Simplifier::Reduce) || changed;
+  }
+
+private:
+  using Rule = bool (Simplifier::*)(Instruction&);
+
+  // A definition in the current block, with the numbers of writes to its
+  // operands before it.
+  struct Definition {
+    Instruction instruction;
+    std::vector<uint32_t> writes;
+  };
+
+  // Applies the given rule to each instruction until it no longer does
+  // anything, and returns whether it did. Simplifies branches too, with
+  // Simplify.
+  bool Rewrite(Rule rule) {
+    bool changed = false;
+    for (Block& block : f_.blocks) {
+      // New maps rather than clear, which takes time in the number of
+      // buckets, that one large block would leave large for all others.
+      definitions_ = decltype(definitions_)();
+      writes_ = decltype(writes_)();
+      std::vector<Instruction> instructions = std::move(block.instructions);
+      block.instructions.clear();
+      out_ = &block.instructions;
+      for (Instruction& i : instructions) {
+        changed |= Propagate(i.operands);
+        while ((this->*rule)(i)) changed = true;
+        Define(std::move(i));
+      }
+      if (rule == &Simplifier::Simplify) {
+        changed |= Propagate(block.terminator.operands);
+        changed |= SimplifyBranch(block.terminator);
+      }
+    }
+    return changed;
+  }
+
+  // Replaces operands that copy others of the same type in this block with
+  // those, and returns whether it did.
+  bool Propagate(std::vector<Reg>& operands) {
+    bool changed = false;
+    for (Reg& r : operands) {
+      while (const Instruction* d = Find(r, Op::kMove)) {
+        if (f_.registers[d->operands[0]] != f_.registers[r]) break;
+        r = d->operands[0];
+        changed = true;
+      }
+    }
+    return changed;
+  }
+
+  // Simplifies the given instruction a step, and returns whether it did.
+  bool Simplify(Instruction& i) {
+    if (i.op == Op::kNeg) {
+      Reg a = i.operands[0];
+      if (auto value = Constant(a)) {
+        i = {Op::kConst, i.dest, Wrap(-int64_t(*value))};
+        return true;
+      }
+      // -(-x) is x.
+      if (const Instruction* d = Find(a, Op::kNeg)) {
+        i = {Op::kMove, i.dest, 0, {d->operands[0]}};
+        return true;
+      }
+      return false;
+    }
+    if (i.op != Op::kAdd && i.op != Op::kSub && i.op != Op::kMul &&
+        i.op != Op::kDiv) {
+      return false;
+    }
+    Reg a = i.operands[0];
+    Reg b = i.operands[1];
+    std::optional<int32_t> ca = Constant(a);
+    std::optional<int32_t> cb = Constant(b);
+    if (ca && cb) {
+      std::optional<int32_t> value = Fold(i.op, *ca, *cb);
+      if (value) i = {Op::kConst, i.dest, *value};
+      return value.has_value();
+    }
+    // Constants go second, where the rules below look for them.
+    if (ca && (i.op == Op::kAdd || i.op == Op::kMul)) {
+      std::swap(i.operands[0], i.operands[1]);
+      return true;
+    }
+    switch (i.op) {
+    case Op::kAdd:
+      if (cb == 0) return Move(i, a);
+      return Reassociate(i);
+    case Op::kSub:
+      if (cb) {
+        i = {Op::kAdd, i.dest, 0, {a, NewConstant(Wrap(-int64_t(*cb)))}};
+        return true;
+      }
+      if (ca == 0) {
+        i = {Op::kNeg, i.dest, 0, {b}};
+        return true;
+      }
+      return false;
+    case Op::kMul:
+      if (cb == 0) {
+        i = {Op::kConst, i.dest, 0};
+        return true;
+      }
+      if (cb == 1) return Move(i, a);
+      if (cb == -1) {
+        i = {Op::kNeg, i.dest, 0, {a}};
+        return true;
+      }
+      return Reassociate(i);
+    default:
+      if (cb == 1) return Move(i, a);
+      if (cb == -1) {
+        i = {Op::kNeg, i.dest, 0, {a}};
+        return true;
+      }
+      return false;
+    }
+  }
+
+  // Rewrites (x + c) + d as x + (c + d), and likewise for *.
+  bool Reassociate(Instruction& i) {
+    std::optional<int32_t> d = Constant(i.operands[1]);
+    const Instruction* inner = Find(i.operands[0], i.op);
+    if (!d || !inner) return false;
+    std::optional<int32_t> c = Constant(inner->operands[1]);
+    if (!c) return false;
+    Reg x = inner->operands[0];
+    i.operands = {x, NewConstant(*Fold(i.op, *c, *d))};
+    return true;
+  }
+
+  bool Move(Instruction& i, Reg a) {
+    i = {Op::kMove, i.dest, 0, {a}};
+    return true;
+  }
+
+  // Replaces multiplications and divisions by powers of 2 by shifts.
+  bool Reduce(Instruction& i) {
+    if (i.op != Op::kMul && i.op != Op::kDiv) return false;
+    std::optional<int32_t> cb = Constant(i.operands[1]);
+    int k = cb ? Log2(*cb) : 0;
+    if (!k) return false;
+    Reg a = i.operands[0];
+    if (i.op == Op::kMul) {
+      i = {Op::kShl, i.dest, 0, {a, NewConstant(k)}};
+      return true;
+    }
+    // Division rounds toward 0, but shifts round down, so negative values
+    // of a need 2^k - 1 more first, which are the k low bits of its sign.
+    Reg bias;
+    if (k == 1) {
+      bias = New(Op::kUShr, {a, NewConstant(31)});
+    } else {
+      Reg sign = New(Op::kShr, {a, NewConstant(31)});
+      bias = New(Op::kUShr, {sign, NewConstant(32 - k)});
+    }
+    Reg biased = New(Op::kAdd, {bias, a});
+    i = {Op::kShr, i.dest, 0, {biased, NewConstant(k)}};
+    return true;
+  }
+
+  // Folds branches on constants, and compares with 0 by branches on one
+  // operand.
+  bool SimplifyBranch(Terminator& t) {
+    if (t.kind != Terminator::kBranch || t.operands.size() != 2) return false;
+    std::optional<int32_t> ca = Constant(t.operands[0]);
+    std::optional<int32_t> cb = Constant(t.operands[1]);
+    if (ca && cb) {
+      BlockId target = t.targets[Holds(t.cmp, *ca, *cb) ? 0 : 1];
+      t = {Terminator::kJump, Cmp::kEq, {}, {target}};
+    } else if (cb == 0) {
+      t.operands.pop_back();
+    } else if (ca == 0) {
+      t.operands.erase(t.operands.begin());
+      t.cmp = Swap(t.cmp);
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  std::optional<int32_t> Constant(Reg r) const {
+    auto constant = constants_.find(r);
+    if (constant == constants_.end()) return {};
+    return constant->second;
+  }
+
+  // Returns the definition of the given register that reaches this point,
+  // if it is by the given operation earlier in this block, on operands
+  // that have not changed since.
+  const Instruction* Find(Reg r, Op op) const {
+    auto d = definitions_.find(r);
+    if (d == definitions_.end() || d->second.instruction.op != op) {
+      return nullptr;
+    }
+    const std::vector<Reg>& operands = d->second.instruction.operands;
+    for (size_t k = 0; k < operands.size(); ++k) {
+      if (Writes(operands[k]) != d->second.writes[k]) return nullptr;
+    }
+    return &d->second.instruction;
+  }
+
+  uint32_t Writes(Reg r) const {
+    auto writes = writes_.find(r);
+    return writes == writes_.end() ? 0 : writes->second;
+  }
+
+  Reg NewConstant(int32_t value) {
+    Reg r = New(Op::kConst, {});
+    out_->back().imm = value;
+    constants_[r] = value;
+    return r;
+  }
+
+  // Adds an instruction on ints before the current one, and returns its
+  // destination.
+  Reg New(Op op, std::vector<Reg> operands) {
+    Reg r = f_.NewRegister(Type::kInt);
+    defs_.push_back(1);
+    Define({op, r, 0, std::move(operands)});
+    return r;
+  }
+
+  void Define(Instruction i) {
+    if (i.dest != kNoReg) {
+      if (i.op == Op::kConst && defs_[i.dest] == 1) {
+        constants_[i.dest] = i.imm;
+      }
+      Definition& d = definitions_[i.dest];
+      d.writes.clear();
+      for (Reg r : i.operands) d.writes.push_back(Writes(r));
+      d.instruction = i;
+      ++writes_[i.dest];
+    }
+    out_->push_back(std::move(i));
+  }
+
+  Function& f_;
+  std::vector<uint32_t> defs_;
+  // Values of registers defined only by constants.
+  std::unordered_map<Reg, int32_t> constants_;
+  // The last definitions so far in the current block, and the numbers of
+  // writes of registers there.
+  std::unordered_map<Reg, Definition> definitions_;
+  std::unordered_map<Reg, uint32_t> writes_;
+  std::vector<Instruction>* out_ = nullptr;
+};
+} // namespace
+
+bool Simplify(Function& f) { return Simplifier(f).Run(); }
+
+namespace {
+
+// Gives each loop header but the entry a preheader, unless it has one: a
+// new block that jumps to the header, where branches from outside the loop
+// go instead. Places
+// it after its only predecessor outside the loop, if it has one, and else
+// before the header, so that code falls through where it did. Returns
+// whether it added blocks.
+bool InsertPreheaders(Function& f, const std::vector<Loop>& loops) {
+  struct Preheader {
+    BlockId header;
+    std::vector<BlockId> outside;
+  };
+  std::vector<std::vector<BlockId>> predecessors = Predecessors(f);
+  // Preheaders by the block they follow.
+  std::vector<std::vector<Preheader>> after(f.blocks.size());
+  bool inserted = false;
+  for (const Loop& loop : loops) {
+    if (loop.header == 0) continue;
+    Preheader preheader = {loop.header, {}};
+    for (BlockId p : predecessors[loop.header]) {
+      if (!loop.Contains(p)) preheader.outside.push_back(p);
+    }
+    if (preheader.outside.empty() ||
+        (preheader.outside.size() == 1 &&
+         Successors(f.blocks[preheader.outside[0]]) ==
+             std::vector<BlockId>{loop.header})) {
+      continue;
+    }
+    BlockId previous = preheader.outside.size() == 1 ? preheader.outside[0]
+                                                     : loop.header - 1;
+    after[previous].push_back(std::move(preheader));
+    inserted = true;
+  }
+  if (!inserted) return false;
+
+  std::vector<BlockId> number(f.blocks.size());
+  BlockId count = 0;
+  for (BlockId b = 0; b < f.blocks.size(); ++b) {
+    number[b] = count++;
+    count += after[b].size();
+  }
+  std::vector<Block> blocks(count);
+  for (BlockId b = 0; b < f.blocks.size(); ++b) {
+    for (BlockId& target : f.blocks[b].terminator.targets) {
+      target = number[target];
+    }
+    blocks[number[b]] = std::move(f.blocks[b]);
+  }
+  for (BlockId b = 0; b < f.blocks.size(); ++b) {
+    BlockId id = number[b];
+    for (const Preheader& preheader : after[b]) {
+      BlockId header = number[preheader.header];
+      blocks[++id].terminator = {Terminator::kJump, Cmp::kEq, {}, {header}};
+      for (BlockId p : preheader.outside) {
+        std::vector<BlockId>& targets = blocks[number[p]].terminator.targets;
+        std::replace(targets.begin(), targets.end(), header, id);
+      }
+    }
+  }
+  f.blocks = std::move(blocks);
+  return true;
+}
+
+// Moves instructions out of loops, see HoistLoopInvariants.
+class Hoister {
+public:
+  explicit Hoister(Function& f) : f_(f), defs_(f.registers.size()) {
+    for (const Block& block : f.blocks) {
+      for (const Instruction& i : block.instructions) {
+        if (i.dest != kNoReg) ++defs_[i.dest];
+      }
+    }
+  }
+
+  // Moves the invariant instructions of the given loop to the end of its
+  // preheader, and returns whether any moved.
+  bool Hoist(const Loop& loop, BlockId preheader) {
+    std::unordered_set<Reg> defined;
+    // Types of arrays stored to, and kRecord if fields are. Calls may store
+    // to any.
+    std::unordered_set<Type> stored;
+    for (BlockId b : loop.blocks) {
+      for (const Instruction& i : f_.blocks[b].instructions) {
+        if (i.dest != kNoReg) defined.insert(i.dest);
+        if (i.op == Op::kStoreElement) {
+          stored.insert(f_.registers[i.operands[0]]);
+        } else if (i.op == Op::kStoreField) {
+          stored.insert(Type::kRecord);
+        } else if (i.op == Op::kCallFunction) {
+          stored.insert({Type::kIntArray, Type::kStringArray, Type::kRecord});
+        }
+      }
+    }
+    // Invariant instructions, in an order where those that define operands
+    // come first, and the index there of the definition of each register.
+    std::vector<std::pair<BlockId, size_t>> invariant;
+    std::unordered_map<Reg, size_t> definition;
+    for (bool changed = true; changed;) {
+      changed = false;
+      for (BlockId b : loop.blocks) {
+        // Whether instructions up to here in the header may stay in the
+        // loop and fail or have effects.
+        bool blocked = b != loop.header;
+        const std::vector<Instruction>& instructions =
+            f_.blocks[b].instructions;
+        for (size_t index = 0; index < instructions.size(); ++index) {
+          const Instruction& i = instructions[index];
+          bool moves = i.dest != kNoReg && definition.count(i.dest);
+          if (!moves && IsInvariant(i, defined, definition, stored) &&
+              (!blocked || !MayFailOrHaveEffects(f_, i))) {
+            definition[i.dest] = invariant.size();
+            invariant.emplace_back(b, index);
+            changed = moves = true;
+          }
+          if (!moves && MayFailOrHaveEffects(f_, i)) blocked = true;
+        }
+      }
+    }
+    // Moves instructions that compute something, and those they need.
+    std::vector<bool> needed(invariant.size());
+    for (size_t k = invariant.size(); k-- > 0;) {
+      const Instruction& i = At(invariant[k]);
+      if (!needed[k] && (i.op == Op::kConst || i.op == Op::kString ||
+                         i.op == Op::kNil || i.op == Op::kMove)) {
+        continue;
+      }
+      needed[k] = true;
+      for (Reg r : i.operands) {
+        if (auto d = definition.find(r); d != definition.end()) {
+          needed[d->second] = true;
+        }
+      }
+    }
+    if (std::find(needed.begin(), needed.end(), true) == needed.end()) {
+      return false;
+    }
+    std::unordered_map<BlockId, std::vector<bool>> moved;
+    std::vector<Instruction>& hoisted = f_.blocks[preheader].instructions;
+    for (size_t k = 0; k < invariant.size(); ++k) {
+      if (!needed[k]) continue;
+      auto [b, index] = invariant[k];
+      std::vector<bool>& block_moved = moved[b];
+      block_moved.resize(f_.blocks[b].instructions.size());
+      block_moved[index] = true;
+      hoisted.push_back(std::move(At(invariant[k])));
+    }
+    for (auto& [b, block_moved] : moved) {
+      std::vector<Instruction>& instructions = f_.blocks[b].instructions;
+      size_t kept = 0;
+      for (size_t index = 0; index < instructions.size(); ++index) {
+        if (block_moved[index]) continue;
+        if (kept != index) instructions[kept] = std::move(instructions[index]);
+        ++kept;
+      }
+      instructions.resize(kept);
+    }
+    return true;
+  }
+
+private:
+  Instruction& At(std::pair<BlockId, size_t> position) {
+    return f_.blocks[position.first].instructions[position.second];
+  }
+
+  // Returns whether the given instruction of a loop computes the same
+  // value in each iteration, into the only definition of its destination.
+  bool IsInvariant(const Instruction& i,
+                   const std::unordered_set<Reg>& defined,
+                   const std::unordered_map<Reg, size_t>& definition,
+                   const std::unordered_set<Type>& stored) {
+    if (i.dest == kNoReg || defs_[i.dest] != 1) return false;
+    for (Reg r : i.operands) {
+      if (defined.count(r) && !definition.count(r)) return false;
+    }
+    switch (i.op) {
+    case Op::kNewArray:
+    case Op::kIncrement:
+    case Op::kCallFunction:
+    case Op::kNewRecord:
+      return false;
+    case Op::kLoadElement:
+      return !stored.count(f_.registers[i.operands[0]]);
+    case Op::kLoadField:
+      return !stored.count(Type::kRecord);
+    case Op::kCall:
+      return FindBuiltInFunction(f_.strings[i.imm])->effects !=
+             BuiltInEffects::kIo;
+    default:
+      return true;
+    }
+  }
+
+  Function& f_;
+  std::vector<uint32_t> defs_;
+};
+} // namespace
+
+bool HoistLoopInvariants(Function& f) {
+  std::vector<Loop> loops = FindLoops(f);
+  bool changed = InsertPreheaders(f, loops);
+  if (changed) loops = FindLoops(f);
+  // Inner loops first, so that their invariants can move on out of outer
+  // loops.
+  std::stable_sort(loops.begin(), loops.end(),
+                   [](const Loop& a, const Loop& b) {
+                     return a.blocks.size() < b.blocks.size();
+                   });
+  std::vector<std::vector<BlockId>> predecessors = Predecessors(f);
+  Hoister hoister(f);
+  for (const Loop& loop : loops) {
+    std::vector<BlockId> outside;
+    for (BlockId p : predecessors[loop.header]) {
+      if (!loop.Contains(p)) outside.push_back(p);
+    }
+    if (outside.size() == 1 && Successors(f.blocks[outside[0]]) ==
+                                   std::vector<BlockId>{loop.header}) {
+      changed |= hoister.Hoist(loop, outside[0]);
+    }
+  }
+  return changed;
+}
+
+bool ThreadJumps(Function& f) {
+  // Follows jumps through empty blocks, at most once through each, so that
+  // empty loops end, and remembers where each block visited leads, so that
+  // long chains take one walk.
+  std::vector<BlockId> final_targets(f.blocks.size(), kNoBlock);
+  std::vector<BlockId> path;
+  auto final_target = [&](BlockId target) {
+    BlockId b = target;
+    while (final_targets[b] == kNoBlock) {
+      const Block& block = f.blocks[b];
+      if (!block.instructions.empty() ||
+          block.terminator.kind != Terminator::kJump) {
+        break;
+      }
+      // Where a chain that loops back to b ends.
+      final_targets[b] = b;
+      path.push_back(b);
+      b = block.terminator.targets[0];
+    }
+    if (final_targets[b] != kNoBlock) b = final_targets[b];
+    for (BlockId visited : path) final_targets[visited] = b;
+    path.clear();
+    return b;
+  };
+  bool changed = false;
+  for (Block& block : f.blocks) {
+    for (BlockId& target : block.terminator.targets) {
+      BlockId threaded = final_target(target);
+      changed |= threaded != target;
+      target = threaded;
+    }
+  }
+  return changed;
+}
+
+bool PeelHotCases(Function& f) {
+  bool changed = false;
+  // Only the switches there were, not the rest of those peeled.
+  for (BlockId b = 0, n = f.blocks.size(); b < n; ++b) {
+    Terminator t = f.blocks[b].terminator;
+    if (t.kind != Terminator::kSwitch || t.counts.empty()) continue;
+    uint64_t total = 0;
+    size_t hot = 1;
+    for (size_t k = 0; k < t.counts.size(); ++k) {
+      total += t.counts[k];
+      if (k > 0 && t.counts[k] > t.counts[hot]) hot = k;
+    }
+    if (hot >= t.counts.size() || t.counts[hot] <= total / 2) continue;
+    Terminator branch = {Terminator::kBranch,
+                         Cmp::kEq,
+                         {t.operands[0]},
+                         {t.targets[hot], f.NewBlock()},
+                         {},
+                         {t.counts[hot], total - t.counts[hot]}};
+    if (int32_t value = t.values[hot - 1]; value != 0) {
+      Reg constant = f.NewRegister(Type::kInt);
+      f.blocks[b].instructions.push_back({Op::kConst, constant, value});
+      branch.operands.push_back(constant);
+    }
+    t.values.erase(t.values.begin() + (hot - 1));
+    t.targets.erase(t.targets.begin() + hot);
+    t.counts.erase(t.counts.begin() + hot);
+    if (t.values.empty()) {
+      t = {Terminator::kJump, Cmp::kEq, {}, {t.targets[0]}};
+    }
+    f.blocks[branch.targets[1]].terminator = std::move(t);
+    f.blocks[b].terminator = std::move(branch);
+    changed = true;
+  }
+  return changed;
+}
+
+bool LayOutBlocks(Function& f) {
+  bool counted = false;
+  for (const Block& block : f.blocks) {
+    counted |= !block.terminator.counts.empty();
+  }
+  if (!counted) return false;
+  // The block to place after the given one: the most frequent target not
+  // placed yet, or without counts, the block after it if a target.
+  std::vector<bool> placed(f.blocks.size());
+  auto next = [&](BlockId b) {
+    const Terminator& t = f.blocks[b].terminator;
+    size_t best = t.targets.size();
+    for (size_t k = 0; k < t.targets.size(); ++k) {
+      if (placed[t.targets[k]]) continue;
+      if (t.counts.empty()) {
+        if (t.targets[k] == b + 1) return t.targets[k];
+      } else if (best == t.targets.size() || t.counts[k] > t.counts[best]) {
+        best = k;
+      }
+    }
+    return best < t.targets.size() ? t.targets[best] : kNoBlock;
+  };
+  // Chains of blocks from each block not placed yet, in order, starting
+  // with the entry.
+  std::vector<BlockId> order;
+  for (BlockId start = 0; start < f.blocks.size(); ++start) {
+    for (BlockId b = start; b != kNoBlock && !placed[b]; b = next(b)) {
+      placed[b] = true;
+      order.push_back(b);
+    }
+  }
+  std::vector<BlockId> number(f.blocks.size());
+  bool changed = false;
+  for (BlockId b = 0; b < order.size(); ++b) {
+    number[order[b]] = b;
+    changed |= order[b] != b;
+  }
+  if (!changed) return false;
+  std::vector<Block> blocks;
+  blocks.reserve(order.size());
+  for (BlockId b : order) {
+    blocks.push_back(std::move(f.blocks[b]));
+    for (BlockId& target : blocks.back().terminator.targets) {
+      target = number[target];
+    }
+  }
+  f.blocks = std::move(blocks);
+  return true;
+}
+} // namespace ir
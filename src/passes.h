@@ -0,0 +1,82 @@
+#pragma once
+#include "ir.h"
+#include <functional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ir {
+
+// Runs passes over functions in order, and verifies the function after
+// each pass, so that a pass that breaks the invariants of the IR is caught
+// where it does.
+class PassManager {
+public:
+  // Transforms a function, and returns whether it changed it.
+  using Pass = std::function<bool(Function&)>;
+
+  void Add(std::string name, Pass pass);
+
+  // Runs the passes over the given function, and returns the errors of
+  // verification, each prefixed by the pass after which it was found, or
+  // by "input". Stops at the first pass whose output fails. Writes the
+  // function, as given and after each pass that changed it, to dump, if
+  // any. Verifies calls against the module of the function, if given.
+  std::vector<std::string> Run(Function& f, std::ostream* dump = nullptr,
+                               const Module* module = nullptr) const;
+
+private:
+  std::vector<std::pair<std::string, Pass>> passes_;
+};
+
+// Removes blocks that the entry does not reach, keeping the others in
+// order.
+bool RemoveUnreachableBlocks(Function& f);
+
+// Removes instructions whose destinations nothing uses, unless they might
+// fail or have effects.
+bool RemoveDeadInstructions(Function& f);
+
+// Simplifies arithmetic on ints, e.g. x * 1 and x + 0 to x, -(-x) to x,
+// (x + 1) + 2 to x + 3 and 2 * 3 to 6, and replaces multiplications and
+// divisions by powers of 2 with shifts, e.g. x * 8 with x << 3. Reads
+// copies of registers from the originals, where they are the same in the
+// block. Branches on constants become jumps, and comparisons with 0
+// branches on one operand, i.e. ifeq and the like. Leaves unused the
+// instructions that computed the operands of those it rewrote, for
+// RemoveDeadInstructions.
+bool Simplify(Function& f);
+
+// Moves instructions whose operands do not change in a loop out of it, to
+// the end of the only block before its header, which it adds if need be,
+// e.g. size(s) and n - 1 in
+//
+//   while i < size(s) do (a[i] := n - 1; i := i + 1)
+//
+// Instructions move if they compute something, with the instructions they
+// need, rather than only copy a variable or a constant, and define the only
+// value of a register. Instructions that might fail, e.g. divisions or
+// substring, move only from the start of the header, ahead of anything
+// with effects or that might fail, which runs whenever the loop is
+// entered, so that a failure happens at the same point. Loads of array
+// elements move only from loops without stores to arrays of their type,
+// which might alias, and loads of fields only from loops without stores
+// to fields. Calls of functions of the module count as stores to both.
+// Strings are never nil, as Tiger has no nil strings.
+bool HoistLoopInvariants(Function& f);
+
+// Redirects branches to empty blocks that only jump to their final
+// target, e.g. to the end of an if nested in the branch of another.
+bool ThreadJumps(Function& f);
+
+// Of switches with counts, see profile.h, tests for the case that takes more
+// than half of the runs with a branch ahead of the switch of the others.
+bool PeelHotCases(Function& f);
+
+// Orders the blocks of functions with counts so that each falls through to
+// its most frequent target where it can, e.g. to the body of a loop rather
+// than its exit if that runs more often, or without counts, to the block
+// that it fell through to. Keeps the entry first.
+bool LayOutBlocks(Function& f);
+} // namespace ir
@@ -0,0 +1,54 @@
+#include "process.h"
+#include <cstdlib>
+#include <fcntl.h>
+#include <sstream>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace process {
+namespace {
+
+// Makes the given file the given descriptor, in a child process, where
+// only calls that are safe after fork may run.
+bool Redirect(const std::string& file, int fd, int flags) {
+  if (file.empty()) return true;
+  int opened = open(file.c_str(), flags, 0666);
+  return opened >= 0 && dup2(opened, fd) >= 0 && close(opened) == 0;
+}
+} // namespace
+
+std::vector<std::string> CCompiler(const std::string& c_path,
+                                   const std::string& path) {
+  std::vector<std::string> command;
+  const char* cc = std::getenv("CC");
+  std::istringstream words(cc && *cc ? cc : "cc");
+  for (std::string word; words >> word;) command.push_back(word);
+  if (command.empty()) command.push_back("cc");
+  for (const char* arg : {"-std=c11", "-O2", "-o"}) command.push_back(arg);
+  command.push_back(path);
+  command.push_back(c_path);
+  return command;
+}
+
+int Run(const std::vector<std::string>& command, const Redirects& redirects) {
+  std::vector<char*> argv;
+  for (const auto& arg : command) {
+    argv.push_back(const_cast<char*>(arg.c_str()));
+  }
+  argv.push_back(nullptr);
+  const int kWrite = O_WRONLY | O_CREAT | O_TRUNC;
+  pid_t pid = fork();
+  if (pid == 0) {
+    if (Redirect(redirects.in, STDIN_FILENO, O_RDONLY) &&
+        Redirect(redirects.out, STDOUT_FILENO, kWrite) &&
+        Redirect(redirects.err, STDERR_FILENO, kWrite)) {
+      execvp(argv[0], argv.data());
+    }
+    _exit(127);
+  }
+  int status = 0;
+  if (pid < 0 || waitpid(pid, &status, 0) != pid) return -1;
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+} // namespace process
@@ -0,0 +1,28 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// Child processes, e.g. of the C compiler for tc --native, started with an
+// argument vector rather than a shell, so that no argument needs quoting.
+namespace process {
+
+// Files for the standard streams of a child process, or empty to share
+// those of this one.
+struct Redirects {
+  std::string in;
+  std::string out;
+  std::string err;
+};
+
+// Returns the command that compiles the C program at c_path to an
+// executable at path, with the C compiler, $CC or cc. $CC may hold
+// arguments, e.g. "ccache cc", which it splits at blanks.
+std::vector<std::string> CCompiler(const std::string& c_path,
+                                   const std::string& path);
+
+// Runs the given command, with its program looked up in PATH, and returns
+// its exit status, 127 if its program could not run, or -1 if there was no
+// process or it did not exit, e.g. on a signal.
+int Run(const std::vector<std::string>& command,
+        const Redirects& redirects = {});
+} // namespace process
@@ -0,0 +1,87 @@
+#include "profile.h"
+#include <sstream>
+
+namespace ir {
+
+uint64_t Hash(const Function& f) {
+  // 64 bit FNV-1a.
+  uint64_t hash = 14695981039346656037u;
+  for (unsigned char c : ToString(f)) {
+    hash ^= c;
+    hash *= 1099511628211u;
+  }
+  return hash;
+}
+
+Profile EmptyProfile(const Function& f) {
+  Profile profile{f.name, Hash(f), 0, {}};
+  for (const Block& block : f.blocks) {
+    size_t targets = block.terminator.targets.size();
+    profile.counts.emplace_back(targets < 2 ? 0 : targets);
+  }
+  return profile;
+}
+
+void WriteProfiles(const std::vector<Profile>& profiles, std::ostream& os) {
+  for (const Profile& profile : profiles) {
+    os << "function " << profile.function << " " << profile.hash << " "
+       << profile.entries << " " << profile.counts.size() << "\n";
+    for (size_t b = 0; b < profile.counts.size(); ++b) {
+      if (profile.counts[b].empty()) continue;
+      os << "b" << b;
+      for (uint64_t count : profile.counts[b]) os << " " << count;
+      os << "\n";
+    }
+  }
+}
+
+std::optional<std::vector<Profile>> ReadProfiles(std::istream& is) {
+  std::vector<Profile> profiles;
+  for (std::string line; std::getline(is, line);) {
+    std::istringstream fields(line);
+    std::string word;
+    if (!(fields >> word)) continue;
+    if (word == "function") {
+      Profile profile;
+      size_t blocks;
+      if (!(fields >> profile.function >> profile.hash >> profile.entries >>
+            blocks)) {
+        return {};
+      }
+      profile.counts.resize(blocks);
+      profiles.push_back(std::move(profile));
+    } else if (word[0] == 'b' && !profiles.empty()) {
+      size_t b;
+      std::vector<std::vector<uint64_t>>& counts = profiles.back().counts;
+      if (!(std::istringstream(word.substr(1)) >> b) || b >= counts.size()) {
+        return {};
+      }
+      for (uint64_t count; fields >> count;) counts[b].push_back(count);
+      if (!fields.eof()) return {};
+    } else {
+      return {};
+    }
+  }
+  return profiles;
+}
+
+bool ApplyProfile(const std::vector<Profile>& profiles, Function& f,
+                  std::vector<std::string>& warnings) {
+  for (const Profile& profile : profiles) {
+    if (profile.function != f.name) continue;
+    if (profile.hash != Hash(f) || profile.counts.size() != f.blocks.size()) {
+      warnings.push_back("Profile of " + f.name +
+                            " is of another version of it, ignored");
+      return false;
+    }
+    for (BlockId b = 0; b < f.blocks.size(); ++b) {
+      Terminator& t = f.blocks[b].terminator;
+      if (profile.counts[b].size() == t.targets.size()) {
+        t.counts = profile.counts[b];
+      }
+    }
+    return true;
+  }
+  return false;
+}
+} // namespace ir
@@ -0,0 +1,56 @@
+#pragma once
+#include "ir.h"
+#include <cstdint>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Counts from runs of programs, for optimizations guided by them: tc
+// --instrument=FILE measures them in the bytecode of vm.h, see
+// vm::Assemble, as class files have no counters, and tc --profile-use=FILE
+// gives them to ir::PeelHotCases and ir::LayOutBlocks through
+// Terminator::counts. Nothing inlines functions by them yet. A profile is
+// of a function as the passes before ApplyProfile leave it, so that later
+// compiles find the blocks counted, whichever the backend.
+namespace ir {
+
+struct Profile {
+  std::string function;
+  // Hash of the function counted, see Hash.
+  uint64_t hash = 0;
+  // Times that the function ran.
+  uint64_t entries = 0;
+  // Times that each target of the terminator of each block was taken, or
+  // none for blocks with fewer than two targets.
+  std::vector<std::vector<uint64_t>> counts;
+};
+
+// Returns a hash of the function as dumped, so that profiles apply only to
+// the function that they counted.
+uint64_t Hash(const Function& f);
+
+// Returns a profile of the given function without counts.
+Profile EmptyProfile(const Function& f);
+
+// Writes profiles as text, e.g.
+//
+//   function main 7804271384625431473 1 4
+//   b0 9 1
+//   b2 0 0 1
+//
+// with the hash, entries and number of blocks of each function, and the
+// counts of the blocks that have some.
+void WriteProfiles(const std::vector<Profile>& profiles, std::ostream& os);
+
+// Returns the profiles that WriteProfiles wrote, or none if malformed.
+std::optional<std::vector<Profile>> ReadProfiles(std::istream& is);
+
+// Sets the counts of the terminators of the given function from the one
+// of the given profiles of it, if any, and returns whether it did. Adds a
+// warning, and leaves the function as it is, if that profile is of another
+// version of the function, e.g. of a program edited since it was measured.
+bool ApplyProfile(const std::vector<Profile>& profiles, Function& f,
+                  std::vector<std::string>& warnings);
+} // namespace ir
@@ -0,0 +1,219 @@
+#include "profile.h"
+#include "compiler.h"
+#include "ir.h"
+#include "passes.h"
+#include "testing/catch.h"
+#include "testing/testing.h"
+#include "vm.h"
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+using namespace ir;
+
+// Returns a function that prints whether a is below 2, i.e.
+//
+//   b0: a = 1; if a < 2 goto b1 else b2
+//   b1: printi(a); goto b2
+//   b2: return
+Function Example() {
+  Function f;
+  f.name = "main";
+  BlockId entry = f.NewBlock();
+  BlockId then_block = f.NewBlock();
+  BlockId end = f.NewBlock();
+  Reg a = f.NewRegister(ir::Type::kInt, "a");
+  Reg two = f.NewRegister(ir::Type::kInt);
+  f.blocks[entry].instructions = {{Op::kConst, a, 1},
+                                  {Op::kConst, two, 2}};
+  f.blocks[entry].terminator = {Terminator::kBranch, Cmp::kLt, {a, two},
+                                {then_block, end}};
+  f.blocks[then_block].instructions = {
+      {Op::kCall, kNoReg, f.AddString("printi"), {a}}};
+  f.blocks[then_block].terminator = {Terminator::kJump, Cmp::kEq, {}, {end}};
+  f.blocks[end].terminator = {Terminator::kReturn};
+  return f;
+}
+
+std::shared_ptr<Expression> Typed(const std::string& program) {
+  std::shared_ptr<Expression> e = testing::Parse(program);
+  Expression::SetNameSpacesBelow(*e);
+  Expression::SetTypesBelow(*e);
+  return e;
+}
+
+SCENARIO("profiles read back and apply", "[profile]") {
+  GIVEN("a profile of a function") {
+    Function f = Example();
+    Profile profile = EmptyProfile(f);
+    profile.entries = 1;
+    profile.counts[0] = {3, 7};
+    THEN("it writes as text and reads back") {
+      std::ostringstream os;
+      WriteProfiles({profile, profile}, os);
+      REQUIRE(os.str() == "function main " + std::to_string(Hash(f)) +
+                              " 1 3\nb0 3 7\n"
+                              "function main " + std::to_string(Hash(f)) +
+                              " 1 3\nb0 3 7\n");
+      std::istringstream is(os.str());
+      auto read = ReadProfiles(is);
+      REQUIRE(read);
+      REQUIRE(read->size() == 2);
+      REQUIRE((*read)[1].function == "main");
+      REQUIRE((*read)[1].hash == Hash(f));
+      REQUIRE((*read)[1].counts ==
+              std::vector<std::vector<uint64_t>>{{3, 7}, {}, {}});
+    }
+    THEN("malformed text does not read") {
+      for (const char* text : {"function main", "b0 1 2",
+                               "function main 1 1 1\nb1 2",
+                               "function main 1 1 1\nb0 x"}) {
+        std::istringstream is(text);
+        REQUIRE(!ReadProfiles(is));
+      }
+    }
+    THEN("it sets the counts of branches") {
+      std::vector<std::string> warnings;
+      REQUIRE(ApplyProfile({profile}, f, warnings));
+      REQUIRE(warnings.empty());
+      REQUIRE(Verify(f).empty());
+      REQUIRE(ToString(f).find("br lt %0.a, %1 ? b1 : b2 ; counts 3 7\n") !=
+              std::string::npos);
+    }
+    THEN("it does not apply to other functions") {
+      f.blocks[1].instructions.clear();
+      std::vector<std::string> warnings;
+      REQUIRE(!ApplyProfile({profile}, f, warnings));
+      REQUIRE(warnings == std::vector<std::string>{
+                                 "Profile of main is of another version of "
+                                 "it, ignored"});
+      f.name = "other";
+      warnings.clear();
+      REQUIRE(!ApplyProfile({profile}, f, warnings));
+      REQUIRE(warnings.empty());
+    }
+  }
+}
+
+SCENARIO("profiles guide passes", "[profile]") {
+  GIVEN("a branch that mostly skips its block") {
+    Function f = Example();
+    f.blocks[0].terminator.counts = {1, 9};
+    REQUIRE(LayOutBlocks(f));
+    REQUIRE(Verify(f).empty());
+    THEN("the more frequent target follows it") {
+      REQUIRE(ToString(f) == "function main\n"
+                             "b0:\n"
+                             "  %0.a:int = const 1\n"
+                             "  %1:int = const 2\n"
+                             "  br lt %0.a, %1 ? b2 : b1 ; counts 1 9\n"
+                             "b1:\n"
+                             "  return\n"
+                             "b2:\n"
+                             "  call printi %0.a\n"
+                             "  jump b1\n");
+      REQUIRE(!LayOutBlocks(f));
+    }
+  }
+  GIVEN("a function without counts") {
+    Function f = Example();
+    REQUIRE(!LayOutBlocks(f));
+    REQUIRE(!PeelHotCases(f));
+  }
+  GIVEN("a switch with a frequent case") {
+    Function f;
+    f.name = "main";
+    for (int k = 0; k < 4; ++k) f.NewBlock();
+    Reg a = f.NewRegister(ir::Type::kInt, "a");
+    f.blocks[0].instructions = {{Op::kConst, a, 1}};
+    f.blocks[0].terminator = {
+        Terminator::kSwitch, Cmp::kEq, {a}, {1, 2, 3}, {5, 7}, {1, 2, 7}};
+    for (BlockId b = 1; b < 4; ++b) {
+      f.blocks[b].terminator = {Terminator::kReturn};
+    }
+    REQUIRE(PeelHotCases(f));
+    REQUIRE(Verify(f).empty());
+    THEN("a branch tests for it first") {
+      REQUIRE(ToString(f) == "function main\n"
+                             "b0:\n"
+                             "  %0.a:int = const 1\n"
+                             "  %1:int = const 7\n"
+                             "  br eq %0.a, %1 ? b3 : b4 ; counts 7 3\n"
+                             "b1:\n"
+                             "  return\n"
+                             "b2:\n"
+                             "  return\n"
+                             "b3:\n"
+                             "  return\n"
+                             "b4:\n"
+                             "  switch %0.a default b1, 5 -> b2 ; counts 1 "
+                             "2\n");
+    }
+  }
+  GIVEN("a profile of a run of a program") {
+    const char* program = "for i := 0 to 99 do if i - i / 10 * 10 = 0 then "
+                          "print(\"a\") else printi(i / 10)";
+    auto e = Typed(program);
+    CompiledBytecode instrumented = CompileToInstrumentedBytecode(*e);
+    std::vector<Profile> profiles = instrumented.program.profiles;
+    std::istringstream in;
+    std::ostringstream out, err;
+    REQUIRE(vm::Run(instrumented.program, in, out, err, &profiles) == 0);
+    REQUIRE(profiles.size() == 1);
+    const Profile& profile = profiles[0];
+    REQUIRE(profile.entries == 1);
+    THEN("branches count how often they went where") {
+      std::vector<uint64_t> totals;
+      for (const std::vector<uint64_t>& counts : profile.counts) {
+        uint64_t total = 0;
+        for (uint64_t count : counts) total += count;
+        if (total) totals.push_back(total);
+      }
+      // The test of the loop, and of the if in it.
+      std::sort(totals.begin(), totals.end());
+      REQUIRE(totals.size() == 2);
+      REQUIRE(totals[0] == 100);
+    }
+    THEN("programs compiled with it run as before") {
+      std::ostringstream dump;
+      REQUIRE(DumpIr(*e, dump, {profile}).empty());
+      REQUIRE(dump.str().find("; after apply-profile") != std::string::npos);
+      std::ostringstream class_file;
+      REQUIRE(Compile(*e, "Main", class_file, {profile}).empty());
+      REQUIRE(testing::RunClass(class_file.str()).out == out.str());
+      std::ostringstream profiled;
+      vm::Run(CompileToBytecode(*e, {profile}).program, in, profiled, err);
+      REQUIRE(profiled.str() == out.str());
+      REQUIRE(testing::RunC(CompileToC(*e, {profile}).source).out ==
+              out.str());
+    }
+  }
+  GIVEN("a profile of a run of a program with functions") {
+    auto e = Typed("let function odd(n: int): int = if n = 0 then 0 else "
+                   "if n - n / 2 * 2 = 1 then 1 else 0 in for i := 0 to 9 do "
+                   "printi(odd(i)) end");
+    CompiledBytecode instrumented = CompileToInstrumentedBytecode(*e);
+    std::vector<Profile> profiles = instrumented.program.profiles;
+    std::istringstream in;
+    std::ostringstream out, err;
+    REQUIRE(vm::Run(instrumented.program, in, out, err, &profiles) == 0);
+    REQUIRE(out.str() == "0101010101");
+    THEN("each function has a profile of its calls") {
+      REQUIRE(profiles.size() == 2);
+      REQUIRE(profiles[0].entries == 1);
+      REQUIRE(profiles[1].function == "odd");
+      REQUIRE(profiles[1].entries == 10);
+    }
+    THEN("programs compiled with it apply each") {
+      std::ostringstream dump;
+      REQUIRE(DumpIr(*e, dump, profiles).empty());
+      REQUIRE(dump.str().find("counts 1 9") != std::string::npos);
+      std::ostringstream profiled;
+      vm::Run(CompileToBytecode(*e, profiles).program, in, profiled, err);
+      REQUIRE(profiled.str() == out.str());
+    }
+  }
+}
+} // namespace
@@ -1,8 +1,11 @@
 %{ /* -*- C++ -*- */
+# include <algorithm>
 # include <cerrno>
 # include <climits>
 # include <cstdlib>
+# include <cstring>
 # include <string>
+# include <string_view>
 # include "driver.h"
 # include "parser.hh"
 
@@ -15,17 +18,22 @@
 
 // The location of the current token.
 static yy::location loc;
+// How many comments enclose the current position.
+static int comment_depth;
 extern "C" int fileno(FILE *);
 %}
 %option noyywrap nounput batch debug noinput
+%x COMMENT
 id    [a-zA-Z][a-zA-Z_0-9]*
 int   [0-9]+
-blank [ \t]
+blank [ \t\r]
 string \"[^\"]*\"
 
 %{
   // Code run each time a pattern is matched.
-  # define YY_USER_ACTION  loc.columns(yyleng);
+  # define YY_USER_ACTION                                                \
+    loc.columns(yyleng);                                                \
+    driver.source_map.Append(std::string_view(yytext, yyleng));
 %}
 
 %%
@@ -37,6 +45,19 @@ string \"[^\"]*\"
 
 {blank}+   loc.step ();
 [\n]+      loc.lines (yyleng); loc.step ();
+"/*"       comment_depth = 1; BEGIN(COMMENT);
+<COMMENT>{
+"/*"       ++comment_depth;
+"*/"       if (--comment_depth == 0) { BEGIN(INITIAL); loc.step(); }
+[\n]+      loc.lines(yyleng);
+[^*/\n]+   |
+.          ;
+<<EOF>>    {
+  BEGIN(INITIAL);
+  driver.error(loc, "unterminated comment");
+  return yy::Parser::make_EOF(loc);
+}
+}
 "&"      return yy::Parser::make_AND(loc);
 "("      return yy::Parser::make_LPAREN(loc);
 ")"      return yy::Parser::make_RPAREN(loc);
@@ -86,7 +107,14 @@ string \"[^\"]*\"
   }
   return yy::Parser::make_NUMBER(n, loc);
 }
-{string}   return yy::Parser::make_STRING_CONSTANT(yytext, loc);
+{string}   {
+  // Strings may span lines.
+  if (const char* last = strrchr(yytext, '\n')) {
+    loc.end.lines(std::count(yytext, last, '\n') + 1);
+    loc.end.columns(yytext + yyleng - last - 1);
+  }
+  return yy::Parser::make_STRING_CONSTANT(yytext, loc);
+}
 {id}       return yy::Parser::make_IDENTIFIER(yytext, loc);
 .          driver.error(loc, std::string("invalid character '")+yytext+"'");
 <<EOF>>    return yy::Parser::make_EOF(loc);
@@ -94,6 +122,7 @@ string \"[^\"]*\"
 
 void Driver::scan_begin() {
   yy_flex_debug = trace_scanning;
+  loc.initialize();
   if (file.empty() || file == "-") {
     yyin = stdin;
   } else if (!(yyin = fopen(file.c_str(), "r"))) {
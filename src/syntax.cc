@@ -0,0 +1,656 @@
+#include "syntax.h"
+#include "BuiltIns.h"
+#include "ScopedMap.h"
+#include "syntax_nodes.h"
+#include <sstream>
+#include <string_view>
+
+namespace syntax {
+namespace {
+template <class... Fs> struct Overloaded : Fs... {
+  using Fs::operator()...;
+};
+template <class... Fs> Overloaded(Fs...) -> Overloaded<Fs...>;
+
+const std::string kIntType = "int";
+const std::string kStringType = "string";
+// Like in Expression.cc.
+const std::string kNoneType = "none";
+const std::string kUnknownType = "???";
+
+// Builds a Program by visiting the nodes of the class hierarchy.
+class Lowerer : public ExpressionVisitor,
+                public LValueVisitor,
+                public DeclarationVisitor,
+                public TypeVisitor {
+public:
+  explicit Lowerer(Program& program) : program_(program) {}
+
+  Expr Lower(const ::Expression& e) {
+    e.Accept(static_cast<ExpressionVisitor&>(*this));
+    Expr expr = std::move(expr_);
+    expr.source_offset = e.source_offset();
+    return expr;
+  }
+
+private:
+  ExprPtr Box(const ::Expression& e) {
+    return std::make_unique<Expr>(Lower(e));
+  }
+  std::vector<Expr>
+  LowerAll(const std::vector<std::shared_ptr<::Expression>>& exprs) {
+    std::vector<Expr> result;
+    result.reserve(exprs.size());
+    for (const auto& e : exprs) result.push_back(Lower(*e));
+    return result;
+  }
+  Symbol Intern(const std::string& text) {
+    return &*program_.symbols.insert(text).first;
+  }
+  Symbol InternOptional(const std::optional<std::string>& text) {
+    return text ? Intern(*text) : nullptr;
+  }
+  std::vector<TypeField> LowerFields(const std::vector<::TypeField>& fields) {
+    std::vector<TypeField> result;
+    for (const auto& f : fields) {
+      result.push_back({Intern(f.id), Intern(f.type_id)});
+    }
+    return result;
+  }
+  template <class Node> bool Set(Node&& node) {
+    expr_.node = std::forward<Node>(node);
+    return false;
+  }
+
+  bool VisitStringConstant(const std::string& text) override {
+    return Set(StringConstant{Intern(text)});
+  }
+  bool VisitIntegerConstant(int value) override {
+    return Set(IntegerConstant{value});
+  }
+  bool VisitNil() override { return Set(Nil{}); }
+  bool VisitLValue(const ::LValue& value) override {
+    return value.Accept(static_cast<LValueVisitor&>(*this));
+  }
+  bool VisitNegated(const ::Expression& value) override {
+    return Set(Negated{Box(value)});
+  }
+  bool VisitBinary(const ::Expression& left, BinaryOp op,
+                   const ::Expression& right) override {
+    return Set(Binary{Box(left), op, Box(right)});
+  }
+  bool VisitAssignment(const ::LValue& value,
+                       const ::Expression& expr) override {
+    return Set(Assignment{Box(value), Box(expr)});
+  }
+  bool VisitFunctionCall(const std::string& id,
+                         const std::vector<std::shared_ptr<::Expression>>& args,
+                         const ::Expression& exp) override {
+    return Set(FunctionCall{Intern(id), LowerAll(args)});
+  }
+  bool VisitBlock(
+      const std::vector<std::shared_ptr<::Expression>>& exprs) override {
+    return Set(Block{LowerAll(exprs)});
+  }
+  bool VisitRecord(const std::string& type_id,
+                   const std::vector<::FieldValue>& field_values,
+                   const ::Expression& exp) override {
+    std::vector<FieldValue> fields;
+    for (const auto& f : field_values) {
+      fields.push_back({Intern(f.id), Box(*f.expr)});
+    }
+    return Set(Record{Intern(type_id), std::move(fields)});
+  }
+  bool VisitArray(const std::string& type_id, const ::Expression& size,
+                  const ::Expression& value) override {
+    return Set(Array{Intern(type_id), Box(size), Box(value)});
+  }
+  bool VisitIfThen(const ::Expression& condition,
+                   const ::Expression& expr) override {
+    return Set(IfThen{Box(condition), Box(expr)});
+  }
+  bool VisitIfThenElse(const ::Expression& condition,
+                       const ::Expression& then_expr,
+                       const ::Expression& else_expr) override {
+    return Set(IfThenElse{Box(condition), Box(then_expr), Box(else_expr)});
+  }
+  bool VisitWhile(const ::Expression& condition,
+                  const ::Expression& body) override {
+    return Set(While{Box(condition), Box(body)});
+  }
+  bool VisitFor(const std::string& id, const ::Expression& first,
+                const ::Expression& last, const ::Expression& body) override {
+    return Set(For{Intern(id), Box(first), Box(last), Box(body)});
+  }
+  bool VisitBreak() override { return Set(Break{}); }
+  bool VisitLet(
+      const std::vector<std::shared_ptr<::Declaration>>& declarations,
+      const std::vector<std::shared_ptr<::Expression>>& body) override {
+    std::vector<Declaration> lowered;
+    lowered.reserve(declarations.size());
+    for (const auto& d : declarations) {
+      d->Accept(static_cast<DeclarationVisitor&>(*this));
+      lowered.push_back(std::move(declaration_));
+    }
+    auto block = std::make_unique<Expr>(Expr{Block{LowerAll(body)}});
+    return Set(Let{std::move(lowered), std::move(block)});
+  }
+
+  bool VisitId(const std::string& id) override {
+    return Set(IdLValue{Intern(id)});
+  }
+  bool VisitField(const ::LValue& value, const std::string& id) override {
+    return Set(FieldLValue{Box(value), Intern(id)});
+  }
+  bool VisitIndex(const ::LValue& value, const ::Expression& expr) override {
+    return Set(IndexLValue{Box(value), Box(expr)});
+  }
+
+  bool VisitTypeDeclaration(const std::string& id,
+                            const ::Type& type) override {
+    type.Accept(static_cast<TypeVisitor&>(*this));
+    declaration_ = TypeDeclaration{Intern(id), std::move(type_)};
+    return false;
+  }
+  bool VisitVariableDeclaration(const std::string& id,
+                                const std::optional<std::string>& type_id,
+                                const ::Expression& expr) override {
+    declaration_ =
+        VariableDeclaration{Intern(id), InternOptional(type_id), Box(expr)};
+    return false;
+  }
+  bool VisitFunctionDeclaration(const std::string& id,
+                                const std::vector<::TypeField>& params,
+                                const std::optional<std::string> type_id,
+                                const ::Expression& body) override {
+    declaration_ = FunctionDeclaration{Intern(id), LowerFields(params),
+                                       InternOptional(type_id), Box(body)};
+    return false;
+  }
+
+  bool VisitTypeReference(const std::string& id) override {
+    type_ = TypeReference{Intern(id)};
+    return false;
+  }
+  bool VisitRecordType(const std::vector<::TypeField>& fields) override {
+    type_ = RecordType{LowerFields(fields)};
+    return false;
+  }
+  bool VisitArrayType(const std::string& type_id) override {
+    type_ = ArrayType{Intern(type_id)};
+    return false;
+  }
+  bool VisitInt() override {
+    type_ = IntType{};
+    return false;
+  }
+  bool VisitString() override {
+    type_ = StringType{};
+    return false;
+  }
+
+  Program& program_;
+  // Results of the last visit.
+  Expr expr_;
+  Declaration declaration_;
+  Type type_;
+};
+
+// Type of a parameter, loop variable, or built-in function, or the
+// declaration of a variable or function, whose type may only be set later.
+using ValueBinding = std::variant<Symbol, const VariableDeclaration*,
+                                  const FunctionDeclaration*>;
+
+// Types and values in scope, as bound by Let expressions, functions and
+// for loops on the path from the root.
+class Scopes {
+public:
+  Scopes() {
+    static const Type kInt = IntType{};
+    static const Type kString = StringType{};
+    types_[kIntType] = &kInt;
+    types_[kStringType] = &kString;
+    for (const BuiltInFunction& f : kBuiltInFunctions) {
+      values_[f.name] = f.result_type.empty()   ? &kUnsetType
+                        : f.result_type == "int" ? &kIntType
+                                                 : &kStringType;
+    }
+    EnterScope();
+  }
+
+  // Declarations see each other, like in Let::ResolveEnter.
+  void EnterLet(const Let& let) {
+    EnterScope();
+    for (const Declaration& d : let.declarations) {
+      std::visit(Overloaded{
+                     [&](const TypeDeclaration& t) { types_[*t.id] = &t.type; },
+                     [&](const VariableDeclaration& v) { values_[*v.id] = &v; },
+                     [&](const FunctionDeclaration& f) { values_[*f.id] = &f; },
+                 },
+                 d);
+    }
+  }
+  void EnterFunction(const FunctionDeclaration& f) {
+    EnterScope();
+    for (const TypeField& p : f.params) values_[*p.id] = p.type_id;
+  }
+  void EnterFor(const For& f) {
+    EnterScope();
+    values_[*f.id] = &kIntType;
+  }
+  void ExitScope() {
+    values_.ExitScope();
+    types_.ExitScope();
+  }
+
+  // Returns the type of the variable or function with the given ID, like
+  // Declaration::GetValueType.
+  Symbol ValueType(Symbol id) const {
+    const ValueBinding* b = values_.Lookup(*id);
+    if (!b) return &kUnknownType;
+    return std::visit(Overloaded{
+                          [](Symbol type) { return type; },
+                          [](const VariableDeclaration* v) {
+                            return v->type_id ? v->type_id : v->value->type;
+                          },
+                          [](const FunctionDeclaration* f) {
+                            return f->result_type_id ? f->result_type_id
+                                                     : f->body->type;
+                          },
+                      },
+                      *b);
+  }
+
+  // Returns the type with the given ID, or nullptr.
+  const Type* LookupType(Symbol id) const {
+    const Type* const* t = types_.Lookup(*id);
+    return t ? *t : nullptr;
+  }
+
+private:
+  void EnterScope() {
+    values_.EnterScope();
+    types_.EnterScope();
+  }
+
+  ScopedMap<ValueBinding> values_;
+  ScopedMap<const Type*> types_;
+};
+
+// Calls pass.Enter before and pass.Leave after the children of every
+// expression below and including e, in the order of TreeNode::Children.
+template <class Pass> void Walk(const Expr& e, Scopes& scopes, Pass& pass) {
+  pass.Enter(e, scopes);
+  auto walk = [&](const Expr& child) { Walk(child, scopes, pass); };
+  std::visit(
+      Overloaded{
+          [&](const FieldLValue& n) { walk(*n.l_value); },
+          [&](const IndexLValue& n) {
+            walk(*n.l_value);
+            walk(*n.index);
+          },
+          [&](const Negated& n) { walk(*n.expr); },
+          [&](const Binary& n) {
+            walk(*n.left);
+            walk(*n.right);
+          },
+          [&](const Assignment& n) {
+            walk(*n.l_value);
+            walk(*n.expr);
+          },
+          [&](const FunctionCall& n) {
+            for (const Expr& arg : n.args) walk(arg);
+          },
+          [&](const Block& n) {
+            for (const Expr& expr : n.exprs) walk(expr);
+          },
+          [&](const Record& n) {
+            for (const FieldValue& f : n.fields) walk(*f.expr);
+          },
+          [&](const Array& n) {
+            walk(*n.size);
+            walk(*n.value);
+          },
+          [&](const IfThen& n) {
+            walk(*n.condition);
+            walk(*n.then_expr);
+          },
+          [&](const IfThenElse& n) {
+            walk(*n.condition);
+            walk(*n.then_expr);
+            walk(*n.else_expr);
+          },
+          [&](const While& n) {
+            walk(*n.condition);
+            walk(*n.body);
+          },
+          // Only the body sees the loop variable.
+          [&](const For& n) {
+            walk(*n.first);
+            walk(*n.last);
+            scopes.EnterFor(n);
+            walk(*n.body);
+            scopes.ExitScope();
+          },
+          [&](const Let& n) {
+            scopes.EnterLet(n);
+            for (const Declaration& d : n.declarations) {
+              if (auto v = std::get_if<VariableDeclaration>(&d)) {
+                walk(*v->value);
+              } else if (auto f = std::get_if<FunctionDeclaration>(&d)) {
+                scopes.EnterFunction(*f);
+                walk(*f->body);
+                scopes.ExitScope();
+              }
+            }
+            walk(*n.body);
+            scopes.ExitScope();
+          },
+          [](const auto& leaf) {},
+      },
+      e.node);
+  pass.Leave(e, scopes);
+}
+
+// Sets types bottom up, like TypeSetter in Expression.cc.
+struct TypeSetter {
+  void Enter(const Expr& e, const Scopes& scopes) {}
+  void Leave(const Expr& e, const Scopes& scopes) {
+    e.type = std::visit(
+        Overloaded{
+            [](const StringConstant&) { return &kStringType; },
+            [](const IntegerConstant&) { return &kIntType; },
+            // Nil is only typed by the assignment of a record to it.
+            [&](const Nil&) { return e.type; },
+            [&](const IdLValue& n) { return scopes.ValueType(n.id); },
+            [&](const FieldLValue& n) {
+              auto r = Get<RecordType>(scopes, *n.l_value);
+              if (r) {
+                for (const TypeField& f : r->fields) {
+                  if (*f.id == *n.id) return f.type_id;
+                }
+              }
+              return &kUnknownType;
+            },
+            [&](const IndexLValue& n) {
+              auto a = Get<ArrayType>(scopes, *n.l_value);
+              return a ? a->element_type_id : &kUnknownType;
+            },
+            [](const Negated& n) { return n.expr->type; },
+            [](const Binary& n) {
+              bool comparison = n.op >= kEqual && n.op <= kNotLessThan;
+              if (comparison && (*n.left->type == *n.right->type ||
+                                 std::holds_alternative<Nil>(n.left->node) ||
+                                 std::holds_alternative<Nil>(n.right->node))) {
+                return &kIntType;
+              }
+              return n.right->type;
+            },
+            [&](const Assignment& n) {
+              if (std::holds_alternative<Nil>(n.expr->node) &&
+                  Get<RecordType>(scopes, *n.l_value)) {
+                n.expr->type = n.l_value->type;
+              }
+              return &kNoneType;
+            },
+            [&](const FunctionCall& n) { return scopes.ValueType(n.id); },
+            [](const Block& n) {
+              return n.exprs.empty() ? &kNoneType : n.exprs.back().type;
+            },
+            [&](const Record& n) {
+              // Nil field values take the types of their record fields.
+              const Type* type = scopes.LookupType(n.type_id);
+              const RecordType* r = type ? std::get_if<RecordType>(type)
+                                         : nullptr;
+              for (size_t i = 0; r && i < n.fields.size() &&
+                                 i < r->fields.size();
+                   ++i) {
+                const Expr& value = *n.fields[i].expr;
+                const Type* field = scopes.LookupType(r->fields[i].type_id);
+                if (std::holds_alternative<Nil>(value.node) && field &&
+                    std::holds_alternative<RecordType>(*field)) {
+                  value.type = r->fields[i].type_id;
+                }
+              }
+              return n.type_id;
+            },
+            [](const Array& n) { return n.type_id; },
+            [](const IfThenElse& n) { return n.then_expr->type; },
+            [](const Let& n) { return n.body->type; },
+            // IfThen, While, For and Break
+            [](const auto&) { return &kNoneType; },
+        },
+        e.node);
+  }
+
+  // Returns the type of e, if one of type T.
+  template <class T> const T* Get(const Scopes& scopes, const Expr& e) {
+    const Type* type = scopes.LookupType(e.type);
+    return type ? std::get_if<T>(type) : nullptr;
+  }
+};
+
+bool IsPrimitive(const std::string& type) {
+  return type == kIntType || type == kStringType;
+}
+
+// Runs the checks of Checker.cc on every expression, top down.
+class Checker {
+public:
+  Checker(std::vector<std::string>& errors, const SourceMap* sources)
+      : errors_(errors), sources_(sources) {}
+
+  void Enter(const Expr& e, const Scopes& scopes) {
+    size_t first_error = errors_.size();
+    std::visit(Overloaded{
+                   [&](const Record& n) { CheckRecord(e, n, scopes); },
+                   [&](const Binary& n) { CheckBinary(n); },
+                   [&](const IfThen& n) { CheckCondition(*n.condition); },
+                   [&](const IfThenElse& n) { CheckCondition(*n.condition); },
+                   [&](const While& n) { CheckCondition(*n.condition); },
+                   [](const auto&) {},
+               },
+               e.node);
+    for (size_t i = first_error; sources_ && i < errors_.size(); ++i) {
+      errors_[i] = sources_->Describe(e.source_offset) + ": " + errors_[i];
+    }
+  }
+  void Leave(const Expr& e, const Scopes& scopes) {}
+
+private:
+  // Record literal field names, expression types, and the order thereof
+  // must exactly match those of the given record type (2.3)
+  void CheckRecord(const Expr& e, const Record& n, const Scopes& scopes) {
+    const Type* type = scopes.LookupType(n.type_id);
+    const RecordType* r = type ? std::get_if<RecordType>(type) : nullptr;
+    if (!type) {
+      Emit("Unknown record type ", *n.type_id);
+    } else if (!r) {
+      Emit("Type ", *n.type_id, " is not a record");
+    } else if (n.fields.size() != r->fields.size()) {
+      Emit("Field counts differ for ", *n.type_id, " ", *type, " and ", e);
+    } else {
+      for (int i = n.fields.size(); --i >= 0;) {
+        const TypeField& field = r->fields[i];
+        if (const std::string& id = *n.fields[i].id; id != *field.id) {
+          Emit("Different names ", id, " and ", *field.id, " for field #",
+               i + 1, " of record ", *n.type_id);
+        } else if (const std::string& t = *n.fields[i].expr->type;
+                   t != *field.type_id) {
+          Emit("Different types ", t, " and ", *field.type_id, " for field ",
+               id, " of record ", *n.type_id);
+        }
+      }
+    }
+  }
+
+  // Binary operators >, <, >=, and <= may be either both integer or both
+  // string (2.5). Operators & and | are lazy logical operators on integers
+  // (2.5)
+  void CheckBinary(const Binary& n) {
+    const std::string& left = *n.left->type;
+    const std::string& right = *n.right->type;
+    switch (n.op) {
+    case kGreaterThan:
+    case kLessThan:
+    case kNotGreaterThan:
+    case kNotLessThan:
+      for (const std::string* type : {&left, &right}) {
+        if (!IsPrimitive(*type)) {
+          Emit("Operand type of ", n.op, " must be int or string, but got ",
+               *type);
+        }
+      }
+      if (left != right) {
+        Emit("Types of ", n.op, " should match, but got ", left, " and ",
+             right);
+      }
+      break;
+    case kAnd:
+    case kOr:
+      for (const std::string* type : {&left, &right}) {
+        if (*type != kIntType) {
+          Emit("Operand type for ", n.op, " must be int, but got ", *type);
+        }
+      }
+      break;
+    default:
+      break;
+    }
+  }
+
+  // Conditionals must evaluate to integers (2.8)
+  void CheckCondition(const Expr& condition) {
+    if (*condition.type != kIntType) {
+      Emit("Conditions must be int, but got ", *condition.type);
+    }
+  }
+
+  template <class... Parts> void Emit(const Parts&... parts) {
+    std::ostringstream os;
+    (os << ... << parts);
+    errors_.push_back(os.str());
+  }
+
+  std::vector<std::string>& errors_;
+  const SourceMap* sources_;
+};
+
+std::ostream& operator<<(std::ostream& os, const TypeField& f) {
+  return os << *f.id << ": " << *f.type_id;
+}
+
+// Prints items separated by sep.
+template <class Items>
+std::ostream& Join(std::ostream& os, const Items& items, const char* sep) {
+  const char* s = "";
+  for (const auto& item : items) {
+    os << s << item;
+    s = sep;
+  }
+  return os;
+}
+} // namespace
+
+Program Lower(const Expression& root) {
+  Program program;
+  program.root = Lowerer(program).Lower(root);
+  return program;
+}
+
+void SetTypes(const Program& program) {
+  Scopes scopes;
+  TypeSetter setter;
+  Walk(program.root, scopes, setter);
+}
+
+std::vector<std::string> ListErrors(const Program& program,
+                                    const SourceMap* sources) {
+  std::vector<std::string> errors;
+  Scopes scopes;
+  Checker checker(errors, sources);
+  Walk(program.root, scopes, checker);
+  return errors;
+}
+
+std::ostream& operator<<(std::ostream& os, const Type& type) {
+  std::visit(Overloaded{
+                 [&](const TypeReference& t) { os << *t.id; },
+                 [&](const RecordType& t) {
+                   Join(os << "{", t.fields, ", ") << "}";
+                 },
+                 [&](const ArrayType& t) {
+                   os << "array of " << *t.element_type_id;
+                 },
+                 [&](const IntType&) { os << kIntType; },
+                 [&](const StringType&) { os << kStringType; },
+             },
+             type);
+  return os;
+}
+
+std::ostream& operator<<(std::ostream& os, const Declaration& declaration) {
+  auto type_id = [](Symbol id) { return id ? ": " + *id : ""; };
+  std::visit(Overloaded{
+                 [&](const TypeDeclaration& d) {
+                   os << "type " << *d.id << " = " << d.type;
+                 },
+                 [&](const VariableDeclaration& d) {
+                   os << "var " << *d.id << type_id(d.type_id) << " = "
+                      << *d.value;
+                 },
+                 [&](const FunctionDeclaration& d) {
+                   os << "function " << *d.id << type_id(d.result_type_id)
+                      << " = " << *d.body;
+                 },
+             },
+             declaration);
+  return os;
+}
+
+// Like the Printer of ToString.cc, prints children of most nodes without
+// separators.
+std::ostream& operator<<(std::ostream& os, const Expr& expr) {
+  std::visit(
+      Overloaded{
+          [&](const StringConstant& n) { os << '"' << *n.text << '"'; },
+          [&](const IntegerConstant& n) { os << n.value; },
+          [&](const Nil&) { os << "nil"; },
+          [&](const IdLValue& n) { os << *n.id; },
+          [&](const FieldLValue& n) { os << *n.l_value << '.' << *n.id; },
+          [&](const IndexLValue& n) {
+            os << *n.l_value << '[' << *n.index << ']';
+          },
+          [&](const Negated& n) { os << '-' << *n.expr; },
+          [&](const Binary& n) { os << *n.left << n.op << *n.right; },
+          [&](const Assignment& n) { os << *n.l_value << ":=" << *n.expr; },
+          [&](const FunctionCall& n) {
+            Join(os << *n.id << "(", n.args, ", ") << ")";
+          },
+          [&](const Block& n) { Join(os << "(", n.exprs, "; ") << ")"; },
+          [&](const Record& n) {
+            os << "{";
+            const char* sep = "";
+            for (const FieldValue& f : n.fields) {
+              os << sep << *f.id << ": " << *f.expr;
+              sep = ", ";
+            }
+            os << "}";
+          },
+          [&](const Array& n) { os << *n.size << *n.value; },
+          [&](const IfThen& n) { os << *n.condition << *n.then_expr; },
+          [&](const IfThenElse& n) {
+            os << *n.condition << *n.then_expr << *n.else_expr;
+          },
+          [&](const While& n) { os << *n.condition << *n.body; },
+          [&](const For& n) { os << *n.first << *n.last << *n.body; },
+          [&](const Break&) {},
+          // Prints only the body.
+          [&](const Let& n) {
+            Join(os, std::get<Block>(n.body->node).exprs, "");
+          },
+      },
+      expr.node);
+  return os;
+}
+} // namespace syntax
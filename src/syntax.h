@@ -1,87 +1,181 @@
 #pragma once
+#include "BinaryOp.h"
+#include "SourceMap.h"
+#include <cstdint>
 #include <memory>
-#include <optional>
+#include <ostream>
 #include <string>
+#include <unordered_set>
 #include <variant>
 #include <vector>
 
+class Expression;
+
+// A value semantic alternative to the class hierarchy of syntax_nodes.h,
+// kept to compare the cost of the two representations, see the "variant"
+// section of tc_bench. Nodes are plain structs held by value in
+// std::variant, without vtable, name spaces or bindings, and with
+// identifiers and string constants interned in the Program. Passes
+// dispatch with std::visit and resolve names in scope as they go.
+//
+// Unlike the passes over the class hierarchy, these recurse, so that the
+// depth of trees is limited by the native stack.
 namespace syntax {
-class Expr;   // forward declaration
-class LValue; // forward declaration
-using Identifier = std::string;
-struct RecordField {
-  std::unique_ptr<LValue> l_value;
-  std::string id;
-};
-struct ArrayElement {
-  std::unique_pre<LValue> l_value;
-  std::unique_ptr<Expr> expr;
-};
-using StringConstant = std::string;
-using IntegerConstant = int;
+struct Expr;
+using ExprPtr = std::unique_ptr<Expr>;
+
+// Identifier or string constant, interned in the Program.
+using Symbol = const std::string*;
+
+struct TypeField {
+  Symbol id;
+  Symbol type_id;
+};
+
+struct TypeReference {
+  Symbol id;
+};
+struct RecordType {
+  std::vector<TypeField> fields;
+};
+struct ArrayType {
+  Symbol element_type_id;
+};
+struct IntType {};
+struct StringType {};
+using Type =
+    std::variant<TypeReference, RecordType, ArrayType, IntType, StringType>;
+
+struct TypeDeclaration {
+  Symbol id;
+  Type type;
+};
+struct VariableDeclaration {
+  Symbol id;
+  Symbol type_id; // nullptr unless declared
+  ExprPtr value;
+};
+struct FunctionDeclaration {
+  Symbol id;
+  std::vector<TypeField> params;
+  Symbol result_type_id; // nullptr for procedures
+  ExprPtr body;
+};
+using Declaration =
+    std::variant<TypeDeclaration, VariableDeclaration, FunctionDeclaration>;
+
+struct StringConstant {
+  Symbol text;
+};
+struct IntegerConstant {
+  int value;
+};
 struct Nil {};
-using LValue = std::variant<Identifier, RecordField, ArrayElement>;
-using Negated = Expr;
+struct IdLValue {
+  Symbol id;
+};
+struct FieldLValue {
+  ExprPtr l_value;
+  Symbol id;
+};
+struct IndexLValue {
+  ExprPtr l_value;
+  ExprPtr index;
+};
+struct Negated {
+  ExprPtr expr;
+};
 struct Binary {
-  std::unique_ptr<Expr> left;
-  Token op;
-  std::unique_ptr<Expr> right;
+  ExprPtr left;
+  BinaryOp op;
+  ExprPtr right;
 };
 struct Assignment {
-  std::unique_ptr<LValue> l_value;
-  std::unique_ptr<Expr> expr;
+  ExprPtr l_value;
+  ExprPtr expr;
 };
-using Parenthesized = std::vector<std::unique_ptr<Expr>>;
 struct FunctionCall {
-  std::string id;
-  Parenthesized arguments;
+  Symbol id;
+  std::vector<Expr> args;
 };
-struct FieldAssignment {
-  std::string id;
-  std::unique_ptr<Expr> expr;
+struct Block {
+  std::vector<Expr> exprs;
 };
-struct RecordLiteral {
-  std::string type_id;
-  std::vector<FieldAssignment> fields;
+struct FieldValue {
+  Symbol id;
+  ExprPtr expr;
 };
-struct ArrayLiteral {
-  std::string type_id;
-  std::unique_ptr<Expr> size;
-  std::unique_ptr<Expr> value;
+struct Record {
+  Symbol type_id;
+  std::vector<FieldValue> fields;
+};
+struct Array {
+  Symbol type_id;
+  ExprPtr size;
+  ExprPtr value;
 };
 struct IfThen {
-  std::unique_ptr<Expr> condition;
-  std::unique_ptr<Expr> then;
+  ExprPtr condition;
+  ExprPtr then_expr;
 };
 struct IfThenElse {
-  std::unique_ptr<Expr> condition;
-  std::unique_ptr<Expr> then_expr;
-  std::unique_ptr<Expr> else_expr;
+  ExprPtr condition;
+  ExprPtr then_expr;
+  ExprPtr else_expr;
 };
 struct While {
-  std::unique_ptr<Expr> condition;
-  std::unique_ptr<Expr> body;
+  ExprPtr condition;
+  ExprPtr body;
 };
 struct For {
-  std::string id;
-  std::unique_ptr<Expr> start;
-  std::unique_ptr<Expr> end;
-  std::unique_ptr<Expr> body;
+  Symbol id;
+  ExprPtr first;
+  ExprPtr last;
+  ExprPtr body;
 };
 struct Break {};
-struct Declaration {
-  std::string id;
-  std::unique_ptr<Expr> value;
-};
+// The body is always a Block, which keeps Let as small as the other
+// alternatives.
 struct Let {
   std::vector<Declaration> declarations;
-  std::unique_ptr<Expr> body;
+  ExprPtr body;
+};
+
+// Type of expressions before SetTypes, and of nil.
+inline const std::string kUnsetType = "unset";
+
+struct Expr {
+  std::variant<StringConstant, IntegerConstant, Nil, IdLValue, FieldLValue,
+               IndexLValue, Negated, Binary, Assignment, FunctionCall, Block,
+               Record, Array, IfThen, IfThenElse, While, For, Break, Let>
+      node;
+  // Type as set by SetTypes, like Expression::GetType.
+  mutable Symbol type = &kUnsetType;
+  uint32_t source_offset = SourceMap::kNoOffset;
+};
+
+struct Program {
+  Expr root;
+  // Strings that symbols point to.
+  std::unordered_set<std::string> symbols;
 };
-using Expr =
-    std::variant<StringConstant, IntegerConstant, Nil, LValue, Negated, Binary,
-                 Assignment, FunctionCall, Parenthesized, RecordLiteral,
-                 ArrayLiteral, IfThen, IfThenElse, While, For, Break, Let>;
 
-// Returns Expression parsed using yylex and yytext.
-std::unique_ptr<Expr> Parse();
+// Returns the tree with the given root as a Program. Needs no passes to
+// have run on the tree.
+Program Lower(const Expression& root);
+
+// Sets types in every expression of the program, with the same results as
+// Expression::SetTypesBelow on the tree it was lowered from.
+void SetTypes(const Program& program);
+
+// Returns errors in the program in source order, with the same messages as
+// ::ListErrors for the tree it was lowered from. Undefined behavior until
+// SetTypes has been called.
+std::vector<std::string> ListErrors(const Program& program,
+                                    const SourceMap* sources = nullptr);
+
+// Prints like the operators of ToString.h print the tree lowered from.
+std::ostream& operator<<(std::ostream& os, const Type& type);
+std::ostream& operator<<(std::ostream& os, const Declaration& declaration);
+std::ostream& operator<<(std::ostream& os, const Expr& expr);
 } // namespace syntax
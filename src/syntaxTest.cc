@@ -0,0 +1,90 @@
+#include "syntax.h"
+#include "Checker.h"
+#include "ToString.h"
+#include "testing/catch.h"
+#include "testing/generator.h"
+#include "testing/testing.h"
+#include <string>
+#include <vector>
+
+namespace {
+using testing::Parse;
+
+// Programs covering all kinds of nodes and errors.
+const char* kPrograms[] = {
+    "3",
+    "\"Hello\"",
+    "nil",
+    "break",
+    "a",
+    "-3",
+    "\"hello\"+\"world\"",
+    "IntArray [3] of 0",
+    "if 1 then \"you\" else \"world\"",
+    "while 1 do \"hello\"",
+    "for i := 1 to 3 do printi(i)",
+    "(1; \"two\"; ())",
+    "let var a : int := 3 in a end",
+    "let type T = int in let type T = string var a : T := \"Hello\" "
+    "in a end end",
+    "let function f():int = g() function g():int = f() in f() end",
+    "let function f() = g() function g() = f() in f() end",
+    "let function f(x: int, s: string): string = s in f(1, \"a\") end",
+    "let type Bulk = {height:int, weight:int} var b := nil in b end",
+    "let type Bulk = {height:int, weight:int} var b : Bulk := nil in "
+    "b := nil; b.height end",
+    "let type Bulk = {height:int, weight:int} in "
+    "Bulk {weight=200, height=6}; Bulk {height=\"6 feet\", weight=200}; "
+    "Bulk {height=6}; Heft {height=6} end",
+    "let type Bulk = int in Bulk {height=6, weight=200} end",
+    "let type A = array of int var a := A [2] of 0 in a[1] := a[0] end",
+    "(666 < \"Hello\"; \"foo\" & \"bar\"; nil | 1; if \"s\" then 1)",
+    "let var x := 1 in for x := x to x do x; x end",
+};
+
+struct Compiled {
+  std::string to_string;
+  std::string type;
+  std::vector<std::string> errors;
+};
+
+Compiled CompileClasses(const std::string& text) {
+  std::shared_ptr<Expression> e = Parse(text);
+  Expression::SetNameSpacesBelow(*e);
+  Expression::SetTypesBelow(*e);
+  return {ToString(*e), e->GetType(), ListErrors(*e)};
+}
+
+Compiled CompileVariants(const std::string& text) {
+  syntax::Program program = syntax::Lower(*Parse(text));
+  syntax::SetTypes(program);
+  return {ToString(program.root), *program.root.type,
+          syntax::ListErrors(program)};
+}
+
+SCENARIO("Variant passes agree with class passes", "[syntax]") {
+  std::vector<std::string> programs(std::begin(kPrograms),
+                                    std::end(kPrograms));
+  programs.push_back(testing::ManyFunctions(20));
+  programs.push_back(testing::RecordTypes(20));
+  for (const std::string& text : programs) {
+    GIVEN(text.substr(0, 60)) {
+      Compiled classes = CompileClasses(text);
+      Compiled variants = CompileVariants(text);
+      REQUIRE(variants.to_string == classes.to_string);
+      REQUIRE(variants.type == classes.type);
+      REQUIRE(variants.errors == classes.errors);
+      if (text.rfind("(666", 0) == 0) REQUIRE(classes.errors.size() == 5);
+    }
+  }
+}
+
+SCENARIO("Lowering keeps source offsets", "[syntax]") {
+  std::shared_ptr<Expression> e = Parse("let var x := 1 in x end");
+  syntax::Program program = syntax::Lower(*e);
+  REQUIRE(program.root.source_offset == e->source_offset());
+  const auto& let = std::get<syntax::Let>(program.root.node);
+  const auto& body = std::get<syntax::Block>(let.body->node);
+  REQUIRE(body.exprs.at(0).source_offset == 18);
+}
+} // namespace
@@ -1,11 +1,66 @@
 #pragma once
 #include "Expression.h"
 #include <algorithm>
+#include <memory>
+#include <vector>
 // Memory management notes. The nodes of the abstract syntax tree own
 // their children, in the sense that the parent destructor is
 // responsibile for destroying the child. This is delegated to
 // unique_ptr or shared_ptr. The constructors take raw pointers and
-// adopt them.
+// adopt them. Destructors of nodes with children pass them to
+// Teardown::Release, so that destroying a deep tree does not recurse.
+//
+// Expression nodes pass their kind to the Expression constructor, and
+// implement Accept with a template Dispatch method, which calls the Visit
+// method for the node on any visitor class. StaticExpressionVisitor.h
+// calls Dispatch without virtual calls.
+
+// Destroys released children one by one from a list. The outermost
+// Release on a thread runs the list until empty, while destructors called
+// from there only add to it.
+class Teardown {
+public:
+  template <class... Owners> static void Release(Owners&... owners) {
+    if (active_) {
+      (active_->Add(owners), ...);
+      return;
+    }
+    Teardown teardown;
+    active_ = &teardown;
+    (teardown.Add(owners), ...);
+    teardown.Run();
+    active_ = nullptr;
+  }
+
+private:
+  template <class T> void Add(std::unique_ptr<T>& p) {
+    if (p) unique_.emplace_back(std::move(p));
+  }
+  template <class T> void Add(std::shared_ptr<T>& p) {
+    if (p) shared_.emplace_back(std::move(p));
+  }
+  void Add(FieldValue& f) { Add(f.expr); }
+  template <class T> void Add(std::vector<T>& v) {
+    for (auto& e : v) Add(e);
+  }
+
+  void Run() {
+    while (!unique_.empty() || !shared_.empty()) {
+      if (!unique_.empty()) {
+        std::unique_ptr<TreeNode> p = std::move(unique_.back());
+        unique_.pop_back();
+      } else {
+        std::shared_ptr<TreeNode> p = std::move(shared_.back());
+        shared_.pop_back();
+      }
+    }
+  }
+
+  // Released children are destroyed when their last owner is.
+  std::vector<std::unique_ptr<TreeNode>> unique_;
+  std::vector<std::shared_ptr<TreeNode>> shared_;
+  static inline thread_local Teardown* active_ = nullptr;
+};
 
 // Reference to a named type.
 class TypeReference : public Type {
@@ -75,6 +130,7 @@ public:
     return visitor.VisitTypeDeclaration(Id(), *type_);
   }
   std::optional<const Type*> GetType() const override { return type_.get(); }
+  void Bind(Scopes& scopes) const override { scopes.BindType(Id(), *this); }
 
 private:
   std::shared_ptr<Type> type_;
@@ -87,6 +143,7 @@ public:
   VariableDeclaration(std::string_view id, std::string_view type_id,
                       Expression* expr)
       : Declaration(id), type_id_(type_id), expr_(expr) {}
+  ~VariableDeclaration() override { Teardown::Release(expr_); }
   bool Accept(DeclarationVisitor& visitor) const override {
     return visitor.VisitVariableDeclaration(Id(), type_id_, *expr_);
   }
@@ -94,6 +151,7 @@ public:
   std::optional<const std::string*> GetValueType() const override {
     return type_id_ ? &*type_id_ : &expr_->GetType();
   }
+  void Bind(Scopes& scopes) const override { scopes.BindValue(Id(), *this); }
 
 private:
   std::optional<std::string> type_id_;
@@ -108,6 +166,7 @@ public:
   std::optional<const std::string*> GetValueType() const override {
     return &type_id_;
   }
+  void Bind(Scopes& scopes) const override { scopes.BindValue(Id(), *this); }
 
 private:
   const std::string& type_id_;
@@ -122,6 +181,7 @@ public:
                       std::string_view type_id, Expression* body)
       : Declaration(id), type_id_(type_id), params_(std::move(params)),
         body_(body) {}
+  ~FunctionDeclaration() override { Teardown::Release(body_); }
   bool Accept(DeclarationVisitor& visitor) const override {
     return visitor.VisitFunctionDeclaration(Id(), params_, type_id_, *body_);
   }
@@ -132,16 +192,31 @@ public:
   GetNonTypeNameSpace(const NameSpace& non_types) const override {
     if (!name_space_) {
       name_space_.reset(new NameSpace(non_types));
-      for (const auto& p : params_) {
-        param_decls_.emplace_back(p.id, p.type_id);
-        (*name_space_)[p.id] = &*param_decls_.rbegin();
-      }
+      for (const auto& p : ParamDeclarations()) (*name_space_)[p.Id()] = &p;
     }
     return name_space_.get();
   }
   std::optional<const std::string*> GetValueType() const override {
     return type_id_ ? &*type_id_ : &body_->GetType();
   }
+  void Bind(Scopes& scopes) const override {
+    scopes.BindFunction(Id(), *this);
+  }
+  void ResolveEnter(Scopes& scopes) const override {
+    scopes.EnterFunction();
+    for (const auto& p : ParamDeclarations()) p.Bind(scopes);
+  }
+  void ResolveLeave(Scopes& scopes) const override { scopes.ExitFunction(); }
+
+  // Returns declarations of the parameters in order.
+  const std::vector<ParamDeclaration>& ParamDeclarations() const {
+    if (param_decls_.empty() && !params_.empty()) {
+      // Reserve, so that pointers to declarations stay valid.
+      param_decls_.reserve(params_.size());
+      for (const auto& p : params_) param_decls_.emplace_back(p.id, p.type_id);
+    }
+    return param_decls_;
+  }
 
 private:
   std::vector<TypeField> params_;
@@ -153,8 +228,12 @@ private:
 
 class StringConstant : public Expression {
 public:
-  StringConstant(std::string_view text) : text_(text) {}
+  StringConstant(std::string_view text)
+      : Expression(Kind::kStringConstant), text_(text) {}
   bool Accept(ExpressionVisitor& visitor) const override {
+    return Dispatch(visitor);
+  }
+  template <class Visitor> bool Dispatch(Visitor& visitor) const {
     return visitor.VisitStringConstant(text_);
   }
 
@@ -164,8 +243,12 @@ private:
 
 class IntegerConstant : public Expression {
 public:
-  IntegerConstant(int value) : value_(value) {}
+  IntegerConstant(int value)
+      : Expression(Kind::kIntegerConstant), value_(value) {}
   bool Accept(ExpressionVisitor& visitor) const override {
+    return Dispatch(visitor);
+  }
+  template <class Visitor> bool Dispatch(Visitor& visitor) const {
     return visitor.VisitIntegerConstant(value_);
   }
 
@@ -175,19 +258,28 @@ private:
 
 class Nil : public Expression {
 public:
-  Nil() {}
+  Nil() : Expression(Kind::kNil) {}
   bool Accept(ExpressionVisitor& visitor) const override {
+    return Dispatch(visitor);
+  }
+  template <class Visitor> bool Dispatch(Visitor& visitor) const {
     return visitor.VisitNil();
   }
 };
 
 class IdLValue : public LValue {
 public:
-  IdLValue(std::string_view id) : id_(id) {}
+  IdLValue(std::string_view id) : LValue(Kind::kIdLValue), id_(id) {}
   bool Accept(LValueVisitor& visitor) const override {
+    return Dispatch(visitor);
+  }
+  template <class Visitor> bool Dispatch(Visitor& visitor) const {
     return visitor.VisitId(id_);
   }
   std::optional<std::string> GetId() const override { return id_; }
+  void ResolveEnter(Scopes& scopes) const override {
+    binding_ = scopes.LookupValue(id_);
+  }
 
 private:
   std::string id_;
@@ -195,8 +287,13 @@ private:
 
 class FieldLValue : public LValue {
 public:
-  FieldLValue(LValue* value, std::string_view id) : value_(value), id_(id) {}
+  FieldLValue(LValue* value, std::string_view id)
+      : LValue(Kind::kFieldLValue), value_(value), id_(id) {}
+  ~FieldLValue() override { Teardown::Release(value_); }
   bool Accept(LValueVisitor& visitor) const override {
+    return Dispatch(visitor);
+  }
+  template <class Visitor> bool Dispatch(Visitor& visitor) const {
     return visitor.VisitField(*value_, id_);
   }
   std::vector<TreeNode*> Children() const override { return {value_.get()}; }
@@ -213,8 +310,13 @@ private:
 
 class IndexLValue : public LValue {
 public:
-  IndexLValue(LValue* value, Expression* expr) : value_(value), expr_(expr) {}
+  IndexLValue(LValue* value, Expression* expr)
+      : LValue(Kind::kIndexLValue), value_(value), expr_(expr) {}
+  ~IndexLValue() override { Teardown::Release(value_, expr_); }
   bool Accept(LValueVisitor& visitor) const override {
+    return Dispatch(visitor);
+  }
+  template <class Visitor> bool Dispatch(Visitor& visitor) const {
     return visitor.VisitIndex(*value_, *expr_);
   }
   std::vector<TreeNode*> Children() const override {
@@ -235,8 +337,12 @@ private:
 
 class Negated : public Expression {
 public:
-  Negated(Expression* expr) : expr_(expr) {}
+  Negated(Expression* expr) : Expression(Kind::kNegated), expr_(expr) {}
+  ~Negated() override { Teardown::Release(expr_); }
   bool Accept(ExpressionVisitor& visitor) const override {
+    return Dispatch(visitor);
+  }
+  template <class Visitor> bool Dispatch(Visitor& visitor) const {
     return visitor.VisitNegated(*expr_);
   }
   std::vector<TreeNode*> Children() const override { return {expr_.get()}; }
@@ -248,8 +354,12 @@ private:
 class Binary : public Expression {
 public:
   Binary(Expression* left, BinaryOp op, Expression* right)
-      : left_(left), op_(op), right_(right) {}
+      : Expression(Kind::kBinary), left_(left), op_(op), right_(right) {}
+  ~Binary() override { Teardown::Release(left_, right_); }
   bool Accept(ExpressionVisitor& visitor) const override {
+    return Dispatch(visitor);
+  }
+  template <class Visitor> bool Dispatch(Visitor& visitor) const {
     return visitor.VisitBinary(*left_, op_, *right_);
   }
   std::vector<TreeNode*> Children() const override {
@@ -265,8 +375,12 @@ private:
 class Assignment : public Expression {
 public:
   Assignment(std::shared_ptr<LValue> value, Expression* expr)
-      : value_(value), expr_(expr) {}
+      : Expression(Kind::kAssignment), value_(value), expr_(expr) {}
+  ~Assignment() override { Teardown::Release(value_, expr_); }
   bool Accept(ExpressionVisitor& visitor) const override {
+    return Dispatch(visitor);
+  }
+  template <class Visitor> bool Dispatch(Visitor& visitor) const {
     return visitor.VisitAssignment(*value_, *expr_);
   }
   std::vector<TreeNode*> Children() const override {
@@ -282,8 +396,12 @@ class FunctionCall : public Expression {
 public:
   FunctionCall(std::string_view id,
                std::vector<std::shared_ptr<Expression>>&& args)
-      : id_(id), args_(std::move(args)) {}
+      : Expression(Kind::kFunctionCall), id_(id), args_(std::move(args)) {}
+  ~FunctionCall() override { Teardown::Release(args_); }
   bool Accept(ExpressionVisitor& visitor) const override {
+    return Dispatch(visitor);
+  }
+  template <class Visitor> bool Dispatch(Visitor& visitor) const {
     return visitor.VisitFunctionCall(id_, args_, *this);
   }
   std::vector<TreeNode*> Children() const override {
@@ -291,6 +409,9 @@ public:
     for (auto& c : args_) children.push_back(c.get());
     return children;
   }
+  void ResolveEnter(Scopes& scopes) const override {
+    binding_ = scopes.LookupValue(id_);
+  }
 
 private:
   std::string id_;
@@ -301,8 +422,12 @@ private:
 class Block : public Expression {
 public:
   Block(std::vector<std::shared_ptr<Expression>>&& exprs)
-      : exprs_(std::move(exprs)) {}
+      : Expression(Kind::kBlock), exprs_(std::move(exprs)) {}
+  ~Block() override { Teardown::Release(exprs_); }
   bool Accept(ExpressionVisitor& visitor) const override {
+    return Dispatch(visitor);
+  }
+  template <class Visitor> bool Dispatch(Visitor& visitor) const {
     return visitor.VisitBlock(exprs_);
   }
   std::vector<TreeNode*> Children() const override {
@@ -319,8 +444,13 @@ private:
 class Record : public Expression {
 public:
   Record(std::string_view type_id, std::vector<FieldValue>&& field_values)
-      : type_id_(type_id), field_values_(std::move(field_values)) {}
+      : Expression(Kind::kRecord), type_id_(type_id),
+        field_values_(std::move(field_values)) {}
+  ~Record() override { Teardown::Release(field_values_); }
   bool Accept(ExpressionVisitor& visitor) const override {
+    return Dispatch(visitor);
+  }
+  template <class Visitor> bool Dispatch(Visitor& visitor) const {
     return visitor.VisitRecord(type_id_, field_values_, *this);
   }
   std::vector<TreeNode*> Children() const override {
@@ -328,6 +458,9 @@ public:
     for (auto& f : field_values_) children.push_back(f.expr.get());
     return children;
   }
+  void ResolveEnter(Scopes& scopes) const override {
+    binding_ = scopes.LookupType(type_id_);
+  }
 
 private:
   std::string type_id_;
@@ -338,13 +471,21 @@ private:
 class Array : public Expression {
 public:
   Array(std::string_view type_id, Expression* size, Expression* value)
-      : type_id_(type_id), size_(size), value_(value) {}
+      : Expression(Kind::kArray), type_id_(type_id), size_(size),
+        value_(value) {}
+  ~Array() override { Teardown::Release(size_, value_); }
   bool Accept(ExpressionVisitor& visitor) const override {
+    return Dispatch(visitor);
+  }
+  template <class Visitor> bool Dispatch(Visitor& visitor) const {
     return visitor.VisitArray(type_id_, *size_, *value_);
   }
   std::vector<TreeNode*> Children() const override {
     return {size_.get(), value_.get()};
   }
+  void ResolveEnter(Scopes& scopes) const override {
+    binding_ = scopes.LookupType(type_id_);
+  }
 
 private:
   std::string type_id_;
@@ -355,8 +496,12 @@ private:
 class IfThen : public Expression {
 public:
   IfThen(Expression* condition, Expression* expr)
-      : condition_(condition), expr_(expr) {}
+      : Expression(Kind::kIfThen), condition_(condition), expr_(expr) {}
+  ~IfThen() override { Teardown::Release(condition_, expr_); }
   bool Accept(ExpressionVisitor& visitor) const override {
+    return Dispatch(visitor);
+  }
+  template <class Visitor> bool Dispatch(Visitor& visitor) const {
     return visitor.VisitIfThen(*condition_, *expr_);
   }
   std::vector<TreeNode*> Children() const override {
@@ -372,8 +517,15 @@ class IfThenElse : public Expression {
 public:
   IfThenElse(Expression* condition, Expression* then_expr,
              Expression* else_expr)
-      : condition_(condition), then_expr_(then_expr), else_expr_(else_expr) {}
+      : Expression(Kind::kIfThenElse), condition_(condition),
+        then_expr_(then_expr), else_expr_(else_expr) {}
+  ~IfThenElse() override {
+    Teardown::Release(condition_, then_expr_, else_expr_);
+  }
   bool Accept(ExpressionVisitor& visitor) const override {
+    return Dispatch(visitor);
+  }
+  template <class Visitor> bool Dispatch(Visitor& visitor) const {
     return visitor.VisitIfThenElse(*condition_, *then_expr_, *else_expr_);
   }
   std::vector<TreeNode*> Children() const override {
@@ -389,8 +541,12 @@ private:
 class While : public Expression {
 public:
   While(Expression* condition, Expression* body)
-      : condition_(condition), body_(body) {}
+      : Expression(Kind::kWhile), condition_(condition), body_(body) {}
+  ~While() override { Teardown::Release(condition_, body_); }
   bool Accept(ExpressionVisitor& visitor) const override {
+    return Dispatch(visitor);
+  }
+  template <class Visitor> bool Dispatch(Visitor& visitor) const {
     return visitor.VisitWhile(*condition_, *body_);
   }
   std::vector<TreeNode*> Children() const override {
@@ -406,25 +562,46 @@ class For : public Expression {
 public:
   For(std::string_view id, Expression* first, Expression* last,
       Expression* body)
-      : id_(id), first_(first), last_(last), body_(body) {}
+      : Expression(Kind::kFor), id_(id), first_(first), last_(last),
+        body_(body) {}
+  ~For() override { Teardown::Release(first_, last_, body_); }
   bool Accept(ExpressionVisitor& visitor) const override {
+    return Dispatch(visitor);
+  }
+  template <class Visitor> bool Dispatch(Visitor& visitor) const {
     return visitor.VisitFor(id_, *first_, *last_, *body_);
   }
   std::vector<TreeNode*> Children() const override {
     return {first_.get(), last_.get(), body_.get()};
   }
+  // Only the body, the last child, sees the loop variable.
+  void ResolveChild(Scopes& scopes, size_t index) const override {
+    if (index == 2) {
+      scopes.EnterScope();
+      variable_.Bind(scopes);
+    }
+  }
+  void ResolveLeave(Scopes& scopes) const override { scopes.ExitScope(); }
+
+  // Returns the declaration of the loop variable.
+  const Declaration& Variable() const { return variable_; }
 
 private:
+  static inline const std::string kVariableType = "int";
   std::string id_;
   std::unique_ptr<Expression> first_;
   std::unique_ptr<Expression> last_;
   std::unique_ptr<Expression> body_;
+  ParamDeclaration variable_{id_, kVariableType};
 };
 
 class Break : public Expression {
 public:
-  Break() {}
+  Break() : Expression(Kind::kBreak) {}
   bool Accept(ExpressionVisitor& visitor) const override {
+    return Dispatch(visitor);
+  }
+  template <class Visitor> bool Dispatch(Visitor& visitor) const {
     return visitor.VisitBreak();
   }
 };
@@ -433,8 +610,13 @@ class Let : public Expression {
 public:
   Let(std::vector<std::shared_ptr<Declaration>>&& declarations,
       std::vector<std::shared_ptr<Expression>>&& body)
-      : declarations_(std::move(declarations)), body_(std::move(body)) {}
+      : Expression(Kind::kLet), declarations_(std::move(declarations)),
+        body_(std::move(body)) {}
+  ~Let() override { Teardown::Release(declarations_, body_); }
   bool Accept(ExpressionVisitor& visitor) const override {
+    return Dispatch(visitor);
+  }
+  template <class Visitor> bool Dispatch(Visitor& visitor) const {
     return visitor.VisitLet(declarations_, body_);
   }
   std::vector<TreeNode*> Children() const override {
@@ -467,6 +649,13 @@ public:
     return my_non_types_.get();
   }
 
+  // Declarations see each other, like in the name spaces above.
+  void ResolveEnter(Scopes& scopes) const override {
+    scopes.EnterScope();
+    for (const auto& d : declarations_) d->Bind(scopes);
+  }
+  void ResolveLeave(Scopes& scopes) const override { scopes.ExitScope(); }
+
 private:
   std::vector<std::shared_ptr<Declaration>> declarations_;
   std::vector<std::shared_ptr<Expression>> body_;
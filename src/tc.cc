@@ -1,8 +1,305 @@
+#include "AstCache.h"
+#include "Checker.h"
 #include "Expression.h"
-#include "ToString.h"
+#include "Instrument.h"
+#include "TreeWalker.h"
+#include "compiler.h"
+#include "driver.h"
+#include "process.h"
+#include "profile.h"
+#include "vm.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+const char kUsage[] =
+    "Usage: tc [--class=FILE] [--jar=FILE [--runtime=Std.class]] "
+    "[--time-passes[=json]] [--lexer=flex|hand] [--jobs=N] "
+    "[--read-ast=CACHE] [--write-ast=CACHE] [--dump-ir] [--native=FILE] "
+    "[--run] [--instrument=FILE] [--profile-use=FILE] FILE.tig\n"
+    "Compiles FILE.tig to /tmp/Main.class, or to FILE with --class, or to a\n"
+    "jar with --jar. Fails and writes nothing if parts of FILE.tig cannot be\n"
+    "compiled yet, e.g. arrays of records.\n"
+    "--run runs FILE.tig instead, compiled to bytecode of the compiler's own\n"
+    "interpreter, and exits with its status.\n"
+    "--instrument=FILE runs FILE.tig like --run, in the interpreter rather\n"
+    "than the JVM, and writes a profile of the run, i.e. how often each\n"
+    "function ran and its branches went where, to FILE.\n"
+    "--profile-use=FILE lays out blocks so that code falls through to the\n"
+    "more frequent targets of branches, and tests for the most frequent\n"
+    "case of switches first, by the profile in FILE. Warns about, and\n"
+    "ignores, profiles of functions edited since.\n"
+    "--native compiles to C in FILE.c instead, and with the C compiler, $CC\n"
+    "or cc, to a native executable FILE.\n"
+    "--time-passes reports time and allocations per phase on stderr.\n"
+    "--lexer picks the flex scanner (default) or the hand written lexer.\n"
+    "--jobs types and checks function bodies on N threads (default 1).\n"
+    "--read-ast reads the typed tree from CACHE instead of parsing and\n"
+    "typing FILE.tig, if CACHE was written from the same source.\n"
+    "--write-ast writes the typed tree to CACHE, unless read from there.\n"
+    "--dump-ir writes the IR, as lowered and after each pass, on stderr.\n";
+
+// Returns value of option `--name=value`, if arg is one.
+std::optional<std::string_view> OptionValue(std::string_view arg,
+                                            std::string_view name) {
+  if (arg.substr(0, name.size()) == name && arg.size() > name.size() &&
+      arg[name.size()] == '=') {
+    return arg.substr(name.size() + 1);
+  }
+  return {};
+}
+
+std::optional<std::string> ReadFile(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) return {};
+  return std::string(std::istreambuf_iterator<char>(in),
+                     std::istreambuf_iterator<char>());
+}
+
+// Returns the tree cached in the given file, if that holds a valid cache of
+// the source with the given hash.
+std::shared_ptr<Expression> ReadAst(const std::string& path,
+                                    uint64_t source_hash) {
+  ast_cache::MappedFile file(path);
+  auto bytes = file.bytes();
+  if (!bytes) return nullptr;
+  auto view = ast_cache::View::Open(*bytes);
+  if (!view) {
+    std::cerr << "ignoring malformed AST cache " << path << std::endl;
+    return nullptr;
+  }
+  if (view->source_hash() != source_hash) return nullptr;
+  return ast_cache::Rehydrate(*view);
+}
+
+size_t CountNodes(const TreeNode& root) {
+  struct Counter : TreeWalker {
+    bool Enter(TreeNode& node) override {
+      ++count;
+      return true;
+    }
+    size_t count = 0;
+  } counter;
+  counter.Walk(root);
+  return counter.count;
+}
+
+// Prints the given warnings, e.g. about stale profiles, which unlike
+// diagnostics do not fail compiles.
+void PrintWarnings(const std::vector<std::string>& warnings) {
+  for (const auto& w : warnings) std::cerr << "warning: " << w << "\n";
+}
+
+// Compiles the given tree to C in path.c, and that to an executable at
+// path, and returns the exit status for main. Writes neither if there are
+// diagnostics, as the program would be incomplete.
+int CompileNative(const Expression& root, const std::string& path,
+                  const std::vector<ir::Profile>& profiles) {
+  CompiledC compiled = CompileToC(root, profiles);
+  PrintWarnings(compiled.warnings);
+  for (const auto& d : compiled.diagnostics) std::cerr << d << "\n";
+  std::string c_path = path + ".c";
+  if (!compiled.diagnostics.empty()) {
+    std::remove(c_path.c_str());
+    std::remove(path.c_str());
+    return 1;
+  }
+  if (!(std::ofstream(c_path) << compiled.source)) {
+    std::cerr << "cannot write " << c_path << std::endl;
+    return 1;
+  }
+  std::vector<std::string> command = process::CCompiler(c_path, path);
+  if (process::Run(command) == 0) return 0;
+  std::cerr << "cannot compile " << c_path << " with " << command[0]
+            << std::endl;
+  return 1;
+}
+
+// Compiles the given tree to bytecode and runs that, on the standard
+// streams, and returns its exit status, or 1 without running it if there
+// are diagnostics. Writes a profile of the run to profile_path instead of
+// using profiles, if not empty.
+int Run(const Expression& root, const std::vector<ir::Profile>& profiles,
+        const std::string& profile_path) {
+  // Only the iostreams read and write the standard streams, which are much
+  // faster when they need not keep in step with stdio.
+  std::ios::sync_with_stdio(false);
+  CompiledBytecode compiled = profile_path.empty()
+                                  ? CompileToBytecode(root, profiles)
+                                  : CompileToInstrumentedBytecode(root);
+  PrintWarnings(compiled.warnings);
+  for (const auto& d : compiled.diagnostics) std::cerr << d << "\n";
+  // Lowering put placeholders where it failed, which would run wrongly.
+  if (!compiled.diagnostics.empty()) return 1;
+  if (profile_path.empty()) {
+    return vm::Run(compiled.program, std::cin, std::cout, std::cerr);
+  }
+  std::vector<ir::Profile> measured = compiled.program.profiles;
+  int status =
+      vm::Run(compiled.program, std::cin, std::cout, std::cerr, &measured);
+  std::ofstream out(profile_path);
+  ir::WriteProfiles(measured, out);
+  if (!out) {
+    std::cerr << "cannot write " << profile_path << std::endl;
+    return 1;
+  }
+  return status;
+}
+
+// Reports instrumentation on destruction, so that every exit path reports.
+struct PassReporter {
+  ~PassReporter() {
+    if (instrument::IsEnabled()) instrument::Report(std::cerr, format);
+  }
+  instrument::Format format = instrument::Format::kTable;
+};
+} // namespace
 
 int main(int argc, char** argv) {
-  std::cout << "I compile Tiger" << std::endl;
-  return 0;
+  std::string source, jar_path, runtime_path, read_ast_path, write_ast_path,
+      native_path, instrument_path, profile_use_path;
+  std::string class_path = "/tmp/Main.class";
+  bool hand_written_lexer = false;
+  bool dump_ir = false;
+  bool run = false;
+  int jobs = 1;
+  PassReporter pass_reporter;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg == "--time-passes") {
+      instrument::Enable();
+    } else if (auto v = OptionValue(arg, "--time-passes"); v && *v == "json") {
+      pass_reporter.format = instrument::Format::kJson;
+      instrument::Enable();
+    } else if (auto v = OptionValue(arg, "--class"); v) {
+      class_path = *v;
+    } else if (auto v = OptionValue(arg, "--jar"); v) {
+      jar_path = *v;
+    } else if (auto v = OptionValue(arg, "--runtime"); v) {
+      runtime_path = *v;
+    } else if (auto v = OptionValue(arg, "--lexer");
+               v && (*v == "flex" || *v == "hand")) {
+      hand_written_lexer = *v == "hand";
+    } else if (auto v = OptionValue(arg, "--jobs"); v) {
+      jobs = std::atoi(std::string(*v).c_str());
+      if (jobs < 1) {
+        std::cerr << kUsage;
+        return 2;
+      }
+    } else if (auto v = OptionValue(arg, "--read-ast"); v) {
+      read_ast_path = *v;
+    } else if (auto v = OptionValue(arg, "--write-ast"); v) {
+      write_ast_path = *v;
+    } else if (auto v = OptionValue(arg, "--native"); v) {
+      native_path = *v;
+    } else if (arg == "--dump-ir") {
+      dump_ir = true;
+    } else if (arg == "--run") {
+      run = true;
+    } else if (auto v = OptionValue(arg, "--instrument"); v) {
+      instrument_path = *v;
+    } else if (auto v = OptionValue(arg, "--profile-use"); v) {
+      profile_use_path = *v;
+    } else if (arg.size() > 1 && arg[0] == '-') {
+      std::cerr << kUsage;
+      return 2;
+    } else {
+      source = arg;
+    }
+  }
+  if (source.empty()) {
+    std::cerr << kUsage;
+    return 2;
+  }
+
+  Driver driver;
+  std::shared_ptr<Expression> tree;
+  uint64_t source_hash = 0;
+  if (!read_ast_path.empty() || !write_ast_path.empty()) {
+    auto text = ReadFile(source);
+    if (!text) {
+      std::cerr << "cannot read " << source << std::endl;
+      return 1;
+    }
+    source_hash = ast_cache::SourceHash(*text);
+    if (!read_ast_path.empty()) tree = ReadAst(read_ast_path, source_hash);
+    if (tree) {
+      // For positions in errors, as the scanner would have.
+      driver.source_map = SourceMap(source);
+      driver.source_map.Append(*text);
+    }
+  }
+  if (!tree) {
+    driver.hand_written_lexer = hand_written_lexer;
+    if (driver.parse(source) != 0) return 1;
+    tree = driver.result;
+    Expression::SetNameSpacesBelow(*tree);
+    Expression::SetTypesBelow(*tree, jobs);
+    if (!write_ast_path.empty()) {
+      std::ofstream out(write_ast_path, std::ios::binary);
+      if (!(out << ast_cache::Write(*tree, source_hash))) {
+        std::cerr << "cannot write " << write_ast_path << std::endl;
+        return 1;
+      }
+    }
+  }
+  Expression& root = *tree;
+  if (instrument::IsEnabled()) {
+    instrument::SetCount("ast nodes", CountNodes(root));
+  }
+  auto errors = ListErrors(root, jobs, &driver.source_map);
+  for (const auto& error : errors) std::cerr << error << "\n";
+  if (!errors.empty()) return 1;
+
+  std::vector<ir::Profile> profiles;
+  if (!profile_use_path.empty()) {
+    auto text = ReadFile(profile_use_path);
+    std::istringstream in(text ? *text : "");
+    auto read = ir::ReadProfiles(in);
+    if (!text || !read) {
+      std::cerr << "cannot read profile " << profile_use_path << std::endl;
+      return 1;
+    }
+    profiles = std::move(*read);
+  }
+  if (dump_ir) DumpIr(root, std::cerr, profiles);
+  if (!native_path.empty()) {
+    return CompileNative(root, native_path, profiles);
+  }
+  if (run || !instrument_path.empty()) {
+    return Run(root, profiles, instrument_path);
+  }
+  // Compiles to memory first, so that a program with diagnostics, whose
+  // code would be incomplete, leaves no class or jar behind.
+  std::string path = jar_path.empty() ? class_path : jar_path;
+  std::ostringstream bytes;
+  std::vector<std::string> diagnostics;
+  std::vector<std::string> warnings;
+  if (jar_path.empty()) {
+    diagnostics = Compile(root, "Main", bytes, profiles, &warnings);
+  } else if (runtime_path.empty()) {
+    diagnostics = CompileToJar(root, bytes, {}, "Main", profiles, &warnings);
+  } else if (auto runtime = ReadFile(runtime_path); runtime) {
+    diagnostics = CompileToJar(root, bytes, {{"Std.class", *runtime}}, "Main",
+                               profiles, &warnings);
+  } else {
+    std::cerr << "cannot read " << runtime_path << std::endl;
+    return 1;
+  }
+  PrintWarnings(warnings);
+  for (const auto& d : diagnostics) std::cerr << d << "\n";
+  if (diagnostics.empty()) {
+    std::ofstream out(path, std::ios::binary);
+    if (out << bytes.str()) return 0;
+    std::cerr << "cannot write " << path << std::endl;
+  }
+  std::remove(path.c_str());
+  return 1;
 }
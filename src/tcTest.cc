@@ -0,0 +1,74 @@
+#include "process.h"
+#include "testing/catch.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Directory of tc, see Makefile.am.
+#ifndef TC_BUILDDIR
+#define TC_BUILDDIR "."
+#endif
+
+namespace {
+
+struct Ran {
+  std::string out;
+  std::string err;
+  int status;
+};
+
+// Returns a path for files of the test, one per process, so that test
+// binaries can run in parallel.
+std::string Path(const std::string& suffix) {
+  return "/tmp/tcTest." + std::to_string(getpid()) + suffix;
+}
+
+std::string Read(const std::string& path) {
+  std::ostringstream text;
+  text << std::ifstream(path, std::ios::binary).rdbuf();
+  return text.str();
+}
+
+// Runs tc with the given arguments, without input.
+Ran Tc(std::vector<std::string> args) {
+  args.insert(args.begin(), TC_BUILDDIR "/tc");
+  int status = process::Run(args, {"/dev/null", Path(".out"), Path(".err")});
+  Ran ran = {Read(Path(".out")), Read(Path(".err")), status};
+  std::remove(Path(".out").c_str());
+  std::remove(Path(".err").c_str());
+  return ran;
+}
+
+SCENARIO("tc uses profiles", "[tc]") {
+  GIVEN("a profile of an earlier version of a program") {
+    std::string tig = Path(".tig");
+    std::string profile = Path(".profile");
+    std::ofstream(tig) << "for i := 1 to 3 do if i = 2 then print(\"a\") "
+                          "else printi(i)";
+    REQUIRE(Tc({"--instrument=" + profile, tig}).out == "1a3");
+    std::ofstream(tig) << "for i := 1 to 4 do if i = 3 then print(\"b\") "
+                          "else printi(i)";
+    const std::string warning = "warning: Profile of main is of another "
+                                "version of it, ignored\n";
+    THEN("it runs the program, with a warning") {
+      Ran ran = Tc({"--profile-use=" + profile, "--run", tig});
+      REQUIRE(ran.out == "12b4");
+      REQUIRE(ran.err == warning);
+      REQUIRE(ran.status == 0);
+    }
+    THEN("it compiles the program, with a warning") {
+      std::string class_file = Path(".class");
+      Ran ran = Tc({"--profile-use=" + profile, "--class=" + class_file, tig});
+      REQUIRE(ran.err == warning);
+      REQUIRE(ran.status == 0);
+      REQUIRE(Read(class_file).substr(0, 4) == "\xca\xfe\xba\xbe");
+      std::remove(class_file.c_str());
+    }
+    std::remove(tig.c_str());
+    std::remove(profile.c_str());
+  }
+}
+} // namespace
@@ -0,0 +1,540 @@
+#include "AstCache.h"
+#include "Checker.h"
+#include "Expression.h"
+#include "Lexer.h"
+#include "ScopedMap.h"
+#include "StaticExpressionVisitor.h"
+#include "TreeWalker.h"
+#include "compiler.h"
+#include "driver.h"
+#include "syntax.h"
+#include "testing/generator.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+// Times each compiler phase over synthetic programs of growing size and
+// reports nanoseconds per AST node and the scaling exponent, i.e. the slope
+// of log(time) over log(nodes). Linear phases have exponents near 1, so an
+// exponent near 2 points at a quadratic algorithm.
+//
+// Usage: tc_bench [--quick] [--max-exponent=X]
+//                 [shape...|lexer|scoped-map|parallel|variant|dispatch|
+//                  ast-cache]
+// With --max-exponent, exits with status 1 if any phase scales worse.
+// "lexer" compares the throughput of the flex scanner and the hand written
+// Lexer, both reading the source from a file. "scoped-map" compares
+// ScopedMap with the vector of maps it replaced. "parallel" times type
+// setting and checking with growing numbers of threads. "variant" compares
+// the class hierarchy of AST nodes with the variant AST of syntax.h.
+// "dispatch" compares visiting nodes through the virtual methods of
+// ExpressionVisitor with StaticExpressionVisitor. "ast-cache" compares
+// parsing, binding, and typing a program with reading its AST cache.
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+// One of each per process, so that benchmarks can run at once, as in
+// testing::Parse.
+const std::string kSourceFile =
+    "/tmp/tc_bench." + std::to_string(getpid()) + ".tig";
+const std::string kAstCacheFile =
+    "/tmp/tc_bench." + std::to_string(getpid()) + ".ast";
+// Removes the files above at exit, also on exit() from the driver.
+struct RemoveFilesAtExit {
+  ~RemoveFilesAtExit() {
+    std::remove(kSourceFile.c_str());
+    std::remove(kAstCacheFile.c_str());
+  }
+} remove_files_at_exit;
+constexpr int kRepetitions = 3;
+// Phases faster than this at the largest size are too noisy to judge.
+constexpr double kMinJudgedNanos = 200e3;
+
+enum Phase { kParse, kBind, kType, kCheck, kCodegen, kPhaseCount };
+const char* kPhaseNames[kPhaseCount] = {"parse", "bind", "type", "check",
+                                        "codegen"};
+
+size_t CountNodes(const TreeNode& root) {
+  struct Counter : TreeWalker {
+    bool Enter(TreeNode& node) override {
+      ++count;
+      return true;
+    }
+    size_t count = 0;
+  } counter;
+  counter.Walk(root);
+  return counter.count;
+}
+
+double Nanos(const std::function<void()>& f) {
+  auto start = Clock::now();
+  f();
+  return std::chrono::duration<double, std::nano>(Clock::now() - start)
+      .count();
+}
+
+struct Sample {
+  size_t nodes = 0;
+  double nanos[kPhaseCount];
+};
+
+// Runs the whole pipeline kRepetitions times and keeps the fastest time per
+// phase.
+Sample Measure(const std::string& source) {
+  std::ofstream(kSourceFile) << source;
+  Sample sample;
+  for (double& n : sample.nanos) n = INFINITY;
+  for (int r = 0; r < kRepetitions; ++r) {
+    Driver driver;
+    double t[kPhaseCount];
+    t[kParse] = Nanos([&] { driver.parse(kSourceFile); });
+    Expression& root = *driver.result;
+    t[kBind] = Nanos([&] { Expression::SetNameSpacesBelow(root); });
+    t[kType] = Nanos([&] { Expression::SetTypesBelow(root); });
+    t[kCheck] = Nanos([&] { ListErrors(root); });
+    t[kCodegen] = Nanos([&] {
+      std::ostringstream jar;
+      CompileToJar(root, jar);
+    });
+    for (int p = 0; p < kPhaseCount; ++p) {
+      sample.nanos[p] = std::min(sample.nanos[p], t[p]);
+    }
+    sample.nodes = CountNodes(root);
+  }
+  return sample;
+}
+
+// Least squares slope of log(nanos) over log(nodes).
+double ScalingExponent(const std::vector<Sample>& samples, int phase) {
+  double n = samples.size(), sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (const Sample& s : samples) {
+    double x = std::log(s.nodes), y = std::log(s.nanos[phase]);
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+  }
+  return (n * sxy - sx * sy) / (n * sxx - sx * sx);
+}
+
+// Scans kSourceFile with the flex scanner or the hand written Lexer.
+// Returns the number of tokens.
+size_t Scan(bool hand_written) {
+  Driver driver;
+  driver.file = kSourceFile;
+  int eof = yy::Parser::make_EOF(yy::location()).type_get();
+  size_t tokens = 0;
+  if (hand_written) {
+    std::ifstream in(kSourceFile, std::ios::binary);
+    std::string text((std::istreambuf_iterator<char>(in)),
+                     std::istreambuf_iterator<char>());
+    Lexer lexer(text, &driver.file);
+    while (lexer.Next(driver).type_get() != eof) ++tokens;
+  } else {
+    driver.scan_begin();
+    while (FlexLex(driver).type_get() != eof) ++tokens;
+    driver.scan_end();
+  }
+  return tokens;
+}
+
+void MeasureLexers(int megabytes) {
+  std::string source;
+  while (source.size() < megabytes * size_t(1 << 20)) {
+    for (const auto& shape : testing::ProgramShapes()) {
+      source += "/* ";
+      source += shape.name;
+      source += " */\n";
+      source += shape.generate(shape.base_size);
+      source += "\n";
+    }
+  }
+  std::ofstream(kSourceFile) << source;
+  std::cout << "lexer (" << megabytes << " MB)\n"
+            << std::setw(8) << "lexer" << std::setw(10) << "tokens"
+            << std::setw(9) << "MB/s" << "\n";
+  for (bool hand_written : {false, true}) {
+    double nanos = INFINITY;
+    size_t tokens = 0;
+    for (int r = 0; r < kRepetitions; ++r) {
+      nanos = std::min(nanos, Nanos([&] { tokens = Scan(hand_written); }));
+    }
+    std::cout << std::setw(8) << (hand_written ? "hand" : "flex")
+              << std::setw(10) << tokens << std::setw(9)
+              << std::setprecision(1) << source.size() / nanos * 1e3
+              << "\n";
+  }
+  std::cout << "\n";
+}
+
+// ScopedMap as it was before it became a single table: a map per scope.
+template <class T> class MapPerScopeMap {
+public:
+  void EnterScope() { maps_.push_back({}); }
+  void ExitScope() { maps_.pop_back(); }
+  std::optional<T> Lookup(const std::string& key) const {
+    for (auto i = maps_.rbegin(); i != maps_.rend(); ++i) {
+      if (auto j = i->find(key); j != i->end()) return j->second;
+    }
+    return {};
+  }
+  T& operator[](std::string key) { return (*maps_.rbegin())[key]; }
+
+private:
+  std::vector<std::unordered_map<std::string, T>> maps_;
+};
+
+// Enters `depth` nested scopes, binding two fresh names and shadowing a
+// common one in each, with lookups of outer names, of the shadowed name and
+// of missing names as a resolver would do. Returns the number of hits.
+template <class Map>
+size_t ExerciseScopes(int depth, const std::vector<std::string>& names) {
+  Map map;
+  size_t hits = 0;
+  uint32_t random = 1;
+  const std::string& shadowed = names[0];
+  for (int d = 1; d <= depth; ++d) {
+    map.EnterScope();
+    map[names[2 * d - 1]] = d;
+    map[names[2 * d]] = d;
+    map[shadowed] = d;
+    for (int k = 0; k < 4; ++k) {
+      random = random * 1103515245 + 12345;
+      if (map.Lookup(names[1 + (random >> 8) % (2 * d)])) ++hits;
+    }
+    for (int k = 0; k < 2; ++k) {
+      if (map.Lookup(shadowed)) ++hits;
+      if (map.Lookup(names[2 * depth + 1 + k])) ++hits;
+    }
+  }
+  for (int d = 0; d < depth; ++d) map.ExitScope();
+  return hits;
+}
+
+void MeasureScopedMaps(const std::vector<int>& depths) {
+  std::cout << "scoped-map (ns/operation)\n"
+            << std::setw(8) << "depth" << std::setw(14) << "map-per-scope"
+            << std::setw(11) << "ScopedMap" << "\n";
+  for (int depth : depths) {
+    std::vector<std::string> names;
+    for (int i = 0; i < 2 * depth + 3; ++i) {
+      names.push_back("name" + std::to_string(i));
+    }
+    // Enter, exit, three bindings, and eight lookups per scope.
+    double operations = 13.0 * depth;
+    double nanos[2] = {INFINITY, INFINITY};
+    size_t hits[2];
+    for (int r = 0; r < kRepetitions; ++r) {
+      nanos[0] = std::min(nanos[0], Nanos([&] {
+        hits[0] = ExerciseScopes<MapPerScopeMap<int>>(depth, names);
+      }));
+      nanos[1] = std::min(nanos[1], Nanos([&] {
+        hits[1] = ExerciseScopes<ScopedMap<int>>(depth, names);
+      }));
+    }
+    if (hits[0] != hits[1]) std::cout << "hits differ: ";
+    std::cout << std::setw(8) << depth << std::setprecision(1)
+              << std::setw(14) << nanos[0] / operations << std::setw(11)
+              << nanos[1] / operations << "\n";
+  }
+  std::cout << "\n";
+}
+
+// Types and checks a program of many functions on 1, 2, 4, ... threads.
+void MeasureParallelPasses(int functions) {
+  std::ofstream(kSourceFile) << testing::ManyFunctions(functions);
+  int max_threads = std::max(1u, std::thread::hardware_concurrency());
+  std::cout << "parallel (" << functions << " functions, ms)\n"
+            << std::setw(8) << "threads" << std::setw(9) << "type"
+            << std::setw(9) << "check" << "\n";
+  for (int threads = 1; threads <= max_threads; threads *= 2) {
+    double nanos[2] = {INFINITY, INFINITY};
+    for (int r = 0; r < kRepetitions; ++r) {
+      Driver driver;
+      driver.parse(kSourceFile);
+      Expression& root = *driver.result;
+      Expression::SetNameSpacesBelow(root);
+      nanos[0] = std::min(nanos[0], Nanos([&] {
+        Expression::SetTypesBelow(root, threads);
+      }));
+      nanos[1] = std::min(nanos[1], Nanos([&] { ListErrors(root, threads); }));
+    }
+    std::cout << std::setw(8) << threads << std::setprecision(1)
+              << std::setw(9) << nanos[0] / 1e6 << std::setw(9)
+              << nanos[1] / 1e6 << "\n";
+  }
+  std::cout << "\n";
+}
+
+// Returns heap bytes in use, including allocator overhead, or 0 where
+// unknown.
+size_t HeapBytesInUse() {
+#ifdef __GLIBC__
+  return mallinfo2().uordblks;
+#else
+  return 0;
+#endif
+}
+
+// Compares the class hierarchy of syntax_nodes.h with the variant AST of
+// syntax.h: heap bytes per node of the tree, and the time of the passes up
+// to checking. The variant passes resolve names as they go, so they are
+// compared with binding, type setting and checking together.
+void MeasureVariantAst(int functions) {
+  std::ofstream(kSourceFile) << testing::ManyFunctions(functions);
+  size_t nodes = 0;
+  double bytes[2] = {0, 0};
+  double nanos[2] = {INFINITY, INFINITY};
+  double lower_nanos = INFINITY;
+  for (int r = 0; r < kRepetitions; ++r) {
+    size_t before = HeapBytesInUse();
+    std::shared_ptr<Expression> root;
+    {
+      Driver driver;
+      driver.parse(kSourceFile);
+      root = driver.result;
+    }
+    bytes[0] = HeapBytesInUse() - before;
+    nodes = CountNodes(*root);
+    nanos[0] = std::min(nanos[0], Nanos([&] {
+      Expression::SetNameSpacesBelow(*root);
+      Expression::SetTypesBelow(*root);
+      ListErrors(*root);
+    }));
+    before = HeapBytesInUse();
+    syntax::Program program;
+    lower_nanos = std::min(lower_nanos,
+                           Nanos([&] { program = syntax::Lower(*root); }));
+    bytes[1] = HeapBytesInUse() - before;
+    nanos[1] = std::min(nanos[1], Nanos([&] {
+      syntax::SetTypes(program);
+      syntax::ListErrors(program);
+    }));
+  }
+  std::cout << "variant (" << nodes << " nodes, sizeof(syntax::Expr) "
+            << sizeof(syntax::Expr) << ", lowering "
+            << std::setprecision(1) << lower_nanos / 1e6 << " ms)\n"
+            << std::setw(10) << "ast" << std::setw(12) << "bytes/node"
+            << std::setw(12) << "passes ms" << "\n";
+  const char* names[2] = {"classes", "variants"};
+  for (int i = 0; i < 2; ++i) {
+    std::cout << std::setw(10) << names[i] << std::setw(12)
+              << bytes[i] / nodes << std::setw(12) << nanos[i] / 1e6 << "\n";
+  }
+  std::cout << "\n";
+}
+
+// Sums integer constants through virtual calls.
+struct VirtualSum : ExpressionVisitor {
+  bool VisitIntegerConstant(int value) override {
+    sum += value;
+    return true;
+  }
+  long sum = 0;
+};
+
+// Sums integer constants like VirtualSum, dispatching statically.
+struct StaticSum : StaticExpressionVisitor<StaticSum> {
+  bool VisitIntegerConstant(int value) {
+    sum += value;
+    return true;
+  }
+  long sum = 0;
+};
+
+// Times a full traversal of programs of the given shapes by visitors that
+// do next to nothing per node, i.e. the cost of dispatching on nodes and
+// of recursing into children.
+void MeasureDispatch(const std::vector<std::pair<std::string, int>>& shapes) {
+  std::cout << "dispatch (ns/node)\n"
+            << std::setw(18) << "shape" << std::setw(9) << "nodes"
+            << std::setw(9) << "virtual" << std::setw(9) << "static"
+            << "\n";
+  for (const auto& [name, size] : shapes) {
+    auto shape = std::find_if(
+        testing::ProgramShapes().begin(), testing::ProgramShapes().end(),
+        [&name = name](const auto& s) { return s.name == name; });
+    std::ofstream(kSourceFile) << shape->generate(size);
+    Driver driver;
+    driver.parse(kSourceFile);
+    const Expression& root = *driver.result;
+    size_t nodes = CountNodes(root);
+    double nanos[2] = {INFINITY, INFINITY};
+    long sums[2];
+    for (int r = 0; r < kRepetitions; ++r) {
+      nanos[0] = std::min(nanos[0], Nanos([&] {
+        VirtualSum visitor;
+        root.Accept(visitor);
+        sums[0] = visitor.sum;
+      }));
+      nanos[1] = std::min(nanos[1], Nanos([&] {
+        StaticSum visitor;
+        visitor.Visit(root);
+        sums[1] = visitor.sum;
+      }));
+    }
+    if (sums[0] != sums[1]) std::cout << "sums differ: ";
+    std::cout << std::setw(18) << name << std::setw(9) << nodes
+              << std::setprecision(2) << std::setw(9) << nanos[0] / nodes
+              << std::setw(9) << nanos[1] / nodes << "\n";
+  }
+  std::cout << "\n";
+}
+
+// Times the front end on a program of the given number of functions, from
+// the source file, and from a file of its AST cache.
+void MeasureAstCache(int functions) {
+  std::string text = testing::ManyFunctions(functions);
+  std::ofstream(kSourceFile) << text;
+  size_t nodes = 0;
+  size_t bytes = 0;
+  double nanos[2] = {INFINITY, INFINITY};
+  for (int r = 0; r < kRepetitions; ++r) {
+    std::shared_ptr<Expression> root;
+    nanos[0] = std::min(nanos[0], Nanos([&] {
+      Driver driver;
+      driver.parse(kSourceFile);
+      root = driver.result;
+      Expression::SetNameSpacesBelow(*root);
+      Expression::SetTypesBelow(*root);
+    }));
+    nodes = CountNodes(*root);
+    std::string cache = ast_cache::Write(*root, ast_cache::SourceHash(text));
+    bytes = cache.size();
+    std::ofstream(kAstCacheFile, std::ios::binary) << cache;
+    // Destroying trees is the same either way.
+    root.reset();
+    nanos[1] = std::min(nanos[1], Nanos([&] {
+      ast_cache::MappedFile file(kAstCacheFile);
+      auto view = ast_cache::View::Open(*file.bytes());
+      root = ast_cache::Rehydrate(*view);
+    }));
+    root.reset();
+  }
+  std::cout << "ast-cache (" << nodes << " nodes, "
+            << bytes / nodes << " bytes/node)\n"
+            << std::setw(10) << "from" << std::setw(12) << "ms"
+            << std::setw(12) << "ns/node" << "\n";
+  const char* names[2] = {"source", "cache"};
+  for (int i = 0; i < 2; ++i) {
+    std::cout << std::setw(10) << names[i] << std::setprecision(1)
+              << std::setw(12) << nanos[i] / 1e6 << std::setw(12)
+              << nanos[i] / nodes << "\n";
+  }
+  std::cout << "\n";
+  std::remove(kAstCacheFile.c_str());
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  std::vector<int> multipliers = {1, 2, 4, 8};
+  int lexer_megabytes = 16;
+  std::vector<int> scope_depths = {16, 256, 4096};
+  int parallel_functions = 20000;
+  int variant_functions = 20000;
+  int cached_functions = 20000;
+  // The visitors recurse, so binary chains stay short.
+  std::vector<std::pair<std::string, int>> dispatch_shapes = {
+      {"long-sequence", 100000},
+      {"string-constants", 50000},
+      {"binary-chain", 20000}};
+  double max_exponent = INFINITY;
+  std::vector<std::string_view> selected;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg == "--quick") {
+      multipliers = {1, 2, 4};
+      lexer_megabytes = 4;
+      scope_depths = {16, 256, 1024};
+      parallel_functions = 5000;
+      variant_functions = 5000;
+      cached_functions = 5000;
+      for (auto& shape : dispatch_shapes) shape.second /= 10;
+    } else if (arg.substr(0, 15) == "--max-exponent=") {
+      max_exponent = std::atof(argv[i] + 15);
+    } else {
+      selected.push_back(arg);
+    }
+  }
+
+  bool regressed = false;
+  std::cout << std::fixed;
+  for (const auto& shape : testing::ProgramShapes()) {
+    if (!selected.empty() &&
+        std::find(selected.begin(), selected.end(), shape.name) ==
+            selected.end()) {
+      continue;
+    }
+    std::cout << shape.name << " (ns/node)\n" << std::setw(8) << "size"
+              << std::setw(9) << "nodes";
+    for (const char* name : kPhaseNames) std::cout << std::setw(9) << name;
+    std::cout << "\n";
+
+    std::vector<Sample> samples;
+    for (int m : multipliers) {
+      int size = shape.base_size * m;
+      samples.push_back(Measure(shape.generate(size)));
+      const Sample& s = samples.back();
+      std::cout << std::setw(8) << size << std::setw(9) << s.nodes
+                << std::setprecision(1);
+      for (double nanos : s.nanos) {
+        std::cout << std::setw(9) << nanos / s.nodes;
+      }
+      std::cout << "\n";
+    }
+    std::cout << std::setw(17) << "exponent" << std::setprecision(2);
+    for (int p = 0; p < kPhaseCount; ++p) {
+      double exponent = ScalingExponent(samples, p);
+      bool judged = samples.back().nanos[p] >= kMinJudgedNanos;
+      std::cout << std::setw(8) << exponent << (judged ? " " : "?");
+      if (judged && exponent > max_exponent) regressed = true;
+    }
+    std::cout << "\n\n";
+  }
+  auto lexer = std::find(selected.begin(), selected.end(), "lexer");
+  if (selected.empty() || lexer != selected.end()) {
+    MeasureLexers(lexer_megabytes);
+  }
+  auto scoped_map = std::find(selected.begin(), selected.end(), "scoped-map");
+  if (selected.empty() || scoped_map != selected.end()) {
+    MeasureScopedMaps(scope_depths);
+  }
+  auto parallel = std::find(selected.begin(), selected.end(), "parallel");
+  if (selected.empty() || parallel != selected.end()) {
+    MeasureParallelPasses(parallel_functions);
+  }
+  auto variant = std::find(selected.begin(), selected.end(), "variant");
+  if (selected.empty() || variant != selected.end()) {
+    MeasureVariantAst(variant_functions);
+  }
+  auto dispatch = std::find(selected.begin(), selected.end(), "dispatch");
+  if (selected.empty() || dispatch != selected.end()) {
+    MeasureDispatch(dispatch_shapes);
+  }
+  auto ast_cache = std::find(selected.begin(), selected.end(), "ast-cache");
+  if (selected.empty() || ast_cache != selected.end()) {
+    MeasureAstCache(cached_functions);
+  }
+  std::cout << "? marks phases too fast at the largest size to judge\n";
+  return regressed ? 1 : 0;
+}
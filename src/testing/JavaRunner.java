@@ -0,0 +1,102 @@
+import java.io.BufferedInputStream;
+import java.io.BufferedOutputStream;
+import java.io.ByteArrayInputStream;
+import java.io.ByteArrayOutputStream;
+import java.io.DataInputStream;
+import java.io.DataOutputStream;
+import java.io.EOFException;
+import java.io.FileDescriptor;
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.io.PrintStream;
+import java.lang.reflect.InvocationTargetException;
+
+// Runs class files for tests in one JVM, so that tests need not start a JVM
+// each, see testing::RunClass. Reads requests from stdin, each the size of a
+// class file as a 4 byte big-endian int followed by the class file. Loads
+// the class with a fresh class loader, so that runs do not share classes,
+// calls its main method with stdout and stderr captured, and writes the
+// exit status, the output, and the error output to stdout, the last two
+// each preceded by its size. Ends at the end of stdin.
+//
+// System.exit ends the JVM. A shutdown hook still writes the response, with
+// status EXITED, so that the caller takes the status of the JVM instead.
+public class JavaRunner {
+  static final int EXITED = -1;
+
+  static final ByteArrayOutputStream out = new ByteArrayOutputStream();
+  static final ByteArrayOutputStream err = new ByteArrayOutputStream();
+  static DataOutputStream responses;
+  static volatile boolean running = false;
+
+  // Defines the class run from bytes, and finds other classes, like Std,
+  // in the class path.
+  static class Loader extends ClassLoader {
+    Loader() { super(JavaRunner.class.getClassLoader()); }
+    Class<?> define(byte[] bytes) {
+      return defineClass(null, bytes, 0, bytes.length);
+    }
+  }
+
+  public static void main(String[] args) throws IOException {
+    DataInputStream requests =
+        new DataInputStream(new BufferedInputStream(System.in));
+    responses = new DataOutputStream(
+        new BufferedOutputStream(new FileOutputStream(FileDescriptor.out)));
+    System.setIn(new ByteArrayInputStream(new byte[0]));
+    System.setOut(new PrintStream(out, true));
+    System.setErr(new PrintStream(err, true));
+    Runtime.getRuntime().addShutdownHook(new Thread(() -> {
+      if (running) respond(EXITED);
+    }));
+    while (true) {
+      byte[] bytes;
+      try {
+        bytes = new byte[requests.readInt()];
+      } catch (EOFException e) {
+        return;
+      }
+      requests.readFully(bytes);
+      respond(run(bytes));
+    }
+  }
+
+  // Returns the status of running the given class file, like that of
+  // `java Main`.
+  static int run(byte[] bytes) {
+    out.reset();
+    err.reset();
+    running = true;
+    try {
+      new Loader()
+          .define(bytes)
+          .getMethod("main", String[].class)
+          .invoke(null, (Object)new String[0]);
+      return 0;
+    } catch (InvocationTargetException e) {
+      System.err.print("Exception in thread \"main\" ");
+      e.getCause().printStackTrace();
+      return 1;
+    } catch (Throwable e) {
+      // E.g. a VerifyError of a malformed class.
+      e.printStackTrace();
+      return 1;
+    }
+  }
+
+  static synchronized void respond(int status) {
+    running = false;
+    System.out.flush();
+    System.err.flush();
+    try {
+      responses.writeInt(status);
+      responses.writeInt(out.size());
+      out.writeTo(responses);
+      responses.writeInt(err.size());
+      err.writeTo(responses);
+      responses.flush();
+    } catch (IOException e) {
+      // The caller is gone.
+    }
+  }
+}
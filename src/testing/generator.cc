@@ -0,0 +1,99 @@
+#include "generator.h"
+#include <sstream>
+#include <string>
+
+namespace testing {
+
+std::string NestedLets(int n) {
+  std::ostringstream os;
+  for (int i = 0; i < n; ++i) {
+    os << "let var v" << i << " := ";
+    if (i == 0) {
+      os << "0";
+    } else {
+      os << "v" << (i - 1);
+    }
+    os << " in ";
+  }
+  os << "v" << (n - 1);
+  for (int i = 0; i < n; ++i) os << " end";
+  return os.str();
+}
+
+std::string WideDeclarations(int n) {
+  std::ostringstream os;
+  os << "let var v0 := 0";
+  for (int i = 1; i < n; ++i) os << "\nvar v" << i << " := v" << (i - 1);
+  os << "\nin v" << (n - 1) << " end";
+  return os.str();
+}
+
+std::string LongSequence(int n) {
+  std::ostringstream os;
+  const char* sep = "(";
+  for (int i = 0; i < n; ++i) {
+    os << sep << "printi(" << i << ")";
+    sep = ";\n";
+  }
+  os << ")";
+  return os.str();
+}
+
+std::string BinaryChain(int n) {
+  std::ostringstream os;
+  os << "printi(1";
+  for (int i = 1; i < n; ++i) os << (i % 2 ? " + " : " - ") << (i % 1000);
+  os << ")";
+  return os.str();
+}
+
+std::string StringConstants(int n) {
+  std::ostringstream os;
+  const char* sep = "(";
+  for (int i = 0; i < n; ++i) {
+    os << sep << "print(\"constant number " << i << "\")";
+    sep = ";\n";
+  }
+  os << ")";
+  return os.str();
+}
+
+std::string RecordTypes(int n) {
+  std::ostringstream os;
+  os << "let type R0 = {id: int, name: string}";
+  for (int i = 1; i < n; ++i) {
+    os << "\ntype R" << i << " = {id: int, previous: R" << (i - 1) << "}";
+  }
+  os << "\nin R" << (n - 1) << " {id = " << n << ", ";
+  os << (n > 1 ? "previous = nil" : "name = \"last\"") << "} end";
+  return os.str();
+}
+
+std::string ManyFunctions(int n) {
+  std::ostringstream os;
+  os << "let";
+  for (int i = 0; i < n; ++i) {
+    os << "\nfunction f" << i << "(x: int): int =\n"
+       << "  let var y := x * " << (i % 7 + 2) << " in\n"
+       << "    if y > 10 & y < 1000 then y - 10 else "
+       << (i > 0 ? "f" + std::to_string(i - 1) + "(y + 1)" : "y + 1")
+       << "\n  end";
+  }
+  os << "\nin printi(" << n << ") end";
+  return os.str();
+}
+
+const std::vector<ProgramShape>& ProgramShapes() {
+  static const std::vector<ProgramShape> kShapes = {
+      {"nested-lets", NestedLets, 250},
+      {"wide-declarations", WideDeclarations, 500},
+      {"long-sequence", LongSequence, 1000},
+      {"binary-chain", BinaryChain, 2000},
+      {"string-constants", StringConstants, 500},
+      {"record-types", RecordTypes, 250},
+      {"many-functions", ManyFunctions, 250},
+  };
+  return kShapes;
+}
+
+} // namespace testing
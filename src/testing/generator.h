@@ -0,0 +1,41 @@
+#pragma once
+#include <string>
+#include <vector>
+
+namespace testing {
+
+// Generators for synthetic Tiger programs whose size grows linearly with n.
+// Each stresses one dimension of the compiler, so that benchmarks can tell
+// linear from superlinear behavior of a phase.
+
+// `let var v0 := 0 in let var v1 := v0 in ... end end`, n levels deep.
+std::string NestedLets(int n);
+
+// `let var v0 := 0 var v1 := v0 ... in v<n-1> end` with n declarations.
+std::string WideDeclarations(int n);
+
+// `(printi(0); printi(1); ...)` with n expressions.
+std::string LongSequence(int n);
+
+// `1+2-3+...` with n operands, parsed as a left leaning Binary tree.
+std::string BinaryChain(int n);
+
+// A sequence printing n distinct string constants.
+std::string StringConstants(int n);
+
+// n record types, each referencing the previous, and a literal of the last.
+std::string RecordTypes(int n);
+
+// n functions, each with a small body calling the previous one.
+std::string ManyFunctions(int n);
+
+struct ProgramShape {
+  const char* name;
+  std::string (*generate)(int n);
+  int base_size; // Size that keeps the smallest instance fast
+};
+
+// Returns all of the above.
+const std::vector<ProgramShape>& ProgramShapes();
+
+} // namespace testing
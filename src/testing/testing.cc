@@ -1,14 +1,33 @@
-#define _POSIX_C_SOURCE 2
+#define _POSIX_C_SOURCE 200809L
 #include "testing.h"
 #include "../driver.h"
+#include "../process.h"
+#include <atomic>
+#include <cstdint>
 #include <cstdio>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Directory of Std.class and testing/JavaRunner.java, see Makefile.am.
+#ifndef TC_SRCDIR
+#define TC_SRCDIR "../../src"
+#endif
 
 namespace testing {
 std::shared_ptr<Expression> Parse(const std::string& text) {
   std::ofstream myfile;
-  std::string file_name = "/tmp/testing.tig";
+  // One file per process, so that test binaries can run in parallel.
+  std::string file_name =
+      "/tmp/testing." + std::to_string(getpid()) + ".tig";
   myfile.open(file_name);
   myfile << text;
   myfile.close();
@@ -21,19 +40,150 @@ std::shared_ptr<Expression> ParseFile(const std::string& file_name) {
   return std::make_shared<Nil>();
 }
 
-std::string RunJava() {
-  std::string result;
-  // Command that works on Cygwin and Linux by avoiding path separator in the
-  // Java classpath.
-  const char* cmd = "test -f /tmp/Std.class || cp -f ../../src/Std.class /tmp;"
-                    "cd /tmp; cp Main.class $(date +%N).class; java Main";
-  std::array<char, 128> buffer;
-  std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(cmd, "r"), pclose);
-  if (pipe) {
-    while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr) {
-      result += buffer.data();
+namespace {
+// Status of runs that called System.exit, see JavaRunner.java.
+constexpr int32_t kExited = -1;
+
+// A JavaRunner process, which reads requests from and writes responses to
+// one end of a socket pair. Sockets, unlike pipes, let writes to a runner
+// that died fail instead of raising SIGPIPE.
+class JavaRunner {
+public:
+  JavaRunner() {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) return;
+    pid_ = fork();
+    if (pid_ == 0) {
+      dup2(fds[1], 0);
+      dup2(fds[1], 1);
+      // Relative paths avoid path separators that the JVM may not know, as
+      // on Cygwin.
+      if (chdir(TC_SRCDIR) == 0) {
+        execlp("java", "java", "-cp", ".", "testing/JavaRunner.java",
+               nullptr);
+      }
+      _exit(127);
     }
+    close(fds[1]);
+    if (pid_ < 0) {
+      close(fds[0]);
+    } else {
+      fd_ = fds[0];
+    }
+  }
+
+  ~JavaRunner() {
+    if (fd_ >= 0) close(fd_);
+    if (pid_ > 0) waitpid(pid_, nullptr, 0);
+  }
+
+  JavaRunner(const JavaRunner&) = delete;
+  JavaRunner& operator=(const JavaRunner&) = delete;
+
+  // Returns the run of the given class file, or none if the runner died.
+  // Runners also die by System.exit, after responding.
+  std::optional<JavaRun> Run(std::string_view class_file) {
+    JavaRun run;
+    int32_t status;
+    if (!WriteInt(class_file.size()) || !Write(class_file) ||
+        !ReadInt(status) || !ReadString(run.out) || !ReadString(run.err)) {
+      return {};
+    }
+    run.exit_code = status;
+    return run;
+  }
+
+  // Waits for the runner to end, and returns its exit status.
+  int Wait() {
+    close(fd_);
+    fd_ = -1;
+    int status = 0;
+    if (pid_ <= 0 || waitpid(pid_, &status, 0) != pid_) return -1;
+    pid_ = 0;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+  }
+
+private:
+  bool Write(std::string_view bytes) {
+    while (!bytes.empty()) {
+      ssize_t n = send(fd_, bytes.data(), bytes.size(), MSG_NOSIGNAL);
+      if (n <= 0) return false;
+      bytes.remove_prefix(n);
+    }
+    return true;
+  }
+
+  bool Read(char* data, size_t size) {
+    while (size > 0) {
+      ssize_t n = recv(fd_, data, size, 0);
+      if (n <= 0) return false;
+      data += n;
+      size -= n;
+    }
+    return true;
+  }
+
+  // Ints are big-endian, as in Java.
+  bool WriteInt(uint32_t value) {
+    char bytes[4] = {char(value >> 24), char(value >> 16), char(value >> 8),
+                     char(value)};
+    return Write(std::string_view(bytes, 4));
+  }
+
+  template <class Int> bool ReadInt(Int& value) {
+    unsigned char bytes[4];
+    if (!Read(reinterpret_cast<char*>(bytes), 4)) return false;
+    value = Int(uint32_t(bytes[0]) << 24 | uint32_t(bytes[1]) << 16 |
+                uint32_t(bytes[2]) << 8 | bytes[3]);
+    return true;
+  }
+
+  bool ReadString(std::string& s) {
+    uint32_t size;
+    if (!ReadInt(size)) return false;
+    s.resize(size);
+    return Read(s.data(), size);
+  }
+
+  int fd_ = -1;
+  pid_t pid_ = -1;
+};
+} // namespace
+
+JavaRun RunClass(std::string_view class_file) {
+  static std::mutex mutex;
+  static std::unique_ptr<JavaRunner> runner;
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!runner) runner = std::make_unique<JavaRunner>();
+  std::optional<JavaRun> run = runner->Run(class_file);
+  if (run && run->exit_code != kExited) return *run;
+  int exit_code = runner->Wait();
+  // Start another runner for the next class.
+  runner.reset();
+  if (!run) return {"", "java runner died", exit_code == 0 ? -1 : exit_code};
+  run->exit_code = exit_code;
+  return *run;
+}
+
+JavaRun RunC(std::string_view source) {
+  static std::atomic<int> runs;
+  std::string path = "/tmp/testing." + std::to_string(getpid()) + "." +
+                     std::to_string(runs++);
+  std::ofstream(path + ".c") << source;
+  if (process::Run(process::CCompiler(path + ".c", path)) != 0) {
+    return {"", "cannot build " + path + ".c", -1};
+  }
+  int status =
+      process::Run({path}, {"/dev/null", path + ".out", path + ".err"});
+  auto read = [](const std::string& file) {
+    std::ostringstream text;
+    text << std::ifstream(file).rdbuf();
+    return text.str();
+  };
+  JavaRun run = {read(path + ".out"), read(path + ".err"), status};
+  for (const char* suffix : {"", ".c", ".out", ".err"}) {
+    std::remove((path + suffix).c_str());
   }
-  return result;
+  return run;
 }
 } // namespace testing
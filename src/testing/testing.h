@@ -1,12 +1,26 @@
 #pragma once
 #include "../Expression.h"
+#include <string>
+#include <string_view>
 
 namespace testing {
 
 std::shared_ptr<Expression> Parse(const std::string& text);
 std::shared_ptr<Expression> ParseFile(const std::string& file_name);
 
-// Returns output of executing code in /tmp/Main.class with Std.class in
-// classpath.
-std::string RunJava();
+// Output and exit status of running a Java class, or a native program.
+struct JavaRun {
+  std::string out;
+  std::string err;
+  int exit_code = 0;
+};
+
+// Runs the main method of the given class file with Std.class in the class
+// path. Classes run in one JVM, started on the first call, see
+// JavaRunner.java, so that tests need not wait for a JVM to start each.
+JavaRun RunClass(std::string_view class_file);
+
+// Builds the given C program like tc --native, see process::CCompiler, and
+// runs it without input.
+JavaRun RunC(std::string_view source);
 } // namespace testing
@@ -0,0 +1,846 @@
+#include "vm.h"
+#include "BuiltIns.h"
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#if defined(__GNUC__)
+// Dispatches by computed goto, from the end of each instruction, where the
+// branch predictor learns which instruction tends to follow which, rather
+// than from one switch for all.
+#define TC_VM_THREADED
+#endif
+
+namespace vm {
+namespace {
+
+enum Opcode : int32_t {
+#define DEF_OPCODE(name, words) name,
+#include "vm_opcode.defs"
+#undef DEF_OPCODE
+};
+
+// Words of each opcode with its operands, but the cases of kSwitch.
+constexpr int32_t kWords[] = {
+#define DEF_OPCODE(name, words) words,
+#include "vm_opcode.defs"
+#undef DEF_OPCODE
+};
+
+constexpr std::pair<std::string_view, Opcode> kBuiltInOpcodes[] = {
+    {"print", kPrint},         {"printi", kPrinti}, {"flush", kFlush},
+    {"getchar", kGetchar},     {"ord", kOrd},       {"chr", kChr},
+    {"size", kSize},           {"substring", kSubstring},
+    {"concat", kConcat},       {"not", kNot},       {"exit", kExit},
+};
+
+constexpr bool AllBuiltInsHaveOpcodes() {
+  for (const BuiltInFunction& f : kBuiltInFunctions) {
+    bool found = false;
+    for (const auto& [name, op] : kBuiltInOpcodes) found |= name == f.name;
+    if (!found) return false;
+  }
+  return true;
+}
+static_assert(AllBuiltInsHaveOpcodes(), "built-in functions need opcodes");
+
+class Assembler {
+public:
+  Assembler(const ir::Module& module, bool count)
+      : module_(module), count_(count) {}
+
+  Program Assemble() {
+    for (uint32_t k = 0; k < module_.functions.size(); ++k) {
+      AssembleFunction(k);
+    }
+    return std::move(program_);
+  }
+
+private:
+  // Appends the code of the function with the given index.
+  void AssembleFunction(uint32_t k) {
+    k_ = k;
+    f_ = &module_.functions[k];
+    Function& function = program_.functions.emplace_back();
+    function.start = program_.code.size();
+    slots_.assign(f_->registers.size(), 0);
+    // Parameters first, in the order that kCallFunction passes them.
+    for (ir::Reg r = 0; r < f_->registers.size(); ++r) {
+      slots_[r] = IsInt(r) ? function.ints++ : function.references++;
+    }
+    // Never written, for comparisons with 0, and new arrays of 0 and nil.
+    zero_ = function.ints++;
+    nil_ = function.references++;
+    // For records made from fields of the register that they replace.
+    record_ = function.references++;
+    strings_ = program_.strings.size();
+    for (const std::string& s : f_->strings) {
+      program_.strings.push_back(ir::Utf16(s));
+    }
+    labels_.clear();
+    edges_.clear();
+    if (count_) {
+      program_.profiles.push_back(ir::EmptyProfile(*f_));
+      Emit(kCount, {int32_t(program_.counters.size())});
+      program_.counters.push_back({k_});
+    }
+    // Of blocks, and then of the code that counts edges, see Edge.
+    std::vector<int32_t> starts(f_->blocks.size());
+    for (ir::BlockId b = 0; b < f_->blocks.size(); ++b) {
+      starts[b] = program_.code.size();
+      for (const ir::Instruction& i : f_->blocks[b].instructions) Assemble(i);
+      Assemble(f_->blocks[b].terminator, b);
+    }
+    for (auto [counter, target] : edges_) {
+      starts.push_back(program_.code.size());
+      Emit(kCount, {counter});
+      Emit(kJump, {});
+      Label(target);
+    }
+    for (auto [offset, block] : labels_) program_.code[offset] = starts[block];
+  }
+
+  bool IsInt(ir::Reg r) const { return f_->registers[r] == ir::Type::kInt; }
+
+  // Returns the destination and operands of the given instruction in the
+  // files of their types.
+  std::vector<int32_t> Slots(const ir::Instruction& i) const {
+    std::vector<int32_t> slots;
+    if (i.dest != ir::kNoReg && i.op != ir::Op::kStoreElement) {
+      slots.push_back(slots_[i.dest]);
+    }
+    for (ir::Reg r : i.operands) slots.push_back(slots_[r]);
+    return slots;
+  }
+
+  void Emit(Opcode op, const std::vector<int32_t>& operands) {
+    program_.code.push_back(op);
+    program_.code.insert(program_.code.end(), operands.begin(),
+                         operands.end());
+  }
+
+  // Emits the offset of the given block, once known.
+  void Label(ir::BlockId b) {
+    labels_.emplace_back(program_.code.size(), b);
+    program_.code.push_back(0);
+  }
+
+  // Emits the offset of the code to take the given target, the one at the
+  // given index in the terminator of the given block, which counts that
+  // first if counting.
+  void Edge(ir::BlockId b, uint32_t k, ir::BlockId target) {
+    if (!count_) return Label(target);
+    edges_.emplace_back(program_.counters.size(), target);
+    program_.counters.push_back({k_, b, k});
+    Label(f_->blocks.size() + edges_.size() - 1);
+  }
+
+  // Counts the given target, as Edge does, where code falls through to it.
+  void Count(ir::BlockId b, uint32_t k) {
+    if (!count_) return;
+    Emit(kCount, {int32_t(program_.counters.size())});
+    program_.counters.push_back({k_, b, k});
+  }
+
+  void Jump(ir::BlockId to, ir::BlockId next) {
+    if (to == next) return;
+    Emit(kJump, {});
+    Label(to);
+  }
+
+  void Assemble(const ir::Instruction& i) {
+    switch (i.op) {
+    case ir::Op::kConst:
+    case ir::Op::kString:
+    case ir::Op::kIncrement:
+      Emit(i.op == ir::Op::kConst    ? kConst
+           : i.op == ir::Op::kString ? kString
+                                     : kIncrement,
+           {slots_[i.dest],
+            i.op == ir::Op::kString ? strings_ + i.imm : i.imm});
+      break;
+    case ir::Op::kNil:
+      Emit(kNil, Slots(i));
+      break;
+    case ir::Op::kMove:
+      Emit(IsInt(i.dest) ? kMoveInt : kMoveRef, Slots(i));
+      break;
+    case ir::Op::kNeg:
+      Emit(kNeg, Slots(i));
+      break;
+    case ir::Op::kAdd:
+      Emit(kAdd, Slots(i));
+      break;
+    case ir::Op::kSub:
+      Emit(kSub, Slots(i));
+      break;
+    case ir::Op::kMul:
+      Emit(kMul, Slots(i));
+      break;
+    case ir::Op::kDiv:
+      Emit(kDiv, Slots(i));
+      break;
+    case ir::Op::kShl:
+      Emit(kShl, Slots(i));
+      break;
+    case ir::Op::kShr:
+      Emit(kShr, Slots(i));
+      break;
+    case ir::Op::kUShr:
+      Emit(kUShr, Slots(i));
+      break;
+    case ir::Op::kCompareStrings:
+      Emit(kCompareStrings, Slots(i));
+      break;
+    case ir::Op::kCall:
+      for (const auto& [name, op] : kBuiltInOpcodes) {
+        if (name == f_->strings[i.imm]) Emit(op, Slots(i));
+      }
+      break;
+    case ir::Op::kNewArray: {
+      bool ints = f_->registers[i.dest] == ir::Type::kIntArray;
+      std::vector<int32_t> slots = Slots(i);
+      if (i.operands.size() == 1) slots.push_back(ints ? zero_ : nil_);
+      Emit(ints ? kNewInts : kNewRefs, slots);
+      break;
+    }
+    case ir::Op::kLoadElement:
+      Emit(IsInt(i.dest) ? kLoadInt : kLoadRef, Slots(i));
+      break;
+    case ir::Op::kStoreElement:
+      Emit(IsInt(i.operands[2]) ? kStoreInt : kStoreRef, Slots(i));
+      break;
+    case ir::Op::kLength:
+      Emit(kLength, Slots(i));
+      break;
+    case ir::Op::kNewRecord: {
+      bool replaced = std::find(i.operands.begin(), i.operands.end(),
+                                i.dest) != i.operands.end();
+      int32_t record = replaced ? record_ : slots_[i.dest];
+      Emit(kNewRecord, {record, int32_t(i.operands.size())});
+      for (size_t k = 0; k < i.operands.size(); ++k) {
+        ir::Reg r = i.operands[k];
+        Emit(IsInt(r) ? kStoreFieldInt : kStoreFieldRef,
+             {record, int32_t(k), slots_[r]});
+      }
+      if (replaced) Emit(kMoveRef, {slots_[i.dest], record});
+      break;
+    }
+    case ir::Op::kLoadField:
+      Emit(IsInt(i.dest) ? kLoadFieldInt : kLoadFieldRef,
+           {slots_[i.dest], slots_[i.operands[0]], i.imm});
+      break;
+    case ir::Op::kStoreField:
+      Emit(IsInt(i.operands[1]) ? kStoreFieldInt : kStoreFieldRef,
+           {slots_[i.operands[0]], i.imm, slots_[i.operands[1]]});
+      break;
+    case ir::Op::kCallFunction: {
+      std::vector<int32_t> ints;
+      std::vector<int32_t> refs;
+      for (ir::Reg r : i.operands) {
+        (IsInt(r) ? ints : refs).push_back(slots_[r]);
+      }
+      Emit(kCallFunction, {i.dest == ir::kNoReg ? -1 : slots_[i.dest], i.imm,
+                           int32_t(ints.size()), int32_t(refs.size())});
+      program_.code.insert(program_.code.end(), ints.begin(), ints.end());
+      program_.code.insert(program_.code.end(), refs.begin(), refs.end());
+      break;
+    }
+    }
+  }
+
+  // Emits the terminator of the given block, falling through to the next
+  // block where it can.
+  void Assemble(const ir::Terminator& t, ir::BlockId b) {
+    ir::BlockId next = b + 1;
+    switch (t.kind) {
+    case ir::Terminator::kNone:
+    case ir::Terminator::kReturn:
+      if (t.operands.empty()) {
+        Emit(kReturn, {});
+      } else {
+        Emit(IsInt(t.operands[0]) ? kReturnInt : kReturnRef,
+             {slots_[t.operands[0]]});
+      }
+      break;
+    case ir::Terminator::kJump:
+      Jump(t.targets[0], next);
+      break;
+    case ir::Terminator::kBranch: {
+      ir::Cmp cmp = t.cmp;
+      ir::BlockId to = t.targets[0];
+      ir::BlockId otherwise = t.targets[1];
+      uint32_t taken = 0;
+      if (to == next) {
+        cmp = ir::Negate(cmp);
+        std::swap(to, otherwise);
+        taken = 1;
+      }
+      bool ints = IsInt(t.operands[0]);
+      int32_t right = t.operands.size() == 2 ? slots_[t.operands[1]] : zero_;
+      Emit(ints ? If(cmp) : cmp == ir::Cmp::kEq ? kIfSame : kIfNotSame,
+           {slots_[t.operands[0]], right});
+      Edge(b, taken, to);
+      Count(b, 1 - taken);
+      Jump(otherwise, next);
+      break;
+    }
+    case ir::Terminator::kSwitch: {
+      // Values and the indexes of their targets.
+      std::vector<std::pair<int32_t, uint32_t>> cases;
+      for (size_t k = 0; k < t.values.size(); ++k) {
+        cases.emplace_back(t.values[k], k + 1);
+      }
+      std::sort(cases.begin(), cases.end());
+      Emit(kSwitch, {slots_[t.operands[0]], int32_t(cases.size())});
+      Edge(b, 0, t.targets[0]);
+      for (const auto& c : cases) program_.code.push_back(c.first);
+      for (const auto& c : cases) Edge(b, c.second, t.targets[c.second]);
+      break;
+    }
+    }
+  }
+
+  static Opcode If(ir::Cmp cmp) {
+    switch (cmp) {
+    case ir::Cmp::kEq:
+      return kIfEq;
+    case ir::Cmp::kNe:
+      return kIfNe;
+    case ir::Cmp::kLt:
+      return kIfLt;
+    case ir::Cmp::kGe:
+      return kIfGe;
+    case ir::Cmp::kGt:
+      return kIfGt;
+    default:
+      return kIfLe;
+    }
+  }
+
+  const ir::Module& module_;
+  const bool count_;
+  Program program_;
+  // The function being assembled, and its index.
+  const ir::Function* f_ = nullptr;
+  uint32_t k_ = 0;
+  // Register of each register of the IR, in the file of its type.
+  std::vector<int32_t> slots_;
+  int32_t zero_ = 0;
+  int32_t nil_ = 0;
+  int32_t record_ = 0;
+  // Index of the first string constant of the function in the program.
+  int32_t strings_ = 0;
+  // Offsets in the code to hold the offsets of blocks, or of the code of
+  // edges past them.
+  std::vector<std::pair<size_t, ir::BlockId>> labels_;
+  // Counters and targets of edges that code past the blocks counts.
+  std::vector<std::pair<int32_t, ir::BlockId>> edges_;
+};
+
+// Header of strings, arrays and records, followed by their elements:
+// UTF-16 code units, ints, references or Fields.
+struct alignas(8) Object {
+  int32_t length;
+};
+
+// A field of a record, whose type the opcodes that use it know.
+union Field {
+  int32_t i;
+  Object* ref;
+};
+
+template <typename T> T* Elements(Object* o) {
+  return reinterpret_cast<T*>(o + 1);
+}
+
+// Uncaught Java exception, e.g. of "ArithmeticException".
+struct Exception {
+  const char* name;
+  std::string message;
+};
+
+// Allocates objects in chunks, all freed with the heap, as programs are
+// short-lived. Like the JVM, fails with OutOfMemoryError beyond a maximum
+// size, rather than when the system runs out of memory.
+class Heap {
+public:
+  template <typename T> Object* New(int32_t length) {
+    size_t size = sizeof(Object) + (sizeof(T) * length + 7) / 8 * 8;
+    if (size > kChunk / 4) return new (Allocate(size)) Object{length};
+    if (size > free_) {
+      next_ = Allocate(kChunk);
+      free_ = kChunk;
+    }
+    Object* o = new (next_) Object{length};
+    next_ += size;
+    free_ -= size;
+    return o;
+  }
+
+private:
+  static constexpr size_t kChunk = size_t(1) << 16;
+  static constexpr size_t kMaxSize = size_t(1) << 30;
+
+  char* Allocate(size_t size) {
+    size_ += size;
+    if (size_ > kMaxSize) {
+      throw Exception{"OutOfMemoryError", "Java heap space"};
+    }
+    chunks_.emplace_back(new char[size]);
+    return chunks_.back().get();
+  }
+
+  std::vector<std::unique_ptr<char[]>> chunks_;
+  char* next_ = nullptr;
+  size_t free_ = 0;
+  size_t size_ = 0;
+};
+
+// Java's conversion of the given bits to an int, without overflow.
+inline int32_t Int(uint32_t bits) { return int32_t(bits); }
+
+void AppendUtf8(uint32_t c, std::string& s) {
+  if (c < 0x80) {
+    s += char(c);
+  } else if (c < 0x800) {
+    s += char(0xc0 | c >> 6);
+    s += char(0x80 | (c & 0x3f));
+  } else if (c < 0x10000) {
+    s += char(0xe0 | c >> 12);
+    s += char(0x80 | (c >> 6 & 0x3f));
+    s += char(0x80 | (c & 0x3f));
+  } else {
+    s += char(0xf0 | c >> 18);
+    s += char(0x80 | (c >> 12 & 0x3f));
+    s += char(0x80 | (c >> 6 & 0x3f));
+    s += char(0x80 | (c & 0x3f));
+  }
+}
+
+class Machine {
+public:
+  Machine(const Program& program, std::istream& in, std::ostream& out)
+      : program_(program), in_(in), out_(out),
+        counters_(program.counters.size()) {
+    for (const std::vector<uint16_t>& s : program.strings) {
+      strings_.push_back(NewString(s.data(), s.size()));
+    }
+  }
+
+  int Run();
+
+  // Adds the counts of the run to the given profiles.
+  void AddCounts(std::vector<ir::Profile>& profiles) const {
+    for (size_t k = 0; k < program_.counters.size(); ++k) {
+      const Counter& c = program_.counters[k];
+      ir::Profile& profile = profiles[c.function];
+      if (c.block == ir::kNoBlock) {
+        profile.entries += counters_[k];
+      } else {
+        profile.counts[c.block][c.target] += counters_[k];
+      }
+    }
+  }
+
+private:
+  Object* NewString(const uint16_t* chars, int32_t length) {
+    Object* s = heap_.New<uint16_t>(length);
+    std::copy(chars, chars + length, Elements<uint16_t>(s));
+    return s;
+  }
+
+  template <typename T> Object* NewArray(int32_t length, T value) {
+    if (length < 0) {
+      throw Exception{"NegativeArraySizeException", std::to_string(length)};
+    }
+    Object* a = heap_.New<T>(length);
+    std::fill(Elements<T>(a), Elements<T>(a) + length, value);
+    return a;
+  }
+
+  template <typename T> static T& At(Object* array, int32_t index) {
+    if (!array) throw Exception{"NullPointerException", ""};
+    if (index < 0 || index >= array->length) {
+      throw Exception{"ArrayIndexOutOfBoundsException",
+                      "Index " + std::to_string(index) +
+                          " out of bounds for length " +
+                          std::to_string(array->length)};
+    }
+    return Elements<T>(array)[index];
+  }
+
+  Object* NewRecord(int32_t length) {
+    Object* r = heap_.New<Field>(length);
+    std::fill_n(Elements<Field>(r), length, Field{});
+    return r;
+  }
+
+  static Field& FieldOf(Object* record, int32_t index) {
+    if (!record) throw Exception{"NullPointerException", ""};
+    return Elements<Field>(record)[index];
+  }
+
+  static int32_t Length(Object* array) {
+    if (!array) throw Exception{"NullPointerException", ""};
+    return array->length;
+  }
+
+  // Like String.compareTo.
+  static int32_t Compare(Object* s, Object* t) {
+    const uint16_t* a = Elements<uint16_t>(s);
+    const uint16_t* b = Elements<uint16_t>(t);
+    int32_t n = std::min(s->length, t->length);
+    for (int32_t i = 0; i < n; ++i) {
+      if (a[i] != b[i]) return a[i] - b[i];
+    }
+    return s->length - t->length;
+  }
+
+  // Prints the given string in UTF-8, with ? for unpaired surrogates.
+  void Print(Object* s) {
+    const uint16_t* chars = Elements<uint16_t>(s);
+    std::string text;
+    for (int32_t i = 0; i < s->length; ++i) {
+      uint32_t c = chars[i];
+      if (c >= 0xd800 && c < 0xdc00 && i + 1 < s->length &&
+          chars[i + 1] >= 0xdc00 && chars[i + 1] < 0xe000) {
+        c = 0x10000 + ((c - 0xd800) << 10) + (chars[++i] - 0xdc00);
+      } else if (c >= 0xd800 && c < 0xe000) {
+        c = '?';
+      }
+      AppendUtf8(c, text);
+    }
+    out_ << text;
+  }
+
+  Object* Chr(int32_t i) {
+    uint16_t c = i;
+    return NewString(&c, 1);
+  }
+
+  Object* Getchar() {
+    int c = in_.get();
+    if (c != std::istream::traits_type::eof()) return Chr(c);
+    if (!empty_) empty_ = NewString(nullptr, 0);
+    return empty_;
+  }
+
+  Object* Substring(Object* s, int32_t f, int32_t n) {
+    int32_t end = Int(uint32_t(f) + uint32_t(n));
+    if (f < 0 || end > s->length || f > end) {
+      throw Exception{"StringIndexOutOfBoundsException",
+                      "begin " + std::to_string(f) + ", end " +
+                          std::to_string(end) + ", length " +
+                          std::to_string(s->length)};
+    }
+    return NewString(Elements<uint16_t>(s) + f, n);
+  }
+
+  Object* Concat(Object* s, Object* t) {
+    if (int64_t(s->length) + t->length > INT32_MAX) {
+      throw Exception{"OutOfMemoryError", "Java heap space"};
+    }
+    Object* u = heap_.New<uint16_t>(s->length + t->length);
+    uint16_t* chars = Elements<uint16_t>(u);
+    std::copy_n(Elements<uint16_t>(s), s->length, chars);
+    std::copy_n(Elements<uint16_t>(t), t->length, chars + s->length);
+    return u;
+  }
+
+  const Program& program_;
+  std::istream& in_;
+  std::ostream& out_;
+  Heap heap_;
+  // Objects of the string constants, each one object, as in the JVM.
+  std::vector<Object*> strings_;
+  Object* empty_ = nullptr;
+  std::vector<uint64_t> counters_;
+};
+
+// Calls nested deeper fail, like those beyond the stack of a thread of the
+// JVM, rather than growing the stacks of registers without bound.
+constexpr size_t kMaxCalls = 1 << 16;
+
+// A call of a function, to return from: the code after it, the registers
+// of the caller, at offsets in the stacks of registers, which may move as
+// they grow, and the register of the result, or -1.
+struct Call {
+  const int32_t* pc;
+  const Function* function;
+  size_t ints;
+  size_t refs;
+  int32_t dest;
+};
+
+int Machine::Run() {
+  // Registers of all calls, of main first.
+  const Function* function = &program_.functions[0];
+  std::vector<int32_t> int_stack(function->ints);
+  std::vector<Object*> ref_stack(function->references);
+  std::vector<Call> calls;
+  int32_t* ints = int_stack.data();
+  Object** refs = ref_stack.data();
+  uint64_t* counters = counters_.data();
+  const int32_t* code = program_.code.data();
+  const int32_t* pc = code + function->start;
+
+#ifdef TC_VM_THREADED
+  static const void* const kHandlers[] = {
+#define DEF_OPCODE(name, words) &&name##_handler,
+#include "vm_opcode.defs"
+#undef DEF_OPCODE
+  };
+#define HANDLER(name) name##_handler
+#define DISPATCH() goto *kHandlers[*pc]
+#else
+#define HANDLER(name) case name
+#define DISPATCH() goto dispatch
+#endif
+// Moves to the instruction after one of the given opcode.
+#define NEXT(name)                                                             \
+  pc += kWords[name];                                                          \
+  DISPATCH()
+// Moves to the target at the given operand if the given condition holds.
+#define BRANCH(name, condition)                                                \
+  pc = (condition) ? code + pc[3] : pc + kWords[name];                         \
+  DISPATCH()
+
+#ifdef TC_VM_THREADED
+  DISPATCH();
+#else
+dispatch:
+  switch (*pc) {
+#endif
+  HANDLER(kConst):
+    ints[pc[1]] = pc[2];
+    NEXT(kConst);
+  HANDLER(kString):
+    refs[pc[1]] = strings_[pc[2]];
+    NEXT(kString);
+  HANDLER(kNil):
+    refs[pc[1]] = nullptr;
+    NEXT(kNil);
+  HANDLER(kMoveInt):
+    ints[pc[1]] = ints[pc[2]];
+    NEXT(kMoveInt);
+  HANDLER(kMoveRef):
+    refs[pc[1]] = refs[pc[2]];
+    NEXT(kMoveRef);
+  HANDLER(kNeg):
+    ints[pc[1]] = Int(0u - uint32_t(ints[pc[2]]));
+    NEXT(kNeg);
+  HANDLER(kAdd):
+    ints[pc[1]] = Int(uint32_t(ints[pc[2]]) + uint32_t(ints[pc[3]]));
+    NEXT(kAdd);
+  HANDLER(kSub):
+    ints[pc[1]] = Int(uint32_t(ints[pc[2]]) - uint32_t(ints[pc[3]]));
+    NEXT(kSub);
+  HANDLER(kMul):
+    ints[pc[1]] = Int(uint32_t(ints[pc[2]]) * uint32_t(ints[pc[3]]));
+    NEXT(kMul);
+  HANDLER(kDiv): {
+    int32_t a = ints[pc[2]];
+    int32_t b = ints[pc[3]];
+    if (b == 0) throw Exception{"ArithmeticException", "/ by zero"};
+    ints[pc[1]] = b == -1 ? Int(0u - uint32_t(a)) : a / b;
+    NEXT(kDiv);
+  }
+  HANDLER(kShl):
+    ints[pc[1]] = Int(uint32_t(ints[pc[2]]) << (ints[pc[3]] & 31));
+    NEXT(kShl);
+  HANDLER(kShr):
+    ints[pc[1]] = ints[pc[2]] >> (ints[pc[3]] & 31);
+    NEXT(kShr);
+  HANDLER(kUShr):
+    ints[pc[1]] = Int(uint32_t(ints[pc[2]]) >> (ints[pc[3]] & 31));
+    NEXT(kUShr);
+  HANDLER(kIncrement):
+    ints[pc[1]] = Int(uint32_t(ints[pc[1]]) + uint32_t(pc[2]));
+    NEXT(kIncrement);
+  HANDLER(kCompareStrings):
+    ints[pc[1]] = Compare(refs[pc[2]], refs[pc[3]]);
+    NEXT(kCompareStrings);
+  HANDLER(kPrint):
+    Print(refs[pc[1]]);
+    NEXT(kPrint);
+  HANDLER(kPrinti):
+    out_ << ints[pc[1]];
+    NEXT(kPrinti);
+  HANDLER(kFlush):
+    out_.flush();
+    NEXT(kFlush);
+  HANDLER(kGetchar):
+    refs[pc[1]] = Getchar();
+    NEXT(kGetchar);
+  HANDLER(kOrd):
+    ints[pc[1]] = refs[pc[2]]->length > 0
+                      ? Elements<uint16_t>(refs[pc[2]])[0]
+                      : -1;
+    NEXT(kOrd);
+  HANDLER(kChr):
+    refs[pc[1]] = Chr(ints[pc[2]]);
+    NEXT(kChr);
+  HANDLER(kSize):
+    ints[pc[1]] = refs[pc[2]]->length;
+    NEXT(kSize);
+  HANDLER(kSubstring):
+    refs[pc[1]] = Substring(refs[pc[2]], ints[pc[3]], ints[pc[4]]);
+    NEXT(kSubstring);
+  HANDLER(kConcat):
+    refs[pc[1]] = Concat(refs[pc[2]], refs[pc[3]]);
+    NEXT(kConcat);
+  HANDLER(kNot):
+    ints[pc[1]] = ints[pc[2]] == 0;
+    NEXT(kNot);
+  HANDLER(kExit):
+    return ints[pc[1]];
+  HANDLER(kNewInts):
+    refs[pc[1]] = NewArray(ints[pc[2]], ints[pc[3]]);
+    NEXT(kNewInts);
+  HANDLER(kNewRefs):
+    refs[pc[1]] = NewArray(ints[pc[2]], refs[pc[3]]);
+    NEXT(kNewRefs);
+  HANDLER(kLoadInt):
+    ints[pc[1]] = At<int32_t>(refs[pc[2]], ints[pc[3]]);
+    NEXT(kLoadInt);
+  HANDLER(kLoadRef):
+    refs[pc[1]] = At<Object*>(refs[pc[2]], ints[pc[3]]);
+    NEXT(kLoadRef);
+  HANDLER(kStoreInt):
+    At<int32_t>(refs[pc[1]], ints[pc[2]]) = ints[pc[3]];
+    NEXT(kStoreInt);
+  HANDLER(kStoreRef):
+    At<Object*>(refs[pc[1]], ints[pc[2]]) = refs[pc[3]];
+    NEXT(kStoreRef);
+  HANDLER(kLength):
+    ints[pc[1]] = Length(refs[pc[2]]);
+    NEXT(kLength);
+  HANDLER(kNewRecord):
+    refs[pc[1]] = NewRecord(pc[2]);
+    NEXT(kNewRecord);
+  HANDLER(kLoadFieldInt):
+    ints[pc[1]] = FieldOf(refs[pc[2]], pc[3]).i;
+    NEXT(kLoadFieldInt);
+  HANDLER(kLoadFieldRef):
+    refs[pc[1]] = FieldOf(refs[pc[2]], pc[3]).ref;
+    NEXT(kLoadFieldRef);
+  HANDLER(kStoreFieldInt):
+    FieldOf(refs[pc[1]], pc[2]).i = ints[pc[3]];
+    NEXT(kStoreFieldInt);
+  HANDLER(kStoreFieldRef):
+    FieldOf(refs[pc[1]], pc[2]).ref = refs[pc[3]];
+    NEXT(kStoreFieldRef);
+  HANDLER(kCallFunction): {
+    if (calls.size() == kMaxCalls) throw Exception{"StackOverflowError", ""};
+    const Function* callee = &program_.functions[pc[2]];
+    size_t int_base = ints - int_stack.data() + function->ints;
+    size_t ref_base = refs - ref_stack.data() + function->references;
+    calls.push_back({pc + kWords[kCallFunction] + pc[3] + pc[4], function,
+                     size_t(ints - int_stack.data()),
+                     size_t(refs - ref_stack.data()), pc[1]});
+    if (int_base + callee->ints > int_stack.size()) {
+      int_stack.resize(std::max(2 * int_stack.size(), int_base + callee->ints));
+    }
+    if (ref_base + callee->references > ref_stack.size()) {
+      ref_stack.resize(
+          std::max(2 * ref_stack.size(), ref_base + callee->references));
+    }
+    ints = int_stack.data() + calls.back().ints;
+    refs = ref_stack.data() + calls.back().refs;
+    int32_t* callee_ints = int_stack.data() + int_base;
+    Object** callee_refs = ref_stack.data() + ref_base;
+    std::fill_n(callee_ints, callee->ints, 0);
+    std::fill_n(callee_refs, callee->references, nullptr);
+    const int32_t* args = pc + kWords[kCallFunction];
+    for (int32_t k = 0; k < pc[3]; ++k) callee_ints[k] = ints[args[k]];
+    args += pc[3];
+    for (int32_t k = 0; k < pc[4]; ++k) callee_refs[k] = refs[args[k]];
+    function = callee;
+    ints = callee_ints;
+    refs = callee_refs;
+    pc = code + callee->start;
+    DISPATCH();
+  }
+  HANDLER(kJump):
+    pc = code + pc[1];
+    DISPATCH();
+  HANDLER(kIfEq):
+    BRANCH(kIfEq, ints[pc[1]] == ints[pc[2]]);
+  HANDLER(kIfNe):
+    BRANCH(kIfNe, ints[pc[1]] != ints[pc[2]]);
+  HANDLER(kIfLt):
+    BRANCH(kIfLt, ints[pc[1]] < ints[pc[2]]);
+  HANDLER(kIfGe):
+    BRANCH(kIfGe, ints[pc[1]] >= ints[pc[2]]);
+  HANDLER(kIfGt):
+    BRANCH(kIfGt, ints[pc[1]] > ints[pc[2]]);
+  HANDLER(kIfLe):
+    BRANCH(kIfLe, ints[pc[1]] <= ints[pc[2]]);
+  HANDLER(kIfSame):
+    BRANCH(kIfSame, refs[pc[1]] == refs[pc[2]]);
+  HANDLER(kIfNotSame):
+    BRANCH(kIfNotSame, refs[pc[1]] != refs[pc[2]]);
+  HANDLER(kSwitch): {
+    int32_t n = pc[2];
+    const int32_t* values = pc + kWords[kSwitch];
+    const int32_t* value = std::lower_bound(values, values + n, ints[pc[1]]);
+    bool found = value != values + n && *value == ints[pc[1]];
+    pc = code + (found ? value[n] : pc[3]);
+    DISPATCH();
+  }
+  HANDLER(kReturn):
+  HANDLER(kReturnInt):
+  HANDLER(kReturnRef): {
+    if (calls.empty()) return 0;
+    Call call = calls.back();
+    calls.pop_back();
+    int32_t int_result = *pc == kReturnInt ? ints[pc[1]] : 0;
+    Object* ref_result = *pc == kReturnRef ? refs[pc[1]] : nullptr;
+    ints = int_stack.data() + call.ints;
+    refs = ref_stack.data() + call.refs;
+    if (call.dest >= 0 && *pc == kReturnInt) ints[call.dest] = int_result;
+    if (call.dest >= 0 && *pc == kReturnRef) refs[call.dest] = ref_result;
+    function = call.function;
+    pc = call.pc;
+    DISPATCH();
+  }
+  HANDLER(kCount):
+    ++counters[pc[1]];
+    NEXT(kCount);
+#ifndef TC_VM_THREADED
+  }
+  return 0;
+#endif
+#undef HANDLER
+#undef DISPATCH
+#undef NEXT
+#undef BRANCH
+}
+} // namespace
+
+Program Assemble(const ir::Module& module, bool count) {
+  return Assembler(module, count).Assemble();
+}
+
+int Run(const Program& program, std::istream& in, std::ostream& out,
+        std::ostream& err, std::vector<ir::Profile>* profiles) {
+  Machine machine(program, in, out);
+  int status;
+  try {
+    status = machine.Run();
+  } catch (const Exception& e) {
+    out.flush();
+    err << "Exception in thread \"main\" java.lang." << e.name
+        << (e.message.empty() ? "" : ": ") << e.message << "\n";
+    status = 1;
+  }
+  out.flush();
+  if (profiles) machine.AddCounts(*profiles);
+  return status;
+}
+} // namespace vm
@@ -0,0 +1,61 @@
+#pragma once
+#include "ir.h"
+#include "profile.h"
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+// Bytecode that the compiler runs itself, e.g. for tc --run, without
+// starting a JVM. Like the IR, it computes in registers, but in two files,
+// of ints and of references, and with operations specific to the types of
+// their operands, e.g. one per built-in function, so that each runs without
+// looking at types or names. Each call of a function has registers of its
+// own. Run implements Std.java in C++.
+namespace vm {
+
+struct Function {
+  // Offset of the first opcode in Program::code.
+  int32_t start = 0;
+  // Numbers of int and reference registers, all 0 or nil at the start.
+  uint32_t ints = 0;
+  uint32_t references = 0;
+};
+
+// What a counter counts: the runs of a function, for block kNoBlock, or
+// else how often the terminator of the block went to the target with the
+// given index.
+struct Counter {
+  uint32_t function = 0;
+  ir::BlockId block = ir::kNoBlock;
+  uint32_t target = 0;
+};
+
+struct Program {
+  // Opcodes, see vm_opcode.defs, each followed by its operands.
+  std::vector<int32_t> code;
+  // Of the functions of the module, main first.
+  std::vector<Function> functions;
+  // UTF-16 code units of string constants.
+  std::vector<std::vector<uint16_t>> strings;
+  // Of programs with counters: the profiles that they measure, one per
+  // function, and what each counter counts.
+  std::vector<ir::Profile> profiles;
+  std::vector<Counter> counters;
+};
+
+// Returns the bytecode of the given module, with counters of the runs of
+// its functions and of the targets taken by their branches and switches if
+// asked, see Run.
+Program Assemble(const ir::Module& module, bool count = false);
+
+// Runs the given program, which reads getchar from in and prints to out,
+// and returns its exit status: that given to exit, 0 at the end, or 1 on
+// failure, with the name of the Java exception that the class file of
+// ir::EmitJvm would throw on err, e.g. StackOverflowError for calls nested
+// too deeply. Strings, arrays and records live in an arena, freed on
+// return. Adds the counts of programs with counters to the given profiles,
+// if any, which must be like Program::profiles.
+int Run(const Program& program, std::istream& in, std::ostream& out,
+        std::ostream& err, std::vector<ir::Profile>* profiles = nullptr);
+} // namespace vm
@@ -0,0 +1,136 @@
+#include "vm.h"
+#include "compiler.h"
+#include "ir.h"
+#include "testing/catch.h"
+#include "testing/testing.h"
+#include <sstream>
+#include <string>
+
+namespace {
+
+struct Ran {
+  std::string out;
+  std::string err;
+  int status;
+};
+
+Ran Run(const vm::Program& program, const std::string& input = "") {
+  std::istringstream in(input);
+  std::ostringstream out, err;
+  int status = vm::Run(program, in, out, err);
+  return {out.str(), err.str(), status};
+}
+
+// Returns the bytecode of a module of the given function.
+vm::Program Assemble(const ir::Function& f) {
+  ir::Module module;
+  module.functions.push_back(f);
+  return vm::Assemble(module);
+}
+
+Ran Run(const std::string& program, const std::string& input = "") {
+  std::shared_ptr<Expression> e = testing::Parse(program);
+  Expression::SetNameSpacesBelow(*e);
+  Expression::SetTypesBelow(*e);
+  CompiledBytecode compiled = CompileToBytecode(*e);
+  REQUIRE(compiled.diagnostics.empty());
+  return Run(compiled.program, input);
+}
+
+SCENARIO("runs bytecode", "[vm]") {
+  GIVEN("input") {
+    const char* echo = "let var c := getchar() in while c <> \"\" do "
+                       "(print(c); printi(ord(c)); c := getchar()) end";
+    REQUIRE(Run(echo, "ab").out == "a97b98");
+    REQUIRE(Run(echo).out == "");
+  }
+  GIVEN("a call of exit") {
+    Ran ran = Run("(print(\"a\"); exit(3); print(\"b\"))");
+    REQUIRE(ran.out == "a");
+    REQUIRE(ran.status == 3);
+  }
+  GIVEN("a failure") {
+    Ran ran = Run("let type ints = array of int var a := ints [2] of 0 in "
+                  "a[2] := 1 end");
+    THEN("it reports it like the JVM") {
+      REQUIRE(ran.status == 1);
+      REQUIRE(ran.err == "Exception in thread \"main\" java.lang."
+                         "ArrayIndexOutOfBoundsException: Index 2 out of "
+                         "bounds for length 2\n");
+    }
+  }
+  GIVEN("arithmetic that overflows") {
+    REQUIRE(Run("let var m := -2147483647 - 1 in (printi(m / -1); "
+                "print(\" \"); printi(m * 2); print(\" \"); printi(-m)) end")
+                .out == "-2147483648 0 -2147483648");
+  }
+  GIVEN("functions") {
+    const char* fib = "let function fib(n: int): int = if n < 2 then n else "
+                      "fib(n - 1) + fib(n - 2) in printi(fib(20)) end";
+    REQUIRE(Run(fib).out == "6765");
+    THEN("each call has registers of its own") {
+      REQUIRE(Run("let function f(n: int, s: string): string = if n = 0 "
+                  "then s else concat(f(n - 1, concat(s, \"a\")), s) in "
+                  "print(f(3, \"x\")) end")
+                  .out == "xaaaxaaxax");
+    }
+    THEN("they reach the variables of functions around them") {
+      REQUIRE(Run("let var total := 0 function add(n: int) = let function "
+                  "inner() = total := total + n in inner() end in for i := "
+                  "1 to 10 do add(i); printi(total) end")
+                  .out == "55");
+    }
+    THEN("calls nested too deeply fail like the JVM") {
+      Ran ran = Run("let function f(n: int): int = f(n + 1) in printi(f(0)) "
+                    "end");
+      REQUIRE(ran.status == 1);
+      REQUIRE(ran.err ==
+              "Exception in thread \"main\" java.lang.StackOverflowError\n");
+    }
+  }
+  GIVEN("records") {
+    const char* list =
+        "let type list = {head: int, tail: list} var l: list := nil in for "
+        "i := 1 to 4 do l := list {head = i, tail = l}; while l <> nil do "
+        "(printi(l.head); l := l.tail) end";
+    REQUIRE(Run(list).out == "4321");
+    THEN("fields of nil fail like the JVM") {
+      Ran ran = Run("let type r = {a: string} var x: r := nil in print(x.a) "
+                    "end");
+      REQUIRE(ran.status == 1);
+      REQUIRE(ran.err.find("NullPointerException") != std::string::npos);
+    }
+  }
+  GIVEN("comparisons with nil") {
+    // b0: s = nil; t = nil; if s = t goto b1 else b2
+    // b1: print("nil"); return
+    // b2: return
+    ir::Function f;
+    for (int k = 0; k < 3; ++k) f.NewBlock();
+    ir::Reg s = f.NewRegister(ir::Type::kIntArray);
+    ir::Reg t = f.NewRegister(ir::Type::kIntArray);
+    ir::Reg text = f.NewRegister(ir::Type::kString);
+    f.blocks[0].instructions = {{ir::Op::kNil, s}, {ir::Op::kNil, t}};
+    f.blocks[0].terminator = {ir::Terminator::kBranch, ir::Cmp::kEq, {s, t},
+                              {1, 2}};
+    f.blocks[1].instructions = {
+        {ir::Op::kString, text, f.AddString("nil")},
+        {ir::Op::kCall, ir::kNoReg, f.AddString("print"), {text}}};
+    f.blocks[1].terminator.kind = ir::Terminator::kReturn;
+    f.blocks[2].terminator.kind = ir::Terminator::kReturn;
+    REQUIRE(ir::Verify(f).empty());
+    THEN("it compares references by identity") {
+      REQUIRE(Run(Assemble(f)).out == "nil");
+      f.blocks[0].terminator.cmp = ir::Cmp::kNe;
+      REQUIRE(Run(Assemble(f)).out == "");
+    }
+    THEN("arrays of nil fail like the JVM") {
+      ir::Reg n = f.NewRegister(ir::Type::kInt);
+      f.blocks[1].instructions.push_back({ir::Op::kLength, n, 0, {s}});
+      Ran ran = Run(Assemble(f));
+      REQUIRE(ran.status == 1);
+      REQUIRE(ran.err.find("NullPointerException") != std::string::npos);
+    }
+  }
+}
+} // namespace